@@ -0,0 +1,718 @@
+/*
+*Description: Logging that keeps formatting and output off the threads doing the work. Each log call site
+*			  registers its printf format once and gets an id; a call then only copies the id, a time
+*			  stamp and its arguments into a lock-free ring owned by the calling thread. A background
+*			  thread drains the rings every LOG_DRAIN_MS, formats what is at or above the console level
+*			  and appends every record, unformatted, to the binary log file if one is open. A full ring
+*			  drops the record and counts it rather than making the caller wait. SetSynchronous(true)
+*			  prints on the calling thread instead, for debugging and for comparing against.
+*
+*			  Levels below LOG_COMPILE_LEVEL compile to nothing, their arguments are not evaluated.
+*			  Arguments may be integers, floating point numbers, pointers, C strings and std::strings;
+*			  strings are copied, so temporaries are fine.
+*
+*			  LOG_INFO("Robot %d collecting order %d", id_, order.ID_);
+*/
+
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO	// define before including to keep debug logging
+#endif
+
+#define LOG_RING_BYTES (64 * 1024)	// per thread, power of two
+#define LOG_MAX_RECORD 1024			// longer records have their strings cut short
+#define LOG_DRAIN_MS 2				// how often the background thread empties the rings
+#define LOG_FILE_MAGIC 0x474F4C41u	// "ALOG" on little endian machines
+#define LOG_FILE_VERSION 1
+
+/**
+* Binary log file, native byte order:
+*	uint32 magic, uint32 version, int64 wall clock at start in ns since the epoch
+*	then records, each starting with a type byte:
+*	'F'	format: uint32 id, uint8 level, uint32 line, uint16 + bytes file, uint16 + bytes format
+*	'E'	entry: uint32 format id, uint32 thread, uint64 ns since start, uint16 + bytes arguments
+*	'D'	dropped: uint32 thread, uint32 records lost because its ring was full
+* A format is always written before the first entry using it.
+*
+* Arguments are a type byte each followed by the value: 'i' int64, 'u' uint64, 'f' double,
+* 's' uint16 length and the bytes.
+*/
+class AsyncLog {
+private:
+	struct CallSite {
+		int level;
+		int line;
+		std::string file;
+		std::string format;
+	};
+
+	// Single producer (its thread), single consumer (the background thread)
+	struct Ring {
+		std::unique_ptr<char[]> data;
+		std::atomic<uint64_t> head;		// bytes consumed
+		std::atomic<uint64_t> tail;		// bytes produced
+		std::atomic<unsigned long> dropped;
+		std::atomic<bool> retired;		// its thread has exited
+		uint32_t thread;
+
+		Ring(uint32_t thread) : data(new char[LOG_RING_BYTES]), head(0), tail(0), dropped(0), retired(false), thread(thread) {}
+
+		bool push(const char* record, size_t size) {
+			uint64_t t = tail.load(std::memory_order_relaxed);
+			if (LOG_RING_BYTES - (t - head.load(std::memory_order_acquire)) < size) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			size_t at = (size_t)(t & (LOG_RING_BYTES - 1));
+			size_t first = std::min(size, (size_t)LOG_RING_BYTES - at);
+			std::memcpy(&data[at], record, first);
+			std::memcpy(&data[0], record + first, size - first);
+			tail.store(t + size, std::memory_order_release);
+			return true;
+		}
+
+		void read(uint64_t from, char* out, size_t size) const {
+			size_t at = (size_t)(from & (LOG_RING_BYTES - 1));
+			size_t first = std::min(size, (size_t)LOG_RING_BYTES - at);
+			std::memcpy(out, &data[at], first);
+			std::memcpy(out + first, &data[0], size - first);
+		}
+	};
+
+	// Gives the ring back when its thread exits, the background thread frees it once drained
+	struct ThreadRing {
+		std::shared_ptr<Ring> ring;
+		~ThreadRing() {
+			if (ring) {
+				ring->retired.store(true, std::memory_order_release);
+			}
+		}
+	};
+
+	struct Entry {
+		uint64_t time;
+		uint32_t thread;
+		uint32_t format;
+		std::string args;
+	};
+
+	// record header in the rings: uint16 size of the whole record, uint32 format id, uint64 time
+	static const size_t RECORD_HEADER = 14;
+
+	std::chrono::steady_clock::time_point start_;
+	int64_t start_wall_ns_;
+
+	std::mutex formats_mutex_;		// protects formats_ and rings_
+	std::vector<CallSite> formats_;
+	std::vector<std::shared_ptr<Ring>> rings_;
+	uint32_t next_thread_;
+
+	std::mutex mutex_;				// protects everything below
+	std::condition_variable drain_cv_;
+	std::condition_variable drained_cv_;
+	uint64_t rounds_;				// drain rounds completed
+	bool stop_;
+	FILE* file_;
+	size_t formats_written_;		// to file_
+	int console_level_;
+	std::thread drainer_;
+	std::atomic<bool> synchronous_;
+
+	AsyncLog() : start_(std::chrono::steady_clock::now()), next_thread_(0), rounds_(0), stop_(false),
+		file_(nullptr), formats_written_(0), console_level_(LOG_LEVEL_INFO), synchronous_(false) {
+		start_wall_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		drainer_ = std::thread(&AsyncLog::Drain, this);
+	}
+
+	~AsyncLog() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		drain_cv_.notify_one();
+		drainer_.join();
+		if (file_ != nullptr) {
+			std::fclose(file_);
+		}
+	}
+
+	Ring& ThisThreadRing() {
+		static thread_local ThreadRing mine;
+		if (!mine.ring) {
+			std::lock_guard<std::mutex> lock(formats_mutex_);
+			mine.ring = std::make_shared<Ring>(next_thread_++);
+			rings_.push_back(mine.ring);
+		}
+		return *mine.ring;
+	}
+
+	//-------------------------------------------------------------------------------------------
+	// argument encoding, on the logging thread
+
+	struct Record {
+		char data[LOG_MAX_RECORD];
+		size_t size;
+
+		bool room(size_t bytes) const {
+			return size + bytes <= LOG_MAX_RECORD;
+		}
+
+		void put(const void* value, size_t bytes) {
+			std::memcpy(data + size, value, bytes);
+			size += bytes;
+		}
+	};
+
+	template<typename T>
+	static void Encode(Record& r, char type, T value) {
+		if (r.room(1 + sizeof(T))) {
+			r.data[r.size++] = type;
+			r.put(&value, sizeof(T));
+		}
+	}
+
+	template<typename T>
+	static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type Arg(Record& r, T value) {
+		Encode<int64_t>(r, 'i', value);
+	}
+
+	template<typename T>
+	static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type Arg(Record& r, T value) {
+		Encode<uint64_t>(r, 'u', value);
+	}
+
+	template<typename T>
+	static typename std::enable_if<std::is_enum<T>::value>::type Arg(Record& r, T value) {
+		Encode<int64_t>(r, 'i', (int64_t)value);
+	}
+
+	template<typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type Arg(Record& r, T value) {
+		Encode<double>(r, 'f', value);
+	}
+
+	static void Arg(Record& r, const char* value, size_t length) {
+		if (!r.room(3)) {
+			return;
+		}
+		uint16_t n = (uint16_t)std::min(length, LOG_MAX_RECORD - r.size - 3);
+		r.data[r.size++] = 's';
+		r.put(&n, sizeof(n));
+		r.put(value, n);
+	}
+
+	static void Arg(Record& r, const char* value) {
+		Arg(r, value, value == nullptr ? 0 : std::strlen(value));
+	}
+
+	static void Arg(Record& r, char* value) {
+		Arg(r, (const char*)value);
+	}
+
+	static void Arg(Record& r, const std::string& value) {
+		Arg(r, value.data(), value.size());
+	}
+
+	static void Arg(Record& r, const void* value) {
+		Encode<uint64_t>(r, 'u', (uint64_t)(uintptr_t)value);
+	}
+
+	static void EncodeArgs(Record&) {}
+
+	template<typename T, typename... Rest>
+	static void EncodeArgs(Record& r, const T& first, const Rest&... rest) {
+		Arg(r, first);
+		EncodeArgs(r, rest...);
+	}
+
+	//-------------------------------------------------------------------------------------------
+	// formatting, on the background thread or in the decoder
+
+	// Formats one conversion with an argument of whatever type it was logged as
+	static void FormatArg(std::string& out, std::string spec, char conversion, const char*& arg, const char* end) {
+		char buffer[256];
+		int n = -1;
+		if (arg >= end) {
+			out += spec + conversion;	// missing argument, print the conversion as written
+			return;
+		}
+		char type = *arg++;
+		bool integer_conv = std::strchr("diouxXc", conversion) != nullptr;
+		bool float_conv = std::strchr("fFeEgGaA", conversion) != nullptr;
+		if (type == 'i' || type == 'u') {
+			uint64_t bits;
+			std::memcpy(&bits, arg, sizeof(bits));
+			arg += sizeof(bits);
+			long long s = (long long)bits;
+			unsigned long long u = (unsigned long long)bits;
+			if (conversion == 'c') {
+				n = std::snprintf(buffer, sizeof(buffer), (spec + "c").c_str(), (int)s);
+			}
+			else if (float_conv) {
+				n = std::snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), type == 'i' ? (double)s : (double)u);
+			}
+			else if (conversion == 'p') {
+				n = std::snprintf(buffer, sizeof(buffer), "0x%llx", u);
+			}
+			else {
+				char c = integer_conv ? conversion : (type == 'i' ? 'd' : 'u');
+				if (c == 'd' || c == 'i') {
+					n = std::snprintf(buffer, sizeof(buffer), (spec + "ll" + c).c_str(), s);
+				}
+				else {
+					n = std::snprintf(buffer, sizeof(buffer), (spec + "ll" + c).c_str(), u);
+				}
+			}
+		}
+		else if (type == 'f') {
+			double d;
+			std::memcpy(&d, arg, sizeof(d));
+			arg += sizeof(d);
+			if (integer_conv) {
+				n = std::snprintf(buffer, sizeof(buffer), (spec + "lld").c_str(), (long long)d);
+			}
+			else {
+				n = std::snprintf(buffer, sizeof(buffer), (spec + (float_conv ? conversion : 'g')).c_str(), d);
+			}
+		}
+		else if (type == 's') {
+			uint16_t length;
+			std::memcpy(&length, arg, sizeof(length));
+			arg += sizeof(length);
+			std::string value(arg, std::min<size_t>(length, end - arg));
+			arg += value.size();
+			if (conversion == 's' && spec.size() == 1) {
+				out += value;
+				return;
+			}
+			n = std::snprintf(buffer, sizeof(buffer), (spec + "s").c_str(), value.c_str());
+		}
+		else {
+			arg = end;	// unknown type, the rest can't be read
+			out += spec + conversion;
+			return;
+		}
+		if (n > 0) {
+			out.append(buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+		}
+	}
+
+	static const char* LevelPrefix(int level) {
+		switch (level) {
+		case LOG_LEVEL_DEBUG: return "DEBUG ";
+		case LOG_LEVEL_WARN: return "WARN ";
+		case LOG_LEVEL_ERROR: return "ERROR ";
+		}
+		return "";
+	}
+
+	// Formats and prints one record on the calling thread, holding the console like the drain does
+	void Print(int format_id, const std::string& args) {
+		CallSite f;
+		{
+			std::lock_guard<std::mutex> flock(formats_mutex_);
+			f = formats_[format_id];
+		}
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (f.level >= console_level_) {
+			std::string line = LevelPrefix(f.level) + Format(f.format, args) + '\n';
+			std::fwrite(line.data(), 1, line.size(), stdout);
+		}
+	}
+
+	//-------------------------------------------------------------------------------------------
+	// background thread
+
+	template<typename T>
+	static void Put(std::string& out, T value) {
+		out.append((const char*)&value, sizeof(value));
+	}
+
+	static void PutString(std::string& out, const std::string& value) {
+		uint16_t n = (uint16_t)std::min<size_t>(value.size(), 0xFFFF);
+		Put(out, n);
+		out.append(value.data(), n);
+	}
+
+	void Drain() {
+		std::vector<Entry> entries;
+		std::string console;
+		std::string binary;
+		std::vector<CallSite> formats;	// copy of formats_, only grows
+		std::vector<std::shared_ptr<Ring>> rings;
+		std::vector<std::pair<uint32_t, unsigned long>> drops;
+		std::vector<char> record(LOG_MAX_RECORD);
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		for (;;) {
+			bool stopping = stop_;
+			lock.unlock();
+
+			{
+				std::lock_guard<std::mutex> flock(formats_mutex_);
+				rings = rings_;
+			}
+
+			entries.clear();
+			drops.clear();
+			for (auto& ring : rings) {
+				bool retired = ring->retired.load(std::memory_order_acquire);
+				uint64_t head = ring->head.load(std::memory_order_relaxed);
+				uint64_t tail = ring->tail.load(std::memory_order_acquire);
+				while (tail - head >= RECORD_HEADER) {
+					uint16_t size;
+					ring->read(head, (char*)&size, sizeof(size));
+					ring->read(head, record.data(), size);
+					Entry e;
+					std::memcpy(&e.format, &record[2], sizeof(e.format));
+					std::memcpy(&e.time, &record[6], sizeof(e.time));
+					e.thread = ring->thread;
+					e.args.assign(&record[RECORD_HEADER], size - RECORD_HEADER);
+					entries.push_back(std::move(e));
+					head += size;
+				}
+				ring->head.store(head, std::memory_order_release);
+				unsigned long dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+				if (dropped > 0) {
+					drops.push_back(std::make_pair(ring->thread, dropped));
+				}
+				if (retired && head == tail) {
+					std::lock_guard<std::mutex> flock(formats_mutex_);
+					rings_.erase(std::remove(rings_.begin(), rings_.end(), ring), rings_.end());
+				}
+			}
+			// formats only after the records, so every record read has its format
+			{
+				std::lock_guard<std::mutex> flock(formats_mutex_);
+				formats.insert(formats.end(), formats_.begin() + formats.size(), formats_.end());
+			}
+
+			// threads were drained one after the other, put their records back in time order
+			std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+
+			lock.lock();
+			console.clear();
+			binary.clear();
+			if (file_ != nullptr) {
+				for (; formats_written_ < formats.size(); formats_written_++) {
+					const CallSite& f = formats[formats_written_];
+					binary += 'F';
+					Put<uint32_t>(binary, (uint32_t)formats_written_);
+					Put<uint8_t>(binary, (uint8_t)f.level);
+					Put<uint32_t>(binary, (uint32_t)f.line);
+					PutString(binary, f.file);
+					PutString(binary, f.format);
+				}
+			}
+			for (auto& e : entries) {
+				const CallSite& f = formats[e.format];
+				if (f.level >= console_level_) {
+					console += LevelPrefix(f.level);
+					console += Format(f.format, e.args);
+					console += '\n';
+				}
+				if (file_ != nullptr) {
+					binary += 'E';
+					Put<uint32_t>(binary, e.format);
+					Put<uint32_t>(binary, e.thread);
+					Put<uint64_t>(binary, e.time);
+					PutString(binary, e.args);
+				}
+			}
+			for (auto& d : drops) {
+				console += "WARN log ring of thread " + std::to_string(d.first) + " was full, "
+					+ std::to_string(d.second) + " records dropped\n";
+				if (file_ != nullptr) {
+					binary += 'D';
+					Put<uint32_t>(binary, d.first);
+					Put<uint32_t>(binary, (uint32_t)d.second);
+				}
+			}
+			if (!console.empty()) {
+				std::fwrite(console.data(), 1, console.size(), stdout);
+				std::fflush(stdout);
+			}
+			if (!binary.empty()) {
+				std::fwrite(binary.data(), 1, binary.size(), file_);
+				std::fflush(file_);
+			}
+
+			rounds_++;
+			drained_cv_.notify_all();
+			if (stopping) {
+				break;
+			}
+			drain_cv_.wait_for(lock, std::chrono::milliseconds(LOG_DRAIN_MS));
+		}
+	}
+
+public:
+	AsyncLog(const AsyncLog&) = delete;
+	AsyncLog& operator=(const AsyncLog&) = delete;
+
+	static AsyncLog& Instance() {
+		static AsyncLog log;
+		return log;
+	}
+
+	// Gives a call site its format id, called once per site by the LOG_ macros
+	static int Register(int level, const char* file, int line, const char* format) {
+		AsyncLog& log = Instance();
+		std::lock_guard<std::mutex> lock(log.formats_mutex_);
+		const char* base = std::max(std::strrchr(file, '/'), std::strrchr(file, '\\'));
+		CallSite f;
+		f.level = level;
+		f.line = line;
+		f.file = base != nullptr ? base + 1 : file;
+		f.format = format;
+		log.formats_.push_back(f);
+		return (int)log.formats_.size() - 1;
+	}
+
+	template<typename... Args>
+	static const char* FormatOf(const char* format, const Args&...) {
+		return format;
+	}
+
+	// Queues a record for the background thread, never blocks
+	template<typename... Args>
+	static void Write(int format_id, const char*, const Args&... args) {
+		AsyncLog& log = Instance();
+		Record r;
+		r.size = RECORD_HEADER;
+		EncodeArgs(r, args...);
+
+		uint16_t size = (uint16_t)r.size;
+		uint32_t id = (uint32_t)format_id;
+		uint64_t time = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - log.start_).count();
+		std::memcpy(&r.data[0], &size, sizeof(size));
+		std::memcpy(&r.data[2], &id, sizeof(id));
+		std::memcpy(&r.data[6], &time, sizeof(time));
+		if (log.synchronous_.load(std::memory_order_relaxed)) {
+			log.Print(format_id, std::string(&r.data[RECORD_HEADER], r.size - RECORD_HEADER));
+			return;
+		}
+		Ring& ring = log.ThisThreadRing();
+		ring.push(r.data, r.size);
+		if (ring.tail.load(std::memory_order_relaxed) - ring.head.load(std::memory_order_relaxed) > LOG_RING_BYTES / 2) {
+			log.drain_cv_.notify_one();		// don't wait for the timer, it is filling up
+		}
+	}
+
+	/**
+	* Formats logged arguments with a printf format. Length modifiers in the format are ignored,
+	* each argument prints as the type it was logged as.
+	*/
+	static std::string Format(const std::string& format, const std::string& args) {
+		std::string out;
+		const char* arg = args.data();
+		const char* end = arg + args.size();
+		for (size_t i = 0; i < format.size(); i++) {
+			if (format[i] != '%') {
+				out += format[i];
+				continue;
+			}
+			if (i + 1 < format.size() && format[i + 1] == '%') {
+				out += '%';
+				i++;
+				continue;
+			}
+			std::string spec = "%";
+			size_t j = i + 1;
+			while (j < format.size() && std::strchr("-+ #0123456789.*", format[j]) != nullptr && format[j] != '\0') {
+				if (format[j] != '*') {
+					spec += format[j];
+				}
+				j++;
+			}
+			while (j < format.size() && std::strchr("hlLqjzt", format[j]) != nullptr && format[j] != '\0') {
+				j++;
+			}
+			if (j >= format.size()) {
+				out += format.substr(i);
+				break;
+			}
+			FormatArg(out, spec, format[j], arg, end);
+			i = j;
+		}
+		return out;
+	}
+
+	/**
+	* Writes every record logged so far to the file and console, e.g. before exiting or reading
+	* the log file
+	*/
+	static void Flush() {
+		AsyncLog& log = Instance();
+		std::unique_lock<std::mutex> lock(log.mutex_);
+		uint64_t target = log.rounds_ + 2;	// the round under way may have started before the call
+		log.drain_cv_.notify_one();
+		log.drained_cv_.wait(lock, [&]() { return log.rounds_ >= target || log.stop_; });
+	}
+
+	/**
+	* Starts appending every record to a binary log file, replacing any file open before
+	* @return false if the file could not be created
+	*/
+	static bool OpenFile(const std::string& path) {
+		Flush();
+		AsyncLog& log = Instance();
+		FILE* file = std::fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			return false;
+		}
+		uint32_t header[2] = { LOG_FILE_MAGIC, LOG_FILE_VERSION };
+		std::fwrite(header, sizeof(header), 1, file);
+		std::fwrite(&log.start_wall_ns_, sizeof(log.start_wall_ns_), 1, file);
+
+		std::lock_guard<std::mutex> lock(log.mutex_);
+		if (log.file_ != nullptr) {
+			std::fclose(log.file_);
+		}
+		log.file_ = file;
+		log.formats_written_ = 0;
+		return true;
+	}
+
+	// Records below this level are only written to the file, LOG_LEVEL_OFF keeps the console quiet
+	static void SetConsoleLevel(int level) {
+		AsyncLog& log = Instance();
+		std::lock_guard<std::mutex> lock(log.mutex_);
+		log.console_level_ = level;
+	}
+
+	/**
+	* Prints each record on the thread logging it, under a lock, instead of queueing it. Records
+	* logged this way are not written to the log file. Call while no other thread is logging.
+	*/
+	static void SetSynchronous(bool synchronous) {
+		Flush();
+		Instance().synchronous_.store(synchronous, std::memory_order_relaxed);
+	}
+
+	/**
+	* Reads a binary log file back as text, one line per record:
+	*	seconds since start, thread, level, file:line, message
+	* @return false if the file is not a log file or ends in the middle of a record
+	*/
+	static bool Decode(std::istream& in, std::ostream& out) {
+		uint32_t header[2];
+		int64_t start_wall_ns;
+		if (!in.read((char*)header, sizeof(header)) || header[0] != LOG_FILE_MAGIC || header[1] != LOG_FILE_VERSION
+			|| !in.read((char*)&start_wall_ns, sizeof(start_wall_ns))) {
+			return false;
+		}
+		auto get = [&](void* value, size_t size) { return (bool)in.read((char*)value, size); };
+		auto get_string = [&](std::string& value) {
+			uint16_t n;
+			if (!get(&n, sizeof(n))) {
+				return false;
+			}
+			value.resize(n);
+			return n == 0 || get(&value[0], n);
+		};
+
+		std::vector<CallSite> formats;
+		char type;
+		while (in.get(type)) {
+			if (type == 'F') {
+				uint32_t id, line;
+				uint8_t level;
+				CallSite f;
+				if (!get(&id, sizeof(id)) || !get(&level, sizeof(level)) || !get(&line, sizeof(line))
+					|| !get_string(f.file) || !get_string(f.format)) {
+					return false;
+				}
+				f.level = level;
+				f.line = (int)line;
+				if (formats.size() <= id) {
+					formats.resize(id + 1);
+				}
+				formats[id] = f;
+			}
+			else if (type == 'E') {
+				uint32_t id, thread;
+				uint64_t time;
+				std::string args;
+				if (!get(&id, sizeof(id)) || !get(&thread, sizeof(thread)) || !get(&time, sizeof(time))
+					|| !get_string(args) || id >= formats.size()) {
+					return false;
+				}
+				const CallSite& f = formats[id];
+				char stamp[64];
+				std::snprintf(stamp, sizeof(stamp), "%12.6f T%-3u %-5s ", time / 1e9, thread,
+					f.level == LOG_LEVEL_DEBUG ? "DEBUG" : f.level == LOG_LEVEL_INFO ? "INFO"
+					: f.level == LOG_LEVEL_WARN ? "WARN" : "ERROR");
+				out << stamp << f.file << ":" << f.line << " " << Format(f.format, args) << "\n";
+			}
+			else if (type == 'D') {
+				uint32_t thread, dropped;
+				if (!get(&thread, sizeof(thread)) || !get(&dropped, sizeof(dropped))) {
+					return false;
+				}
+				out << "             T" << thread << " dropped " << dropped << " records\n";
+			}
+			else {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+#define ASYNC_LOG(level, ...) do { \
+		static const int async_log_format_id = AsyncLog::Register(level, __FILE__, __LINE__, AsyncLog::FormatOf(__VA_ARGS__)); \
+		AsyncLog::Write(async_log_format_id, __VA_ARGS__); \
+	} while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) ASYNC_LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) ASYNC_LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) ASYNC_LOG(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) ASYNC_LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,287 @@
+/*
+*Description: Sharded open-addressing hash map from an integer id to a pointer. Lookups never lock,
+*			  a lookup only starts its probe over when a writer reuses the slot it was reading. Inserts
+*			  and erases lock only the shard the id hashes to.
+*/
+
+#ifndef CONCURRENTIDMAP_H
+#define CONCURRENTIDMAP_H
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define ID_MAP_NUM_SHARDS 16		// must be a power of two
+#define ID_MAP_BUCKET_SLOTS 4		// slots sharing one cache line
+#define ID_MAP_MAX_LOAD 0.75
+#define ID_MAP_EMPTY_KEY INT_MIN
+#define ID_MAP_TOMBSTONE (INT_MIN + 1)
+#define CACHE_LINE_SIZE 64
+
+/**
+* Maps ids to pointers that are owned elsewhere and must stay valid for the lifetime of the map.
+* Ids ID_MAP_EMPTY_KEY and ID_MAP_TOMBSTONE are reserved.
+*
+* Readers probe the current table of a shard with acquire loads only. When a shard grows, the new
+* table is published atomically and the old one is kept alive until the map is destroyed (or the
+* owner calls ReleaseRetiredTables()), so a reader that is still probing an old table sees a
+* consistent (if slightly stale) view.
+*/
+template<typename T>
+class ConcurrentIdMap {
+private:
+	struct Slot {
+		std::atomic<int> key;
+		std::atomic<T*> value;
+	};
+
+	// one bucket fills exactly one cache line, a probe touches one line per bucket
+	struct alignas(CACHE_LINE_SIZE) Bucket {
+		Slot slots[ID_MAP_BUCKET_SLOTS];
+
+		Bucket() {
+			for (auto& slot : slots) {
+				slot.key.store(ID_MAP_EMPTY_KEY, std::memory_order_relaxed);
+				slot.value.store(nullptr, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	struct Table {
+		std::unique_ptr<char[]> storage;
+		Bucket* buckets;
+		size_t mask;		// number of buckets - 1
+
+		// operator new does not honour alignas before C++17, so align the buckets by hand
+		Table(size_t nbuckets) : storage(new char[nbuckets * sizeof(Bucket) + CACHE_LINE_SIZE]), mask(nbuckets - 1) {
+			void* ptr = storage.get();
+			size_t space = nbuckets * sizeof(Bucket) + CACHE_LINE_SIZE;
+			buckets = static_cast<Bucket*>(std::align(CACHE_LINE_SIZE, nbuckets * sizeof(Bucket), ptr, space));
+			for (size_t b = 0; b < nbuckets; b++) {
+				new (&buckets[b]) Bucket();
+			}
+		}
+
+		size_t capacity() const {
+			return (mask + 1) * ID_MAP_BUCKET_SLOTS;
+		}
+	};
+
+	struct alignas(CACHE_LINE_SIZE) Shard {
+		std::mutex mutex;
+		std::atomic<Table*> table;
+		size_t size;		// live keys
+		size_t used;		// live keys + tombstones
+		std::vector<std::unique_ptr<Table>> tables;		// current table is tables.back()
+
+		Shard() : table(nullptr), size(0), used(0) {}
+	};
+
+	Shard shards_[ID_MAP_NUM_SHARDS];
+
+public:
+	/**
+	* @param expected number of ids expected, used to size the tables so early inserts don't grow them
+	*/
+	ConcurrentIdMap(size_t expected = 1024) {
+		size_t per_shard = (size_t)(expected / ID_MAP_NUM_SHARDS / ID_MAP_MAX_LOAD) / ID_MAP_BUCKET_SLOTS + 1;
+		size_t nbuckets = 1;
+		while (nbuckets < per_shard) {
+			nbuckets <<= 1;
+		}
+		for (auto& shard : shards_) {
+			shard.tables.emplace_back(new Table(nbuckets));
+			shard.table.store(shard.tables.back().get(), std::memory_order_release);
+		}
+	}
+
+	ConcurrentIdMap(const ConcurrentIdMap&) = delete;
+	ConcurrentIdMap& operator=(const ConcurrentIdMap&) = delete;
+
+	/**
+	* Lock-free lookup, retries if the slot it read was erased and reused meanwhile
+	* @param id key
+	* @return mapped pointer or nullptr if the id is not in the map
+	*/
+	T* find(int id) const {
+		uint32_t h = hash(id);
+		const Table* table = shards_[h & (ID_MAP_NUM_SHARDS - 1)].table.load(std::memory_order_acquire);
+		return lookup(*table, id, h);
+	}
+
+	/**
+	* Maps id to value unless the id is already present
+	* @return the pointer now mapped to id (the existing one if the id was already there)
+	*/
+	T* insert(int id, T* value) {
+		uint32_t h = hash(id);
+		Shard& shard = shards_[h & (ID_MAP_NUM_SHARDS - 1)];
+		std::lock_guard<std::mutex> mylock(shard.mutex);
+
+		Table* table = shard.table.load(std::memory_order_relaxed);
+		T* existing = lookup(*table, id, h);
+		if (existing != nullptr) {
+			return existing;
+		}
+
+		if (shard.used + 1 > table->capacity() * ID_MAP_MAX_LOAD) {
+			table = rehash(shard);
+		}
+		if (place(*table, id, value, h)) {
+			shard.used++;
+		}
+		shard.size++;
+		return value;
+	}
+
+	/**
+	* Removes an id, the pointed-to object is not touched
+	* @return the pointer that was mapped, nullptr if the id was not in the map
+	*/
+	T* erase(int id) {
+		uint32_t h = hash(id);
+		Shard& shard = shards_[h & (ID_MAP_NUM_SHARDS - 1)];
+		std::lock_guard<std::mutex> mylock(shard.mutex);
+
+		Table* table = shard.table.load(std::memory_order_relaxed);
+		Slot* slot = probe(*table, id, h);
+		if (slot == nullptr) {
+			return nullptr;
+		}
+		T* out = slot->value.load(std::memory_order_relaxed);
+		slot->key.store(ID_MAP_TOMBSTONE, std::memory_order_release);
+		shard.size--;
+		return out;
+	}
+
+	/**
+	* Frees the tables replaced by earlier growth. Only call once no reader can still be probing
+	* an old table, i.e. every find() that started before the last insert has returned.
+	*/
+	void ReleaseRetiredTables() {
+		for (auto& shard : shards_) {
+			std::lock_guard<std::mutex> mylock(shard.mutex);
+			if (shard.tables.size() > 1) {
+				shard.tables.erase(shard.tables.begin(), shard.tables.end() - 1);
+			}
+		}
+	}
+
+	size_t size() {
+		size_t out = 0;
+		for (auto& shard : shards_) {
+			std::lock_guard<std::mutex> mylock(shard.mutex);
+			out += shard.size;
+		}
+		return out;
+	}
+
+private:
+	// murmur3 finalizer: consecutive product ids end up far apart
+	static uint32_t hash(int id) {
+		uint32_t h = (uint32_t)id;
+		h ^= h >> 16;
+		h *= 0x85ebca6b;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35;
+		h ^= h >> 16;
+		return h;
+	}
+
+	// low bits pick the shard, the rest pick the bucket
+	static size_t home(const Table& table, uint32_t h) {
+		return (h / ID_MAP_NUM_SHARDS) & table.mask;
+	}
+
+	static T* lookup(const Table& table, int id, uint32_t h) {
+		T* out;
+		while (!lookupOnce(table, id, h, out)) {}
+		return out;
+	}
+
+	// false if the slot holding id was erased and reused while it was read, the probe must start over
+	static bool lookupOnce(const Table& table, int id, uint32_t h, T*& out) {
+		out = nullptr;
+		size_t b = home(table, h);
+		for (size_t n = 0; n <= table.mask; n++) {
+			const Bucket& bucket = table.buckets[b];
+			for (auto& slot : bucket.slots) {
+				int key = slot.key.load(std::memory_order_acquire);
+				if (key == id) {
+					out = slot.value.load(std::memory_order_acquire);
+					// place() stores the value before the key, so a value from a reuse makes the
+					// tombstone or new key visible to this second read
+					return slot.key.load(std::memory_order_acquire) == id;
+				}
+				if (key == ID_MAP_EMPTY_KEY) {
+					return true;
+				}
+			}
+			b = (b + 1) & table.mask;
+		}
+		return true;
+	}
+
+	static Slot* probe(Table& table, int id, uint32_t h) {
+		size_t b = home(table, h);
+		for (size_t n = 0; n <= table.mask; n++) {
+			for (auto& slot : table.buckets[b].slots) {
+				int key = slot.key.load(std::memory_order_relaxed);
+				if (key == id) {
+					return &slot;
+				}
+				if (key == ID_MAP_EMPTY_KEY) {
+					return nullptr;
+				}
+			}
+			b = (b + 1) & table.mask;
+		}
+		return nullptr;
+	}
+
+	// stores into the first free or dead slot, returns true if a never-used slot was consumed
+	static bool place(Table& table, int id, T* value, uint32_t h) {
+		size_t b = home(table, h);
+		for (;;) {
+			for (auto& slot : table.buckets[b].slots) {
+				int key = slot.key.load(std::memory_order_relaxed);
+				if (key == ID_MAP_EMPTY_KEY || key == ID_MAP_TOMBSTONE) {
+					// value first so a reader that sees the key also sees the value
+					slot.value.store(value, std::memory_order_release);
+					slot.key.store(id, std::memory_order_release);
+					return key == ID_MAP_EMPTY_KEY;
+				}
+			}
+			b = (b + 1) & table.mask;
+		}
+	}
+
+	// builds a bigger table without tombstones and publishes it, caller holds the shard lock
+	Table* rehash(Shard& shard) {
+		Table* old_table = shard.table.load(std::memory_order_relaxed);
+		size_t nbuckets = old_table->mask + 1;
+		if (shard.size + 1 > old_table->capacity() * ID_MAP_MAX_LOAD / 2) {
+			nbuckets *= 2;
+		}
+
+		std::unique_ptr<Table> table(new Table(nbuckets));
+		for (size_t b = 0; b <= old_table->mask; b++) {
+			for (auto& slot : old_table->buckets[b].slots) {
+				int key = slot.key.load(std::memory_order_relaxed);
+				if (key != ID_MAP_EMPTY_KEY && key != ID_MAP_TOMBSTONE) {
+					place(*table, key, slot.value.load(std::memory_order_relaxed), hash(key));
+				}
+			}
+		}
+
+		shard.used = shard.size;
+		shard.table.store(table.get(), std::memory_order_release);
+		shard.tables.push_back(std::move(table));
+		return shard.tables.back().get();
+	}
+};
+
+#endif
@@ -9,48 +9,137 @@
 
 #include "product.h"
 #include "Storage.h"
+#include "AsyncLog.h"
+#include <atomic>
 #include <mutex>
 #include <string>
 
 #define LOW_STOCK_THRESHOLD 18
 
+/**
+* Stock is tracked with two counters: available (stored and free to reserve) and reserved (promised
+* to an order but still on the shelf). Reserving only moves counts between them, the shelf locations
+* themselves sit in a pool that is touched when items are stored or physically aquired.
+*
+* The pool always holds at least available + reserved locations, so an aquire that got past the
+* reserved counter always finds a location.
+*
+* Every change to the counters is followed by a bump of version_, so a reader that loads the
+* version before the counters can tell later whether what it read is still current.
+*
+* With a journal, each change is logged before it can be seen: stores and aquires inside the pool
+* lock so a shelf's events are logged in the order they happen to it, reservations between taking
+* the stock and counting it as reserved so an aquire of it is always logged after them.
+*/
 class Inventory {
 private:
-	std::mutex mutex; 
-	std::vector<ShelfLocation> stored;
-	std::vector<ShelfLocation> reserved;
+	std::mutex mutex;		// protects locations
+	std::vector<ShelfLocation> locations;
+	std::atomic<int> available_;
+	std::atomic<int> reserved_;
+	std::atomic<unsigned long> version_;	// bumped after every change to the counters
+	std::atomic<bool> low_stock_;			// below LOW_STOCK_THRESHOLD and already warned about
+	WarehouseJournal* journal_;	// nullptr if nothing is logged
     int ID_;
-	
+
+	// batch reservations take and return stock of several inventories
+	friend class InventoryTable;
+
+	/**
+	* Takes quantity from counter if it holds at least that much
+	* @param retries incremented each time another thread changed the counter under us
+	* @return value of the counter seen when giving up or succeeding
+	*/
+	static int take(std::atomic<int>& counter, int quantity, unsigned long& retries) {
+		int cur = counter.load(std::memory_order_relaxed);
+		while (cur >= quantity) {
+			if (counter.compare_exchange_weak(cur, cur - quantity, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+				return cur;
+			}
+			retries++;
+		}
+		return cur;
+	}
+
+	// Marks a change to the counters, call after making it
+	void changed() {
+		version_.fetch_add(1, std::memory_order_release);
+	}
+
+	// Warns when the stock drops below LOW_STOCK_THRESHOLD, once until a restock lifts it back up
+	void CheckLowStock() {
+		int stored = numStored();
+		if (stored < LOW_STOCK_THRESHOLD && !low_stock_.exchange(true, std::memory_order_relaxed)) {
+			LOG_WARN("Product ID %d LOW ON STOCK!! %d left", ID_, stored);
+		}
+	}
+
+	// Call after adding stock, the next drop below LOW_STOCK_THRESHOLD warns again
+	void Restocked() {
+		if (numStored() >= LOW_STOCK_THRESHOLD) {
+			low_stock_.store(false, std::memory_order_relaxed);
+		}
+	}
 
 public:
-	Inventory(int id ): ID_(id){}
+	Inventory(int id ): available_(0), reserved_(0), version_(0), low_stock_(false), journal_(nullptr), ID_(id){}
 
-	Inventory(const Inventory &other) { 
-		std::mutex mutex;
-		ID_ = other.ID_;
-		stored = other.stored;
-		reserved = other.reserved;
+	// Starts logging changes, call before the inventory is shared
+	void SetJournal(WarehouseJournal* journal) {
+		journal_ = journal;
+	}
+
+	/**
+	* Replaces the stock with what it was before a restart, not logged and only safe before the
+	* inventory is shared
+	* @param locations_in shelves holding the available and reserved items
+	*/
+	void Restore(const std::vector<ShelfLocation>& locations_in, int available, int reserved) {
+		{
+			std::lock_guard<std::mutex> mylock(mutex);
+			locations = locations_in;
+		}
+		available_.store(available, std::memory_order_release);
+		reserved_.store(reserved, std::memory_order_release);
+		changed();
 	}
 
 	void store(ShelfLocation location) {
-		std::lock_guard<std::mutex> mylock(mutex);
-		stored.push_back(location);
+		{
+			std::lock_guard<std::mutex> mylock(mutex);
+			locations.push_back(location);
+			if (journal_ != nullptr) {
+				journal_->Store(ID_, location.slot());
+			}
+		}
+		// only count it once the location is in the pool
+		available_.fetch_add(1, std::memory_order_release);
+		changed();
+		Restocked();
 		//std::cout << "Item added to Inventory " << std::to_string(ID_) <<std::endl;
 	}
 
-	void store(std::vector<ShelfLocation>& locations) {
-		std::lock_guard<std::mutex> mylock(mutex);
-		stored.insert(
-			stored.end(),
-			std::make_move_iterator(locations.begin()),
-			std::make_move_iterator(locations.end())
-		);
-
-
+	void store(std::vector<ShelfLocation>& locations_in) {
+		{
+			std::lock_guard<std::mutex> mylock(mutex);
+			locations.insert(
+				locations.end(),
+				std::make_move_iterator(locations_in.begin()),
+				std::make_move_iterator(locations_in.end())
+			);
+			if (journal_ != nullptr) {
+				for (auto& location : locations_in) {
+					journal_->Store(ID_, location.slot());
+				}
+			}
+		}
+		available_.fetch_add((int)locations_in.size(), std::memory_order_release);
+		changed();
+		Restocked();
 	}
 
 	/**
-	* Tries to reserve a quantity from the stored vector
+	* Tries to reserve a quantity of the available stock
 	* if it cant reserve them all it wont reserve any
 	*
 	* @param quantity number of products to be reserved
@@ -58,25 +147,21 @@ public:
 	*         all items have been reserved other wise none of them are reserved.
 	*/
 	int Reserve(size_t quantity) {
-		std::lock_guard<std::mutex> mylock(mutex);
-
-		if (stored.size() < quantity) {
-			return stored.size();
+		unsigned long retries = 0;
+		int seen = take(available_, (int)quantity, retries);
+		if (seen < (int)quantity) {
+			return seen;
 		}
-
-		for (size_t i = 0; i < quantity; i++)
-		{
-			reserved.push_back(stored.back());
-			stored.pop_back();
+		if (journal_ != nullptr) {
+			journal_->Reserve(ID_, (int)quantity);
 		}
-		std::cout << "Inventory " << std::to_string(ID_) << " : Successfuly Reserved "<< std::to_string(quantity) 
-			<< " items."
-			<< std::endl;
+		reserved_.fetch_add((int)quantity, std::memory_order_release);
+		changed();
 		return quantity;
 	}
 
 	/**
-	* Tries to unreserve a quantity from the reserved vector
+	* Tries to return a reserved quantity to the available stock
 	* if it cant unreserve them all it wont unreserve any
 	*
 	* @param quantity number of products to be reserved
@@ -84,42 +169,49 @@ public:
 	*         all items have been unreserved other wise none of them are.
 	*/
 	int UnReserve(size_t quantity) {
-		std::lock_guard<std::mutex> mylock(mutex);
-
-		if (reserved.size() < quantity) {
-			return reserved.size();
+		unsigned long retries = 0;
+		int seen = take(reserved_, (int)quantity, retries);
+		if (seen < (int)quantity) {
+			return seen;
 		}
-
-		for (size_t i = 0; i < quantity; i++)
-		{
-			stored.push_back(reserved.back());
-			reserved.pop_back();
+		if (journal_ != nullptr) {
+			journal_->UnReserve(ID_, (int)quantity);
 		}
-
+		available_.fetch_add((int)quantity, std::memory_order_release);
+		changed();
 		return quantity;
 	}
 
+	// Takes the location of one reserved item off the shelf pool, invalid location if nothing is reserved
 	ShelfLocation aquire() {
 		ShelfLocation out;
-		if (!reserved.empty()) {
-			std::lock_guard<std::mutex> mylock(mutex);
-			out = reserved.back();
-			reserved.pop_back();
-		}
-		if (numStored() < LOW_STOCK_THRESHOLD) {
-			std::cout << "Product ID " << std::to_string(ID_) << " LOW ON STOCK!!" << std::endl;
+		unsigned long retries = 0;
+		if (take(reserved_, 1, retries) >= 1) {
+			{
+				std::lock_guard<std::mutex> mylock(mutex);
+				out = locations.back();
+				locations.pop_back();
+				if (journal_ != nullptr) {
+					journal_->Aquire(ID_, out.slot());
+				}
+			}
+			changed();
 		}
+		CheckLowStock();
 		return out;
 	}
 
 	int numReserved() {
-		std::lock_guard<std::mutex> mylock(mutex);
-		return reserved.size();
+		return reserved_.load(std::memory_order_acquire);
 	}
 
 	int numStored() {
-		std::lock_guard<std::mutex> mylock(mutex);
-		return stored.size();
+		return available_.load(std::memory_order_acquire);
+	}
+
+	// Changes with every store, reservation and aquire, load it before reading the counters
+	unsigned long version() {
+		return version_.load(std::memory_order_acquire);
 	}
 
 	int getID(){
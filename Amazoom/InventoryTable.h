@@ -0,0 +1,189 @@
+/*
+*Description: Owns one Inventory per product and finds it by product ID without locking. Inventories
+*			  never move once created so robots can keep pointers to them while products are added.
+*/
+
+#ifndef INVENTORYTABLE_H
+#define INVENTORYTABLE_H
+
+#include "Inventory.h"
+#include "ConcurrentIdMap.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define INVENTORY_TABLE_INIT_CAPACITY 1024
+
+// One product line of a batch reservation
+struct ReservationLine {
+	int product_id;
+	int quantity;
+
+	ReservationLine(int id = 0, int qty = 0) : product_id(id), quantity(qty) {}
+};
+
+// Counters for sizing contention on the reservation path
+struct ReservationStats {
+	std::atomic<unsigned long> committed;	// batches fully reserved
+	std::atomic<unsigned long> rejected;	// batches refused because of a shortfall
+	std::atomic<unsigned long> conflicts;	// batches rolled back because another order took the stock first
+	std::atomic<unsigned long> retries;		// counter updates repeated because of a concurrent update
+
+	ReservationStats() : committed(0), rejected(0), conflicts(0), retries(0) {}
+};
+
+class InventoryTable {
+private:
+	ConcurrentIdMap<Inventory> index_;
+	std::mutex mutex_;		// protects owned_, only taken when adding products or listing them
+	std::vector<std::unique_ptr<Inventory>> owned_;
+	ReservationStats stats_;
+	WarehouseJournal* journal_;	// given to every inventory, nullptr if nothing is logged
+
+public:
+	/**
+	* @param expected number of products expected in the catalog, avoids growing the index during loading
+	*/
+	InventoryTable(size_t expected = INVENTORY_TABLE_INIT_CAPACITY) : index_(expected), journal_(nullptr) {}
+
+	InventoryTable(const InventoryTable&) = delete;
+	InventoryTable& operator=(const InventoryTable&) = delete;
+
+	/**
+	* Creates the inventory for a product, safe to call while the warehouse is running
+	* @param product_id product ID
+	* @return the inventory for this product (the existing one if it was already added)
+	*/
+	Inventory* add(int product_id) {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		Inventory* inv = index_.find(product_id);
+		if (inv != nullptr) {
+			return inv;
+		}
+
+		owned_.emplace_back(new Inventory(product_id));
+		owned_.back()->SetJournal(journal_);
+		return index_.insert(product_id, owned_.back().get());
+	}
+
+	/**
+	* Wait-free lookup
+	* @param product_id product ID
+	* @return the inventory or nullptr if the product is unknown
+	*/
+	Inventory* find(int product_id) const {
+		return index_.find(product_id);
+	}
+
+	/**
+	* Reserves every line of an order as one unit: either all quantities are reserved or none are.
+	*
+	* Optimistic: the available counters are checked first so a batch that can't fit is refused
+	* without touching any stock. The lines are then taken one by one in ascending product ID
+	* order, and only if another order drained a product between the check and the take are the
+	* lines taken so far put back and the batch tried again.
+	*
+	* @param lines product IDs and quantities, the same product may appear more than once
+	* @param shortfall on failure set to the first product that can't be reserved and its available quantity
+	* @return true if every line was reserved
+	*/
+	bool ReserveAll(std::vector<ReservationLine> lines, ReservationLine& shortfall) {
+		std::sort(lines.begin(), lines.end(), [](const ReservationLine& a, const ReservationLine& b) {
+			return a.product_id < b.product_id;
+		});
+
+		// merge duplicate products and resolve inventories up front
+		std::vector<std::pair<Inventory*, int>> wanted;
+		for (auto& line : lines) {
+			if (line.quantity <= 0) {
+				continue;
+			}
+			if (!wanted.empty() && wanted.back().first->getID() == line.product_id) {
+				wanted.back().second += line.quantity;
+				continue;
+			}
+			Inventory* inv = find(line.product_id);
+			if (inv == nullptr) {
+				shortfall = ReservationLine(line.product_id, 0);
+				stats_.rejected++;
+				return false;
+			}
+			wanted.push_back(std::make_pair(inv, line.quantity));
+		}
+
+		unsigned long retries = 0;
+		for (;;) {
+			for (auto& want : wanted) {
+				int available = want.first->numStored();
+				if (available < want.second) {
+					shortfall = ReservationLine(want.first->getID(), available);
+					stats_.rejected++;
+					stats_.retries += retries;
+					return false;
+				}
+			}
+
+			size_t taken = 0;
+			while (taken < wanted.size() &&
+				Inventory::take(wanted[taken].first->available_, wanted[taken].second, retries) >= wanted[taken].second) {
+				taken++;
+			}
+
+			if (taken == wanted.size()) {
+				break;
+			}
+
+			// lost a race for one product, hand back what we took and re-check
+			for (size_t i = 0; i < taken; i++) {
+				wanted[i].first->available_.fetch_add(wanted[i].second, std::memory_order_release);
+				wanted[i].first->changed();
+			}
+			stats_.conflicts++;
+		}
+
+		for (auto& want : wanted) {
+			if (journal_ != nullptr) {
+				journal_->Reserve(want.first->getID(), want.second);
+			}
+			want.first->reserved_.fetch_add(want.second, std::memory_order_release);
+			want.first->changed();
+		}
+		stats_.committed++;
+		stats_.retries += retries;
+		return true;
+	}
+
+	// Starts logging changes to every inventory, including those added later. Call before the
+	// inventories are shared.
+	void SetJournal(WarehouseJournal* journal) {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		journal_ = journal;
+		for (auto& inv : owned_) {
+			inv->SetJournal(journal);
+		}
+	}
+
+	const ReservationStats& stats() const {
+		return stats_;
+	}
+
+	// Returns every inventory in the order they were added
+	std::vector<Inventory*> all() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		std::vector<Inventory*> out;
+		out.reserve(owned_.size());
+		for (auto& inv : owned_) {
+			out.push_back(inv.get());
+		}
+		return out;
+	}
+
+	size_t size() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		return owned_.size();
+	}
+};
+
+#endif
@@ -1,129 +1,308 @@
+/*
+*Description: Loading bays and the dock thread that runs them. Delivery trucks reach the yard on a fixed
+*			  schedule and back into the first free bay, robots wait on the clock until a docked truck
+*			  has room for their load, and a truck leaves once it is full or once it has waited long
+*			  enough after its first load.
+*/
+
 #ifndef DOCKINGBAY_H
 #define DOCKINGBAY_H
 
-#include "Trucks.h"
 #include <cpen333/thread/thread_object.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "Trucks.h"
+#include "TruckQueue.h"
 #include "Storage.h"
-#include "product.h"
-#include "Order.h"
-#include "safe_printf.h"
-
-
-#define TRUCK_MAX_CAPACITY 2000.00 //kg
-#define TRUCK_THRESHOLD 16.00
+#include "SimClock.h"
+#include "AsyncLog.h"
 
 #define NUM_BAYS 2
 #define RAND_STOCK 3 // number of max random stock items per product
 #define BAY1 0
 #define BAY2 1
-//
-//struct LoadingBay {
-//	std::mutex mutex;
-//	double payload_weight;
-//	bool Truck_available;
-//	int baynum;
-//
-//	LoadingBay() {
-//		payload_weight = 0;
-//		Truck_available = false;
-//	}
-//
-//	void dockTruck() {
-//		std::lock_guard<std::mutex> mylock(mutex);
-//		Truck_available = true;
-//	}
-//
-//	void TruckLeaving(int id) {
-//		std::lock_guard<std::mutex> mylock(mutex);
-//		safe_printf("\nTruck %d Left bay %d. \n", id, baynum);
-//		Truck_available = false;
-//	}
-//
-//	bool LoadOrder(double weight) {
-//		if (!Truck_available) {
-//			return false;
-//		}
-//
-//		if ((weight + payload_weight) < TRUCK_MAX_CAPACITY) {
-//			std::lock_guard<std::mutex> mylock(mutex);
-//			payload_weight += weight;
-//			return true;
-//		}
-//
-//		return false;
-//	}
-//};
-//
-//class TruckHandler : public cpen333::thread::thread_object {
-//private:
-//	DeliveryTruck* Delivery_truck;
-//	LoadingBay& Delivery_bay;
-//	bool& quit_;
-//	int numtrucks;
-//	std::vector<Product> Products_;
-//
-//public:
-//	
-//	TruckHandler(std::vector<Product> Products, bool& quit, LoadingBay& Deliver_bay):
-//		Products_(Products), quit_(quit), Delivery_bay(Deliver_bay) {}
-//	
-//	~TruckHandler() {
-//		
-//			delete Delivery_truck;
-//			Delivery_truck = nullptr;
-//		
-//
-//	}
-//
-//	//Generates a vector of random number of each product
-//	std::vector<Product> GenerateStock() {
-//		srand(time(NULL));
-//		int rand_num = rand() % 1;
-//		std::vector<Product> out;
-//
-//		for (auto product : Products_) {
-//			rand_num = rand() % RAND_STOCK;
-//
-//			for (int i = 0; i < rand_num; i++)
-//			{
-//				out.push_back(product);
-//			}
-//		}
-//
-//		return out;
-//	}
-//
-//	int main() {
-//		safe_printf("\Truck Handler Started. \n ");
-//		numtrucks = 0;
-//		Delivery_bay.baynum = 1; //intialize bay
-//
-//		//creat first truck
-//		Delivery_truck = new DeliveryTruck(quit_, Delivery_bay.payload_weight, numtrucks, Delivery_bay); // link the bay weight to this truck
-//		Delivery_truck->start();
-//		//Dock it to the bay
-//		Delivery_bay.dockTruck();
-//		safe_printf("\Truck Handler: Docking Delivery Truck %d at bay %d \n ", numtrucks, 1);
-//
-//		while (1) {
-//
-//			if (quit_) {
-//				Delivery_truck->join();
-//				safe_printf("\nTruck Handler Quiting..\n ");
-//				break;
-//			}
-//
-//			if (!Delivery_bay.Truck_available) {
-//				//create new random truck
-//				safe_printf("\nTruck Handler Quiting..\n ");
-//			}
-//		}
-//		// end main
-//		return 0;
-//	}
-//
-//};
+#define TRUCK_ARRIVAL_MS 30000		// a delivery truck reaches the yard this often, simulated
+#define TRUCK_MAX_WAIT_MS 60000		// a truck leaves this long after its first load even if it is not full
 
-#endif
+struct LoadingBay {
+	int baynum;
+	bool open;			// has cells on the floor map
+	bool docked;		// a truck is in the bay
+	Truck truck;
+	int inbound;		// robots holding room on the truck that have not loaded yet
+	double occupied_ms;	// simulated time trucks spent in the bay, finished stays only
+	double loading_ms;	// of that, time between a truck's first load and its departure
+
+	LoadingBay() : baynum(0), open(false), docked(false), inbound(0), occupied_ms(0), loading_ms(0) {}
+};
+
+// Snapshot of the dock counters
+struct DockStats {
+	unsigned long trucks_arrived;
+	unsigned long trucks_departed;
+	unsigned long full_departures;		// left because they were full
+	unsigned long deadline_departures;	// left part loaded after TRUCK_MAX_WAIT_MS
+	double kg_shipped;
+	unsigned long loads;				// robot loads put on trucks
+	unsigned long robot_waits;			// loads whose robot found no truck with room
+	double robot_wait_ms;				// simulated time robots spent waiting for room, summed
+	double max_robot_wait_ms;
+	double elapsed_ms;					// simulated time since the dock opened
+	std::vector<double> bay_occupied;	// per bay, fraction of elapsed time a truck was in it
+	std::vector<double> bay_loading;	// per bay, fraction of elapsed time a part loaded truck was in it
+
+	DockStats() : trucks_arrived(0), trucks_departed(0), full_departures(0), deadline_departures(0), kg_shipped(0),
+		loads(0), robot_waits(0), robot_wait_ms(0), max_robot_wait_ms(0), elapsed_ms(0) {}
+
+	double averageWait() const {
+		return loads == 0 ? 0 : robot_wait_ms / loads;
+	}
+
+	// average share of its capacity a departed truck carried
+	double averageFill() const {
+		return trucks_departed == 0 ? 0 : kg_shipped / (trucks_departed * TRUCK_MAX_CAPACITY);
+	}
+};
+
+/**
+* Robots call Reserve() once they carry a load and Load() once they reach the bay it returned. Both the
+* dock thread and the robots only block through the SimClock, so the dock runs under every clock mode.
+*/
+class TruckHandler : public cpen333::thread::thread_object {
+private:
+	SimClock& clock_;
+	const int participant_;
+	const double interval_;
+	const double max_wait_;
+	const double start_;
+
+	std::mutex mutex_;			// protects everything below
+	std::vector<LoadingBay> bays_;
+	TruckQueue yard_;			// only touched under mutex_, so it never blocks
+	double next_arrival_;		// simulated ms the next truck is due in the yard
+	bool yard_full_;			// the due truck is held back until a truck leaves the yard
+	int next_truck_id_;
+	bool quit_;
+	DockStats stats_;
 
+	void Depart(LoadingBay& bay, double now, bool full) {
+		Truck& truck = bay.truck;
+		bay.occupied_ms += now - truck.docked_;
+		if (truck.first_load_ >= 0) {
+			bay.loading_ms += now - truck.first_load_;
+		}
+		bay.docked = false;
+		stats_.trucks_departed++;
+		stats_.kg_shipped += truck.payload_;
+		if (full) {
+			stats_.full_departures++;
+		}
+		else {
+			stats_.deadline_departures++;
+		}
+		LOG_INFO("Truck %d left bay %d with %.1f kg, %zu loads", truck.id_, bay.baynum, truck.payload_, truck.orders_.size());
+	}
 
+	// backs trucks from the yard into free bays
+	bool DockFromYard(double now) {
+		bool docked = false;
+		for (auto& bay : bays_) {
+			if (bay.open && !bay.docked && yard_.try_get(bay.truck)) {
+				bay.truck.docked_ = now;
+				bay.docked = true;
+				bay.inbound = 0;
+				docked = true;
+				LOG_INFO("Truck %d docked at bay %d", bay.truck.id_, bay.baynum);
+			}
+		}
+		return docked;
+	}
+
+	// lets the trucks that are due into the yard, a truck due while the yard is full waits for room
+	bool Arrive(double now) {
+		bool docked = DockFromYard(now);
+		while (now >= next_arrival_) {
+			yard_full_ = !yard_.try_add(Truck(next_truck_id_, DELIVERY_TRUCK, next_arrival_));
+			if (yard_full_) {
+				break;
+			}
+			next_truck_id_++;
+			stats_.trucks_arrived++;
+			next_arrival_ += interval_;
+			docked = DockFromYard(now) || docked;
+		}
+		return docked;
+	}
+
+public:
+	/**
+	* @param clock arrivals, departures and robot waits run on simulated time
+	* @param storage floor map, only its bays with cells are used
+	* @param interval_ms time between truck arrivals
+	* @param max_wait_ms longest a truck waits after its first load
+	*/
+	TruckHandler(SimClock& clock, const Storage& storage, double interval_ms = TRUCK_ARRIVAL_MS, double max_wait_ms = TRUCK_MAX_WAIT_MS)
+		: clock_(clock), participant_(clock.AddParticipant()), interval_(interval_ms), max_wait_(max_wait_ms), start_(clock.now()),
+		bays_(NUM_BAYS), yard_(), next_arrival_(start_), yard_full_(false), next_truck_id_(0), quit_(false) {
+		for (int b = 0; b < NUM_BAYS; b++) {
+			bays_[b].baynum = b;
+			bays_[b].open = !storage.getBay(b).empty();
+		}
+	}
+
+	/**
+	* Waits until a docked truck has room for a load and holds that room for the robot
+	* @param participant the robot's id on the clock
+	* @param weight kg the robot brings
+	* @return bay to take the load to, -1 if the dock was stopped
+	*/
+	int Reserve(int participant, double weight) {
+		double start = clock_.now();
+		bool waited = false;
+		while (true) {
+			unsigned long epoch = clock_.epoch();
+			{
+				std::lock_guard<std::mutex> mylock(mutex_);
+				if (quit_) {
+					return -1;
+				}
+				// the fullest truck that fits, so trucks fill up and leave rather than all sitting part loaded
+				LoadingBay* best = nullptr;
+				for (auto& bay : bays_) {
+					if (bay.docked && bay.truck.fits(weight) && (best == nullptr || bay.truck.payload_ > best->truck.payload_)) {
+						best = &bay;
+					}
+				}
+				if (best != nullptr) {
+					best->truck.payload_ += weight;
+					best->inbound++;
+					double wait = clock_.now() - start;
+					stats_.loads++;
+					stats_.robot_wait_ms += wait;
+					stats_.max_robot_wait_ms = std::max(stats_.max_robot_wait_ms, wait);
+					if (waited) {
+						stats_.robot_waits++;
+					}
+					return best->baynum;
+				}
+			}
+			waited = true;
+			clock_.idle_until(participant, NO_DEADLINE, epoch);
+		}
+	}
+
+	/**
+	* Puts a reserved load on the truck at a bay, the truck leaves if that filled it or its wait is over
+	* @param bay_num bay returned by Reserve()
+	* @param orders ids of the orders in the load
+	* @return id of the truck loaded, -1 if the dock was stopped and the truck sent off before the robot got there
+	*/
+	int Load(int bay_num, const std::vector<int>& orders) {
+		int truck_id;
+		{
+			std::lock_guard<std::mutex> mylock(mutex_);
+			LoadingBay& bay = bays_[bay_num];
+			if (quit_ || !bay.docked) {
+				return -1;
+			}
+			Truck& truck = bay.truck;
+			double now = clock_.now();
+			truck.orders_.insert(truck.orders_.end(), orders.begin(), orders.end());
+			if (truck.first_load_ < 0) {
+				truck.first_load_ = now;
+			}
+			truck_id = truck.id_;
+			bay.inbound--;
+			if (bay.inbound == 0 && (truck.full() || now >= truck.first_load_ + max_wait_)) {
+				Depart(bay, now, truck.full());
+			}
+		}
+		// the dock thread brings in the next truck, and keeps the deadline of a new first load
+		clock_.notify();
+		return truck_id;
+	}
+
+	// Sends off part loaded trucks and stops the dock thread, robots still waiting in Reserve() or on their
+	// way to a bay give up
+	void stop() {
+		{
+			std::lock_guard<std::mutex> mylock(mutex_);
+			if (quit_) {
+				return;
+			}
+			quit_ = true;
+		}
+		clock_.notify();
+		join();
+	}
+
+	DockStats getStats() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		DockStats stats = stats_;
+		double now = clock_.now();
+		stats.elapsed_ms = now - start_;
+		for (auto& bay : bays_) {
+			double occupied = bay.occupied_ms;
+			double loading = bay.loading_ms;
+			if (bay.docked) {
+				occupied += now - bay.truck.docked_;
+				if (bay.truck.first_load_ >= 0) {
+					loading += now - bay.truck.first_load_;
+				}
+			}
+			stats.bay_occupied.push_back(stats.elapsed_ms > 0 ? occupied / stats.elapsed_ms : 0);
+			stats.bay_loading.push_back(stats.elapsed_ms > 0 ? loading / stats.elapsed_ms : 0);
+		}
+		return stats;
+	}
+
+	int main() {
+		clock_.Begin(participant_);
+		while (true) {
+			unsigned long epoch = clock_.epoch();
+			bool docked;
+			double deadline = NO_DEADLINE;
+			{
+				std::lock_guard<std::mutex> mylock(mutex_);
+				double now = clock_.now();
+				if (quit_) {
+					for (auto& bay : bays_) {
+						if (bay.docked && bay.truck.payload_ > 0) {
+							Depart(bay, now, bay.truck.full());
+						}
+					}
+					break;
+				}
+
+				for (auto& bay : bays_) {
+					// a truck with robots on the way leaves from Load() once the last one arrives
+					if (bay.docked && bay.inbound == 0 && bay.truck.first_load_ >= 0 && now >= bay.truck.first_load_ + max_wait_) {
+						Depart(bay, now, bay.truck.full());
+					}
+				}
+				docked = Arrive(now);
+
+				// wake up for the next arrival and the earliest departure, an empty truck waits for its first load
+				if (!yard_full_) {
+					deadline = next_arrival_;
+				}
+				for (auto& bay : bays_) {
+					if (bay.docked && bay.inbound == 0 && bay.truck.first_load_ >= 0) {
+						double leave = bay.truck.first_load_ + max_wait_;
+						deadline = deadline == NO_DEADLINE ? leave : std::min(deadline, leave);
+					}
+				}
+			}
+
+			if (docked) {
+				clock_.notify(); // robots may be waiting for room
+			}
+			clock_.idle_until(participant_, deadline, epoch);
+		}
+		clock_.RemoveParticipant(participant_);
+		return 0;
+	}
+};
+
+#endif
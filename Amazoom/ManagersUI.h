@@ -7,31 +7,23 @@
 #ifndef MANAGERSUI_H
 #define MANAGERSUI_H
 #include "warehouse.h"
+#include "safe_printf.h"
 
 class ManagerUI : public cpen333::thread::thread_object {
-	std::map<int, int>& Inventory_ptr; //maps product id to inventory
-	std::vector<Inventory>& Inventories_;
+	InventoryTable& Inventories_; //maps product id to inventory
 	std::map<int, int>& Product_ptr;
 	std::vector<Product>& Products_;
-	std::mutex& order_mutex;
-	std::map<int, int>& Order_ptr; // maps the order to an order id
-	std::vector<Order>& Orders_;
+	OrderStore& orders_; // status reads don't lock
 	bool& quit_;
 
-	ManagerUI(std::vector<Order>& Orders, 
-			  std::map<int, int>& Orderptr, 
-			  std::mutex& ordermutex, 
+	ManagerUI(OrderStore& orders,
 			  std::vector<Product>& Products, 
 			  std::map<int, int>& Productptr, 
-			  std::vector<Inventory>& Inventories,
-			  std::map<int, int>& Inventory_ptr, bool& quit)
-			:	Orders_(Orders),
-				Order_ptr(Orderptr),
-				order_mutex(ordermutex),
+			  InventoryTable& Inventories, bool& quit)
+			:	orders_(orders),
 				Products_(Products),
 				Product_ptr(Productptr),
 				Inventories_(Inventories),
-				Inventory_ptr(Inventory_ptr),
 				quit_(quit){
 
 	
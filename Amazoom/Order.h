@@ -8,16 +8,9 @@
 #define ORDER_H
 
 #include "product.h"
+#include "OrderStatus.h"
 #include <vector>
 
-enum OrderStatus {
-	READY_FOR_COLLECTION,
-	ROBOT_COLLECTING_ORDER,
-	COLLECTION_COMPLETE,
-	OUT_FOR_DELIVERY,
-	UNKNOWN
-};
-
 enum RobotTask {
 	COLLECT_AND_LOAD,
 	UNLOAD,
@@ -26,11 +19,13 @@ enum RobotTask {
 
 struct OrderReport {
 	bool verified;
+	bool duplicate; // an order with the same ID was already placed
 	Product product;
 	int quantity;
 
 	OrderReport() {
 		verified = true;
+		duplicate = false;
 	}
 };
 
@@ -39,6 +34,7 @@ struct Order {
     int task_;
     int bay_;
 	std::vector<Product> products_;
+	std::vector<int> orders_; // for batched robot tasks: ids of the customer orders it carries items of
 	OrderStatus status;
 
 	Order(){}
@@ -59,6 +55,7 @@ struct Order {
 		bay_ = other.bay_;
 		status = other.status;
 		products_ = other.products_;
+		orders_ = other.orders_;
 		return *this;
 	}
 	//Order(Product prod, int quantity): {}
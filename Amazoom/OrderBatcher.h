@@ -0,0 +1,291 @@
+/*
+*Description: Collects verified orders for a short window, groups orders whose items sit close together
+*			  and packs them into robot tasks up to the robot carrying capacity so one trip serves
+*			  several orders. Keeps track of which tasks each order was split into.
+*/
+
+#ifndef ORDERBATCHER_H
+#define ORDERBATCHER_H
+
+#include <cpen333/thread/thread_object.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "Order.h"
+#include "RobotScheduler.h"
+#include "SimClock.h"
+
+#define BATCH_WINDOW_MS 500		// longest an order waits for others to share a trip with
+#define BATCH_MAX_ORDERS 16		// flush as soon as this many orders are waiting
+
+class OrderBatcher : public cpen333::thread::thread_object {
+private:
+	RobotScheduler& scheduler_;
+	SimClock& clock_;
+	const int participant_;
+	const double capacity_;
+	const double window_;
+	const size_t max_orders_;
+
+	std::mutex mutex_;
+	std::vector<Order> pending_;
+	double first_arrival_; // simulated ms
+	bool quit_;
+
+	std::mutex parts_mutex_;
+	std::map<int, int> parts_; // order id -> tasks still carrying part of it
+
+	int next_task_id_;
+	std::atomic<unsigned long> orders_batched_;
+	std::atomic<unsigned long> tasks_created_;
+
+public:
+	/**
+	* @param scheduler hands the tasks to the robots
+	* @param clock the batching window is measured in simulated time
+	* @param capacity weight a robot can carry on one trip
+	* @param window_ms longest time to hold an order back waiting for others
+	* @param max_orders number of waiting orders that triggers an immediate flush
+	*/
+	OrderBatcher(RobotScheduler& scheduler, SimClock& clock, double capacity, int window_ms = BATCH_WINDOW_MS, size_t max_orders = BATCH_MAX_ORDERS)
+		: scheduler_(scheduler), clock_(clock), participant_(clock.AddParticipant()), capacity_(capacity), window_(window_ms),
+		max_orders_(max_orders), first_arrival_(0), quit_(false), next_task_id_(0), orders_batched_(0), tasks_created_(0) {}
+
+	/**
+	* Queues an order for batching
+	* @param order verified order, products_ holds one entry per item with its shelf location
+	* @return false if the batcher was stopped, the order is not queued and stays with the caller
+	*/
+	bool add(const Order& order) {
+		bool wake;
+		{
+			std::lock_guard<std::mutex> mylock(mutex_);
+			if (quit_) {
+				return false;
+			}
+			wake = pending_.empty();
+			if (wake) {
+				first_arrival_ = clock_.now();
+			}
+			pending_.push_back(order);
+			wake = wake || pending_.size() >= max_orders_;
+		}
+		// the first order opens the window, a full batch closes it early
+		if (wake) {
+			clock_.notify();
+		}
+		return true;
+	}
+
+	/**
+	* Queues several orders under one lock, e.g. a batch submitted by the web server
+	* @param orders verified orders, as for add(const Order&)
+	* @return false if the batcher was stopped, none of the orders are queued
+	*/
+	bool add(const std::vector<Order>& orders) {
+		if (orders.empty()) {
+			return true;
+		}
+		bool wake;
+		{
+			std::lock_guard<std::mutex> mylock(mutex_);
+			if (quit_) {
+				return false;
+			}
+			wake = pending_.empty();
+			if (wake) {
+				first_arrival_ = clock_.now();
+			}
+			pending_.insert(pending_.end(), orders.begin(), orders.end());
+			wake = wake || pending_.size() >= max_orders_;
+		}
+		if (wake) {
+			clock_.notify();
+		}
+		return true;
+	}
+
+	/**
+	* Called by a robot once it delivered a task
+	* @param task task created by this batcher
+	* @return ids of the orders that are now fully collected
+	*/
+	std::vector<int> CompleteTask(const Order& task) {
+		std::vector<int> done;
+		std::lock_guard<std::mutex> mylock(parts_mutex_);
+		for (int id : task.orders_) {
+			auto it = parts_.find(id);
+			if (it == parts_.end()) {
+				continue;
+			}
+			if (--(it->second) == 0) {
+				done.push_back(id);
+				parts_.erase(it);
+			}
+		}
+		return done;
+	}
+
+	// Flushes everything still waiting and stops the batching thread, add() refuses orders from here on
+	void stop() {
+		{
+			std::lock_guard<std::mutex> mylock(mutex_);
+			if (quit_) {
+				return;
+			}
+			quit_ = true;
+		}
+		clock_.notify();
+		join();
+	}
+
+	// average number of trips needed per order so far
+	double TripsPerOrder() const {
+		unsigned long orders = orders_batched_.load();
+		return orders == 0 ? 0 : (double)tasks_created_.load() / orders;
+	}
+
+	int main() {
+		clock_.Begin(participant_);
+		while (true) {
+			unsigned long epoch = clock_.epoch();
+			std::vector<Order> batch;
+			bool quit;
+			double deadline = NO_DEADLINE;
+			{
+				std::lock_guard<std::mutex> mylock(mutex_);
+				quit = quit_;
+				// hold the window open unless it filled up or we are shutting down
+				if (quit_ || pending_.size() >= max_orders_ ||
+					(!pending_.empty() && clock_.now() >= first_arrival_ + window_)) {
+					batch.swap(pending_);
+				}
+				else if (!pending_.empty()) {
+					deadline = first_arrival_ + window_;
+				}
+			}
+
+			if (batch.empty() && !quit) {
+				clock_.idle_until(participant_, deadline, epoch);
+				continue;
+			}
+
+			Flush(batch);
+			if (quit) {
+				break;
+			}
+		}
+		clock_.RemoveParticipant(participant_);
+		return 0;
+	}
+
+private:
+	struct Centroid {
+		double col;
+		double row;
+	};
+
+	static Centroid CentroidOf(const Order& order) {
+		Centroid c = { 0, 0 };
+		for (auto& product : order.products_) {
+			c.col += product.location_.col;
+			c.row += product.location_.row;
+		}
+		if (!order.products_.empty()) {
+			c.col /= order.products_.size();
+			c.row /= order.products_.size();
+		}
+		return c;
+	}
+
+	static double WeightOf(const Order& order) {
+		double weight = 0;
+		for (auto& product : order.products_) {
+			weight += product.weight_;
+		}
+		return weight;
+	}
+
+	TaskHandle NewTask() {
+		TaskHandle task(new Order());
+		task->ID_ = next_task_id_++;
+		task->task_ = RobotTask::COLLECT_AND_LOAD;
+		task->status = OrderStatus::READY_FOR_COLLECTION;
+		return task;
+	}
+
+	// Sorts orders by where their items are (aisle first, then row) and packs neighbours together
+	void Flush(std::vector<Order>& batch) {
+		if (batch.empty()) {
+			return;
+		}
+
+		std::vector<std::pair<Centroid, size_t>> keyed;
+		for (size_t i = 0; i < batch.size(); i++) {
+			keyed.push_back(std::make_pair(CentroidOf(batch[i]), i));
+		}
+		std::sort(keyed.begin(), keyed.end(), [](const std::pair<Centroid, size_t>& a, const std::pair<Centroid, size_t>& b) {
+			if (a.first.col != b.first.col) {
+				return a.first.col < b.first.col;
+			}
+			return a.first.row < b.first.row;
+		});
+
+		std::vector<TaskHandle> tasks;
+		TaskHandle task = NewTask();
+		double load = 0;
+		std::map<int, int> parts;
+
+		for (auto& key : keyed) {
+			Order& order = batch[key.second];
+			double weight = WeightOf(order);
+
+			// start a new trip rather than split an order that would fit in an empty robot
+			if (load > 0 && load + weight > capacity_ && weight <= capacity_) {
+				tasks.push_back(std::move(task));
+				task = NewTask();
+				load = 0;
+			}
+
+			for (auto& product : order.products_) {
+				if (load > 0 && load + product.weight_ > capacity_) {
+					tasks.push_back(std::move(task));
+					task = NewTask();
+					load = 0;
+				}
+				task->products_.push_back(product);
+				load += product.weight_;
+				if (task->orders_.empty() || task->orders_.back() != order.ID_) {
+					task->orders_.push_back(order.ID_);
+					parts[order.ID_]++;
+				}
+			}
+
+			// an order with no items has nothing to collect but still needs its status updated
+			if (order.products_.empty()) {
+				task->orders_.push_back(order.ID_);
+				parts[order.ID_]++;
+			}
+		}
+		if (!task->orders_.empty()) {
+			tasks.push_back(std::move(task));
+		}
+
+		{
+			std::lock_guard<std::mutex> mylock(parts_mutex_);
+			for (auto& part : parts) {
+				parts_[part.first] += part.second;
+			}
+		}
+
+		orders_batched_ += batch.size();
+		tasks_created_ += tasks.size();
+		for (auto& t : tasks) {
+			scheduler_.add(std::move(t));
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,514 @@
+/*
+*Description: Same-host channel for placing orders with the warehouse process through shared memory. Orders
+*			  go into a ring of fixed-size records, the warehouse takes whatever is waiting in one batch,
+*			  places it with a single AddOrders call and writes each report back into its record. Named
+*			  semaphores are only touched when the warehouse has nothing to do or a submitter has to wait
+*			  longer than a few yields for its reports. A submitter keeps a lease on the records it holds
+*			  while it waits, records whose lease ran out are taken back by the warehouse so a submitter
+*			  that died can't stop the ring.
+*/
+
+#ifndef ORDERCHANNEL_H
+#define ORDERCHANNEL_H
+
+#include <cpen333/process/shared_memory.h>
+#include <cpen333/process/mutex.h>
+#include <cpen333/process/semaphore.h>
+#include <cpen333/thread/thread_object.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Order.h"
+
+#define ORDER_CHANNEL_CAPACITY 256		// records in the ring, a power of two
+#define ORDER_CHANNEL_MAX_LINES 16		// products an order may have to go through the channel
+#define ORDER_CHANNEL_BATCH 64			// records the warehouse places at once, at most
+#define ORDER_CHANNEL_SPIN_TRIES 64		// yields before a submitter sleeps waiting for its reports
+#define ORDER_CHANNEL_POLL_MS 5			// a sleeping submitter looks at its records at least this often
+#define ORDER_CHANNEL_REAP_MS 100		// an idle warehouse looks for records left by dead submitters this often
+#define ORDER_CHANNEL_LEASE_MS 1000		// how long a submitter holds a record without renewing its lease
+#define ORDER_CHANNEL_CACHE_LINE 64
+#define ORDER_CHANNEL_INITIALIZED 0x4F434831
+
+#define ORDER_CHANNEL_MEMORY_SUFFIX "_ocm"
+#define ORDER_CHANNEL_ORDERS_SUFFIX "_oco"
+#define ORDER_CHANNEL_REPLIES_SUFFIX "_ocr"
+
+struct OrderChannelLine {
+	int32_t product_id;
+	int32_t quantity;
+};
+
+// One order and, once the warehouse answered, its report
+struct OrderChannelRecord {
+	int32_t order_id;
+	int32_t num_lines;
+	OrderChannelLine lines[ORDER_CHANNEL_MAX_LINES];
+
+	int32_t verified;
+	int32_t duplicate;
+	int32_t product_id;		// first short product if not verified
+	int32_t quantity;		// quantity of it available
+};
+
+/**
+* Layout of the shared memory, the same in every process that opens the channel. A record at ring
+* position pos goes through these sequence numbers:
+*	pos							free, a submitter may claim it
+*	pos + 1						order written, the warehouse may take it
+*	pos + 2						report written, the submitter reads it
+*	pos + ORDER_CHANNEL_CAPACITY	freed by the submitter for the next lap
+* The record is only freed by the submitter that wrote it, so a report can't be overwritten before
+* it was read. A submitter sets a lease when it claims a record and renews it every
+* ORDER_CHANNEL_POLL_MS while it waits. Once a lease ran out the warehouse frees an answered record
+* itself, and skips a claimed record that never got published. Leases are steady clock times, which
+* every process on the host shares, so they work whatever process ids the submitters see.
+*/
+struct OrderChannelMemory {
+	struct Cell {
+		std::atomic<uint64_t> seq;
+		std::atomic<int64_t> lease;		// steady clock ms, the submitter holding the record renews it
+		OrderChannelRecord record;
+	};
+
+	uint32_t initialized;
+	alignas(ORDER_CHANNEL_CACHE_LINE) std::atomic<uint64_t> head;		// next record to claim, submitters
+	alignas(ORDER_CHANNEL_CACHE_LINE) std::atomic<uint64_t> tail;		// next record to place, the warehouse only
+	alignas(ORDER_CHANNEL_CACHE_LINE) std::atomic<int32_t> warehouse_sleeping;
+	std::atomic<int32_t> reply_waiters;		// submitters asleep or about to sleep on the replies semaphore
+	alignas(ORDER_CHANNEL_CACHE_LINE) Cell cells[ORDER_CHANNEL_CAPACITY];
+};
+
+class OrderChannel {
+protected:
+	static const uint64_t mask_ = ORDER_CHANNEL_CAPACITY - 1;
+
+	std::string name_;
+	cpen333::process::shared_object<OrderChannelMemory> memory_;
+	cpen333::process::mutex mutex_;					// only protects initialization of the memory
+	cpen333::process::semaphore orders_;			// the warehouse sleeps here while the ring is empty
+	cpen333::process::semaphore replies_;			// submitters sleep here waiting for reports
+
+	OrderChannelMemory::Cell& cell(uint64_t pos) {
+		return memory_->cells[pos & mask_];
+	}
+
+	// caller holds mutex_
+	void initialize() {
+		memory_->head.store(0);
+		memory_->tail.store(0);
+		memory_->warehouse_sleeping.store(0);
+		memory_->reply_waiters.store(0);
+		for (uint64_t i = 0; i < ORDER_CHANNEL_CAPACITY; i++) {
+			memory_->cells[i].seq.store(i);
+			memory_->cells[i].lease.store(0);
+		}
+		memory_->initialized = ORDER_CHANNEL_INITIALIZED;
+	}
+
+	static int64_t Now() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+public:
+	/**
+	* Creates or connects to a channel
+	* @param name identifier shared by the warehouse and the submitting processes
+	*/
+	OrderChannel(const std::string& name)
+		: name_(name), memory_(name + ORDER_CHANNEL_MEMORY_SUFFIX), mutex_(name + ORDER_CHANNEL_MEMORY_SUFFIX),
+		orders_(name + ORDER_CHANNEL_ORDERS_SUFFIX, 0), replies_(name + ORDER_CHANNEL_REPLIES_SUFFIX, 0) {
+		static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory atomics must be lock-free");
+		std::lock_guard<cpen333::process::mutex> lock(mutex_);
+		if (memory_->initialized != ORDER_CHANNEL_INITIALIZED) {
+			initialize();
+		}
+	}
+
+	OrderChannel(const OrderChannel&) = delete;
+	OrderChannel& operator=(const OrderChannel&) = delete;
+
+	const std::string& name() const {
+		return name_;
+	}
+
+	// Empties the ring, e.g. of records left by a previous run, submitters still waiting lose their records
+	void reset() {
+		std::lock_guard<cpen333::process::mutex> lock(mutex_);
+		initialize();
+	}
+
+	// Removes the shared memory and semaphores once every process closed them
+	bool unlink() {
+		return unlink(name_);
+	}
+
+	static bool unlink(const std::string& name) {
+		bool ok = cpen333::process::shared_object<OrderChannelMemory>::unlink(name + ORDER_CHANNEL_MEMORY_SUFFIX);
+		ok = cpen333::process::mutex::unlink(name + ORDER_CHANNEL_MEMORY_SUFFIX) && ok;
+		ok = cpen333::process::semaphore::unlink(name + ORDER_CHANNEL_ORDERS_SUFFIX) && ok;
+		ok = cpen333::process::semaphore::unlink(name + ORDER_CHANNEL_REPLIES_SUFFIX) && ok;
+		return ok;
+	}
+};
+
+/**
+* Submitting end, any number of threads in any number of processes
+*/
+class OrderChannelWriter : public OrderChannel {
+private:
+	// claims the next free record, false if the ring is full
+	bool claim(uint64_t& out) {
+		uint64_t pos = memory_->head.load(std::memory_order_relaxed);
+		for (;;) {
+			uint64_t seq = cell(pos).seq.load(std::memory_order_acquire);
+			int64_t dif = (int64_t)(seq - pos);
+			if (dif == 0) {
+				if (memory_->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell(pos).lease.store(Now() + ORDER_CHANNEL_LEASE_MS, std::memory_order_relaxed);
+					out = pos;
+					return true;
+				}
+			}
+			else if (dif < 0) {
+				return false;
+			}
+			else {
+				pos = memory_->head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void wakeWarehouse() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (memory_->warehouse_sleeping.load(std::memory_order_relaxed) != 0
+			&& memory_->warehouse_sleeping.exchange(0) != 0) {
+			orders_.notify();
+		}
+	}
+
+	bool answered(uint64_t pos) {
+		return cell(pos).seq.load(std::memory_order_acquire) == pos + 2;
+	}
+
+	// the warehouse freed the record because our lease ran out, e.g. the process was stopped for a while
+	bool takenBack(uint64_t pos) {
+		return cell(pos).seq.load(std::memory_order_acquire) > pos + 2;
+	}
+
+	// extends the lease on the records positions[from] to positions[to - 1]
+	void renew(const std::vector<uint64_t>& positions, size_t from, size_t to) {
+		int64_t lease = Now() + ORDER_CHANNEL_LEASE_MS;
+		for (size_t k = from; k < to; k++) {
+			cell(positions[k]).lease.store(lease, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	* Waits for the report of positions[from], yielding first and only then sleeping on the replies
+	* semaphore, and keeps the lease on every record up to positions[to - 1] while it waits
+	* @return false if the record was taken back before its report could be read
+	*/
+	bool awaitReport(const std::vector<uint64_t>& positions, size_t from, size_t to) {
+		uint64_t pos = positions[from];
+		for (int i = 0; i < ORDER_CHANNEL_SPIN_TRIES; i++) {
+			if (answered(pos)) {
+				return true;
+			}
+			std::this_thread::yield();
+		}
+		while (true) {
+			renew(positions, from, to);
+			if (takenBack(pos)) {
+				return false;
+			}
+			memory_->reply_waiters.fetch_add(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (answered(pos)) {
+				memory_->reply_waiters.fetch_sub(1);
+				return true;
+			}
+			// the warehouse posts once per waiter it saw, another submitter can take ours, so don't sleep for good
+			replies_.wait_for(std::chrono::milliseconds(ORDER_CHANNEL_POLL_MS));
+			memory_->reply_waiters.fetch_sub(1);
+		}
+	}
+
+	// reads an answered record and frees it
+	void collect(uint64_t pos, OrderReport& report) {
+		const OrderChannelRecord& record = cell(pos).record;
+		report.verified = record.verified != 0;
+		report.duplicate = record.duplicate != 0;
+		report.product.ID_ = record.product_id;
+		report.quantity = record.quantity;
+		cell(pos).seq.store(pos + ORDER_CHANNEL_CAPACITY, std::memory_order_release);
+	}
+
+	// false if the warehouse gave up on the record before it was published, the order has to be sent again
+	bool publish(uint64_t pos) {
+		uint64_t claimed = pos;
+		return cell(pos).seq.compare_exchange_strong(claimed, pos + 1, std::memory_order_release, std::memory_order_relaxed);
+	}
+
+public:
+	OrderChannelWriter(const std::string& name) : OrderChannel(name) {}
+
+	/**
+	* Places orders with the warehouse and waits for its reports
+	* @param orders orders with product IDs and quantities filled in
+	* @param reports set to one report per order, in the order they were given
+	* @return false if an order has more than ORDER_CHANNEL_MAX_LINES products, nothing is sent then.
+	*		  Also false if the warehouse took back a record before its report was read, because this
+	*		  process didn't renew its lease for ORDER_CHANNEL_LEASE_MS. That order was placed but its
+	*		  report says not verified, look the order up by id.
+	*/
+	bool Submit(const std::vector<Order>& orders, std::vector<OrderReport>& reports) {
+		for (auto& order : orders) {
+			if (order.products_.size() > ORDER_CHANNEL_MAX_LINES) {
+				return false;
+			}
+		}
+		reports.assign(orders.size(), OrderReport());
+
+		std::vector<uint64_t> positions(orders.size());
+		size_t collected = 0;
+		for (size_t i = 0; i < orders.size(); i++) {
+			do {
+				while (!claim(positions[i])) {
+					// the ring is full, our oldest records may be what holds it up, so take what is answered
+					wakeWarehouse();
+					renew(positions, collected, i);
+					while (collected < i && answered(positions[collected])) {
+						collect(positions[collected], reports[collected]);
+						collected++;
+					}
+					std::this_thread::yield();
+				}
+				uint64_t pos = positions[i];
+				OrderChannelRecord& record = cell(pos).record;
+				record.order_id = orders[i].ID_;
+				record.num_lines = (int32_t)orders[i].products_.size();
+				for (int32_t k = 0; k < record.num_lines; k++) {
+					record.lines[k].product_id = orders[i].products_[k].ID_;
+					record.lines[k].quantity = orders[i].products_[k].quantity_;
+				}
+			} while (!publish(positions[i]));
+		}
+		wakeWarehouse();
+
+		bool complete = true;
+		for (; collected < orders.size(); collected++) {
+			if (awaitReport(positions, collected, orders.size())) {
+				collect(positions[collected], reports[collected]);
+			}
+			else {
+				reports[collected].verified = false;
+				reports[collected].quantity = 0;
+				complete = false;
+			}
+		}
+		return complete;
+	}
+
+	OrderReport Submit(const Order& order) {
+		std::vector<OrderReport> reports;
+		if (!Submit(std::vector<Order>(1, order), reports)) {
+			OrderReport report;
+			report.verified = false;
+			report.quantity = 0;
+			return report;
+		}
+		return reports[0];
+	}
+};
+
+/**
+* Warehouse end, one per channel. Places the waiting orders in batches on its own thread.
+*/
+class OrderChannelReader : public OrderChannel, public cpen333::thread::thread_object {
+public:
+	typedef std::function<std::vector<OrderReport>(const std::vector<Order>&)> PlaceOrders;
+
+private:
+	PlaceOrders place_;
+	std::atomic<bool> quit_;
+	std::atomic<unsigned long> placed_;
+	std::atomic<unsigned long> batches_;
+	std::atomic<unsigned long> reclaimed_;
+
+	uint64_t reaped_;		// records before this one are known to be freed
+	uint64_t stuck_pos_;	// claimed but unpublished record seen at the tail, and since when
+	int64_t stuck_since_;
+
+	bool ready(uint64_t pos) {
+		return cell(pos).seq.load(std::memory_order_acquire) == pos + 1;
+	}
+
+	bool expired(uint64_t pos, int64_t now) {
+		return now > cell(pos).lease.load(std::memory_order_relaxed);
+	}
+
+	// skips the record at the tail if it was claimed but its submitter stopped before publishing it
+	bool abandonStuck() {
+		uint64_t pos = memory_->tail.load(std::memory_order_relaxed);
+		if (memory_->head.load() == pos || cell(pos).seq.load(std::memory_order_acquire) != pos) {
+			return false;
+		}
+		// right after claiming, the lease still holds the last lap's time, so give the submitter a
+		// whole lease from when the record was first seen stuck
+		int64_t now = Now();
+		if (stuck_pos_ != pos) {
+			stuck_pos_ = pos;
+			stuck_since_ = now;
+			return false;
+		}
+		if (now - stuck_since_ <= ORDER_CHANNEL_LEASE_MS || !expired(pos, now)) {
+			return false;
+		}
+		// a submitter that comes back finds its publish refused and sends the order again
+		uint64_t claimed = pos;
+		if (!cell(pos).seq.compare_exchange_strong(claimed, pos + ORDER_CHANNEL_CAPACITY)) {
+			return false;
+		}
+		memory_->tail.store(pos + 1, std::memory_order_relaxed);
+		reclaimed_.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// frees answered records, oldest first, whose submitter let the lease run out before reading its report
+	void reapAnswered() {
+		uint64_t tail = memory_->tail.load(std::memory_order_relaxed);
+		int64_t now = Now();
+		for (; reaped_ < tail; reaped_++) {
+			OrderChannelMemory::Cell& c = cell(reaped_);
+			uint64_t seq = c.seq.load(std::memory_order_acquire);
+			if (seq >= reaped_ + ORDER_CHANNEL_CAPACITY) {
+				continue;	// collected
+			}
+			if (seq != reaped_ + 2 || !expired(reaped_, now)) {
+				break;		// its submitter will collect it
+			}
+			uint64_t answered = reaped_ + 2;
+			if (c.seq.compare_exchange_strong(answered, reaped_ + ORDER_CHANNEL_CAPACITY)) {
+				reclaimed_.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// takes the records waiting at the tail, places them as one batch and writes the reports back
+	bool placeWaiting() {
+		uint64_t first = memory_->tail.load(std::memory_order_relaxed);
+		uint64_t end = first;
+		std::vector<Order> orders;
+		while (end - first < ORDER_CHANNEL_BATCH && ready(end)) {
+			const OrderChannelRecord& record = cell(end).record;
+			Order order;
+			order.ID_ = record.order_id;
+			for (int32_t k = 0; k < record.num_lines && k < ORDER_CHANNEL_MAX_LINES; k++) {
+				Product product;
+				product.ID_ = record.lines[k].product_id;
+				product.quantity_ = record.lines[k].quantity;
+				order.products_.push_back(product);
+			}
+			orders.push_back(order);
+			end++;
+		}
+		if (orders.empty()) {
+			return false;
+		}
+		memory_->tail.store(end, std::memory_order_relaxed);
+
+		std::vector<OrderReport> reports = place_(orders);
+		for (uint64_t pos = first; pos < end; pos++) {
+			OrderChannelRecord& record = cell(pos).record;
+			const OrderReport& report = reports[pos - first];
+			record.verified = report.verified ? 1 : 0;
+			record.duplicate = report.duplicate ? 1 : 0;
+			record.product_id = report.verified || report.duplicate ? 0 : report.product.ID_;
+			record.quantity = report.verified ? 0 : report.quantity;
+			cell(pos).seq.store(pos + 2, std::memory_order_release);
+		}
+		placed_.fetch_add(orders.size(), std::memory_order_relaxed);
+		batches_.fetch_add(1, std::memory_order_relaxed);
+
+		// one post per submitter that may be asleep
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		for (int32_t waiters = memory_->reply_waiters.load(); waiters > 0; waiters--) {
+			replies_.notify();
+		}
+		return true;
+	}
+
+public:
+	/**
+	* @param name identifier shared with the submitting processes
+	* @param place places a batch of orders and returns one report per order, e.g. Warehouse::AddOrders
+	*/
+	OrderChannelReader(const std::string& name, PlaceOrders place)
+		: OrderChannel(name), place_(place), quit_(false), placed_(0), batches_(0), reclaimed_(0),
+		reaped_(memory_->tail.load()), stuck_pos_(UINT64_MAX), stuck_since_(0) {}
+
+	~OrderChannelReader() {
+		stop();
+	}
+
+	// Stops taking orders, records already written stay in the ring for the next reader
+	void stop() {
+		if (quit_.exchange(true)) {
+			return;
+		}
+		orders_.notify();
+		join();
+	}
+
+	// orders placed through the channel so far
+	unsigned long numOrders() const {
+		return placed_.load(std::memory_order_relaxed);
+	}
+
+	// AddOrders calls made for them
+	unsigned long numBatches() const {
+		return batches_.load(std::memory_order_relaxed);
+	}
+
+	// records taken back from submitting processes whose lease ran out
+	unsigned long numReclaimed() const {
+		return reclaimed_.load(std::memory_order_relaxed);
+	}
+
+	// Empties the ring, call before start()
+	void reset() {
+		OrderChannel::reset();
+		reaped_ = 0;
+		stuck_pos_ = UINT64_MAX;
+	}
+
+	int main() {
+		while (!quit_.load()) {
+			if (placeWaiting() || abandonStuck()) {
+				continue;
+			}
+			reapAnswered();
+			memory_->warehouse_sleeping.store(1);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (ready(memory_->tail.load(std::memory_order_relaxed)) || quit_.load()) {
+				memory_->warehouse_sleeping.store(0);
+				continue;
+			}
+			// a submitter clears the flag before posting, extra posts only cost a spurious wakeup. Wake up
+			// now and then anyway, in case a submitter let the lease on its records run out.
+			orders_.wait_for(std::chrono::milliseconds(ORDER_CHANNEL_REAP_MS));
+			memory_->warehouse_sleeping.store(0);
+		}
+		return 0;
+	}
+};
+
+#endif
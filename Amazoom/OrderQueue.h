@@ -1,44 +1,276 @@
-
 #ifndef DYNAMICORDERQUEUE_H
 #define DYNAMICORDERQUEUE_H
 
-#include <deque>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 #include "Order.h"
 
+#define ROBOT_QUEUE_CAPACITY 1024 // must be a power of two
+#define QUEUE_CACHE_LINE 64
+#define QUEUE_YIELD_TRIES 16 // retries (yielding in between) before going to sleep on the condition variable
+
+// Robot tasks move through the queue by pointer, the Order itself is never copied
+typedef std::unique_ptr<Order> TaskHandle;
+
+/**
+* Bounded multi-producer multi-consumer queue of robot tasks (Vyukov's sequence-numbered ring).
+*
+* Adding and getting are lock-free; the mutex and condition variables are only touched by a thread
+* that has to sleep because the ring is empty (or full), and by the thread that wakes it up.
+* close() wakes everyone: get() keeps returning tasks until the ring is drained and then
+* returns false, so robots can shut down without poison pills.
+*/
 class RobotOrderQueue {
-	std::deque<Order> buff_;
+	struct Cell {
+		std::atomic<size_t> seq;
+		Order* task;
+	};
+
+	std::unique_ptr<Cell[]> cells_;
+	const size_t mask_;
+
+	// producers and consumers each hammer their own index, keep them on separate cache lines
+	alignas(QUEUE_CACHE_LINE) std::atomic<size_t> head_;	// next slot to fill
+	alignas(QUEUE_CACHE_LINE) std::atomic<size_t> tail_;	// next slot to empty
+	alignas(QUEUE_CACHE_LINE) std::atomic<int> waiting_getters_;
+	std::atomic<int> waiting_adders_;
+	std::atomic<bool> closed_;
+
 	std::mutex mutex_;
-	std::condition_variable cv_;
+	std::condition_variable not_empty_;
+	std::condition_variable not_full_;
 
 public:
 
-	RobotOrderQueue() :
-		buff_(), mutex_(), cv_() {}
+	RobotOrderQueue(size_t capacity = ROBOT_QUEUE_CAPACITY) :
+		cells_(new Cell[capacity]), mask_(capacity - 1), head_(0), tail_(0),
+		waiting_getters_(0), waiting_adders_(0), closed_(false), mutex_(), not_empty_(), not_full_() {
+		for (size_t i = 0; i < capacity; i++) {
+			cells_[i].seq.store(i, std::memory_order_relaxed);
+			cells_[i].task = nullptr;
+		}
+	}
+
+	~RobotOrderQueue() {
+		TaskHandle task;
+		while (try_get(task)) {}
+	}
+
+	RobotOrderQueue(const RobotOrderQueue&) = delete;
+	RobotOrderQueue& operator=(const RobotOrderQueue&) = delete;
+
+	/**
+	* Adds a task without blocking
+	* @param task moved from on success, untouched if the queue is full or closed
+	* @return true if added
+	*/
+	bool try_add(TaskHandle& task) {
+		if (closed_.load(std::memory_order_relaxed) || !enqueue(task)) {
+			return false;
+		}
+		wake(waiting_getters_, not_empty_);
+		return true;
+	}
+
+	/**
+	* Adds a task, waiting for room if the queue is full
+	* @return false if the queue was closed, the task is dropped
+	*/
+	bool add(TaskHandle task) {
+		for (int i = 0; i < QUEUE_YIELD_TRIES; i++) {
+			if (try_add(task)) {
+				return true;
+			}
+			std::this_thread::yield();
+		}
+		if (closed()) {
+			return false;
+		}
+		bool added = false;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			waiting_adders_.fetch_add(1);
+			not_full_.wait(lock, [&]() { return (added = enqueue(task)) || closed_.load(); });
+			waiting_adders_.fetch_sub(1);
+		}
+		if (added) {
+			wake(waiting_getters_, not_empty_);
+		}
+		return added;
+	}
+
+	bool add(const Order& order) {
+		return add(TaskHandle(new Order(order)));
+	}
+
+	/**
+	* Takes the oldest task without blocking
+	* @return true if out now holds a task
+	*/
+	bool try_get(TaskHandle& out) {
+		if (!dequeue(out)) {
+			return false;
+		}
+		wake(waiting_adders_, not_full_);
+		return true;
+	}
+
+	/**
+	* Waits for a task
+	* @return false once the queue is closed and empty
+	*/
+	bool get(TaskHandle& out) {
+		// a producer that already claimed a slot is usually about to publish it, sleeping
+		// on the condition variable costs far more than a few yields
+		for (int i = 0; i < QUEUE_YIELD_TRIES; i++) {
+			if (try_get(out)) {
+				return true;
+			}
+			std::this_thread::yield();
+		}
+		bool got = false;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			waiting_getters_.fetch_add(1);
+			not_empty_.wait(lock, [&]() { return (got = dequeue(out)) || closed_.load(); });
+			waiting_getters_.fetch_sub(1);
+		}
+		if (got) {
+			wake(waiting_adders_, not_full_);
+		}
+		return got;
+	}
+
+	/**
+	* Waits up to timeout for a task
+	* @return false on timeout or if the queue is closed and empty
+	*/
+	template<typename Rep, typename Period>
+	bool get_for(TaskHandle& out, const std::chrono::duration<Rep, Period>& timeout) {
+		if (try_get(out)) {
+			return true;
+		}
+		bool got = false;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			waiting_getters_.fetch_add(1);
+			not_empty_.wait_for(lock, timeout, [&]() { return (got = dequeue(out)) || closed_.load(); });
+			waiting_getters_.fetch_sub(1);
+		}
+		if (got) {
+			wake(waiting_adders_, not_full_);
+		}
+		return got;
+	}
+
+	/**
+	* Waits for at least one task then takes up to n without waiting further
+	* @param out tasks are appended
+	* @return number of tasks taken, 0 once the queue is closed and empty
+	*/
+	size_t get_n(std::vector<TaskHandle>& out, size_t n) {
+		TaskHandle task;
+		if (n == 0 || !get(task)) {
+			return 0;
+		}
+		out.push_back(std::move(task));
+		size_t count = 1;
+		while (count < n && try_get(task)) {
+			out.push_back(std::move(task));
+			count++;
+		}
+		return count;
+	}
 
-	void add(const Order& order) {
+	// Stops accepting tasks and wakes every waiting thread, tasks already queued can still be taken
+	void close() {
 		{
-			std::unique_lock<decltype(mutex_)> lock{ mutex_ };
-			buff_.push_back(order);
+			std::lock_guard<std::mutex> lock(mutex_);
+			closed_.store(true);
 		}
-		cv_.notify_one();
+		not_empty_.notify_all();
+		not_full_.notify_all();
+	}
 
+	bool closed() const {
+		return closed_.load();
 	}
 
-	Order get() {
-		
-		std::unique_lock<decltype(mutex_)> lock{ mutex_ };
-		cv_.wait(lock, [&]() { return !buff_.empty(); });
-		// get first item in queue
-		Order out = buff_.front();
-		buff_.pop_front();
-		
-		cv_.notify_one();
+	// true if no task is queued, a task an adder already claimed a slot for counts as queued
+	bool empty() const {
+		return head_.load() == tail_.load();
+	}
 
-		return out;
+private:
+	// lock-free ring insert, false if full
+	bool enqueue(TaskHandle& task) {
+		size_t pos = head_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for (;;) {
+			cell = &cells_[pos & mask_];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+			if (dif == 0) {
+				if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (dif < 0) {
+				return false;
+			}
+			else {
+				pos = head_.load(std::memory_order_relaxed);
+			}
+		}
+		cell->task = task.release();
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// lock-free ring removal, false if empty
+	bool dequeue(TaskHandle& out) {
+		size_t pos = tail_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for (;;) {
+			cell = &cells_[pos & mask_];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (dif == 0) {
+				if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (dif < 0) {
+				return false;
+			}
+			else {
+				pos = tail_.load(std::memory_order_relaxed);
+			}
+		}
+		out.reset(cell->task);
+		cell->task = nullptr;
+		cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Only pays for the mutex when someone is actually asleep. The seq_cst fence pairs with the
+	// waiter's fetch_add so either the waiter sees our update or we see the waiter.
+	// Must not be called with mutex_ held.
+	void wake(std::atomic<int>& waiting, std::condition_variable& cv) {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting.load(std::memory_order_relaxed) > 0) {
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+			}
+			cv.notify_one();
+		}
 	}
 };
 
 #endif
-
@@ -0,0 +1,17 @@
+/*
+*Description: Where an order is on its way through the warehouse. Kept apart from Order.h so code below
+*			  the product definitions, like the journal, can use it.
+*/
+
+#ifndef ORDERSTATUS_H
+#define ORDERSTATUS_H
+
+enum OrderStatus {
+	READY_FOR_COLLECTION,
+	ROBOT_COLLECTING_ORDER,
+	COLLECTION_COMPLETE,
+	OUT_FOR_DELIVERY,
+	UNKNOWN
+};
+
+#endif
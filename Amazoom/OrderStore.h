@@ -0,0 +1,307 @@
+/*
+*Description: Keeps every customer order in fixed size segments so an order never moves once stored.
+*			  Order status is an atomic field robots update and the manager reads without locking, an
+*			  id index finds an order's slot, and segments whose orders have all left the warehouse are
+*			  compacted away once no reader can still be looking at them.
+*/
+
+#ifndef ORDERSTORE_H
+#define ORDERSTORE_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Order.h"
+#include "ConcurrentIdMap.h"
+#include "WarehouseJournal.h"
+
+#define ORDER_SEGMENT_SIZE 256
+#define ORDER_KEEP_SEGMENTS 4		// newest segments are never compacted so recent orders stay queryable
+#define ORDER_INDEX_INIT_CAPACITY 4096
+
+class OrderStore {
+private:
+	struct Segment;
+
+	struct Record {
+		Order order;					// written once before the record is published, read-only after
+		std::atomic<int> status;		// OrderStatus, the status field inside order is not kept up to date
+		std::atomic<bool> finished;		// already counted in segment->finished
+		Segment* segment;
+	};
+
+	struct Segment {
+		Record records[ORDER_SEGMENT_SIZE];
+		size_t used;					// only touched under the store mutex
+		std::atomic<size_t> finished;	// records delivered or removed
+
+		Segment() : used(0), finished(0) {}
+	};
+
+	std::mutex mutex_;		// taken by insert, erase and compaction, never by readers
+	std::deque<std::unique_ptr<Segment>> segments_;	// oldest first, the last one is being filled
+	ConcurrentIdMap<Record> index_;
+
+	// readers announce themselves in the counter of the epoch they started in, compaction moves to
+	// the next epoch and waits for the previous one to drain before freeing anything
+	std::atomic<unsigned long> epoch_;
+	std::atomic<int> readers_[2];
+
+	std::atomic<unsigned long> compacted_;
+
+	WarehouseJournal* journal_;	// logs inserts, erases and status changes, nullptr if nothing is logged
+
+	class ReadGuard {
+		OrderStore& store_;
+		unsigned long epoch_;
+	public:
+		ReadGuard(OrderStore& store) : store_(store) {
+			for (;;) {
+				epoch_ = store_.epoch_.load();
+				store_.readers_[epoch_ & 1]++;
+				if (store_.epoch_.load() == epoch_) {
+					break;
+				}
+				store_.readers_[epoch_ & 1]--;
+			}
+		}
+		~ReadGuard() {
+			store_.readers_[epoch_ & 1]--;
+		}
+	};
+
+public:
+	OrderStore() : index_(ORDER_INDEX_INIT_CAPACITY), epoch_(0), compacted_(0), journal_(nullptr) {
+		readers_[0] = 0;
+		readers_[1] = 0;
+	}
+
+	OrderStore(const OrderStore&) = delete;
+	OrderStore& operator=(const OrderStore&) = delete;
+
+	// Starts logging changes, call before the store is shared
+	void SetJournal(WarehouseJournal* journal) {
+		journal_ = journal;
+	}
+
+	// an order in this state has left the warehouse and its slot can be reclaimed
+	static bool IsFinal(OrderStatus status) {
+		return status == OrderStatus::OUT_FOR_DELIVERY;
+	}
+
+	/**
+	* Stores a copy of the order with the given status
+	* @return false if an order with that id is already stored
+	*/
+	bool insert(const Order& order, OrderStatus status) {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		return InsertLocked(order, status);
+	}
+
+	/**
+	* Stores copies of several orders under one lock acquisition
+	* @param inserted set to one flag per order, false where the id was already stored or
+	*		 appears earlier in the batch
+	* @return number of orders stored
+	*/
+	size_t insert(const std::vector<Order>& orders, OrderStatus status, std::vector<bool>& inserted) {
+		inserted.assign(orders.size(), false);
+		size_t count = 0;
+		std::lock_guard<std::mutex> mylock(mutex_);
+		for (size_t i = 0; i < orders.size(); i++) {
+			if (InsertLocked(orders[i], status)) {
+				inserted[i] = true;
+				count++;
+			}
+		}
+		return count;
+	}
+
+	/**
+	* Forgets an order, e.g. one that failed verification
+	* @return false if the order is not stored
+	*/
+	bool erase(int order_id) {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		return EraseLocked(order_id);
+	}
+
+	/**
+	* Forgets several orders under one lock acquisition
+	* @return number of orders that were stored
+	*/
+	size_t erase(const std::vector<int>& order_ids) {
+		size_t count = 0;
+		std::lock_guard<std::mutex> mylock(mutex_);
+		for (int id : order_ids) {
+			if (EraseLocked(id)) {
+				count++;
+			}
+		}
+		return count;
+	}
+
+	/**
+	* Lock-free status update
+	* @return false if the order is not stored
+	*/
+	bool setStatus(int order_id, OrderStatus status) {
+		ReadGuard guard(*this);
+		Record* record = Lookup(order_id);
+		if (record == nullptr) {
+			return false;
+		}
+		if (journal_ != nullptr) {
+			journal_->SetStatus(order_id, status);
+		}
+		record->status.store(status, std::memory_order_release);
+		if (IsFinal(status)) {
+			Finish(*record);
+		}
+		return true;
+	}
+
+	// Lock-free status read, UNKNOWN if the order is not stored (or was compacted away)
+	OrderStatus getStatus(int order_id) {
+		ReadGuard guard(*this);
+		Record* record = Lookup(order_id);
+		if (record == nullptr) {
+			return OrderStatus::UNKNOWN;
+		}
+		return (OrderStatus)record->status.load(std::memory_order_acquire);
+	}
+
+	/**
+	* Copies an order out with its current status
+	* @return false if the order is not stored
+	*/
+	bool get(int order_id, Order& out) {
+		ReadGuard guard(*this);
+		Record* record = Lookup(order_id);
+		if (record == nullptr) {
+			return false;
+		}
+		out = record->order;
+		out.status = (OrderStatus)record->status.load(std::memory_order_acquire);
+		return true;
+	}
+
+	bool contains(int order_id) {
+		ReadGuard guard(*this);
+		return Lookup(order_id) != nullptr;
+	}
+
+	// number of orders that can still be looked up
+	size_t size() {
+		return index_.size();
+	}
+
+	size_t numSegments() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		return segments_.size();
+	}
+
+	// number of orders dropped by compaction so far
+	unsigned long numCompacted() const {
+		return compacted_.load();
+	}
+
+private:
+	// Index lookup for readers, the record must hold the order asked for, so a slot the index handed
+	// out for another id counts as a miss. Caller holds a ReadGuard.
+	Record* Lookup(int order_id) {
+		Record* record = index_.find(order_id);
+		if (record == nullptr || record->order.ID_ != order_id) {
+			return nullptr;
+		}
+		return record;
+	}
+
+	// Caller holds mutex_
+	bool InsertLocked(const Order& order, OrderStatus status) {
+		if (index_.find(order.ID_) != nullptr) {
+			return false;
+		}
+		if (journal_ != nullptr) {
+			journal_->PlaceOrder(order, status);
+		}
+
+		if (segments_.empty() || segments_.back()->used == ORDER_SEGMENT_SIZE) {
+			Compact();
+			segments_.emplace_back(new Segment());
+		}
+		Segment* segment = segments_.back().get();
+		Record& record = segment->records[segment->used++];
+		record.order = order;
+		record.order.status = status;
+		record.status.store(status);
+		record.finished.store(false);
+		record.segment = segment;
+		if (IsFinal(status)) {
+			Finish(record);
+		}
+
+		index_.insert(order.ID_, &record);
+		return true;
+	}
+
+	// Caller holds mutex_
+	bool EraseLocked(int order_id) {
+		Record* record = index_.erase(order_id);
+		if (record == nullptr) {
+			return false;
+		}
+		if (journal_ != nullptr) {
+			journal_->EraseOrder(order_id);
+		}
+		record->status.store(OrderStatus::UNKNOWN);
+		Finish(*record);
+		return true;
+	}
+
+	void Finish(Record& record) {
+		if (!record.finished.exchange(true)) {
+			record.segment->finished++;
+		}
+	}
+
+	// Frees full segments, other than the newest ORDER_KEEP_SEGMENTS, whose orders are all finished.
+	// Caller holds mutex_.
+	void Compact() {
+		std::vector<std::unique_ptr<Segment>> retired;
+		size_t candidates = segments_.size() > ORDER_KEEP_SEGMENTS ? segments_.size() - ORDER_KEEP_SEGMENTS : 0;
+		auto it = segments_.begin();
+		for (size_t i = 0; i < candidates; i++) {
+			Segment& segment = **it;
+			if (segment.used < ORDER_SEGMENT_SIZE || segment.finished.load() < ORDER_SEGMENT_SIZE) {
+				++it;
+				continue;
+			}
+			for (auto& record : segment.records) {
+				// the id may have been erased and stored again in a newer segment
+				if (index_.find(record.order.ID_) == &record) {
+					index_.erase(record.order.ID_);
+					compacted_++;
+				}
+			}
+			retired.push_back(std::move(*it));
+			it = segments_.erase(it);
+		}
+
+		if (retired.empty()) {
+			return;
+		}
+
+		// wait out every reader that might have found a record before it was unlinked
+		unsigned long epoch = epoch_.fetch_add(1);
+		while (readers_[epoch & 1].load() != 0) {
+			std::this_thread::yield();
+		}
+		index_.ReleaseRetiredTables();
+	}
+};
+
+#endif
@@ -0,0 +1,388 @@
+/*
+*Description: Compiled, memory-mapped form of the product description file (Products.txt). The text
+*			  file is compiled once into a binary file that the warehouse maps at start up: opening it
+*			  only checks the header, and pages of records and names are read in by the OS as they are
+*			  first touched. A binary file compiled from another version of the text file is stale and
+*			  is compiled again, or the text file is read directly if that fails.
+*/
+
+#ifndef PRODUCTCATALOG_H
+#define PRODUCTCATALOG_H
+
+#include <cpen333/os.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "product.h"
+
+#ifdef WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define ID_FILE_IDENTIFIER "ID"
+#define NAME_FILE_IDENTIFIER "name"
+#define PRICE_FILE_IDENTIFIER "price"
+#define WEIGHT_FILE_IDENTIFIER "weight"
+
+#define PRODUCT_CATALOG_MAGIC 0x4341544Du	// "MTAC" on little endian machines, wrong byte order reads as stale
+#define PRODUCT_CATALOG_VERSION 1			// bump whenever the layout below changes
+
+/**
+* Binary catalog layout, all in native byte order:
+*	header
+*	records		count fixed-width records in file order
+*	buckets		open-addressing hash from product id to record index + 1 (0 is empty), linear probing
+*	strings		product names back to back, not terminated
+*
+* The header remembers the size and modification time of the text file it was compiled from.
+*/
+class ProductCatalog {
+private:
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t source_size;
+		int64_t source_mtime;
+		uint32_t count;
+		uint32_t buckets;			// power of two, at least twice count
+		uint64_t records_offset;
+		uint64_t buckets_offset;
+		uint64_t strings_offset;
+		uint64_t strings_size;
+		uint64_t file_size;
+	};
+
+	struct Record {
+		int32_t id;
+		uint32_t name_offset;		// into strings
+		uint32_t name_size;
+		uint32_t reserved;
+		double weight;
+		double price;
+	};
+
+	const char* base_;
+	size_t size_;
+	const Header* header_;
+	const Record* records_;
+	const uint32_t* buckets_;
+	const char* strings_;
+#ifdef WINDOWS
+	HANDLE file_;
+	HANDLE mapping_;
+#endif
+
+	static size_t bucket(int id, uint32_t buckets) {
+		return (size_t)(((uint64_t)(uint32_t)id * 0x9E3779B97F4A7C15ull) >> 32) & (buckets - 1);
+	}
+
+	// size and modification time of a file, false if it does not exist
+	static bool stamp(const std::string& path, uint64_t& size, int64_t& mtime) {
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			return false;
+		}
+		size = (uint64_t)st.st_size;
+		mtime = (int64_t)st.st_mtime;
+		return true;
+	}
+
+	// true if the mapped header and sections are consistent with the mapped size
+	bool valid() const {
+		const Header& h = *header_;
+		if (size_ < sizeof(Header) || h.magic != PRODUCT_CATALOG_MAGIC || h.version != PRODUCT_CATALOG_VERSION
+			|| h.file_size != size_ || h.buckets == 0 || (h.buckets & (h.buckets - 1)) != 0 || h.buckets < h.count) {
+			return false;
+		}
+		return h.records_offset % alignof(Record) == 0 && h.buckets_offset % alignof(uint32_t) == 0
+			&& h.records_offset + (uint64_t)h.count * sizeof(Record) <= size_
+			&& h.buckets_offset + (uint64_t)h.buckets * sizeof(uint32_t) <= size_
+			&& h.strings_offset + h.strings_size <= size_;
+	}
+
+	bool map(const std::string& path) {
+#ifdef WINDOWS
+		file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file_ == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file_, &size) || size.QuadPart < (LONGLONG)sizeof(Header)) {
+			Close();
+			return false;
+		}
+		mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping_ == NULL) {
+			Close();
+			return false;
+		}
+		base_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+		if (base_ == nullptr) {
+			Close();
+			return false;
+		}
+		size_ = (size_t)size.QuadPart;
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+			close(fd);
+			return false;
+		}
+		void* addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);	// the mapping keeps the file open
+		if (addr == MAP_FAILED) {
+			return false;
+		}
+		base_ = (const char*)addr;
+		size_ = (size_t)st.st_size;
+#endif
+		return true;
+	}
+
+public:
+	ProductCatalog() : base_(nullptr), size_(0), header_(nullptr), records_(nullptr), buckets_(nullptr), strings_(nullptr)
+#ifdef WINDOWS
+		, file_(INVALID_HANDLE_VALUE), mapping_(NULL)
+#endif
+	{}
+
+	ProductCatalog(const ProductCatalog&) = delete;
+	ProductCatalog& operator=(const ProductCatalog&) = delete;
+
+	~ProductCatalog() {
+		Close();
+	}
+
+	/**
+	* Reads a product description file
+	* @param source text file, see the note at the top of Products.txt
+	* @param out products in file order, an ID seen before is skipped as the warehouse would
+	* @return false if the file could not be opened
+	*/
+	static bool ReadText(const std::string& source, std::vector<Product>& out) {
+		std::ifstream fin(source);
+		if (!fin.is_open()) {
+			return false;
+		}
+
+		std::unordered_set<int> seen;
+		std::string line;
+		std::string name;
+		int id = 0;
+		double weight = 0;
+		double price = 0;
+		while (std::getline(fin, line)) {
+			bool is_name = line.compare(NAME_FILE_IDENTIFIER) == 0;
+			bool is_id = line.compare(ID_FILE_IDENTIFIER) == 0;
+			bool is_weight = line.compare(WEIGHT_FILE_IDENTIFIER) == 0;
+			bool is_price = line.compare(PRICE_FILE_IDENTIFIER) == 0;
+			if (!(is_name || is_id || is_weight || is_price) || !std::getline(fin, line)) {
+				continue;
+			}
+			try {
+				if (is_name) {
+					name = line;
+				} else if (is_id) {
+					id = std::stoi(line);
+				} else if (is_weight) {
+					weight = std::stod(line);
+				} else {
+					// price comes last and completes a product
+					price = std::stod(line);
+					if (seen.insert(id).second) {
+						out.push_back(Product(name, id, weight, price));
+					}
+				}
+			} catch (const std::exception&) {
+				// malformed number, ignored like a missing line
+			}
+		}
+		return true;
+	}
+
+	/**
+	* Compiles a product description file into a binary catalog
+	* @param source text file
+	* @param target binary file, replaced only once the new one is complete
+	* @return false if the text file could not be read or the binary file could not be written
+	*/
+	static bool Compile(const std::string& source, const std::string& target) {
+		Header header = {};
+		if (!stamp(source, header.source_size, header.source_mtime)) {
+			return false;
+		}
+		std::vector<Product> products;
+		if (!ReadText(source, products)) {
+			return false;
+		}
+
+		header.magic = PRODUCT_CATALOG_MAGIC;
+		header.version = PRODUCT_CATALOG_VERSION;
+		header.count = (uint32_t)products.size();
+		header.buckets = 2;
+		while (header.buckets < 2 * header.count) {
+			header.buckets <<= 1;
+		}
+
+		std::vector<Record> records(products.size());
+		std::vector<uint32_t> buckets(header.buckets, 0);
+		std::string strings;
+		for (size_t i = 0; i < products.size(); i++) {
+			Record& r = records[i];
+			r.id = products[i].ID_;
+			r.name_offset = (uint32_t)strings.size();
+			r.name_size = (uint32_t)products[i].name_.size();
+			r.reserved = 0;
+			r.weight = products[i].weight_;
+			r.price = products[i].price_;
+			strings.append(products[i].name_);
+
+			size_t b = bucket(r.id, header.buckets);
+			while (buckets[b] != 0) {
+				b = (b + 1) & (header.buckets - 1);
+			}
+			buckets[b] = (uint32_t)i + 1;
+		}
+
+		header.records_offset = sizeof(Header);
+		header.buckets_offset = header.records_offset + records.size() * sizeof(Record);
+		header.strings_offset = header.buckets_offset + buckets.size() * sizeof(uint32_t);
+		header.strings_size = strings.size();
+		header.file_size = header.strings_offset + strings.size();
+
+		std::string temp = target + ".tmp";
+		{
+			std::ofstream fout(temp, std::ios::binary | std::ios::trunc);
+			fout.write((const char*)&header, sizeof(Header));
+			fout.write((const char*)records.data(), records.size() * sizeof(Record));
+			fout.write((const char*)buckets.data(), buckets.size() * sizeof(uint32_t));
+			fout.write(strings.data(), strings.size());
+			if (!fout) {
+				std::remove(temp.c_str());
+				return false;
+			}
+		}
+		std::remove(target.c_str());	// rename does not replace files on Windows
+		if (std::rename(temp.c_str(), target.c_str()) != 0) {
+			std::remove(temp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	* Maps a binary catalog
+	* @param path binary file
+	* @param source text file it must have been compiled from, a binary file is accepted as is
+	*		 if there is no text file to compare it to
+	* @return false if the file is missing, invalid or stale, the catalog is then left empty
+	*/
+	bool Open(const std::string& path, const std::string& source) {
+		Close();
+		if (!map(path)) {
+			return false;
+		}
+		header_ = (const Header*)base_;
+		uint64_t source_size;
+		int64_t source_mtime;
+		if (!valid() || (stamp(source, source_size, source_mtime)
+			&& (source_size != header_->source_size || source_mtime != header_->source_mtime))) {
+			Close();
+			return false;
+		}
+		records_ = (const Record*)(base_ + header_->records_offset);
+		buckets_ = (const uint32_t*)(base_ + header_->buckets_offset);
+		strings_ = base_ + header_->strings_offset;
+		return true;
+	}
+
+	void Close() {
+#ifdef WINDOWS
+		if (base_ != nullptr) {
+			UnmapViewOfFile(base_);
+		}
+		if (mapping_ != NULL) {
+			CloseHandle(mapping_);
+		}
+		if (file_ != INVALID_HANDLE_VALUE) {
+			CloseHandle(file_);
+		}
+		file_ = INVALID_HANDLE_VALUE;
+		mapping_ = NULL;
+#else
+		if (base_ != nullptr) {
+			munmap((void*)base_, size_);
+		}
+#endif
+		base_ = nullptr;
+		size_ = 0;
+		header_ = nullptr;
+		records_ = nullptr;
+		buckets_ = nullptr;
+		strings_ = nullptr;
+	}
+
+	bool isOpen() const {
+		return records_ != nullptr;
+	}
+
+	// number of products, 0 if nothing is mapped
+	int size() const {
+		return isOpen() ? (int)header_->count : 0;
+	}
+
+	/**
+	* Looks a product up in the prebuilt hash
+	* @return index of its record, -1 if the product is not in the catalog
+	*/
+	int Find(int id) const {
+		if (!isOpen()) {
+			return -1;
+		}
+		uint32_t mask = header_->buckets - 1;
+		for (size_t b = bucket(id, header_->buckets), probes = 0; probes <= mask; b = (b + 1) & mask, probes++) {
+			uint32_t entry = buckets_[b];
+			if (entry == 0 || entry > header_->count) {
+				return -1;
+			}
+			if (records_[entry - 1].id == id) {
+				return (int)entry - 1;
+			}
+		}
+		return -1;
+	}
+
+	// ID of the record at index, only touches the record itself
+	int id(int index) const {
+		return records_[index].id;
+	}
+
+	// Product of the record at index, names out of bounds of the string pool read as empty
+	Product product(int index) const {
+		const Record& r = records_[index];
+		std::string name;
+		if ((uint64_t)r.name_offset + r.name_size <= header_->strings_size) {
+			name.assign(strings_ + r.name_offset, r.name_size);
+		}
+		return Product(name, r.id, r.weight, r.price);
+	}
+};
+
+#endif
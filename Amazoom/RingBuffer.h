@@ -0,0 +1,450 @@
+/*
+*Description: Bounded ring buffer with its capacity fixed at compile time. A single producer single consumer
+*			  ring only loads and stores its two indices, a multi producer multi consumer ring claims cells
+*			  through a sequence number per cell (Vyukov's scheme, as in RobotOrderQueue). Pushing to a full
+*			  ring or popping an empty one spins briefly and then sleeps on a futex, or on a condition
+*			  variable where there are no futexes.
+*/
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <cpen333/os.h>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#ifdef LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+#define RING_CACHE_LINE 64
+#define RING_SPIN_TRIES 16	// retries (yielding in between) before a blocked push or pop goes to sleep
+
+enum RingMode {
+	RING_SPSC,	// one thread pushes and one thread pops, no read-modify-writes at all
+	RING_MPMC	// any number of threads on both ends
+};
+
+/**
+* Where threads blocked on one end of a ring sleep. A sleeper calls prepare(), looks at the ring once
+* more and only then calls wait() with the epoch prepare() returned, so a notify() in between is never
+* missed. notify() is a load and a fence while nobody sleeps.
+*/
+class RingWaiter {
+private:
+	alignas(RING_CACHE_LINE) std::atomic<uint32_t> epoch_;
+	std::atomic<int> waiters_;
+#ifndef LINUX
+	std::mutex mutex_;
+	std::condition_variable cv_;
+#endif
+
+public:
+	RingWaiter() : epoch_(0), waiters_(0) {}
+
+	RingWaiter(const RingWaiter&) = delete;
+	RingWaiter& operator=(const RingWaiter&) = delete;
+
+	uint32_t prepare() {
+		waiters_.fetch_add(1);
+		// pairs with the fence in notify(): either the notifier sees us or we see its update
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return epoch_.load();
+	}
+
+	// call once after prepare(), whether or not wait() was called
+	void done() {
+		waiters_.fetch_sub(1);
+	}
+
+	/**
+	* Sleeps until notify() is called after the prepare() that returned epoch
+	* @param deadline nullptr to wait without a timeout
+	* @return false if the deadline passed
+	*/
+	bool wait(uint32_t epoch, const std::chrono::steady_clock::time_point* deadline) {
+#ifdef LINUX
+		static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+		while (epoch_.load() == epoch) {
+			struct timespec ts;
+			struct timespec* timeout = nullptr;
+			if (deadline != nullptr) {
+				auto left = *deadline - std::chrono::steady_clock::now();
+				if (left <= std::chrono::steady_clock::duration::zero()) {
+					return false;
+				}
+				auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+				ts.tv_sec = (time_t)(ns / 1000000000);
+				ts.tv_nsec = (long)(ns % 1000000000);
+				timeout = &ts;
+			}
+			// returns straight away if the epoch already moved on
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE, epoch, timeout, nullptr, 0);
+		}
+		return true;
+#else
+		std::unique_lock<std::mutex> lock(mutex_);
+		auto woken = [&]() { return epoch_.load() != epoch; };
+		if (deadline == nullptr) {
+			cv_.wait(lock, woken);
+			return true;
+		}
+		return cv_.wait_until(lock, *deadline, woken);
+#endif
+	}
+
+	// wakes one sleeper, call after every push or pop that may unblock the other end
+	void notify() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiters_.load(std::memory_order_relaxed) == 0) {
+			return;
+		}
+#ifdef LINUX
+		epoch_.fetch_add(1);
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			epoch_.fetch_add(1);
+		}
+		cv_.notify_one();
+#endif
+	}
+};
+
+/**
+* @tparam T stored by value, must be default constructible and move assignable
+* @tparam Capacity power of two
+* @tparam Mode RING_SPSC only if exactly one thread pushes and one thread pops
+*/
+template<typename T, size_t Capacity, RingMode Mode = RING_MPMC>
+class RingBuffer {
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "RingBuffer capacity must be a power of two");
+
+private:
+	struct Cell {
+		std::atomic<size_t> seq;	// MPMC only: pos when free to fill, pos + 1 once filled
+		T value;
+	};
+
+	static const size_t mask_ = Capacity - 1;
+
+	Cell cells_[Capacity];
+
+	// producers and consumers each hammer their own index, keep them on separate cache lines
+	alignas(RING_CACHE_LINE) std::atomic<size_t> head_;	// next slot to fill
+	size_t tail_cache_;		// SPSC: the producer's last look at tail_
+	alignas(RING_CACHE_LINE) std::atomic<size_t> tail_;	// next slot to empty
+	size_t head_cache_;		// SPSC: the consumer's last look at head_
+
+	RingWaiter not_empty_;	// poppers sleep here
+	RingWaiter not_full_;	// pushers sleep here
+
+	// false if full, value is only moved from on success
+	template<typename U>
+	bool enqueue(U&& value) {
+		if (Mode == RING_SPSC) {
+			size_t head = head_.load(std::memory_order_relaxed);
+			if (head - tail_cache_ == Capacity) {
+				tail_cache_ = tail_.load(std::memory_order_acquire);
+				if (head - tail_cache_ == Capacity) {
+					return false;
+				}
+			}
+			cells_[head & mask_].value = std::forward<U>(value);
+			head_.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		size_t pos = head_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for (;;) {
+			cell = &cells_[pos & mask_];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+			if (dif == 0) {
+				if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (dif < 0) {
+				return false;
+			}
+			else {
+				pos = head_.load(std::memory_order_relaxed);
+			}
+		}
+		cell->value = std::forward<U>(value);
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// false if empty
+	bool dequeue(T& out) {
+		if (Mode == RING_SPSC) {
+			size_t tail = tail_.load(std::memory_order_relaxed);
+			if (tail == head_cache_) {
+				head_cache_ = head_.load(std::memory_order_acquire);
+				if (tail == head_cache_) {
+					return false;
+				}
+			}
+			out = std::move(cells_[tail & mask_].value);
+			tail_.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		size_t pos = tail_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for (;;) {
+			cell = &cells_[pos & mask_];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (dif == 0) {
+				if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (dif < 0) {
+				return false;
+			}
+			else {
+				pos = tail_.load(std::memory_order_relaxed);
+			}
+		}
+		out = std::move(cell->value);
+		cell->seq.store(pos + Capacity, std::memory_order_release);
+		return true;
+	}
+
+	// retries attempt, sleeping on waiter once spinning did not help
+	template<typename Attempt>
+	static bool block(RingWaiter& waiter, Attempt attempt, const std::chrono::steady_clock::time_point* deadline) {
+		for (int i = 0; i < RING_SPIN_TRIES; i++) {
+			if (attempt()) {
+				return true;
+			}
+			std::this_thread::yield();
+		}
+		for (;;) {
+			uint32_t epoch = waiter.prepare();
+			if (attempt()) {
+				waiter.done();
+				return true;
+			}
+			bool woken = waiter.wait(epoch, deadline);
+			waiter.done();
+			if (!woken) {
+				return attempt();
+			}
+		}
+	}
+
+	template<typename Clock, typename Duration>
+	static std::chrono::steady_clock::time_point steady(const std::chrono::time_point<Clock, Duration>& timeout) {
+		return std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout - Clock::now());
+	}
+
+public:
+	RingBuffer() : head_(0), tail_cache_(0), tail_(0), head_cache_(0) {
+		for (size_t i = 0; i < Capacity; i++) {
+			cells_[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+
+	static size_t capacity() {
+		return Capacity;
+	}
+
+	// items in the ring, only a hint while other threads push or pop
+	size_t size() const {
+		size_t tail = tail_.load(std::memory_order_acquire);
+		size_t head = head_.load(std::memory_order_acquire);
+		return head > tail ? head - tail : 0;
+	}
+
+	bool empty() const {
+		return size() == 0;
+	}
+
+	// Adds an item without blocking, false if the ring is full
+	bool try_push(const T& value) {
+		if (!enqueue(value)) {
+			return false;
+		}
+		not_empty_.notify();
+		return true;
+	}
+
+	// As above, value is left alone if the ring is full
+	bool try_push(T&& value) {
+		if (!enqueue(std::move(value))) {
+			return false;
+		}
+		not_empty_.notify();
+		return true;
+	}
+
+	// Adds an item, waiting for room while the ring is full
+	void push(const T& value) {
+		block(not_full_, [&]() { return enqueue(value); }, nullptr);
+		not_empty_.notify();
+	}
+
+	void push(T&& value) {
+		block(not_full_, [&]() { return enqueue(std::move(value)); }, nullptr);
+		not_empty_.notify();
+	}
+
+	/**
+	* Adds an item, waiting up to a point in time for room
+	* @return false if the ring stayed full until timeout
+	*/
+	template<typename Clock, typename Duration>
+	bool try_push_until(const T& value, const std::chrono::time_point<Clock, Duration>& timeout) {
+		std::chrono::steady_clock::time_point deadline = steady(timeout);
+		if (!block(not_full_, [&]() { return enqueue(value); }, &deadline)) {
+			return false;
+		}
+		not_empty_.notify();
+		return true;
+	}
+
+	template<typename Rep, typename Period>
+	bool try_push_for(const T& value, const std::chrono::duration<Rep, Period>& rel_time) {
+		return try_push_until(value, std::chrono::steady_clock::now() + rel_time);
+	}
+
+	// Takes the oldest item without blocking, false if the ring is empty
+	bool try_pop(T& out) {
+		if (!dequeue(out)) {
+			return false;
+		}
+		not_full_.notify();
+		return true;
+	}
+
+	// Takes the oldest item, waiting for one while the ring is empty
+	void pop(T& out) {
+		block(not_empty_, [&]() { return dequeue(out); }, nullptr);
+		not_full_.notify();
+	}
+
+	T pop() {
+		T out;
+		pop(out);
+		return out;
+	}
+
+	/**
+	* Takes the oldest item, waiting up to a point in time for one
+	* @return false if the ring stayed empty until timeout
+	*/
+	template<typename Clock, typename Duration>
+	bool try_pop_until(T& out, const std::chrono::time_point<Clock, Duration>& timeout) {
+		std::chrono::steady_clock::time_point deadline = steady(timeout);
+		if (!block(not_empty_, [&]() { return dequeue(out); }, &deadline)) {
+			return false;
+		}
+		not_full_.notify();
+		return true;
+	}
+
+	template<typename Rep, typename Period>
+	bool try_pop_for(T& out, const std::chrono::duration<Rep, Period>& rel_time) {
+		return try_pop_until(out, std::chrono::steady_clock::now() + rel_time);
+	}
+};
+
+/**
+* The cpen333::thread::fifo interface on a RingBuffer, so code written against fifo can switch by changing
+* the type. The size is a template parameter instead of a constructor argument, and there is no peek():
+* with several consumers another one can take the item between a peek and the pop.
+*/
+template<typename ValueType, size_t Capacity = 1024, RingMode Mode = RING_MPMC>
+class RingFifo {
+private:
+	RingBuffer<ValueType, Capacity, Mode> ring_;
+
+public:
+	using value_type = ValueType;
+
+	RingFifo() : ring_() {}
+
+	void push(const ValueType& val) {
+		ring_.push(val);
+	}
+
+	void push(ValueType&& val) {
+		ring_.push(std::move(val));
+	}
+
+	bool try_push(const ValueType& val) {
+		return ring_.try_push(val);
+	}
+
+	template<typename Rep, typename Period>
+	bool try_push_for(const ValueType& val, const std::chrono::duration<Rep, Period>& rel_time) {
+		return ring_.try_push_for(val, rel_time);
+	}
+
+	template<typename Clock, typename Duration>
+	bool try_push_until(const ValueType& val, const std::chrono::time_point<Clock, Duration>& timeout) {
+		return ring_.try_push_until(val, timeout);
+	}
+
+	// @param out destination, if nullptr the item is removed but not returned
+	void pop(ValueType* out) {
+		ValueType val;
+		ring_.pop(val);
+		if (out != nullptr) {
+			*out = std::move(val);
+		}
+	}
+
+	ValueType pop() {
+		return ring_.pop();
+	}
+
+	bool try_pop(ValueType* out) {
+		ValueType val;
+		if (!ring_.try_pop(val)) {
+			return false;
+		}
+		if (out != nullptr) {
+			*out = std::move(val);
+		}
+		return true;
+	}
+
+	template<typename Rep, typename Period>
+	bool try_pop_for(ValueType* out, const std::chrono::duration<Rep, Period>& rel_time) {
+		return try_pop_until(out, std::chrono::steady_clock::now() + rel_time);
+	}
+
+	template<typename Clock, typename Duration>
+	bool try_pop_until(ValueType* out, const std::chrono::time_point<Clock, Duration>& timeout) {
+		ValueType val;
+		if (!ring_.try_pop_until(val, timeout)) {
+			return false;
+		}
+		if (out != nullptr) {
+			*out = std::move(val);
+		}
+		return true;
+	}
+};
+
+#endif
@@ -10,43 +10,48 @@
 #include <cpen333/thread/thread_object.h>
 #include <iostream>
 #include <thread>
-#include "OrderQueue.h"
-#include "safe_printf.h"
+#include "RobotScheduler.h"
+#include "AsyncLog.h"
 #include "product.h"
 #include "Storage.h"
 #include "Order.h"
 #include "LoadingBay.h"
+#include "InventoryTable.h"
+#include "OrderStore.h"
+#include "RoutePlanner.h"
+#include "OrderBatcher.h"
+#include "SimClock.h"
 
 #define ROBOT_MAX_CAPACITY 200.00 //in kg
 
 class Robot : public cpen333::thread::thread_object {
 private:
-	RobotOrderQueue& queue_;
+	RobotScheduler& scheduler_;
+	OrderBatcher& batcher_;
+	SimClock& clock_;
 
 	Storage& storage_;
+	const RoutePlanner& planner_;
+	Location position_; // floor cell the robot is at
 
-	std::map<int, int> Inventory_ptr_; //maps product id to inventory
-	std::vector<Inventory> Inventories_;
+	InventoryTable& Inventories_; //maps product id to inventory
 
-	std::map<int, int>& Order_ptr_;
-	std::vector<Order>& Orders_;
-	std::mutex& order_mutex_;
+	OrderStore& orders_;
+	TruckHandler& dock_;
 
 	std::vector<Product> Onboard_;
 	std::vector<Product> Collection_;
 
 	double payload_; // weight of order being carried
 	const int id_;
-
-	/*LoadingBay& Delivery_bay;*/
+	const int slot_; // index in the scheduler
+	const int clock_id_; // participant id on the clock
 
 public:
-	Robot(RobotOrderQueue& queue, int id, Storage& storage, std::map<int, int>& Order_ptr, 
-		std::vector<Order>& Orders, std::mutex& order_mutex,
-		 std::map<int, int>& Inventory_ptr, std::vector<Inventory>& Inventories)
-		: queue_(queue), id_(id), storage_(storage),
-		Order_ptr_(Order_ptr), Orders_(Orders),
-		Inventories_(Inventories), Inventory_ptr_(Inventory_ptr),order_mutex_(order_mutex){}
+	Robot(RobotScheduler& scheduler, OrderBatcher& batcher, SimClock& clock, int id, Storage& storage, const RoutePlanner& planner, OrderStore& orders,
+		InventoryTable& Inventories, TruckHandler& dock)
+		: scheduler_(scheduler), batcher_(batcher), clock_(clock), storage_(storage), planner_(planner), position_(planner.Dock(BAY1)),
+		Inventories_(Inventories), orders_(orders), dock_(dock), id_(id), slot_(scheduler.AddRobot()), clock_id_(clock.AddParticipant()) {}
 	/*Robot(RobotOrderQueue& queue, int id, Storage& storage, std::map<int, int>& Order_ptr,
 		std::vector<Order>& Orders, std::mutex& order_mutex,
 		LoadingBay& Deliver_bay, std::map<int, int>& Inventory_ptr, std::vector<Inventory>& Inventories)
@@ -56,11 +61,14 @@ public:
 
 	int main() {
 
-		safe_printf("Robot %d started\n", id_);
+		clock_.Begin(clock_id_);
+		LOG_INFO("Robot %d started", id_);
 
-		Order order = queue_.get();
+		TaskHandle task;
 
-		while (1) {
+		// next() only fails once the queue is closed and every robot's deque is drained
+		while (scheduler_.next(slot_, clock_id_, task)) {
+			Order& order = *task;
 
 			if (order.task_ == RobotTask::QUIT) {
 				break;
@@ -72,54 +80,75 @@ public:
 			else if (order.task_ == RobotTask::UNLOAD) {
 				UnloadTruck(order);
 			}
-
-			//get next order
-			order = queue_.get();
-			
+			scheduler_.TaskDone(slot_);
 		}
 
-		safe_printf("Robot %d Quiting.\n", id_);
+		LOG_INFO("Robot %d Quiting.", id_);
+		clock_.RemoveParticipant(clock_id_);
 
 		return 0;
 	}
 
 	void UnloadTruck(Order& order) {
-		safe_printf("\nRobot %d going to loading bay to pick up items \n", id_);
-		std::this_thread::sleep_for(std::chrono::seconds(2));
+		LOG_INFO("Robot %d going to loading bay to pick up items", id_);
+		Location dock = planner_.Dock(BAY1);
+		TravelTo(dock);
 		//XXXXXXXXXXXXXXXXXX
 		//TO DO :
 		// tell the truck your unloading items
 		//XXXXXXXXXXXXXXXXXXXXXXX
-		safe_printf("\nRobot %d aquired items. \n", id_, order.ID_);
+		LOG_INFO("Robot %d aquired %d items.", id_, (int)order.products_.size());
 
+		Collection_ = planner_.PlanRoute(order.products_, dock);
 		for (auto& product : Collection_) {
-			safe_printf("\nRobot %d going to location: \n %s", id_, product.location_.toString().c_str());
-			std::this_thread::sleep_for(std::chrono::seconds(2));
-			safe_printf("\nRobot %d placing %s on the shelf. \n ", id_, product.toString().c_str());
-			getInventory(product.ID_).store(product.location_);
+			LOG_DEBUG("Robot %d going to row %d col %d shelf %d", id_, product.location_.row, product.location_.col, product.location_.shelf);
+			TravelTo(product.location_);
+			LOG_DEBUG("Robot %d placing product %d on the shelf.", id_, product.ID_);
+			Inventory* inv = getInventory(product.ID_);
+			if (inv == nullptr) {
+				LOG_WARN("Robot %d: Unknown product %d, freeing the shelf.", id_, product.ID_);
+				storage_.FreeShelf(product.location_);
+				continue;
+			}
+			inv->store(product.location_);
 		}
+		TravelTo(dock);
 
 	}
 
 	void CollectLoad(Order& order) {
-		safe_printf("Robot %d collecting order %d \n", id_, order.ID_);
-		safe_printf("%s", order.toString().c_str());
+		// the customer orders in the load, a task that isn't batched is one order itself
+		std::vector<int> shipped = order.orders_;
+		if (shipped.empty()) {
+			shipped.push_back(order.ID_);
+		}
+		LOG_INFO("Robot %d collecting orders %s, %d items", id_, IdList(shipped), (int)Collection_.size());
 		int count = 0;
+		payload_ = 0;
+		double load = 0; // everything going on the truck, Tin-Man's items too
+		Onboard_.clear();
+		Location dock = planner_.Dock(BAY1);
+
+		for (int id : order.orders_) {
+			UpdateOrderStatus(id, OrderStatus::ROBOT_COLLECTING_ORDER);
+		}
 
-		// Go Collect items in order
+		// Go Collect items along the shortest route found
+		Collection_ = planner_.PlanRoute(Collection_, dock);
 		for (auto& product : Collection_) {
-			safe_printf("\nRobot %d going to location: \n %s", id_, product.location_.toString().c_str());
-			std::this_thread::sleep_for(std::chrono::seconds(2));
+			LOG_DEBUG("Robot %d going to row %d col %d shelf %d", id_, product.location_.row, product.location_.col, product.location_.shelf);
+			TravelTo(product.location_);
 
 			if (product.weight_ > ROBOT_MAX_CAPACITY) {
-				safe_printf("\nRobot %d: Are you Kidding this product is too heavy to carry! Requesting Tin-Man! ", id_, product.toString().c_str());
-				safe_printf("BIG T IS HERE TO HELP YOU SON!\nX   X\nX X X\nXXXXX\n  X  \n  X  \n  X  \n  X  \nXXXXX\nX   X\nX   X\nX   X\n");
+				LOG_WARN("Robot %d: Are you Kidding product %d is too heavy to carry (%.1f)! Requesting Tin-Man! BIG T IS HERE TO HELP YOU SON!", id_, product.ID_, product.weight_);
 				Onboard_.push_back(product);
 				storage_.FreeShelf(product.location_);
+				load += product.weight_;
 			}
 			else{
-				safe_printf("\nRobot %d picking up: %s \n ", id_, product.toString().c_str());
+				LOG_DEBUG("Robot %d picking up product %d", id_, product.ID_);
 				payload_ += product.weight_;
+				load += product.weight_;
 				Onboard_.push_back(product);
 				storage_.FreeShelf(product.location_);
 				count++;
@@ -128,24 +157,61 @@ public:
 
 		}
 
-		safe_printf("Robot %d Placed Order on Truck and updated status \n", id_);
-
-		/*safe_printf("Robot %d Going to delivery bay %d \n", id_, Delivery_bay.baynum);
-		while (!Delivery_bay.LoadOrder(payload_)){
-			safe_printf("Robot %d Could not load order waiting for next truck. \n", id_);
-			std::this_thread::sleep_for(std::chrono::seconds(2));
-		}*/
+		// waits on the clock until a docked truck has room, then takes the load to its bay
+		int bay = dock_.Reserve(clock_id_, load);
+		int truck = -1;
+		if (bay >= 0) {
+			TravelTo(planner_.Dock(bay));
+			truck = dock_.Load(bay, shipped);
+		}
+		else {
+			TravelTo(dock);
+		}
+		if (truck < 0) {
+			// nothing went on a truck, the orders stay ROBOT_COLLECTING_ORDER rather than being reported shipped
+			LOG_WARN("Robot %d: dock closed, orders %s left at bay %d", id_, IdList(shipped), bay >= 0 ? bay : BAY1);
+			return;
+		}
+		LOG_INFO("Robot %d Placed orders %s on Truck %d at bay %d and updated status", id_, IdList(shipped), truck, bay);
 
-		UpdateOrderStatus(order.ID_);
+		// a batched task may finish some orders and only part of others
+		if (order.orders_.empty()) {
+			UpdateOrderStatus(order.ID_, OrderStatus::OUT_FOR_DELIVERY);
+		}
+		for (int id : batcher_.CompleteTask(order)) {
+			UpdateOrderStatus(id, OrderStatus::OUT_FOR_DELIVERY);
+		}
 	}
 
-	void UpdateOrderStatus(int order_id) {
-		std::lock_guard<std::mutex> mylock(order_mutex_);
-		Orders_[Order_ptr_[order_id]].status = OrderStatus::OUT_FOR_DELIVERY;
+	void UpdateOrderStatus(int order_id, OrderStatus status) {
+		orders_.setStatus(order_id, status);
 	}
 	
-	Inventory& getInventory(int product_id) {
-		return Inventories_[Inventory_ptr_[product_id]];
+	// Moves the robot, taking as long on the clock as walking the shortest path there
+	void TravelTo(const Location& target) {
+		int cells = planner_.Distance(position_, target);
+		if (cells == UNREACHABLE_DISTANCE) {
+			cells = std::abs(position_.row - target.row) + std::abs(position_.col - target.col);
+		}
+		clock_.sleep_for(clock_id_, cells * ROBOT_MS_PER_CELL);
+		position_.row = target.row;
+		position_.col = target.col;
+	}
+
+	Inventory* getInventory(int product_id) {
+		return Inventories_.find(product_id);
+	}
+
+	// "12, 15, 19" for log lines
+	static std::string IdList(const std::vector<int>& ids) {
+		std::string out;
+		for (int id : ids) {
+			if (!out.empty()) {
+				out += ", ";
+			}
+			out += std::to_string(id);
+		}
+		return out;
 	}
 };
 
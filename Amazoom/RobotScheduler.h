@@ -0,0 +1,247 @@
+/*
+*Description: Hands robot tasks out with work stealing. New tasks arrive on the shared RobotOrderQueue,
+*			  are moved onto the local deque of the robot whose floor zone they fall in, and a robot that
+*			  runs out of work steals from the tail of the busiest robot before going idle on the clock.
+*/
+
+#ifndef ROBOTSCHEDULER_H
+#define ROBOTSCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Order.h"
+#include "OrderQueue.h"
+#include "Storage.h"
+#include "SimClock.h"
+
+#define SCHEDULER_MAX_ROBOTS 64
+#define SCHEDULER_SEED_BATCH 8		// tasks moved off the shared queue at a time
+
+// Snapshot of one robot's scheduling counters
+struct RobotStats {
+	unsigned long tasks_completed;
+	unsigned long steals;		// tasks taken from another robot's deque
+	double idle_ms;				// simulated time spent waiting for a task
+
+	RobotStats() : tasks_completed(0), steals(0), idle_ms(0) {}
+};
+
+class RobotScheduler {
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<TaskHandle> tasks;	// owner pops the front, thieves take the back
+		std::atomic<size_t> size;		// read without the lock to pick a victim
+
+		std::atomic<unsigned long> tasks_completed;
+		std::atomic<unsigned long> steals;
+		std::atomic<long long> idle_us;
+
+		Worker() : size(0), tasks_completed(0), steals(0), idle_us(0) {}
+	};
+
+	RobotOrderQueue& injection_;
+	const Storage& storage_;
+	SimClock& clock_;
+	std::unique_ptr<Worker> workers_[SCHEDULER_MAX_ROBOTS];
+	std::atomic<int> num_robots_;
+	std::atomic<unsigned> round_robin_;
+
+public:
+	/**
+	* @param injection queue every task is first added to
+	* @param storage floor the zones are cut from
+	* @param clock idle robots wait on it for new work
+	*/
+	RobotScheduler(RobotOrderQueue& injection, const Storage& storage, SimClock& clock)
+		: injection_(injection), storage_(storage), clock_(clock), num_robots_(0), round_robin_(0) {
+		for (auto& worker : workers_) {
+			worker.reset(new Worker());
+		}
+	}
+
+	RobotScheduler(const RobotScheduler&) = delete;
+	RobotScheduler& operator=(const RobotScheduler&) = delete;
+
+	/**
+	* Registers a robot, call before the robot thread starts
+	* @return the robot's slot to pass to next() and TaskDone(), -1 if SCHEDULER_MAX_ROBOTS are registered
+	*/
+	int AddRobot() {
+		int id = num_robots_.load();
+		while (id < SCHEDULER_MAX_ROBOTS && !num_robots_.compare_exchange_weak(id, id + 1)) {}
+		return id < SCHEDULER_MAX_ROBOTS ? id : -1;
+	}
+
+	/**
+	* Adds a task for the robots
+	* @return false if the scheduler was closed
+	*/
+	bool add(TaskHandle task) {
+		bool added = injection_.add(std::move(task));
+		clock_.notify();
+		return added;
+	}
+
+	bool add(const Order& order) {
+		return add(TaskHandle(new Order(order)));
+	}
+
+	// Stops accepting tasks, robots finish what is queued and then next() returns false
+	void close() {
+		injection_.close();
+		clock_.notify();
+	}
+
+	/**
+	* Waits for the next task for a robot: its own deque first, then new tasks from the shared
+	* queue, then stealing from another robot
+	* @param participant the robot's id on the clock
+	* @return false once the scheduler is closed and neither the shared queue nor any robot has tasks left
+	*/
+	bool next(int robot, int participant, TaskHandle& out) {
+		Worker& self = *workers_[robot];
+		double idle_start = clock_.now();
+		bool got = false;
+
+		while (!got) {
+			unsigned long epoch = clock_.epoch();
+			if (PopLocal(self, out) || Seed(robot, out)) {
+				got = true;
+			}
+			else if (Steal(robot, out)) {
+				self.steals++;
+				got = true;
+			}
+			else if (injection_.closed() && injection_.empty() && !AnyQueued()) {
+				break;
+			}
+			else {
+				clock_.idle_until(participant, NO_DEADLINE, epoch);
+			}
+		}
+
+		self.idle_us += (long long)((clock_.now() - idle_start) * 1000);
+		return got;
+	}
+
+	// Called by a robot once it finished the task next() gave it
+	void TaskDone(int robot) {
+		workers_[robot]->tasks_completed++;
+	}
+
+	RobotStats getStats(int robot) const {
+		RobotStats stats;
+		const Worker& w = *workers_[robot];
+		stats.tasks_completed = w.tasks_completed.load();
+		stats.steals = w.steals.load();
+		stats.idle_ms = w.idle_us.load() / 1000.0;
+		return stats;
+	}
+
+	int numRobots() const {
+		return num_robots_.load();
+	}
+
+private:
+	bool PopLocal(Worker& w, TaskHandle& out) {
+		if (w.size.load(std::memory_order_relaxed) == 0) {
+			return false;
+		}
+		std::lock_guard<std::mutex> mylock(w.mutex);
+		if (w.tasks.empty()) {
+			return false;
+		}
+		out = std::move(w.tasks.front());
+		w.tasks.pop_front();
+		w.size.store(w.tasks.size(), std::memory_order_relaxed);
+		return true;
+	}
+
+	// Moves a few tasks off the shared queue onto their zone's deque, keeping the first one for this robot
+	bool Seed(int robot, TaskHandle& out) {
+		bool got = false;
+		bool handed_out = false;
+		TaskHandle task;
+		for (int i = 0; i < SCHEDULER_SEED_BATCH && injection_.try_get(task); i++) {
+			int home = HomeOf(*task);
+			if (!got && home == robot) {
+				out = std::move(task);
+				got = true;
+				continue;
+			}
+			Worker& w = *workers_[home];
+			std::lock_guard<std::mutex> mylock(w.mutex);
+			w.tasks.push_back(std::move(task));
+			w.size.store(w.tasks.size(), std::memory_order_relaxed);
+			handed_out = true;
+		}
+		if (handed_out) {
+			clock_.notify(); // the owners may be idle
+		}
+		return got || PopLocal(*workers_[robot], out);
+	}
+
+	// Takes the newest task of the robot with the longest deque
+	bool Steal(int robot, TaskHandle& out) {
+		int n = num_robots_.load();
+		int victim = -1;
+		size_t longest = 0;
+		for (int i = 0; i < n; i++) {
+			size_t size = workers_[i]->size.load(std::memory_order_relaxed);
+			if (i != robot && size > longest) {
+				longest = size;
+				victim = i;
+			}
+		}
+		if (victim < 0) {
+			return false;
+		}
+
+		Worker& w = *workers_[victim];
+		std::lock_guard<std::mutex> mylock(w.mutex);
+		if (w.tasks.empty()) {
+			return false;
+		}
+		out = std::move(w.tasks.back());
+		w.tasks.pop_back();
+		w.size.store(w.tasks.size(), std::memory_order_relaxed);
+		return true;
+	}
+
+	bool AnyQueued() const {
+		int n = num_robots_.load();
+		for (int i = 0; i < n; i++) {
+			if (workers_[i]->size.load() > 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// The floor is cut into one band of columns per robot, a task belongs to the band its shelves
+	// are centred in. Restocks and picks both carry their shelf locations so the same rule covers both.
+	int HomeOf(const Order& task) {
+		int n = num_robots_.load();
+		if (n <= 1) {
+			return 0;
+		}
+		size_t cols = storage_.numCols();
+		if (task.products_.empty() || cols == 0) {
+			return round_robin_++ % n;
+		}
+		double col = 0;
+		for (auto& product : task.products_) {
+			col += product.location_.col;
+		}
+		col /= task.products_.size();
+		int zone = (int)(col * n / cols);
+		return std::min(std::max(zone, 0), n - 1);
+	}
+};
+
+#endif
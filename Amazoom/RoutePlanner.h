@@ -0,0 +1,226 @@
+/*
+*Description: Plans robot pick routes on the warehouse floor. Shortest walking distances between every
+*			  shelf aisle cell and bay are precomputed from the floor map, and pick lists are ordered
+*			  with a nearest-neighbour tour improved by 2-opt.
+*/
+
+#ifndef ROUTEPLANNER_H
+#define ROUTEPLANNER_H
+
+#include "Storage.h"
+#include "product.h"
+#include <vector>
+#include <queue>
+#include <algorithm>
+
+#define ROBOT_MS_PER_CELL 100	// time for a robot to move one floor cell
+#define UNREACHABLE_DISTANCE 100000
+
+class RoutePlanner {
+private:
+	const Storage& storage_;
+	std::vector<int> stop_of_cell_;		// cell -> stop index, -1 if the cell is not a stop
+	std::vector<Location> stops_;		// cells a robot stops at: shelf aisle cells and bay cells
+	std::vector<int> dist_;				// stops_.size() x stops_.size() walking distances
+
+public:
+	RoutePlanner(const Storage& storage) : storage_(storage), stop_of_cell_(MAX_FLOOR_SIZE * MAX_FLOOR_SIZE, -1) {
+		FindStops();
+		ComputeDistances();
+	}
+
+	/**
+	* Walking distance between two floor cells
+	* @return number of cells walked, UNREACHABLE_DISTANCE if either cell is not a stop or no path exists
+	*/
+	int Distance(const Location& a, const Location& b) const {
+		int sa = StopOf(a);
+		int sb = StopOf(b);
+		if (sa < 0 || sb < 0) {
+			return UNREACHABLE_DISTANCE;
+		}
+		return dist_[sa * stops_.size() + sb];
+	}
+
+	// Cell a robot waits at when using the given bay (middle of the bay)
+	Location Dock(int bay) const {
+		const std::vector<Location>& cells = storage_.getBay(bay);
+		if (cells.empty()) {
+			Location none;
+			none.row = -1;
+			none.col = -1;
+			return none;
+		}
+		return cells[cells.size() / 2];
+	}
+
+	/**
+	* Total length of visiting the picks in the given order, starting and ending at start
+	*/
+	int RouteLength(const std::vector<Product>& picks, const Location& start) const {
+		int length = 0;
+		Location cur = start;
+		for (auto& pick : picks) {
+			length += Distance(cur, pick.location_);
+			cur = pick.location_;
+		}
+		return length + Distance(cur, start);
+	}
+
+	/**
+	* Orders a pick list to shorten the closed tour from start through every pick and back
+	*
+	* @param picks products with their shelf locations
+	* @param start cell the robot starts from and returns to
+	* @return the same picks in visiting order
+	*/
+	std::vector<Product> PlanRoute(const std::vector<Product>& picks, const Location& start) const {
+		int start_stop = StopOf(start);
+		if (picks.size() < 2 || start_stop < 0) {
+			return picks;
+		}
+
+		size_t n = picks.size();
+		std::vector<int> stop(n);
+		for (size_t i = 0; i < n; i++) {
+			stop[i] = StopOf(picks[i].location_);
+			if (stop[i] < 0) {
+				return picks;
+			}
+		}
+
+		// nearest neighbour tour, tour[0] is the start
+		std::vector<int> tour;
+		tour.reserve(n + 1);
+		tour.push_back(start_stop);
+		std::vector<size_t> order;
+		order.reserve(n);
+		std::vector<bool> visited(n, false);
+		int cur = start_stop;
+		for (size_t k = 0; k < n; k++) {
+			size_t best = n;
+			for (size_t i = 0; i < n; i++) {
+				if (!visited[i] && (best == n || D(cur, stop[i]) < D(cur, stop[best]))) {
+					best = i;
+				}
+			}
+			visited[best] = true;
+			order.push_back(best);
+			cur = stop[best];
+			tour.push_back(cur);
+		}
+
+		// 2-opt: reverse tour[i..j] whenever that shortens the closed tour
+		size_t m = tour.size();
+		bool improved = true;
+		while (improved) {
+			improved = false;
+			for (size_t i = 1; i + 1 < m; i++) {
+				for (size_t j = i + 1; j < m; j++) {
+					int a = tour[i - 1];
+					int b = tour[i];
+					int c = tour[j];
+					int d = tour[(j + 1) % m];
+					if (D(a, c) + D(b, d) < D(a, b) + D(c, d)) {
+						std::reverse(tour.begin() + i, tour.begin() + j + 1);
+						std::reverse(order.begin() + (i - 1), order.begin() + j);
+						improved = true;
+					}
+				}
+			}
+		}
+
+		std::vector<Product> out;
+		out.reserve(n);
+		for (size_t idx : order) {
+			out.push_back(picks[idx]);
+		}
+		return out;
+	}
+
+private:
+	int D(int a, int b) const {
+		return dist_[a * stops_.size() + b];
+	}
+
+	int StopOf(const Location& loc) const {
+		if (loc.row < 0 || loc.col < 0 || loc.row >= MAX_FLOOR_SIZE || loc.col >= MAX_FLOOR_SIZE) {
+			return -1;
+		}
+		return stop_of_cell_[loc.row * MAX_FLOOR_SIZE + loc.col];
+	}
+
+	bool Walkable(int row, int col) const {
+		char c = storage_.getCell(row, col);
+		return c != WALL_CHAR && c != LEFT_STORAGE_CHAR && c != RIGHT_STORAGE_CHAR;
+	}
+
+	void AddStop(int row, int col) {
+		int cell = row * MAX_FLOOR_SIZE + col;
+		if (stop_of_cell_[cell] < 0) {
+			Location loc;
+			loc.row = row;
+			loc.col = col;
+			stop_of_cell_[cell] = stops_.size();
+			stops_.push_back(loc);
+		}
+	}
+
+	// same cells Storage hands out as shelf locations, plus the bays
+	void FindStops() {
+		for (int row = 0; row < (int)storage_.numRows(); row++) {
+			for (int col = 0; col < (int)storage_.numCols(); col++) {
+				char c = storage_.getCell(row, col);
+				if (c == LEFT_STORAGE_CHAR && Walkable(row, col - 1)) {
+					AddStop(row, col - 1);
+				}
+				else if (c == RIGHT_STORAGE_CHAR && Walkable(row, col + 1)) {
+					AddStop(row, col + 1);
+				}
+				else if (c == BAY_1_CHAR || c == BAY_2_CHAR) {
+					AddStop(row, col);
+				}
+			}
+		}
+	}
+
+	// one breadth first search per stop over the walkable cells
+	void ComputeDistances() {
+		size_t n = stops_.size();
+		dist_.assign(n * n, UNREACHABLE_DISTANCE);
+		std::vector<int> cell_dist(MAX_FLOOR_SIZE * MAX_FLOOR_SIZE);
+		const int drow[] = { -1, 1, 0, 0 };
+		const int dcol[] = { 0, 0, -1, 1 };
+
+		for (size_t s = 0; s < n; s++) {
+			std::fill(cell_dist.begin(), cell_dist.end(), -1);
+			std::queue<Location> frontier;
+			frontier.push(stops_[s]);
+			cell_dist[stops_[s].row * MAX_FLOOR_SIZE + stops_[s].col] = 0;
+
+			while (!frontier.empty()) {
+				Location cur = frontier.front();
+				frontier.pop();
+				int d = cell_dist[cur.row * MAX_FLOOR_SIZE + cur.col];
+
+				int stop = stop_of_cell_[cur.row * MAX_FLOOR_SIZE + cur.col];
+				if (stop >= 0) {
+					dist_[s * n + stop] = d;
+				}
+
+				for (int k = 0; k < 4; k++) {
+					Location next;
+					next.row = cur.row + drow[k];
+					next.col = cur.col + dcol[k];
+					if (!Walkable(next.row, next.col) || cell_dist[next.row * MAX_FLOOR_SIZE + next.col] >= 0) {
+						continue;
+					}
+					cell_dist[next.row * MAX_FLOOR_SIZE + next.col] = d + 1;
+					frontier.push(next);
+				}
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,200 @@
+/*
+*Description: Keeps track of which shelf slots are free using dense slot ids so that allocating and
+*			  releasing a shelf are O(1) regardless of the size of the floor.
+*/
+
+#ifndef SHELFALLOCATOR_H
+#define SHELFALLOCATOR_H
+
+#include <vector>
+#include <random>
+
+#define MAX_FLOOR_SIZE 34
+#define NUM_SHELVES 6
+#define NUM_SLOTS (MAX_FLOOR_SIZE * MAX_FLOOR_SIZE * NUM_SHELVES)
+#define MAX_BAY_DISTANCE (2 * MAX_FLOOR_SIZE)
+#define INVALID_SLOT -1
+
+// How a free shelf is chosen when new stock is placed
+enum PlacementPolicy {
+	RANDOM_PLACEMENT,	// uniformly random free shelf
+	NEAREST_TO_BAY,		// free shelf with the shortest distance to a loading bay
+	ZONE_BALANCED		// random free shelf in the aisle that has the most free shelves
+};
+
+class ShelfAllocator {
+private:
+	enum SlotState : char {
+		NOT_A_SHELF,
+		FREE,
+		OCCUPIED
+	};
+
+	std::vector<char> state_;		// indexed by slot id
+	std::vector<int> distance_;		// distance of the slot to the closest bay
+	std::vector<int> zone_;			// aisle the slot belongs to
+
+	// every free slot is in exactly one list of each kind, pos_* hold its index in that list
+	std::vector<int> free_;
+	std::vector<std::vector<int>> free_by_distance_;
+	std::vector<std::vector<int>> free_by_zone_;
+	std::vector<int> pos_;
+	std::vector<int> pos_distance_;
+	std::vector<int> pos_zone_;
+
+	size_t num_slots_;
+
+public:
+	ShelfAllocator() :
+		state_(NUM_SLOTS, NOT_A_SHELF), distance_(NUM_SLOTS, 0), zone_(NUM_SLOTS, 0),
+		free_(), free_by_distance_(MAX_BAY_DISTANCE + 1), free_by_zone_(MAX_FLOOR_SIZE),
+		pos_(NUM_SLOTS, -1), pos_distance_(NUM_SLOTS, -1), pos_zone_(NUM_SLOTS, -1),
+		num_slots_(0) {}
+
+	static int Encode(int row, int col, int shelf) {
+		if (row < 0 || col < 0 || shelf < 0 || row >= MAX_FLOOR_SIZE || col >= MAX_FLOOR_SIZE || shelf >= NUM_SHELVES) {
+			return INVALID_SLOT;
+		}
+		return (row * MAX_FLOOR_SIZE + col) * NUM_SHELVES + shelf;
+	}
+
+	static int Row(int slot) {
+		return slot / NUM_SHELVES / MAX_FLOOR_SIZE;
+	}
+
+	static int Col(int slot) {
+		return (slot / NUM_SHELVES) % MAX_FLOOR_SIZE;
+	}
+
+	static int Shelf(int slot) {
+		return slot % NUM_SHELVES;
+	}
+
+	/**
+	* Registers a new free shelf slot
+	*
+	* @param slot dense slot id from Encode()
+	* @param bay_distance distance from the slot to the closest loading bay
+	* @param zone aisle the slot belongs to
+	* @return true if added, false if invalid or already registered
+	*/
+	bool AddSlot(int slot, int bay_distance, int zone) {
+		if (slot < 0 || slot >= NUM_SLOTS || state_[slot] != NOT_A_SHELF) {
+			return false;
+		}
+		if (bay_distance > MAX_BAY_DISTANCE) {
+			bay_distance = MAX_BAY_DISTANCE;
+		}
+		distance_[slot] = bay_distance;
+		zone_[slot] = zone % MAX_FLOOR_SIZE;
+		num_slots_++;
+		Push(slot);
+		return true;
+	}
+
+	/**
+	* Takes a free slot according to the placement policy
+	*
+	* @param policy how to pick among the free slots
+	* @param rnd random engine used by the random policies
+	* @return the slot id, or INVALID_SLOT if the warehouse is full
+	*/
+	int Allocate(PlacementPolicy policy, std::mt19937& rnd) {
+		if (free_.empty()) {
+			return INVALID_SLOT;
+		}
+
+		int slot = INVALID_SLOT;
+		if (policy == NEAREST_TO_BAY) {
+			for (auto& bucket : free_by_distance_) {
+				if (!bucket.empty()) {
+					slot = bucket.back();
+					break;
+				}
+			}
+		}
+		else if (policy == ZONE_BALANCED) {
+			size_t best = 0;
+			for (size_t zone = 1; zone < free_by_zone_.size(); zone++) {
+				if (free_by_zone_[zone].size() > free_by_zone_[best].size()) {
+					best = zone;
+				}
+			}
+			slot = PickRandom(free_by_zone_[best], rnd);
+		}
+		else {
+			slot = PickRandom(free_, rnd);
+		}
+
+		Pop(slot);
+		state_[slot] = OCCUPIED;
+		return slot;
+	}
+
+	// Marks a specific free slot as occupied, returns false if it is not free
+	bool Occupy(int slot) {
+		if (slot < 0 || slot >= NUM_SLOTS || state_[slot] != FREE) {
+			return false;
+		}
+		Pop(slot);
+		state_[slot] = OCCUPIED;
+		return true;
+	}
+
+	// Returns an occupied slot to the free lists, returns false if it was not occupied
+	bool Release(int slot) {
+		if (slot < 0 || slot >= NUM_SLOTS || state_[slot] != OCCUPIED) {
+			return false;
+		}
+		Push(slot);
+		return true;
+	}
+
+	bool IsOccupied(int slot) const {
+		return slot >= 0 && slot < NUM_SLOTS && state_[slot] == OCCUPIED;
+	}
+
+	size_t NumFree() const {
+		return free_.size();
+	}
+
+	size_t NumOccupied() const {
+		return num_slots_ - free_.size();
+	}
+
+private:
+	static int PickRandom(const std::vector<int>& list, std::mt19937& rnd) {
+		std::uniform_int_distribution<size_t> dist(0, list.size() - 1);
+		return list[dist(rnd)];
+	}
+
+	static void Insert(std::vector<int>& list, std::vector<int>& pos, int slot) {
+		pos[slot] = list.size();
+		list.push_back(slot);
+	}
+
+	// swap with the last element so removal does not shift the list
+	static void Erase(std::vector<int>& list, std::vector<int>& pos, int slot) {
+		int idx = pos[slot];
+		int last = list.back();
+		list[idx] = last;
+		pos[last] = idx;
+		list.pop_back();
+		pos[slot] = -1;
+	}
+
+	void Push(int slot) {
+		state_[slot] = FREE;
+		Insert(free_, pos_, slot);
+		Insert(free_by_distance_[distance_[slot]], pos_distance_, slot);
+		Insert(free_by_zone_[zone_[slot]], pos_zone_, slot);
+	}
+
+	void Pop(int slot) {
+		Erase(free_, pos_, slot);
+		Erase(free_by_distance_[distance_[slot]], pos_distance_, slot);
+		Erase(free_by_zone_[zone_[slot]], pos_zone_, slot);
+	}
+};
+
+#endif
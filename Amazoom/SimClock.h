@@ -0,0 +1,394 @@
+/*
+*Description: Time source for the simulation. Robots and the order batcher sleep and wait through a SimClock
+*			  so the same code runs in real time, sped up by a constant factor, or as a discrete event
+*			  simulation where virtual time jumps straight to the next scheduled wakeup.
+*/
+
+#ifndef SIMCLOCK_H
+#define SIMCLOCK_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#define NO_DEADLINE -1.0
+#define SCALED_CLOCK_FACTOR 100.0 // default speed up of the scaled clock
+
+enum ClockMode {
+	REAL_TIME_CLOCK,
+	SCALED_CLOCK,
+	DISCRETE_EVENT_CLOCK
+};
+
+// One turn handed out by a discrete event clock
+struct ClockEvent {
+	double time;
+	int participant;
+};
+
+/**
+* Threads that block through the clock register as participants and pass their id on every call.
+* Register from the thread that creates the participant, before starting it, so ids are handed out
+* in the same order on every run, then call Begin() first thing on the participant's thread.
+*
+* idle_until() is how a participant waits for work: read epoch(), check for work, then call
+* idle_until() with that epoch. It returns straight away if notify() was called in between, so
+* work added after the check is never missed.
+*/
+class SimClock {
+public:
+	virtual ~SimClock() {}
+
+	// simulated milliseconds since the clock was created
+	virtual double now() = 0;
+
+	virtual int AddParticipant() = 0;
+	// blocks until the participant's first turn, call from its thread before touching shared state
+	virtual void Begin(int participant) = 0;
+	// call when the participant thread is about to exit
+	virtual void RemoveParticipant(int participant) = 0;
+
+	// blocks the participant for ms of simulated time
+	virtual void sleep_for(int participant, double ms) = 0;
+
+	virtual unsigned long epoch() = 0;
+
+	/**
+	* Blocks until notify() is called or the simulated deadline passes
+	* @param deadline simulated time in ms, NO_DEADLINE to wait for notify() only
+	* @param epoch value of epoch() read before checking for work
+	*/
+	virtual void idle_until(int participant, double deadline, unsigned long epoch) = 0;
+
+	// wakes every idle participant, call after handing out work
+	virtual void notify() = 0;
+
+	// blocks the participant until every other one is idle with nothing scheduled
+	virtual void wait_idle(int participant) = 0;
+
+	/**
+	* Bracket work handed in by a thread that is not a participant, e.g. orders from the server.
+	* Simulated time stands still in between so all of it is stamped with the same time.
+	*/
+	virtual void BeginInput() = 0;
+	virtual void EndInput() = 0;
+
+	// keeps every turn handed out from now on, only a discrete event clock has turns
+	virtual void RecordEvents(bool /*record*/) {}
+	virtual std::vector<ClockEvent> Events() {
+		return std::vector<ClockEvent>();
+	}
+};
+
+// Holds simulated time for the lifetime of the guard, see SimClock::BeginInput()
+class ClockInput {
+private:
+	SimClock& clock_;
+
+public:
+	ClockInput(SimClock& clock) : clock_(clock) {
+		clock_.BeginInput();
+	}
+
+	~ClockInput() {
+		clock_.EndInput();
+	}
+
+	ClockInput(const ClockInput&) = delete;
+	ClockInput& operator=(const ClockInput&) = delete;
+};
+
+// Wall clock time multiplied by a constant factor, a factor of 1 runs in real time
+class ScaledClock : public SimClock {
+private:
+	const double scale_;
+	const std::chrono::steady_clock::time_point start_;
+	std::atomic<int> next_participant_;
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::atomic<unsigned long> epoch_;
+
+	std::chrono::steady_clock::time_point RealTime(double sim_ms) const {
+		return start_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double, std::milli>(sim_ms / scale_));
+	}
+
+public:
+	ScaledClock(double scale = 1.0)
+		: scale_(scale), start_(std::chrono::steady_clock::now()), next_participant_(0), epoch_(0) {}
+
+	double now() {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count() * scale_;
+	}
+
+	int AddParticipant() {
+		return next_participant_++;
+	}
+
+	void Begin(int /*participant*/) {}
+
+	void RemoveParticipant(int /*participant*/) {}
+
+	void sleep_for(int /*participant*/, double ms) {
+		if (ms > 0) {
+			std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms / scale_));
+		}
+	}
+
+	unsigned long epoch() {
+		return epoch_.load();
+	}
+
+	void idle_until(int /*participant*/, double deadline, unsigned long epoch) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		auto woken = [&]() { return epoch_.load() != epoch; };
+		if (deadline == NO_DEADLINE) {
+			cv_.wait(lock, woken);
+		}
+		else {
+			cv_.wait_until(lock, RealTime(deadline), woken);
+		}
+	}
+
+	void notify() {
+		{
+			std::lock_guard<std::mutex> mylock(mutex_);
+			epoch_++;
+		}
+		cv_.notify_all();
+	}
+
+	// wall clock time never stands still, so there is nothing to wait for
+	void wait_idle(int /*participant*/) {}
+
+	void BeginInput() {}
+	void EndInput() {}
+};
+
+class RealClock : public ScaledClock {
+public:
+	RealClock() : ScaledClock(1.0) {}
+};
+
+/**
+* Discrete event clock. Only one participant runs at a time: a participant runs until it sleeps or
+* goes idle, then the clock hands over to the earliest pending wakeup, ordered by (time, participant id),
+* and moves virtual time forward to it. New participants start blocked with a wakeup at the current time,
+* so even their first steps are taken one at a time in id order. Time only advances once every participant
+* is blocked, so a run does the same thing every time given the same seed and inputs.
+*
+* Participants must block only through the clock (short mutex holds are fine), a participant waiting
+* on anything else stops the simulation. Input from other threads is stamped with the time it arrives
+* at, so it only replays the same if it comes from a participant.
+*/
+class DiscreteEventClock : public SimClock {
+private:
+	enum ParticipantState { RUNNING, WAITING, GONE };
+
+	struct Participant {
+		ParticipantState state;
+		unsigned long ticket;	// bumped every time it blocks, older wakeups are stale
+		bool granted;
+		bool idle;				// waiting for notify() rather than only sleeping
+		bool settling;			// waiting in wait_idle()
+	};
+
+	struct Wakeup {
+		double time;
+		int participant;
+		unsigned long ticket;
+	};
+
+	struct Later {
+		bool operator()(const Wakeup& a, const Wakeup& b) const {
+			if (a.time != b.time) {
+				return a.time > b.time;
+			}
+			return a.participant > b.participant;
+		}
+	};
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	double now_;
+	unsigned long epoch_;
+	int running_;
+	int inputs_;		// threads between BeginInput() and EndInput()
+	std::vector<Participant> participants_;
+	std::priority_queue<Wakeup, std::vector<Wakeup>, Later> wakeups_;
+	bool record_;
+	std::vector<ClockEvent> events_;
+
+	void Grant(int participant) {
+		Participant& p = participants_[participant];
+		p.state = RUNNING;
+		p.granted = true;
+		running_++;
+		if (record_) {
+			ClockEvent e = { now_, participant };
+			events_.push_back(e);
+		}
+		cv_.notify_all();
+	}
+
+	// hands over to the earliest valid wakeup once nobody is running, or to a participant in
+	// wait_idle() once nothing is scheduled at all
+	void Advance() {
+		if (inputs_ > 0) {
+			return;
+		}
+		while (running_ == 0 && !wakeups_.empty()) {
+			Wakeup w = wakeups_.top();
+			wakeups_.pop();
+			Participant& p = participants_[w.participant];
+			if (p.state != WAITING || p.ticket != w.ticket) {
+				continue;
+			}
+			now_ = std::max(now_, w.time);
+			Grant(w.participant);
+		}
+		for (size_t i = 0; running_ == 0 && i < participants_.size(); i++) {
+			Participant& p = participants_[i];
+			if (p.state == WAITING && p.settling) {
+				p.settling = false;
+				Grant((int)i);
+			}
+		}
+	}
+
+	void Await(std::unique_lock<std::mutex>& lock, int participant) {
+		// participants_ may grow while we wait, index it again each time
+		cv_.wait(lock, [&]() { return participants_[participant].granted; });
+		participants_[participant].granted = false;
+	}
+
+	void Block(std::unique_lock<std::mutex>& lock, int participant, double deadline, bool idle) {
+		Participant& p = participants_[participant];
+		p.state = WAITING;
+		p.idle = idle;
+		p.ticket++;
+		if (deadline != NO_DEADLINE) {
+			Wakeup w = { std::max(deadline, now_), participant, p.ticket };
+			wakeups_.push(w);
+		}
+		running_--;
+		Advance();
+		Await(lock, participant);
+	}
+
+public:
+	DiscreteEventClock() : now_(0), epoch_(0), running_(0), inputs_(0), record_(false) {}
+
+	double now() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		return now_;
+	}
+
+	// the participant waits for its first turn at the current time, see Begin()
+	int AddParticipant() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		Participant p = { WAITING, 0, false, false, false };
+		participants_.push_back(p);
+		Wakeup w = { now_, (int)participants_.size() - 1, 0 };
+		wakeups_.push(w);
+		return participants_.size() - 1;
+	}
+
+	void Begin(int participant) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		Advance();
+		Await(lock, participant);
+	}
+
+	void RemoveParticipant(int participant) {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		Participant& p = participants_[participant];
+		if (p.state == RUNNING) {
+			running_--;
+		}
+		p.state = GONE;
+		Advance();
+	}
+
+	void sleep_for(int participant, double ms) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		Block(lock, participant, now_ + std::max(ms, 0.0), false);
+	}
+
+	unsigned long epoch() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		return epoch_;
+	}
+
+	void idle_until(int participant, double deadline, unsigned long epoch) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (epoch_ != epoch) {
+			return;
+		}
+		Block(lock, participant, deadline, true);
+	}
+
+	// idle participants are woken one at a time, lowest id first, at the current time
+	void notify() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		epoch_++;
+		for (size_t i = 0; i < participants_.size(); i++) {
+			Participant& p = participants_[i];
+			if (p.state == WAITING && p.idle) {
+				p.idle = false;
+				p.ticket++;
+				Wakeup w = { now_, (int)i, p.ticket };
+				wakeups_.push(w);
+			}
+		}
+		Advance();
+	}
+
+	void wait_idle(int participant) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		participants_[participant].settling = true;
+		Block(lock, participant, NO_DEADLINE, false);
+	}
+
+	// no turn is handed out while input is handed in, so time can't move under it
+	void BeginInput() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		inputs_++;
+	}
+
+	void EndInput() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		inputs_--;
+		Advance();
+	}
+
+	void RecordEvents(bool record) {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		record_ = record;
+	}
+
+	std::vector<ClockEvent> Events() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		return events_;
+	}
+};
+
+// Creates the clock for the given mode, scale is only used by SCALED_CLOCK
+inline SimClock* MakeClock(ClockMode mode, double scale = SCALED_CLOCK_FACTOR) {
+	switch (mode) {
+	case SCALED_CLOCK:
+		return new ScaledClock(scale);
+	case DISCRETE_EVENT_CLOCK:
+		return new DiscreteEventClock();
+	default:
+		return new RealClock();
+	}
+}
+
+#endif
@@ -18,6 +18,10 @@
 #include <vector>
 #include <mutex>
 #include <iostream>
+#include <algorithm>
+#include "ShelfAllocator.h"
+#include "WarehouseJournal.h"
+#include "AsyncLog.h"
 
 #define WALL_CHAR 'X'
 #define EMPTY_CHAR ' '
@@ -26,8 +30,6 @@
 #define BAY_1_CHAR '1'
 #define BAY_2_CHAR '2'
 
-#define MAX_FLOOR_SIZE 34
-#define NUM_SHELVES 6
 #define FLOOR_FILE_NAME "Warehouse1.txt"
 
 struct Location
@@ -82,6 +84,19 @@ struct ShelfLocation : Location
 		return false;
 	}
 
+	// Slot number of the shelf as ShelfAllocator numbers them
+	int slot() const {
+		return ShelfAllocator::Encode(row, col, shelf);
+	}
+
+	static ShelfLocation FromSlot(int slot) {
+		ShelfLocation location;
+		location.row = ShelfAllocator::Row(slot);
+		location.col = ShelfAllocator::Col(slot);
+		location.shelf = ShelfAllocator::Shelf(slot);
+		return location;
+	}
+
 	std::string toString() const {
 		std::string out = "Row: ";
 		out.append(std::to_string(row));
@@ -101,14 +116,15 @@ class Storage {
 private:
 	std::mutex mutex_;
 	char floor[MAX_FLOOR_SIZE][MAX_FLOOR_SIZE]; // floor storage [r][c]
-	std::vector<ShelfLocation> FreeShelfs_;
-	std::vector<ShelfLocation> OccupiedShelfs_;
+	ShelfAllocator shelves_;
+	std::mt19937 rnd_;
 	std::vector<Location> bay1;
 	std::vector<Location> bay2;
 	size_t max_row;
 	size_t max_col;
+	WarehouseJournal* journal_;	// logs freed shelves, nullptr if nothing is logged
 public:
-	Storage() {
+	Storage() : rnd_(std::chrono::system_clock::now().time_since_epoch().count()), max_row(0), max_col(0), journal_(nullptr) {
 		LoadFloor();
 		std::cout << "Loaded floormap of warehouse: " << std::endl;
 		printFloor();
@@ -116,10 +132,10 @@ public:
 		InitializeShelfLocations();
 	}
 
-	Storage(const Storage &other) {
+	Storage(const Storage &other) : journal_(nullptr) {
 		std::mutex mutex_;
-		FreeShelfs_ = other.FreeShelfs_;
-		OccupiedShelfs_ = other.OccupiedShelfs_;
+		shelves_ = other.shelves_;
+		rnd_ = other.rnd_;
 		bay1 = other.bay1;
 		bay2 = other.bay2;
 	}
@@ -127,31 +143,37 @@ public:
 	Storage& operator=(Storage other)
 	{
 		std::mutex mutex_;
-		FreeShelfs_ = other.FreeShelfs_;
-		OccupiedShelfs_ = other.OccupiedShelfs_;
+		shelves_ = other.shelves_;
+		rnd_ = other.rnd_;
 		bay1 = other.bay1;
 		bay2 = other.bay2;
 		return *this;
 	}
-	//Returns a random free shelf location or if none available returns 
-	//a loc with row==col==0
-	ShelfLocation GetFreeShelf() {
+
+	// Starts logging freed shelves, call before any robot runs
+	void SetJournal(WarehouseJournal* journal) {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		journal_ = journal;
+	}
+
+	// Reseeds random shelf placement so runs can be repeated
+	void Seed(unsigned int seed) {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		rnd_.seed(seed);
+	}
+
+	//Returns a free shelf location chosen by the placement policy or if none available returns 
+	//an invalid location
+	ShelfLocation GetFreeShelf(PlacementPolicy policy = RANDOM_PLACEMENT) {
 		ShelfLocation location;
+		std::lock_guard<std::mutex> mylock(mutex_);
 
-		if (!FreeShelfs_.empty()) {
-			std::lock_guard<std::mutex> mylock(mutex_);
-			/*std::default_random_engine rnd(
-				std::chrono::system_clock::now().time_since_epoch().count());
-			std::uniform_real_distribution<int> dist(0, FreeShelfs_.size());*/
-			srand(time(NULL));
-			int rand_num = rand() % FreeShelfs_.size();
-
-			location = FreeShelfs_[rand_num];
-			OccupiedShelfs_.push_back(location);
-			FreeShelfs_.erase(FreeShelfs_.begin() + rand_num);
-			return location;
+		int slot = shelves_.Allocate(policy, rnd_);
+		if (slot != INVALID_SLOT) {
+			location.row = ShelfAllocator::Row(slot);
+			location.col = ShelfAllocator::Col(slot);
+			location.shelf = ShelfAllocator::Shelf(slot);
 		}
-
 		
 		return location;
 	}
@@ -159,23 +181,60 @@ public:
 	// tries to free the given location in return true if successful false otherwise
 	bool FreeShelf(ShelfLocation location) {
 		if (!location.isValid()) {
+			LOG_ERROR("Location invalid!");
 			return false;
-			std::cout << "Location invalid! " << std::endl;
 		}
-		int i = 0;
-		for (auto& shelf : OccupiedShelfs_) {
-			if (shelf == location) {
-				FreeShelfs_.push_back(shelf);	
-				OccupiedShelfs_.erase(OccupiedShelfs_.begin() + i);
-				std::cout << "Storage Successfully freed shelf location: " << FreeShelfs_.back().toString() << std::endl;
-				return true;
+
+		int slot = ShelfAllocator::Encode(location.row, location.col, location.shelf);
+		std::lock_guard<std::mutex> mylock(mutex_);
+		if (shelves_.Release(slot)) {
+			if (journal_ != nullptr) {
+				journal_->Free(slot);
 			}
-			i++;
+			return true;
 		}
-		std::cout << "Error! Could not find storage location! " << location.toString() << std::endl;
+		LOG_ERROR("Error! Could not find storage location! Row: %d Col: %d Shelf Unit: %d", location.row, location.col, location.shelf);
 		return false;
 	}
 
+	// Marks a given free shelf as occupied, used to restore shelves that were occupied before a restart
+	//@return false if the shelf is invalid or already occupied
+	bool OccupyShelf(const ShelfLocation& location) {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		return shelves_.Occupy(location.slot());
+	}
+
+	size_t numFreeShelves() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		return shelves_.NumFree();
+	}
+
+	size_t numOccupiedShelves() {
+		std::lock_guard<std::mutex> mylock(mutex_);
+		return shelves_.NumOccupied();
+	}
+
+	// floor map accessors, the map is read once at construction and never changes
+	char getCell(int row, int col) const {
+		if (row < 0 || col < 0 || row >= (int)max_row || col >= (int)max_col) {
+			return WALL_CHAR;
+		}
+		return floor[row][col];
+	}
+
+	size_t numRows() const {
+		return max_row;
+	}
+
+	size_t numCols() const {
+		return max_col;
+	}
+
+	// @param bay BAY1 or BAY2
+	const std::vector<Location>& getBay(int bay) const {
+		return (bay == 1) ? bay2 : bay1;
+	}
+
 	void printFloor() {
 		for (size_t row = 0; row < max_row; row++) {
 			for (size_t col = 0; col < max_col; col++) {
@@ -196,10 +255,10 @@ private:
 			//std::cout << "File is open" << std::endl;
 			int row = 0;  // zeroeth row
 			
-			while (std::getline(fin, line)) {
+			while (row < MAX_FLOOR_SIZE && std::getline(fin, line)) {
 				//std::cout << line << std::endl;
-				max_col = line.length();
-				for (size_t col = 0; col<line.length(); col++) {
+				max_col = std::min<size_t>(line.length(), MAX_FLOOR_SIZE);
+				for (size_t col = 0; col<max_col; col++) {
 					floor[row][col] = line[col];
 				}
 				row++;
@@ -210,9 +269,27 @@ private:
 
 	}
 
-	//Reads the floorplan and retrieves all shelf loactions 
+	//Reads the floorplan and retrieves all bay and shelf loactions 
 	void InitializeShelfLocations() {
 		char cur_char;
+		Location bay;
+
+		// bays first so every shelf knows how far it is from the closest one
+		for (size_t row = 0; row < max_row; row++) {
+			for (size_t col = 0; col < max_col; col++) {
+				cur_char = floor[row][col];
+				bay.row = row;
+				bay.col = col;
+
+				if (cur_char == BAY_1_CHAR) {
+					bay1.push_back(bay);
+				}
+				else if (cur_char == BAY_2_CHAR) {
+					bay2.push_back(bay);
+				}
+			}
+		}
+
 		ShelfLocation cur_loc;
 
 		for (size_t row = 0; row < max_row; row++) {
@@ -223,40 +300,34 @@ private:
 					cur_loc.col = col - 1;
 					cur_loc.row = row;
 					PopulateShelfs(cur_loc);
-					//std::cout << "Current Char: " << cur_char << std::endl;
-					//std::cout << "Recognized as =  "<< LEFT_STORAGE_CHAR << std::endl;
-					
 				}
 				else if (cur_char == RIGHT_STORAGE_CHAR)
 				{
-					//std::cout << "Current Char: " << cur_char << std::endl;
-					//std::cout << "Recognized as =  " << RIGHT_STORAGE_CHAR << std::endl;
 					cur_loc.col = col + 1;
 					cur_loc.row = row;
 					PopulateShelfs(cur_loc);
 				}
-				else if (cur_char == BAY_1_CHAR) {
-					//std::cout << "Current Char: " << cur_char << std::endl;
-					//std::cout << "Recognized as =  " << BAY_1_CHAR << std::endl;
-					cur_loc.col = col;
-					cur_loc.row = row;
-					PopulateShelfs(cur_loc);
-				}
-				else if (cur_char == BAY_2_CHAR) {
-					//std::cout << "Current Char: " << cur_char << std::endl;
-					//std::cout << "Recognized as =  " << BAY_2_CHAR  << std::endl;
-					cur_loc.col = col;
-					cur_loc.row = row;
-					PopulateShelfs(cur_loc);
-				}
 			}
 		}
 	}
 
+	// Manhattan distance from a location to the closest bay
+	int BayDistance(const Location& loc) {
+		int best = MAX_BAY_DISTANCE;
+		for (auto bays : { &bay1, &bay2 }) {
+			for (auto& bay : *bays) {
+				best = std::min(best, std::abs(bay.row - loc.row) + std::abs(bay.col - loc.col));
+			}
+		}
+		return best;
+	}
+
 	void PopulateShelfs(ShelfLocation loc) {
+		int distance = BayDistance(loc);
 		for (int i = 0; i < NUM_SHELVES; i++) {
 			loc.shelf = i;
-			FreeShelfs_.push_back(loc);
+			// aisles run along the columns so the column identifies the zone
+			shelves_.AddSlot(ShelfAllocator::Encode(loc.row, loc.col, loc.shelf), distance, loc.col);
 		}
 	}
 };
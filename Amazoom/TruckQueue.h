@@ -2,15 +2,51 @@
 *Date: 12/1/2017
 *Author: Muhab Tomoum - 52141132
 *Description: Trucks either restock warehouse or collect outgoing orders for delivery.
+*			  The yard, trucks that arrived wait here in arrival order for a free loading bay.
 */
 
 #ifndef TRUCKQUEUE_H
 #define TRUCKQUEUE_H
 
-#include <cpen333/thread/semaphore.h>
+#include "RingBuffer.h"
 #include "Trucks.h"
-#include <mutex>
 
+class TruckQueue {
+	RingBuffer<Truck, CIRCULAR_BUFF_SIZE> buff_;
 
+public:
+	/**
+	* Creates a queue holding up to CIRCULAR_BUFF_SIZE trucks
+	*/
+	TruckQueue() : buff_() {}
 
-#endif
\ No newline at end of file
+	// Blocks while the yard is full
+	void add(const Truck& truck) {
+		buff_.push(truck);
+	}
+
+	// Blocks while the yard is empty
+	Truck get() {
+		return buff_.pop();
+	}
+
+	/**
+	* Adds a truck unless the yard is full, for threads that may only block through the SimClock
+	* @return false if the truck was turned away
+	*/
+	bool try_add(const Truck& truck) {
+		return buff_.try_push(truck);
+	}
+
+	// Takes the truck that has waited longest, if any
+	bool try_get(Truck& out) {
+		return buff_.try_pop(out);
+	}
+
+	size_t size() const {
+		return buff_.size();
+	}
+
+};
+
+#endif
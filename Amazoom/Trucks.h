@@ -7,98 +7,45 @@
 #ifndef TRUCKS_H
 #define TRUCKS_H
 
-#include "Storage.h"
-#include "product.h"
-#include "Order.h"
-#include "safe_printf.h"
-#include <cpen333/thread/thread_object.h>
-#include "LoadingBay.h"
+#include <vector>
 
 #define TRUCK_MAX_CAPACITY 2000.00 //kg
-#define TRUCK_THRESHOLD 16.00
-#define CIRCULAR_BUFF_SIZE 2
-
-//
-//class DeliveryTruck : public cpen333::thread::thread_object {
-//private:
-//	double& payload_;
-//	bool& quit_;
-//	LoadingBay& Delivery_bay;
-//	const int id_;
-//
-//public:
-//	DeliveryTruck(bool& quit, double& payload_weight, const int id, LoadingBay& Deliver_bay)
-//		: quit_(quit), payload_(payload_weight), id_(id), Delivery_bay(Deliver_bay) {}
-//	//LoadingBay& Deliver_bay
-//	int main() {
-//		safe_printf("Delivery Truck %d Arrived!\n", id_);
-//		while (payload_ < TRUCK_THRESHOLD) {
-//			if (quit_) {
-//				return 0;
-//			}
-//
-//		}
-//		safe_printf("Delivery Truck %d Hit capacity and Departing!\n", id_);
-//		Delivery_bay.TruckLeaving(id_);
-//
-//		return 0;
-//	}
-//};
-
-
-class TruckQueue {
-	Truck buff_[CIRCULAR_BUFF_SIZE];
-	cpen333::thread::semaphore producer_;
-	cpen333::thread::semaphore consumer_;
-	std::mutex pmutex_;
-	std::mutex cmutex_;
-	size_t pidx_;
-	size_t cidx_;
+#define TRUCK_THRESHOLD 16.00 // kg of spare capacity under which a delivery truck counts as full
+#define CIRCULAR_BUFF_SIZE 2 // trucks that fit in the yard waiting for a free bay, a power of two
 
+enum TruckType {
+	DELIVERY_TRUCK,
+	RESTOCK_TRUCK
+};
 
-public:
-	/**
-	* Creates a queue with provided circular buffer size
-	* @param buffsize size of circular buffer
-	*/
-	TruckQueue() :
-		buff_(),
-		producer_(CIRCULAR_BUFF_SIZE), consumer_(0),
-		pmutex_(), cmutex_(), pidx_(0), cidx_(0) {}
+struct Truck {
+	int id_;
+	TruckType type_;
+	double capacity_;	// kg
+	double payload_;	// kg loaded so far
+	double arrival_;	// simulated ms it reached the yard
+	double docked_;		// simulated ms it backed into a bay, -1 while in the yard
+	double first_load_;	// simulated ms of the first load, -1 while empty
+	std::vector<int> orders_; // ids of the orders on board, in loading order
 
-	void add(Truck& truck) {
+	Truck() : id_(-1), type_(DELIVERY_TRUCK), capacity_(TRUCK_MAX_CAPACITY), payload_(0), arrival_(0),
+		docked_(-1), first_load_(-1) {}
 
-		int pidx;
-		producer_.wait();
-		{
-			std::lock_guard<std::mutex> mylock(pmutex_);
-			pidx = pidx_;
-			// update producer index
-			pidx_ = (pidx_ + 1) % CIRCULAR_BUFF_SIZE;
-			buff_[pidx] = truck;
-		}
-		consumer_.notify();
+	Truck(int id, TruckType type, double arrival, double capacity = TRUCK_MAX_CAPACITY)
+		: id_(id), type_(type), capacity_(capacity), payload_(0), arrival_(arrival), docked_(-1), first_load_(-1) {}
 
+	double spare() const {
+		return capacity_ - payload_;
 	}
 
-	Truck get() {
-
-		int cidx;
-		Truck out;
-		consumer_.wait();
-		{
-			std::lock_guard<std::mutex> mylock(cmutex_);
-			cidx = cidx_;
-			// update consumer index
-			cidx_ = (cidx_ + 1) % CIRCULAR_BUFF_SIZE;
-			out = buff_[cidx];
-		}
-		producer_.notify();
-
-		return out;
+	// an empty truck takes any load, even one heavier than it is rated for, so nothing waits forever
+	bool fits(double weight) const {
+		return payload_ == 0 || weight <= spare();
 	}
 
+	bool full() const {
+		return spare() < TRUCK_THRESHOLD;
+	}
 };
 
-
 #endif
@@ -0,0 +1,650 @@
+/*
+*Description: Keeps the warehouse state across restarts. Every change to stock, shelf occupancy and orders
+*			  is appended to a write-ahead log where it happens, and the log is compacted as it grows:
+*			  each sealed segment is folded into a snapshot of the state on a background thread and
+*			  then deleted, so the running warehouse never stops for a snapshot. Recovery loads the
+*			  snapshot and replays the segments written after it.
+*/
+
+#ifndef WAREHOUSEJOURNAL_H
+#define WAREHOUSEJOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "AsyncLog.h"
+#include "OrderStatus.h"
+#include "WriteAheadLog.h"
+
+#define JOURNAL_SNAPSHOT_MAGIC 0x4C4E524Au	// "JRNL" on little endian machines
+#define JOURNAL_SNAPSHOT_VERSION 1
+
+// Log record types, the first byte of every record
+enum JournalEvent {
+	JOURNAL_STORE = 1,		// product, slot: an item was put on a shelf and counted as available
+	JOURNAL_RESERVE,		// product, quantity: available stock promised to an order
+	JOURNAL_UNRESERVE,		// product, quantity: reserved stock handed back
+	JOURNAL_AQUIRE,			// product, slot: a reserved item was taken out of stock for collection
+	JOURNAL_FREE,			// slot: a shelf was emptied by a robot
+	JOURNAL_ORDER,			// id, status, line count, then product and quantity per line
+	JOURNAL_ORDER_STATUS,	// id, status
+	JOURNAL_ORDER_ERASE		// id
+};
+
+/**
+* The warehouse state a journal describes. Shelves are slot numbers as ShelfAllocator::Encode makes them.
+* A shelf is occupied if it is in some product's stock or in aquired.
+*/
+struct JournalState {
+	struct Stock {
+		int available;
+		int reserved;
+		std::vector<int> slots;		// shelves holding available and reserved items
+
+		Stock() : available(0), reserved(0) {}
+	};
+
+	struct PlacedOrder {
+		int status;
+		std::vector<std::pair<int, int>> lines;	// product and quantity
+	};
+
+	std::unordered_map<int, Stock> stock;		// by product id
+	std::unordered_map<int, int> aquired;		// slot to product, taken out of stock for an order but not picked up yet
+	std::map<int, PlacedOrder> orders;			// by order id, only orders that have not left the warehouse
+
+	bool empty() const {
+		return stock.empty() && aquired.empty() && orders.empty();
+	}
+
+	static int get32(const char* in) {
+		int32_t value;
+		std::memcpy(&value, in, sizeof(value));
+		return value;
+	}
+
+	static void put32(std::string& out, int value) {
+		int32_t v = value;
+		out.append((const char*)&v, sizeof(v));
+	}
+
+	// Applies one log record, false if it is not a valid record
+	bool Apply(const char* event, size_t size) {
+		if (size < 1 || (size - 1) % 4 != 0) {
+			return false;
+		}
+		size_t fields = (size - 1) / 4;
+		auto field = [&](size_t i) { return get32(event + 1 + 4 * i); };
+
+		switch (event[0]) {
+		case JOURNAL_STORE: {
+			if (fields != 2) return false;
+			Stock& s = stock[field(0)];
+			s.slots.push_back(field(1));
+			s.available++;
+			return true;
+		}
+		case JOURNAL_RESERVE:
+		case JOURNAL_UNRESERVE: {
+			if (fields != 2) return false;
+			Stock& s = stock[field(0)];
+			int quantity = event[0] == JOURNAL_RESERVE ? field(1) : -field(1);
+			s.available -= quantity;
+			s.reserved += quantity;
+			return true;
+		}
+		case JOURNAL_AQUIRE: {
+			if (fields != 2) return false;
+			Stock& s = stock[field(0)];
+			int slot = field(1);
+			// aquire takes the newest location, so look from the back
+			for (size_t i = s.slots.size(); i-- > 0;) {
+				if (s.slots[i] == slot) {
+					s.slots.erase(s.slots.begin() + i);
+					break;
+				}
+			}
+			s.reserved--;
+			aquired[slot] = field(0);
+			return true;
+		}
+		case JOURNAL_FREE: {
+			if (fields != 1) return false;
+			aquired.erase(field(0));
+			return true;
+		}
+		case JOURNAL_ORDER: {
+			if (fields < 3 || fields != 3 + 2 * (size_t)field(2)) return false;
+			PlacedOrder& order = orders[field(0)];
+			order.status = field(1);
+			order.lines.clear();
+			for (int i = 0; i < field(2); i++) {
+				order.lines.push_back(std::make_pair(field(3 + 2 * i), field(4 + 2 * i)));
+			}
+			if (order.status == OrderStatus::OUT_FOR_DELIVERY) {
+				orders.erase(field(0));
+			}
+			return true;
+		}
+		case JOURNAL_ORDER_STATUS: {
+			if (fields != 2) return false;
+			auto it = orders.find(field(0));
+			if (it != orders.end()) {
+				it->second.status = field(1);
+				if (field(1) == OrderStatus::OUT_FOR_DELIVERY) {
+					orders.erase(it);
+				}
+			}
+			return true;
+		}
+		case JOURNAL_ORDER_ERASE: {
+			if (fields != 1) return false;
+			orders.erase(field(0));
+			return true;
+		}
+		}
+		return false;
+	}
+
+	/**
+	* Turns the state found after a crash into one the warehouse can restart from:
+	*	- orders still UNKNOWN were being placed and never confirmed, they are dropped and the stock
+	*	  they reserved is made available again (an order is only marked ready once its items are
+	*	  aquired, so no other order holds reserved stock)
+	*	- open orders share out the aquired shelves of their products, items a robot had already
+	*	  picked up were on the robot and are not collected again
+	*	- orders with nothing left on the shelves are dropped
+	*	- aquired shelves no order claims go back into stock
+	*	- products known() rejects are dropped with their shelves
+	* @return the collection of every open order as product and slot pairs, all orders are then
+	*		 READY_FOR_COLLECTION
+	*/
+	std::map<int, std::vector<std::pair<int, int>>> Settle(std::function<bool(int)> known) {
+		for (auto it = stock.begin(); it != stock.end();) {
+			if (!known(it->first)) {
+				it = stock.erase(it);
+				continue;
+			}
+			it->second.available += it->second.reserved;
+			it->second.reserved = 0;
+			++it;
+		}
+
+		std::unordered_map<int, std::vector<int>> unclaimed;	// aquired slots by product
+		for (auto& entry : aquired) {
+			if (known(entry.second)) {
+				unclaimed[entry.second].push_back(entry.first);
+			}
+		}
+		aquired.clear();
+
+		std::map<int, std::vector<std::pair<int, int>>> collections;
+		for (auto it = orders.begin(); it != orders.end();) {
+			if (it->second.status != OrderStatus::READY_FOR_COLLECTION
+				&& it->second.status != OrderStatus::ROBOT_COLLECTING_ORDER) {
+				it = orders.erase(it);
+				continue;
+			}
+			std::vector<std::pair<int, int>>& items = collections[it->first];
+			for (auto& line : it->second.lines) {
+				if (!known(line.first)) {
+					continue;
+				}
+				std::vector<int>& from_aquired = unclaimed[line.first];
+				for (int i = 0; i < line.second && !from_aquired.empty(); i++) {
+					int slot = from_aquired.back();
+					from_aquired.pop_back();
+					items.push_back(std::make_pair(line.first, slot));
+					aquired[slot] = line.first;
+				}
+			}
+			if (items.empty()) {
+				collections.erase(it->first);
+				it = orders.erase(it);
+				continue;
+			}
+			it->second.status = OrderStatus::READY_FOR_COLLECTION;
+			++it;
+		}
+
+		for (auto& entry : unclaimed) {
+			Stock& s = stock[entry.first];
+			s.slots.insert(s.slots.end(), entry.second.begin(), entry.second.end());
+			s.available += (int)entry.second.size();
+		}
+		return collections;
+	}
+
+	std::string Serialize() const {
+		std::string out;
+		put32(out, (int)stock.size());
+		for (auto& entry : stock) {
+			put32(out, entry.first);
+			put32(out, entry.second.available);
+			put32(out, entry.second.reserved);
+			put32(out, (int)entry.second.slots.size());
+			for (int slot : entry.second.slots) {
+				put32(out, slot);
+			}
+		}
+		put32(out, (int)aquired.size());
+		for (auto& entry : aquired) {
+			put32(out, entry.first);
+			put32(out, entry.second);
+		}
+		put32(out, (int)orders.size());
+		for (auto& entry : orders) {
+			put32(out, entry.first);
+			put32(out, entry.second.status);
+			put32(out, (int)entry.second.lines.size());
+			for (auto& line : entry.second.lines) {
+				put32(out, line.first);
+				put32(out, line.second);
+			}
+		}
+		return out;
+	}
+
+	// false if data is not a whole serialized state, the state is then left partly filled
+	bool Deserialize(const char* data, size_t size) {
+		const char* end = data + size;
+		auto next = [&](int& value) {
+			if (end - data < 4) {
+				return false;
+			}
+			value = get32(data);
+			data += 4;
+			return true;
+		};
+
+		int count, key, n;
+		if (!next(count)) return false;
+		for (int i = 0; i < count; i++) {
+			if (!next(key)) return false;
+			Stock& s = stock[key];
+			if (!next(s.available) || !next(s.reserved) || !next(n) || n < 0 || end - data < 4 * (ptrdiff_t)n) return false;
+			s.slots.resize(n);
+			for (int& slot : s.slots) {
+				next(slot);
+			}
+		}
+		if (!next(count)) return false;
+		for (int i = 0; i < count; i++) {
+			if (!next(key) || !next(n)) return false;
+			aquired[key] = n;
+		}
+		if (!next(count)) return false;
+		for (int i = 0; i < count; i++) {
+			if (!next(key)) return false;
+			PlacedOrder& order = orders[key];
+			if (!next(order.status) || !next(n) || n < 0 || end - data < 8 * (ptrdiff_t)n) return false;
+			order.lines.resize(n);
+			for (auto& line : order.lines) {
+				next(line.first);
+				next(line.second);
+			}
+		}
+		return data == end;
+	}
+};
+
+// What the last recovery found, for sizing snapshot intervals
+struct JournalRecoveryStats {
+	uint64_t snapshot_segment;	// last segment folded into the snapshot, 0 if there was none
+	unsigned long segments;		// segments replayed after it
+	unsigned long events;		// records replayed
+	bool torn;					// the newest segment ended in a torn record
+	bool damaged;				// the snapshot could not be read, nothing was recovered
+	double snapshot_ms;			// loading the snapshot
+	double replay_ms;			// replaying the segments
+
+	JournalRecoveryStats() : snapshot_segment(0), segments(0), events(0), torn(false), damaged(false), snapshot_ms(0), replay_ms(0) {}
+};
+
+/**
+* Files, for a path prefix P:
+*	P.snapshot		magic, version, last segment folded in, body size and checksum, then the
+*					serialized JournalState
+*	P.wal.N			log segments, numbered from 1, only those after the snapshot's are kept
+*
+* Events are appended where the change is made, inside the same lock where there is one, so the
+* log holds them in the order they took effect. Appending does not wait for the disk: call Sync
+* before telling anyone a change was made, e.g. once per batch of orders.
+*/
+class WarehouseJournal {
+private:
+	std::string prefix_;
+	WriteAheadLog log_;
+	uint64_t last_segment_;		// newest segment found by Recover
+
+	std::mutex compact_mutex_;	// protects sealed_ and stop_
+	std::condition_variable compact_cv_;
+	std::deque<uint64_t> sealed_;
+	bool stop_;
+	std::thread compactor_;
+	JournalState compacted_;	// snapshot state, only touched by the compactor once started
+	std::atomic<unsigned long> snapshots_;
+
+	JournalRecoveryStats recovery_;
+
+	struct SnapshotHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t segment;
+		uint64_t size;
+		uint32_t checksum;
+		uint32_t reserved;
+	};
+
+	std::string SnapshotPath() const {
+		return prefix_ + ".snapshot";
+	}
+
+	uint64_t Append(const std::string& event) {
+		return log_.Append(event.data(), event.size());
+	}
+
+	uint64_t Append(JournalEvent type, int a) {
+		char event[5];
+		event[0] = (char)type;
+		std::memcpy(event + 1, &a, 4);
+		return log_.Append(event, sizeof(event));
+	}
+
+	uint64_t Append(JournalEvent type, int a, int b) {
+		char event[9];
+		event[0] = (char)type;
+		std::memcpy(event + 1, &a, 4);
+		std::memcpy(event + 5, &b, 4);
+		return log_.Append(event, sizeof(event));
+	}
+
+	// Writes the snapshot file, replaced only once the new one is complete
+	bool WriteSnapshot(const JournalState& state, uint64_t segment) {
+		std::string body = state.Serialize();
+		SnapshotHeader header = {};
+		header.magic = JOURNAL_SNAPSHOT_MAGIC;
+		header.version = JOURNAL_SNAPSHOT_VERSION;
+		header.segment = segment;
+		header.size = body.size();
+		header.checksum = WriteAheadLog::Checksum(body.data(), body.size());
+
+		std::string temp = SnapshotPath() + ".tmp";
+		FILE* fout = std::fopen(temp.c_str(), "wb");
+		if (fout == nullptr) {
+			return false;
+		}
+		bool ok = std::fwrite(&header, sizeof(header), 1, fout) == 1
+			&& std::fwrite(body.data(), 1, body.size(), fout) == body.size()
+			&& std::fflush(fout) == 0;
+#ifdef WINDOWS
+		ok = ok && _commit(_fileno(fout)) == 0;
+#else
+		ok = ok && fsync(fileno(fout)) == 0;
+#endif
+		std::fclose(fout);
+		if (!ok) {
+			std::remove(temp.c_str());
+			return false;
+		}
+		std::remove(SnapshotPath().c_str());	// rename does not replace files on Windows
+		if (std::rename(temp.c_str(), SnapshotPath().c_str()) != 0) {
+			std::remove(temp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Folds a sealed segment into the snapshot, then deletes it
+	bool Compact(uint64_t segment) {
+		bool torn;
+		if (!WriteAheadLog::Replay(WriteAheadLog::SegmentPath(prefix_, segment),
+			[this](const char* event, size_t size) { compacted_.Apply(event, size); }, torn)) {
+			return false;
+		}
+		if (!WriteSnapshot(compacted_, segment)) {
+			LOG_ERROR("Journal: could not write %s", SnapshotPath());
+			return false;
+		}
+		std::remove(WriteAheadLog::SegmentPath(prefix_, segment).c_str());
+		snapshots_.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	void RunCompactor() {
+		std::unique_lock<std::mutex> lock(compact_mutex_);
+		for (;;) {
+			compact_cv_.wait(lock, [this]() { return stop_ || !sealed_.empty(); });
+			if (sealed_.empty()) {
+				break;
+			}
+			uint64_t segment = sealed_.front();
+			sealed_.pop_front();
+			lock.unlock();
+			bool ok = Compact(segment);
+			lock.lock();
+			if (!ok) {
+				sealed_.clear();	// later segments must not be folded in without this one, they stay on disk
+				break;
+			}
+		}
+	}
+
+	void Sealed(uint64_t segment) {
+		{
+			std::lock_guard<std::mutex> lock(compact_mutex_);
+			sealed_.push_back(segment);
+		}
+		compact_cv_.notify_one();
+	}
+
+public:
+	WarehouseJournal() : last_segment_(0), stop_(false), snapshots_(0) {}
+
+	WarehouseJournal(const WarehouseJournal&) = delete;
+	WarehouseJournal& operator=(const WarehouseJournal&) = delete;
+
+	~WarehouseJournal() {
+		Close();
+	}
+
+	/**
+	* Reads the state a previous run left: the snapshot, then every segment after it in order up to
+	* the first torn record
+	* @param prefix path prefix of the journal files
+	* @param state filled with the recovered state
+	* @return false if there is no journal to recover
+	*/
+	bool Recover(const std::string& prefix, JournalState& state) {
+		prefix_ = prefix;
+		recovery_ = JournalRecoveryStats();
+		state = JournalState();
+		auto start = std::chrono::steady_clock::now();
+
+		bool found = false;
+		std::ifstream fin(SnapshotPath(), std::ios::binary);
+		if (fin.is_open()) {
+			std::string data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+			SnapshotHeader header = {};
+			if (data.size() >= sizeof(header)) {
+				std::memcpy(&header, data.data(), sizeof(header));
+			}
+			const char* body = data.data() + sizeof(header);
+			if (header.magic != JOURNAL_SNAPSHOT_MAGIC || header.version != JOURNAL_SNAPSHOT_VERSION
+				|| data.size() - sizeof(header) != header.size
+				|| WriteAheadLog::Checksum(body, header.size) != header.checksum
+				|| !state.Deserialize(body, header.size)) {
+				LOG_ERROR("Journal: %s is damaged, it is left as is and nothing is logged", SnapshotPath());
+				state = JournalState();
+				recovery_.damaged = true;
+				return false;
+			}
+			recovery_.snapshot_segment = header.segment;
+			found = true;
+		}
+		auto loaded = std::chrono::steady_clock::now();
+
+		last_segment_ = recovery_.snapshot_segment;
+		for (uint64_t segment = recovery_.snapshot_segment + 1; !recovery_.torn; segment++) {
+			bool torn;
+			bool bad = false;
+			if (!WriteAheadLog::Replay(WriteAheadLog::SegmentPath(prefix_, segment),
+				[&](const char* event, size_t size) {
+					if (!bad && state.Apply(event, size)) {
+						recovery_.events++;
+					}
+					else {
+						bad = true;
+					}
+				}, torn)) {
+				break;
+			}
+			recovery_.segments++;
+			recovery_.torn = torn || bad;
+			last_segment_ = segment;
+			found = true;
+		}
+
+		auto replayed = std::chrono::steady_clock::now();
+		recovery_.snapshot_ms = std::chrono::duration<double, std::milli>(loaded - start).count();
+		recovery_.replay_ms = std::chrono::duration<double, std::milli>(replayed - loaded).count();
+		return found;
+	}
+
+	/**
+	* Starts logging on top of a state, which is written as the new snapshot first. Segments up to
+	* the newest one Recover found are then deleted, and so is anything after it that recovery did
+	* not replay, so call Recover first even for a new journal.
+	* @param state the warehouse state now, e.g. the recovered state once settled
+	* @return false if the snapshot or the log could not be written, or the old snapshot is damaged
+	*		 and would be lost, nothing is logged then
+	*/
+	bool Start(const JournalState& state) {
+		if (recovery_.damaged) {
+			return false;
+		}
+		if (!WriteSnapshot(state, last_segment_)) {
+			LOG_ERROR("Journal: could not write %s", SnapshotPath());
+			return false;
+		}
+		for (uint64_t segment = last_segment_; segment > 0; segment--) {
+			if (std::remove(WriteAheadLog::SegmentPath(prefix_, segment).c_str()) != 0) {
+				break;
+			}
+		}
+		// segments past a torn record were not replayed, the next recovery must not pick them up either
+		for (uint64_t segment = last_segment_ + 2; ; segment++) {
+			if (std::remove(WriteAheadLog::SegmentPath(prefix_, segment).c_str()) != 0) {
+				break;
+			}
+		}
+
+		compacted_ = state;
+		stop_ = false;
+		compactor_ = std::thread(&WarehouseJournal::RunCompactor, this);
+		if (!log_.Open(prefix_, last_segment_ + 1, [this](uint64_t segment) { Sealed(segment); })) {
+			LOG_ERROR("Journal: could not open %s", WriteAheadLog::SegmentPath(prefix_, last_segment_ + 1));
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	// Syncs the log and stops compacting, the open segment is replayed by the next Recover
+	void Close() {
+		log_.Close();
+		if (compactor_.joinable()) {
+			{
+				std::lock_guard<std::mutex> lock(compact_mutex_);
+				stop_ = true;
+			}
+			compact_cv_.notify_one();
+			compactor_.join();
+		}
+	}
+
+	uint64_t Store(int product_id, int slot) {
+		return Append(JOURNAL_STORE, product_id, slot);
+	}
+
+	uint64_t Reserve(int product_id, int quantity) {
+		return Append(JOURNAL_RESERVE, product_id, quantity);
+	}
+
+	uint64_t UnReserve(int product_id, int quantity) {
+		return Append(JOURNAL_UNRESERVE, product_id, quantity);
+	}
+
+	uint64_t Aquire(int product_id, int slot) {
+		return Append(JOURNAL_AQUIRE, product_id, slot);
+	}
+
+	uint64_t Free(int slot) {
+		return Append(JOURNAL_FREE, slot);
+	}
+
+	// Order is a template parameter only because Order.h comes after Storage.h, which logs here
+	template<typename OrderType>
+	uint64_t PlaceOrder(const OrderType& order, OrderStatus status) {
+		std::string event(1, (char)JOURNAL_ORDER);
+		JournalState::put32(event, order.ID_);
+		JournalState::put32(event, status);
+		JournalState::put32(event, (int)order.products_.size());
+		for (auto& product : order.products_) {
+			JournalState::put32(event, product.ID_);
+			JournalState::put32(event, product.quantity_);
+		}
+		return Append(event);
+	}
+
+	uint64_t SetStatus(int order_id, OrderStatus status) {
+		return Append(JOURNAL_ORDER_STATUS, order_id, status);
+	}
+
+	uint64_t EraseOrder(int order_id) {
+		return Append(JOURNAL_ORDER_ERASE, order_id);
+	}
+
+	// Waits until the events up to a log sequence number are on disk, false if the log failed
+	bool Sync(uint64_t lsn) {
+		return log_.Sync(lsn);
+	}
+
+	// Waits until every event appended so far is on disk, false if the log failed
+	bool Sync() {
+		return log_.Sync();
+	}
+
+	const JournalRecoveryStats& recoveryStats() const {
+		return recovery_;
+	}
+
+	unsigned long numEvents() const {
+		return log_.numRecords();
+	}
+
+	unsigned long numCommits() const {
+		return log_.numCommits();
+	}
+
+	// snapshots written by compaction since Start
+	unsigned long numSnapshots() const {
+		return snapshots_.load(std::memory_order_relaxed);
+	}
+};
+
+#endif
@@ -0,0 +1,290 @@
+/*
+*Description: Append-only log of records made durable by group commit. Appending only copies the record
+*			  into a buffer, one flusher thread writes whatever accumulated and fsyncs it in one go,
+*			  so threads waiting for their records to be durable share the cost of a sync. The log is
+*			  split into numbered segment files that are sealed once they pass WAL_SEGMENT_BYTES.
+*/
+
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <cpen333/os.h>
+#include "AsyncLog.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define WAL_SEGMENT_BYTES (4 << 20)		// a segment is sealed after the write that takes it past this
+#define WAL_RECORD_HEADER 8				// payload size and checksum, both uint32
+
+/**
+* Segment file layout, native byte order: records back to back, each as
+*	uint32 payload size
+*	uint32 checksum of the payload
+*	payload
+* A crash can leave the last record of the newest segment torn, replay stops there.
+*/
+class WriteAheadLog {
+private:
+	std::string prefix_;
+	FILE* file_;
+	uint64_t segment_;			// number of the segment being written
+	uint64_t segment_bytes_;	// written to it so far, only touched by the flusher
+
+	std::mutex mutex_;			// protects everything below
+	std::condition_variable flush_cv_;		// flusher waits for records
+	std::condition_variable durable_cv_;	// appenders wait for their sync
+	std::string buffer_;		// appended but not yet handed to the flusher
+	uint64_t appended_;			// bytes appended since Open, the log sequence number of the next record
+	uint64_t durable_;			// bytes written and synced since Open
+	bool stop_;
+	bool failed_;
+	std::thread flusher_;
+	std::function<void(uint64_t)> on_sealed_;
+
+	std::atomic<unsigned long> records_;
+	std::atomic<unsigned long> commits_;
+
+	static void put32(char* out, uint32_t value) {
+		std::memcpy(out, &value, sizeof(value));
+	}
+
+	static uint32_t get32(const char* in) {
+		uint32_t value;
+		std::memcpy(&value, in, sizeof(value));
+		return value;
+	}
+
+	static bool sync(FILE* file) {
+		if (std::fflush(file) != 0) {
+			return false;
+		}
+#ifdef WINDOWS
+		return _commit(_fileno(file)) == 0;
+#else
+		return fsync(fileno(file)) == 0;
+#endif
+	}
+
+	void flush() {
+		std::string batch;
+		std::unique_lock<std::mutex> lock(mutex_);
+		for (;;) {
+			flush_cv_.wait(lock, [this]() { return stop_ || !buffer_.empty(); });
+			if (buffer_.empty()) {
+				break;	// stopping with nothing left
+			}
+			batch.clear();
+			batch.swap(buffer_);
+			uint64_t end = appended_;
+			lock.unlock();
+
+			// everything appended while this write and sync run goes into the next batch
+			bool ok = std::fwrite(batch.data(), 1, batch.size(), file_) == batch.size() && sync(file_);
+			segment_bytes_ += batch.size();
+
+			uint64_t sealed = 0;
+			if (ok && segment_bytes_ >= WAL_SEGMENT_BYTES) {
+				std::fclose(file_);
+				sealed = segment_++;
+				segment_bytes_ = 0;
+				file_ = std::fopen(SegmentPath(prefix_, segment_).c_str(), "wb");
+				ok = file_ != nullptr;
+			}
+
+			lock.lock();
+			if (!ok && !failed_) {
+				LOG_ERROR("Write-ahead log: could not write %s", SegmentPath(prefix_, segment_));
+				failed_ = true;
+			}
+			durable_ = end;
+			commits_.fetch_add(1, std::memory_order_relaxed);
+			durable_cv_.notify_all();
+			if (failed_) {
+				break;
+			}
+			if (sealed != 0 && on_sealed_) {
+				lock.unlock();
+				on_sealed_(sealed);
+				lock.lock();
+			}
+		}
+		durable_ = appended_;
+		durable_cv_.notify_all();
+	}
+
+public:
+	WriteAheadLog() : file_(nullptr), segment_(0), segment_bytes_(0), appended_(0), durable_(0),
+		stop_(false), failed_(false), records_(0), commits_(0) {}
+
+	WriteAheadLog(const WriteAheadLog&) = delete;
+	WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+	~WriteAheadLog() {
+		Close();
+	}
+
+	static std::string SegmentPath(const std::string& prefix, uint64_t segment) {
+		return prefix + ".wal." + std::to_string(segment);
+	}
+
+	// FNV-1a, enough to tell a torn or garbled record from a complete one
+	static uint32_t Checksum(const char* data, size_t size) {
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+		}
+		return hash;
+	}
+
+	/**
+	* Starts appending to a segment and starts the flusher
+	* @param prefix path prefix of the segment files
+	* @param segment number of the first segment to write, emptied if it exists so nothing a crash
+	*		 left in it is replayed after the new records
+	* @param on_sealed called on the flusher thread with the number of each segment sealed
+	* @return false if the segment could not be opened
+	*/
+	bool Open(const std::string& prefix, uint64_t segment, std::function<void(uint64_t)> on_sealed = nullptr) {
+		Close();
+		file_ = std::fopen(SegmentPath(prefix, segment).c_str(), "wb");
+		if (file_ == nullptr) {
+			return false;
+		}
+		prefix_ = prefix;
+		segment_ = segment;
+		segment_bytes_ = 0;
+		on_sealed_ = on_sealed;
+		appended_ = 0;
+		durable_ = 0;
+		stop_ = false;
+		failed_ = false;
+		flusher_ = std::thread(&WriteAheadLog::flush, this);
+		return true;
+	}
+
+	// Writes and syncs everything appended, then closes the segment
+	void Close() {
+		if (!flusher_.joinable()) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		flush_cv_.notify_one();
+		flusher_.join();
+		if (file_ != nullptr) {
+			std::fclose(file_);
+			file_ = nullptr;
+		}
+	}
+
+	bool isOpen() const {
+		return file_ != nullptr;
+	}
+
+	/**
+	* Appends a record, does not wait for it to be written
+	* @return log sequence number to pass to Sync to wait for the record
+	*/
+	uint64_t Append(const char* payload, size_t size) {
+		char header[WAL_RECORD_HEADER];
+		put32(header, (uint32_t)size);
+		put32(header + 4, Checksum(payload, size));
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (failed_) {
+			return appended_;	// nothing is written any more, Sync reports the failure
+		}
+		bool idle = buffer_.empty();
+		buffer_.append(header, WAL_RECORD_HEADER);
+		buffer_.append(payload, size);
+		appended_ += WAL_RECORD_HEADER + size;
+		records_.fetch_add(1, std::memory_order_relaxed);
+		if (idle) {
+			flush_cv_.notify_one();
+		}
+		return appended_;
+	}
+
+	/**
+	* Waits until the records up to a log sequence number are on disk
+	* @return false if the log failed to write, the records may then be lost
+	*/
+	bool Sync(uint64_t lsn) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		durable_cv_.wait(lock, [&]() { return durable_ >= lsn || failed_; });
+		return !failed_;
+	}
+
+	// Waits until everything appended so far is on disk
+	bool Sync() {
+		uint64_t lsn;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			lsn = appended_;
+		}
+		return Sync(lsn);
+	}
+
+	// records appended since Open
+	unsigned long numRecords() const {
+		return records_.load(std::memory_order_relaxed);
+	}
+
+	// write and sync rounds since Open, records per commit is the group commit batch size
+	unsigned long numCommits() const {
+		return commits_.load(std::memory_order_relaxed);
+	}
+
+	/**
+	* Reads the records of a segment file in order
+	* @param path segment file
+	* @param record called with each record's payload
+	* @param torn set if the file ends in an incomplete or corrupt record, which is not passed on
+	* @return false if the file could not be opened
+	*/
+	static bool Replay(const std::string& path, std::function<void(const char*, size_t)> record, bool& torn) {
+		torn = false;
+		std::ifstream fin(path, std::ios::binary);
+		if (!fin.is_open()) {
+			return false;
+		}
+		std::string data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+		size_t pos = 0;
+		while (pos < data.size()) {
+			if (data.size() - pos < WAL_RECORD_HEADER) {
+				torn = true;
+				break;
+			}
+			uint32_t size = get32(&data[pos]);
+			uint32_t checksum = get32(&data[pos + 4]);
+			if (data.size() - pos - WAL_RECORD_HEADER < size
+				|| Checksum(&data[pos + WAL_RECORD_HEADER], size) != checksum) {
+				torn = true;
+				break;
+			}
+			record(&data[pos + WAL_RECORD_HEADER], size);
+			pos += WAL_RECORD_HEADER + size;
+		}
+		return true;
+	}
+};
+
+#endif
@@ -25,10 +25,14 @@
 #include <string>
 #include <chrono>
 
+#include "../os.h"
 #include "named_resource.h"
 #include "shared_memory.h"
 #include "mutex.h"
 #include "semaphore.h"
+#ifdef LINUX
+#include "impl/linux/futex.h"
+#endif
 
 namespace cpen333 {
 namespace process {
@@ -37,7 +41,12 @@ namespace process {
  * @brief Simple thread-safe multi-process first-in-first-out queue using a circular buffer.
  *
  * The buffer can only contain a single type of object.  Push will block until space is available
- * in the queue.  Pop will block until there is an item in the queue.
+ * in the queue.  Pop will block until there is an item in the queue.  push_n() and pop_n() move a batch
+ * of items with one semaphore operation and one lock on each side.
+ *
+ * On Linux the semaphores and mutexes are futexes kept in the shared memory itself, so a push or pop
+ * only makes a system call when the other side is asleep or the lock is contended.  Elsewhere they are
+ * named semaphores and mutexes.
  * @tparam ValueType type of data to store in the queue
  */
 template<typename ValueType>
@@ -56,23 +65,33 @@ class fifo : public virtual named_resource {
    */
   fifo(const std::string& name, size_t size = 1024) :
       memory_(name + std::string(FIFO_SUFFIX), sizeof(fifo_info)+size*sizeof(ValueType)), // reserve memory
-      info_(nullptr), data_(nullptr), // will initialize these after memory valid
+      // info is at start of memory block, followed by the actual data in the fifo
+      info_((fifo_info*)memory_.get()),
+      data_((ValueType*)memory_.get(sizeof(fifo_info))),
+#ifdef LINUX
+      // zero-filled new memory holds unlocked mutexes, the semaphores are set below
+      pmutex_(&info_->pmutex),
+      cmutex_(&info_->cmutex),
+      psem_(&info_->psem),
+      csem_(&info_->csem) {
+#else
       pmutex_(name + std::string(FIFO_PRODUCER_SUFFIX)),
       cmutex_(name + std::string(FIFO_CONSUMER_SUFFIX)),
       psem_(name + std::string(FIFO_PRODUCER_SUFFIX), size),  // start at size of fifo
       csem_(name + std::string(FIFO_CONSUMER_SUFFIX), 0) {    // start at zero
-
-    // info is at start of memory block, followed by the actual data in the fifo
-    info_ = (fifo_info*)memory_.get();
-    data_ = (ValueType*)memory_.get(sizeof(fifo_info));  // start of fifo data is after fifo info
+#endif
 
     // protect memory with a mutex (either one) to check if data is initialized, and initialize if not
     // This is only to stop multiple constructors from simultaneously trying to initialize data
-    std::lock_guard<cpen333::process::mutex> lock(pmutex_);
+    std::lock_guard<mutex_type> lock(pmutex_);
     if (info_->initialized != FIFO_INITIALIZED) {
       info_->pidx = 0;
       info_->cidx = 0;
       info_->size = size;
+#ifdef LINUX
+      psem_.init(size);  // start at size of fifo
+      csem_.init(0);     // start at zero
+#endif
       info_->initialized = FIFO_INITIALIZED;  // mark initialized
     }
   }
@@ -83,11 +102,46 @@ class fifo : public virtual named_resource {
    */
   void push(const ValueType &val) {
     psem_.wait();   // wait until room to push
-    push_item(val);
+    push_items(&val, 1);
     csem_.notify(); // let consumer know a item is available
 
   }
 
+  /**
+   * @brief Adds several items to the fifo, in order
+   *
+   * Blocks until all items are added.  Items are added in as few batches as the free space allows, each with a
+   * single semaphore operation per side and a single lock.  Items of other producers may be interleaved between
+   * batches.
+   *
+   * @param vals items to add
+   * @param n number of items
+   */
+  void push_n(const ValueType* vals, size_t n) {
+    while (n > 0) {
+      size_t k = psem_.wait_n(n);  // wait until room for at least one, take room for up to n
+      push_items(vals, k);
+      csem_.notify_n(k);
+      vals += k;
+      n -= k;
+    }
+  }
+
+  /**
+   * @brief Adds as many of several items as fit without blocking, in order
+   * @param vals items to add
+   * @param n number of items
+   * @return number of items added, the first ones of `vals`
+   */
+  size_t try_push_n(const ValueType* vals, size_t n) {
+    size_t k = psem_.try_wait_n(n);
+    if (k > 0) {
+      push_items(vals, k);
+      csem_.notify_n(k);
+    }
+    return k;
+  }
+
   /**
    * @brief Tries to add an item to the fifo without blocking
    *
@@ -102,7 +156,7 @@ class fifo : public virtual named_resource {
     if (!psem_.try_wait()) {
       return false;
     }
-    push_item(val);
+    push_items(&val, 1);
     csem_.notify();  // let consumer know a item is available
     return true;
   }
@@ -142,7 +196,7 @@ class fifo : public virtual named_resource {
     if (!psem_.wait_until(timeout)) {
       return false;
     }
-    push_item(val);
+    push_items(&val, 1);
     csem_.notify();  // let consumer know a item is available
     return true;
   }
@@ -157,10 +211,42 @@ class fifo : public virtual named_resource {
    */
   void pop(ValueType* out) {
     csem_.wait();      // wait until item available
-    pop_item(out);
+    pop_items(out, 1);
     psem_.notify();    // let producer know that we are done with the slot
   }
 
+  /**
+   * @brief Removes up to `n` items from the fifo
+   *
+   * Blocks until at least one item is available, then removes as many as are available up to `n` with a
+   * single semaphore operation per side and a single lock.
+   *
+   * @param out destination for at least `n` items.  If `nullptr`, items are removed but not returned.
+   * @param n maximum number of items to remove
+   * @return number of items removed
+   */
+  size_t pop_n(ValueType* out, size_t n) {
+    size_t k = csem_.wait_n(n);
+    pop_items(out, k);
+    psem_.notify_n(k);
+    return k;
+  }
+
+  /**
+   * @brief Removes up to `n` items from the fifo without blocking
+   * @param out destination for at least `n` items.  If `nullptr`, items are removed but not returned.
+   * @param n maximum number of items to remove
+   * @return number of items removed, 0 if the fifo is empty
+   */
+  size_t try_pop_n(ValueType* out, size_t n) {
+    size_t k = csem_.try_wait_n(n);
+    if (k > 0) {
+      pop_items(out, k);
+      psem_.notify_n(k);
+    }
+    return k;
+  }
+
   /**
    * @brief Removes and returns the next item in the fifo
    *
@@ -188,7 +274,7 @@ class fifo : public virtual named_resource {
     if (!csem_.try_wait()) {
       return false;
     } 
-    pop_item(out);
+    pop_items(out, 1);
     psem_.notify();    // let producer know that we are done with the slot
     return true;
   }
@@ -229,7 +315,7 @@ class fifo : public virtual named_resource {
     if (!csem_.wait_until(timeout)) {
       return false;
     }
-    pop_item(out);
+    pop_items(out, 1);
     psem_.notify();  // let consumer know a item is available
     return true;
   }
@@ -246,6 +332,7 @@ class fifo : public virtual named_resource {
   void peek(ValueType* out) {
     csem_.wait();      // wait until item available
     peek_item(out);
+    csem_.notify();    // item stays in the fifo
   }
 
   /**
@@ -278,6 +365,7 @@ class fifo : public virtual named_resource {
       return false;
     }
     peek_item(out);
+    csem_.notify();    // item stays in the fifo
     return true;
   }
 
@@ -319,6 +407,7 @@ class fifo : public virtual named_resource {
       return false;
     }
     peek_item(out);
+    csem_.notify();    // item stays in the fifo
     return true;
   }
 
@@ -331,8 +420,8 @@ class fifo : public virtual named_resource {
    * @return number of items
    */
   size_t size() {
-    std::lock_guard<cpen333::process::mutex> lock1(pmutex_);
-    std::lock_guard<cpen333::process::mutex> lock2(cmutex_);
+    std::lock_guard<mutex_type> lock1(pmutex_);
+    std::lock_guard<mutex_type> lock2(cmutex_);
 
     if (info_->pidx < info_->cidx) {
       return info_->size - info_->cidx+info_->pidx;
@@ -349,56 +438,96 @@ class fifo : public virtual named_resource {
    * @return `true` if empty, `false` otherwise
    */
   bool empty() {
-    std::lock_guard<cpen333::process::mutex> lock1(pmutex_);
-    std::lock_guard<cpen333::process::mutex> lock2(cmutex_);
+    std::lock_guard<mutex_type> lock1(pmutex_);
+    std::lock_guard<mutex_type> lock2(cmutex_);
     return info_->pidx == info_->cidx;
   }
 
   bool unlink() {
+#ifdef LINUX
+    return memory_.unlink();  // nothing else is named
+#else
     bool b1 = memory_.unlink();
     bool b2 = pmutex_.unlink();
     bool b3 = cmutex_.unlink();
     bool b4 = psem_.unlink();
     bool b5 = csem_.unlink();
     return b1 && b2 && b3 && b4 && b5;
+#endif
   }
 
   /**
    * @copydoc cpen333::process::named_resource::unlink(const std::string&)
    */
   static bool unlink(const std::string& name) {
+#ifdef LINUX
+    return cpen333::process::shared_memory::unlink(name + std::string(FIFO_SUFFIX));
+#else
     bool b1 = cpen333::process::shared_memory::unlink(name + std::string(FIFO_SUFFIX));
     bool b2 = cpen333::process::mutex::unlink(name + std::string(FIFO_PRODUCER_SUFFIX));
     bool b3 = cpen333::process::mutex::unlink(name + std::string(FIFO_CONSUMER_SUFFIX));
     bool b4 = cpen333::process::semaphore::unlink(name + std::string(FIFO_PRODUCER_SUFFIX));
     bool b5 = cpen333::process::semaphore::unlink(name + std::string(FIFO_CONSUMER_SUFFIX));
     return b1 && b2 && b3 && b4 && b5;
+#endif
   }
 
  private:
 
+#ifdef LINUX
+  typedef cpen333::process::impl::futex_mutex mutex_type;
+  typedef cpen333::process::impl::futex_semaphore semaphore_type;
+#else
+  typedef cpen333::process::mutex mutex_type;
+
+  // named semaphore with the batch operations of the futex one, one count at a time
+  class semaphore_type : public cpen333::process::semaphore {
+   public:
+    semaphore_type(const std::string& name, size_t value) : cpen333::process::semaphore(name, value) {}
+
+    size_t try_wait_n(size_t n) {
+      size_t k = 0;
+      while (k < n && try_wait()) {
+        ++k;
+      }
+      return k;
+    }
+
+    size_t wait_n(size_t n) {
+      if (n == 0) {
+        return 0;
+      }
+      wait();
+      return 1 + try_wait_n(n-1);
+    }
+
+    void notify_n(size_t n) {
+      for (size_t i = 0; i < n; ++i) {
+        notify();
+      }
+    }
+  };
+#endif
+
   // only to be called internally, does not wait for semaphore
-  void push_item(const ValueType &val) {
-    size_t loc = 0;
-    {
-      // look at index, protect memory from multiple simultaneous pushes
-      std::lock_guard<cpen333::process::mutex> lock(pmutex_);
-      loc = info_->pidx;
+  void push_items(const ValueType* vals, size_t n) {
+    // look at index, protect memory from multiple simultaneous pushes
+    std::lock_guard<mutex_type> lock(pmutex_);
+    for (size_t i = 0; i < n; ++i) {
+      data_[info_->pidx] = vals[i];  // add item to fifo
       // increment producer index for next item, wrap around if at end
       if ((++info_->pidx) == info_->size) {
         info_->pidx = 0;
       }
-      // copy data to correct location
-      data_[loc] = val;  // add item to fifo
-      // lock will unlock here as guard runs out of scope
     }
+    // lock will unlock here as guard runs out of scope
   }
 
   void peek_item(ValueType* val) {
     size_t loc = 0;  // will store location of item to take
     {
       // look at index, protect memory from multiple simultaneous pops
-      std::lock_guard<cpen333::process::mutex> lock(cmutex_);
+      std::lock_guard<mutex_type> lock(cmutex_);
       loc = info_->cidx;
       // copy data to output
       if (val != nullptr) {
@@ -408,23 +537,20 @@ class fifo : public virtual named_resource {
     }
   }
 
-  void pop_item(ValueType* val) {
-    size_t loc = 0;  // will store location of item to take
-    {
-      // look at index, protect memory from multiple simultaneous pops
-      std::lock_guard<cpen333::process::mutex> lock(cmutex_);
-      loc = info_->cidx;
-
+  void pop_items(ValueType* vals, size_t n) {
+    // look at index, protect memory from multiple simultaneous pops
+    std::lock_guard<mutex_type> lock(cmutex_);
+    for (size_t i = 0; i < n; ++i) {
+      // copy data to output
+      if (vals != nullptr) {
+        vals[i] = data_[info_->cidx];  // copy item
+      }
       // increment consumer index for next item, wrap around if at end
-      if ( (++info_->cidx) == info_->size) {
+      if ((++info_->cidx) == info_->size) {
         info_->cidx = 0;
       }
-      // copy data to output
-      if (val != nullptr) {
-        *val = data_[loc];  // copy item
-      }
-      // lock will unlock here as guard runs out of scope
     }
+    // lock will unlock here as guard runs out of scope
   }
 
   struct fifo_info {
@@ -432,15 +558,21 @@ class fifo : public virtual named_resource {
     size_t cidx;      // consumer index
     size_t size;      // size (in counts of ValueType)
     size_t initialized;  // magic initialized marker
+#ifdef LINUX
+    cpen333::process::impl::futex_mutex::shared_data pmutex;
+    cpen333::process::impl::futex_mutex::shared_data cmutex;
+    cpen333::process::impl::futex_semaphore::shared_data psem;
+    cpen333::process::impl::futex_semaphore::shared_data csem;
+#endif
   };
 
   cpen333::process::shared_memory memory_;   // actual memory
   fifo_info* info_;                         // pointer to fifo information, will be at start of memory_
   ValueType* data_;                        // pointer to data in fifo, after info_ in memory
-  cpen333::process::mutex pmutex_;           // mutex for protecting memory modified by producers
-  cpen333::process::mutex cmutex_;           // mutex for protecting memory modified by consumers
-  cpen333::process::semaphore psem_;         // semaphore controlling when producer can add an item
-  cpen333::process::semaphore csem_;         //     "            "         consumer can remove an item
+  mutex_type pmutex_;                       // mutex for protecting memory modified by producers
+  mutex_type cmutex_;                       // mutex for protecting memory modified by consumers
+  semaphore_type psem_;                     // semaphore controlling when producer can add an item
+  semaphore_type csem_;                     //     "            "         consumer can remove an item
 
 };
 
@@ -0,0 +1,222 @@
+/**
+ * @file
+ * @brief Mutex and counting semaphore built on Linux futexes, for use inside shared memory
+ */
+#ifndef CPEN333_PROCESS_LINUX_FUTEX_H
+#define CPEN333_PROCESS_LINUX_FUTEX_H
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace cpen333 {
+namespace process {
+namespace impl {
+
+/**
+ * @brief Sleeps while a shared 32-bit word holds an expected value
+ * @param word futex word, may be in memory shared between processes
+ * @param expected value to sleep on, returns immediately if the word already differs
+ * @param timeout absolute timeout time, `nullptr` to wait without a timeout
+ * @return `false` if the timeout time has passed
+ */
+template<typename Clock, typename Duration>
+bool futex_wait(std::atomic<int32_t>* word, int32_t expected,
+                const std::chrono::time_point<Clock,Duration>* timeout) {
+  static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t), "futex needs a plain 32-bit word");
+  struct timespec ts;
+  struct timespec* rel = nullptr;
+  if (timeout != nullptr) {
+    auto left = *timeout - Clock::now();
+    if (left <= Clock::duration::zero()) {
+      return false;
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+    ts.tv_sec = (time_t)(ns / 1000000000);
+    ts.tv_nsec = (long)(ns % 1000000000);
+    rel = &ts;
+  }
+  // not FUTEX_*_PRIVATE, the word may be mapped by other processes
+  syscall(SYS_futex, reinterpret_cast<int32_t*>(word), FUTEX_WAIT, expected, rel, nullptr, 0);
+  return true;
+}
+
+/**
+ * @brief Wakes up to `count` threads or processes sleeping on a futex word
+ */
+inline void futex_wake(std::atomic<int32_t>* word, int32_t count) {
+  syscall(SYS_futex, reinterpret_cast<int32_t*>(word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+/**
+ * @brief Mutex whose state lives in shared memory
+ *
+ * Locking and unlocking only make a system call when another thread or process is waiting.  Zero-filled
+ * memory is an unlocked mutex.  The object itself only refers to the state, so each process constructs its own.
+ */
+class futex_mutex {
+ public:
+  /**
+   * @brief State in shared memory: 0 unlocked, 1 locked, 2 locked with possible waiters
+   */
+  typedef std::atomic<int32_t> shared_data;
+
+  /**
+   * @brief Refers to a mutex state
+   * @param data state in shared memory
+   */
+  futex_mutex(shared_data* data) : data_(data) {}
+
+  void lock() {
+    int32_t c = 0;
+    if (data_->compare_exchange_strong(c, 1)) {
+      return;
+    }
+    if (c != 2) {
+      c = data_->exchange(2);
+    }
+    while (c != 0) {
+      futex_wait<std::chrono::steady_clock, std::chrono::steady_clock::duration>(data_, 2, nullptr);
+      c = data_->exchange(2);
+    }
+  }
+
+  bool try_lock() {
+    int32_t c = 0;
+    return data_->compare_exchange_strong(c, 1);
+  }
+
+  void unlock() {
+    if (data_->fetch_sub(1) != 1) {
+      data_->store(0);
+      futex_wake(data_, 1);
+    }
+  }
+
+ private:
+  shared_data* data_;
+};
+
+/**
+ * @brief Counting semaphore whose state lives in shared memory, with batch wait and notify
+ *
+ * Waiting while the count is positive and notifying while no one waits stay in user space.  Zero-filled
+ * memory is a semaphore with a count of zero.  The object itself only refers to the state, so each process
+ * constructs its own.
+ */
+class futex_semaphore {
+ public:
+  /**
+   * @brief State in shared memory
+   */
+  struct shared_data {
+    std::atomic<int32_t> value;     ///< count, the futex word
+    std::atomic<int32_t> waiters;   ///< threads asleep or about to sleep on value
+  };
+
+  /**
+   * @brief Refers to a semaphore state
+   * @param data state in shared memory
+   */
+  futex_semaphore(shared_data* data) : data_(data) {}
+
+  /**
+   * @brief Sets the count, only to be used while no one else can use the semaphore
+   */
+  void init(size_t value) {
+    data_->value.store((int32_t)value);
+    data_->waiters.store(0);
+  }
+
+  /**
+   * @brief Takes up to `n` counts without blocking
+   * @return number of counts taken
+   */
+  size_t try_wait_n(size_t n) {
+    int32_t v = data_->value.load(std::memory_order_relaxed);
+    while (v > 0 && n > 0) {
+      int32_t k = n < (size_t)v ? (int32_t)n : v;
+      if (data_->value.compare_exchange_weak(v, v - k, std::memory_order_acquire, std::memory_order_relaxed)) {
+        return (size_t)k;
+      }
+    }
+    return 0;
+  }
+
+  /**
+   * @brief Blocks until the count is positive, then takes up to `n` counts
+   * @param timeout absolute timeout time, `nullptr` to wait without a timeout
+   * @return number of counts taken, 0 if the timeout time passed first
+   */
+  template<typename Clock, typename Duration>
+  size_t wait_n_until(size_t n, const std::chrono::time_point<Clock,Duration>* timeout) {
+    for (;;) {
+      size_t k = try_wait_n(n);
+      if (k > 0 || n == 0) {
+        return k;
+      }
+      // either notify_n sees us in waiters, or its new count is seen by futex_wait
+      data_->waiters.fetch_add(1);
+      bool waited = futex_wait(&data_->value, 0, timeout);
+      data_->waiters.fetch_sub(1);
+      if (!waited) {
+        return try_wait_n(n);
+      }
+    }
+  }
+
+  size_t wait_n(size_t n) {
+    return wait_n_until<std::chrono::steady_clock, std::chrono::steady_clock::duration>(n, nullptr);
+  }
+
+  void wait() {
+    wait_n(1);
+  }
+
+  bool try_wait() {
+    return try_wait_n(1) == 1;
+  }
+
+  template<typename Clock, typename Duration>
+  bool wait_until(const std::chrono::time_point<Clock,Duration>& timeout) {
+    return wait_n_until(1, &timeout) == 1;
+  }
+
+  /**
+   * @brief Adds `n` counts, waking up to `n` waiters
+   */
+  void notify_n(size_t n) {
+    if (n == 0) {
+      return;
+    }
+    data_->value.fetch_add((int32_t)n);
+    if (data_->waiters.load() > 0) {
+      futex_wake(&data_->value, n < INT_MAX ? (int32_t)n : INT_MAX);
+    }
+  }
+
+  void notify() {
+    notify_n(1);
+  }
+
+  /**
+   * @brief Current count, which may change immediately after the call
+   */
+  size_t value() const {
+    return (size_t)data_->value.load();
+  }
+
+ private:
+  shared_data* data_;
+};
+
+} // impl
+} // process
+} // cpen333
+
+#endif //CPEN333_PROCESS_LINUX_FUTEX_H
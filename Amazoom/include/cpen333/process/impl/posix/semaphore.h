@@ -163,7 +163,7 @@ class semaphore : public impl::named_resource_base {
    */
   template< class Rep, class Period >
   bool wait_for( const std::chrono::duration<Rep,Period>& timeout_duration ) {
-    return wait_until(std::chrono::steady_clock::now()+timeout_duration);
+    return wait_until(std::chrono::system_clock::now()+timeout_duration);
   }
 
   /**
@@ -179,7 +179,8 @@ class semaphore : public impl::named_resource_base {
    */
   template< class Clock, class Duration >
   bool wait_until( const std::chrono::time_point<Clock,Duration>& timeout_time ) {
-    auto duration = timeout_time.time_since_epoch();
+    // sem_timedwait takes a CLOCK_REALTIME time, so a time from any other clock is moved onto the system clock
+    auto duration = (std::chrono::system_clock::now() + (timeout_time - Clock::now())).time_since_epoch();
     auto sec = std::chrono::duration_cast<std::chrono::seconds>(duration);
     timespec ts;
     ts.tv_sec = sec.count();
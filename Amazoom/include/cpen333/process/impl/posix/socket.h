@@ -449,6 +449,14 @@ class socket_server {
     return port_;
   }
 
+  /**
+   * @brief Listening socket descriptor, e.g. for registering with epoll
+   * @return descriptor, INVALID_SOCKET if the server is not open
+   */
+  int native_handle() {
+    return socket_;
+  }
+
   /**
    * @copydoc cpen333::process::windows::socket_server::address_lookup()
    */
@@ -0,0 +1,27 @@
+/*
+*Description: Prints a binary log file written by AsyncLog as text, one line per record. Not part of the
+*			  warehouse build, compile on its own:
+*				g++ -std=c++14 -pthread logdecode.cpp -o logdecode
+*			  Usage: logdecode amazoom.alog
+*/
+
+#include "AsyncLog.h"
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+	if (argc != 2) {
+		std::cerr << "Usage: " << argv[0] << " <log file>" << std::endl;
+		return 2;
+	}
+	std::ifstream in(argv[1], std::ios::binary);
+	if (!in.is_open()) {
+		std::cerr << "Could not open " << argv[1] << std::endl;
+		return 1;
+	}
+	if (!AsyncLog::Decode(in, std::cout)) {
+		std::cerr << argv[1] << " is not a log file or ends in the middle of a record" << std::endl;
+		return 1;
+	}
+	return 0;
+}
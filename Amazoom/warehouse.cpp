@@ -10,6 +10,7 @@
 
 int main() {
 
+	AsyncLog::OpenFile("amazoom.alog");
 	Warehouse Amazoom;
 
 	Amazoom.CreateRobotArmy(4);
@@ -22,15 +23,19 @@ int main() {
 		report = Amazoom.AddOrder(ord);
 
 		if (report.verified) {
-			std::cout << "Succesfully verified and reserved order!! " << ord.toString() << std::endl;
+			LOG_INFO("Succesfully verified and reserved order %d with %zu products", ord.ID_, ord.products_.size());
+		}
+		else if (report.duplicate) {
+			LOG_INFO("Order ID %d was already placed.", ord.ID_);
 		}
 		else {
-			std::cout << "Failed to verify order! Product ID: " << report.product << "Quantity Available: " << std::to_string(report.quantity) << std::endl;
+			LOG_WARN("Failed to verify order! Product ID: %d Quantity Available: %d", report.product.ID_, report.quantity);
 		}
 	}
 	
 	Amazoom.KillRobots();
 
+	AsyncLog::Flush();
 	std::cin.get();
 	return 0;
 }
@@ -16,60 +16,97 @@
 #include <string>
 #include <map>
 #include "Inventory.h"
+#include "InventoryTable.h"
 #include "Robot.h"
 #include "OrderQueue.h"
+#include "RobotScheduler.h"
+#include "OrderBatcher.h"
+#include "OrderStore.h"
 #include "Storage.h"
+#include "RoutePlanner.h"
+#include "SimClock.h"
 #include "Trucks.h"
 #include <cpen333/thread/semaphore.h>
 #include "LoadingBay.h"
 #include "ManagersUI.h"
+#include "ProductCatalog.h"
+#include "WarehouseJournal.h"
+#include "OrderChannel.h"
+#include "AsyncLog.h"
 
 #define NUM_PRODUCTS_INIT 20
-#define ID_FILE_IDENTIFIER "ID"
-#define NAME_FILE_IDENTIFIER "name"
-#define PRICE_FILE_IDENTIFIER "price"
-#define WEIGHT_FILE_IDENTIFIER "weight"
 #define PRODUCT_DESCRIPTION_FILE "Products.txt"
+#define PRODUCT_CATALOG_FILE "Products.bin"	// compiled from PRODUCT_DESCRIPTION_FILE
 
 
 class Warehouse {
 private:
+	std::unique_ptr<SimClock> clock_; // everything below may use it, keep declared first
+	WarehouseJournal journal_; // everything below may log to it, keep declared before them
+	bool journaling_;
+	std::mt19937 rnd_;
 	Storage StorageUnits_;
+	RoutePlanner planner_; // built from StorageUnits_ floor map, keep declared after it
 	bool quit_all;
-	/*TruckHandler* truck_handler;
-
-	LoadingBay Delivery_bay;*/
+	int driver_; // the owning thread's participant id on the clock, -1 once it let go of simulated time
+	TruckHandler truck_handler_; // delivery trucks at the floor map's bays
 	//ManagerUI* ui;
 
 	RobotOrderQueue order_queue;
+	RobotScheduler scheduler_; // spreads order_queue over the robots
+	OrderBatcher order_batcher; // groups orders into robot trips, feeds scheduler_
 	std::vector<Robot*> robots_;
 
 	//std::map<int, bool> low_stock; // if true then the product is low stock
-	std::map<int, int> Inventory_ptr; //maps product id to inventory
-	std::vector<Inventory> Inventories_;
+	InventoryTable Inventories_; //maps product id to inventory
 
+	ProductCatalog catalog_; // products of the description file, mapped read-only
+	std::mutex product_mutex; // protects the products below
 	std::map<int, int> Product_ptr;
-	std::vector<Product> Products_;
+	std::vector<Product> Products_; // products added while running, or all of them if there is no catalog_
 
-	std::mutex order_mutex;
-	std::map<int, int> Order_ptr; // maps the order to an order id
-	std::vector<Order> Orders_;
+	OrderStore orders_; // every placed order by order id
+	std::unique_ptr<OrderChannelReader> order_channel_; // orders from other processes on this host, if open
 
 public:
-	Warehouse(){
+	/**
+	* @param mode real time, sped up or discrete event simulation
+	* @param seed seeds stock, order and shelf placement generation, runs with the same seed and a
+	*		 DISCRETE_EVENT_CLOCK behave the same. Simulated time then only moves in RunFor(),
+	*		 RunUntilIdle() and KillRobots(), so orders placed in between arrive at the same time
+	* @param scale speed up used by SCALED_CLOCK
+	* @param journal path prefix of the journal files to recover from and log to, empty to keep
+	*		 everything in memory and start with generated stock
+	*/
+	Warehouse(ClockMode mode = REAL_TIME_CLOCK, unsigned int seed = (unsigned int)time(NULL), double scale = SCALED_CLOCK_FACTOR,
+		const std::string& journal = "")
+		: clock_(MakeClock(mode, scale)), journaling_(false), rnd_(seed), planner_(StorageUnits_), truck_handler_(*clock_, StorageUnits_), scheduler_(order_queue, StorageUnits_, *clock_),
+		order_batcher(scheduler_, *clock_, ROBOT_MAX_CAPACITY) {
+		StorageUnits_.Seed(seed);
 		InitWarehouse();
-		InitInventories();
+		if (journal.empty()) {
+			InitInventories();
+		}
+		else {
+			OpenJournal(journal);
+		}
 		quit_all = false;
-		/*ui = new ManagerUI(Orders_, Orderptr, order_mutex, Products_, Product_ptr, Inventories_, Inventory_ptr, quit_all);
+		// the creating thread holds simulated time like any other participant, see RunFor()
+		driver_ = clock_->AddParticipant();
+		order_batcher.start();
+		truck_handler_.start();
+		clock_->Begin(driver_);
+		/*ui = new ManagerUI(orders_, Products_, Product_ptr, Inventories_, quit_all);
 
 		ui->start();*/
-		//truck_handler = new TruckHandler(Products_, quit_all, Delivery_bay);
-		//loading_bay = new LoadingBay(Products_, quit_all);
-		//truck_handler->start();
 	}
 
 	~Warehouse(){
 		//KillRobots();
+		CloseOrderChannel();
+		ReleaseClock();
+		order_batcher.stop();
+		truck_handler_.stop();
 		// Free memory
 		for (auto& robot : robots_) {
 			delete robot;
@@ -81,9 +118,10 @@ public:
 	}
 
 	void CreateRobotArmy(int nrobots) {
+		nrobots = std::min(nrobots, SCHEDULER_MAX_ROBOTS - (int)robots_.size());
 
 		for (int i = 0; i<nrobots; ++i) {
-			robots_.push_back(new Robot(order_queue, i, StorageUnits_,Order_ptr,Orders_,order_mutex,Inventory_ptr,Inventories_) );
+			robots_.push_back(new Robot(scheduler_, order_batcher, *clock_, i, StorageUnits_, planner_, orders_, Inventories_, truck_handler_) );
 		}
 
 		//creating robots
@@ -94,46 +132,87 @@ public:
 	}
 
 	std::vector<Product> getProducts() {
-		return Products_;
+		std::vector<Product> out;
+		out.reserve(catalog_.size());
+		for (int i = 0; i < catalog_.size(); i++) {
+			out.push_back(catalog_.product(i));
+		}
+		std::lock_guard<std::mutex> mylock(product_mutex);
+		out.insert(out.end(), Products_.begin(), Products_.end());
+		return out;
 	}
 
 	//Sets a shared bool for all threads to quit and waits for them to join.
 	void KillAllThreads() {
 		KillRobots();
 		quit_all = true;
-		
-		//truck_handler->join();
-		//std::cout << "Truck handler quit." << std::endl;
 	}
 
-	//Closes the robot threads by putting a poisen pill in the queue
-	void KillRobots(){
-
-		Order kill_order;
-		kill_order.task_ = RobotTask::QUIT;
+	//Lets simulated time run for ms. Call from the thread that created the warehouse.
+	void RunFor(double ms) {
+		if (driver_ >= 0) {
+			clock_->sleep_for(driver_, ms);
+		}
+	}
 
-		for (size_t i = 0; i < robots_.size(); ++i) {
-			order_queue.add(kill_order);
+	//Lets simulated time run until the robots, the batcher and the dock have nothing left to do,
+	//returns straight away unless the clock is a DISCRETE_EVENT_CLOCK
+	void RunUntilIdle() {
+		if (driver_ >= 0) {
+			clock_->wait_idle(driver_);
 		}
-		
+	}
+
+	//Closes the robot threads once they have finished every queued task
+	void KillRobots(){
+		ReleaseClock();
+
+		// hand the robots whatever is still waiting to be batched before they quit
+		order_batcher.stop();
+		scheduler_.close();
 
 		//waiting for robots to quit
 		for (auto& robot : robots_) {
 			robot->join();
 		}
 
-		std::cout << "All Robots dead." << std::endl;
+		LOG_INFO("All Robots dead. Simulated time: %.3f s", clock_->now() / 1000);
+		for (int i = 0; i < scheduler_.numRobots(); i++) {
+			RobotStats stats = scheduler_.getStats(i);
+			LOG_INFO("Robot %d: %lu tasks, %lu stolen, idle %.0f ms", i, stats.tasks_completed, stats.steals, stats.idle_ms);
+		}
+
+		// every load is on a truck now, send off the part loaded ones
+		truck_handler_.stop();
+		DockStats dock = truck_handler_.getStats();
+		LOG_INFO("Trucks: %lu arrived, %lu left (%lu full, %lu on deadline), %.0f%% average fill",
+			dock.trucks_arrived, dock.trucks_departed, dock.full_departures, dock.deadline_departures, dock.averageFill() * 100);
+		LOG_INFO("Robots at the dock: %lu loads, %lu waited for room, %.0f ms average wait, %.0f ms longest",
+			dock.loads, dock.robot_waits, dock.averageWait(), dock.max_robot_wait_ms);
+		for (size_t b = 0; b < dock.bay_occupied.size(); b++) {
+			LOG_INFO("Bay %zu: truck in bay %.0f%% of the time, loading %.0f%%", b, dock.bay_occupied[b] * 100, dock.bay_loading[b] * 100);
+		}
+
+	}
 
+	//Lets the simulation have simulated time for good once everything placed so far is done,
+	//threads stopped after that all stop at the same simulated time
+	void ReleaseClock() {
+		if (driver_ >= 0) {
+			clock_->wait_idle(driver_);
+			clock_->RemoveParticipant(driver_);
+			driver_ = -1;
+		}
 	}
 
 	//Generates a vector of random number of each product
 	std::vector<Product> GenerateStock() {
-		srand(time(NULL));
-		int rand_num = rand() % 1;
+		std::uniform_int_distribution<int> stock(0, RAND_STOCK - 1);
+		int rand_num;
 		std::vector<Product> out;
 
-		for (auto product : Products_) {
-			rand_num = rand() % RAND_STOCK;
+		for (auto product : getProducts()) {
+			rand_num = stock(rnd_);
 
 			for (int i = 0; i < rand_num; i++)
 			{
@@ -146,13 +225,13 @@ public:
 
 	Order GenerateOrder() {
 		Order order;
-		srand(time(NULL));
-		order.ID_ = rand() % 500;
+		std::uniform_int_distribution<int> stock(0, RAND_STOCK - 1);
+		order.ID_ = std::uniform_int_distribution<int>(0, 499)(rnd_);
 		int rand_num;
 		std::vector<Product> out;
 
-		for (auto product : Products_) {
-			rand_num = rand() % RAND_STOCK;
+		for (auto product : getProducts()) {
+			rand_num = stock(rnd_);
 			product.quantity_ = rand_num;
 			out.push_back(product);
 		}
@@ -168,16 +247,18 @@ public:
 		std::vector<Product> stocked_products = GenerateStock();
 		
 		double weight = 0;
-		int num_orders = 1;
+		int num_orders = 0;
 
 		for (auto product : stocked_products) {
-			product.location_ = StorageUnits_.GetFreeShelf();
+			// spread restocks over the aisles so later picks don't all queue in one zone
+			product.location_ = StorageUnits_.GetFreeShelf(ZONE_BALANCED);
 			if (weight + product.weight_ < ROBOT_MAX_CAPACITY) {
 				order.products_.push_back(product);
+				weight += product.weight_;
 			}
 			else {
 				
-				order_queue.add(order);
+				scheduler_.add(order);
 
 				order.products_.clear();
 				order.task_ = RobotTask::UNLOAD;
@@ -191,110 +272,232 @@ public:
 			
 		}
 
-		std::cout << "Added " << std::to_string(num_orders)<< " orders for unloading." << std::endl;
+		// the last load is usually not full
+		if (!order.products_.empty()) {
+			scheduler_.add(order);
+			num_orders++;
+		}
+
+		LOG_INFO("Added %d orders for unloading.", num_orders);
 
 	}
 
-	//Verifies an order by checking inventories if they can reserve all items
+	//Verifies an order by reserving all of its items in one batch, nothing is reserved if
+	//any product is short. Does not store the order, AddOrder does.
 	//
 	//@param order must have order id, products, quantity intialized
+	//@param report on failure holds the first short product and the quantity available
 	//@return true if successful false otherwise
 	bool VerifyOrder(Order &order, OrderReport& report) {
-		std::vector<Product> reserved;
-		int numReserved;
-		int numUnRes;
-
-		//std::cout << "Verifying Order: " << order.toString() << std::endl;
-
-			for (auto prod : order.products_) {
-			std::cout << "Product: " << prod.ID_ << std::endl;
-			std::cout << "Quantity: " << prod.quantity_<< std::endl;
-			//Inventory* Inv = getInventory(prod->ID_);
-			numReserved = getInventory(prod.ID_).Reserve(prod.quantity_);
-
-			//if u couldnt reserve the required quantity of a certain product free them all
-			if (numReserved != prod.quantity_) {
-				std::cout << "Could not Reserve: " << prod.toString() << std::endl;
-				report.product = prod;
-				report.quantity = numReserved;
-				report.verified = false;
-				
-				// free all the reserved items if any
-				for (std::vector<Product>::iterator res_it = reserved.begin(); res_it != reserved.end(); ++res_it) {
-					numUnRes = getInventory(res_it->ID_).UnReserve(res_it->quantity_);
-					if (numUnRes != res_it->quantity_) {
-						std::cout << "Could not Unreserve: " << *res_it << std::endl;
-					}
-					std::cout << "Removed Reservation of: " << *res_it << std::endl;
+		std::vector<ReservationLine> lines;
+		lines.reserve(order.products_.size());
+		for (auto& prod : order.products_) {
+			lines.push_back(ReservationLine(prod.ID_, prod.quantity_));
+		}
+
+		ReservationLine shortfall;
+		if (!Inventories_.ReserveAll(lines, shortfall)) {
+			for (auto& prod : order.products_) {
+				if (prod.ID_ == shortfall.product_id) {
+					report.product = prod;
+					break;
 				}
-				return false;
 			}
-			
-			reserved.push_back(Product(prod));
-			std::cout << "Reserved: " << prod.toString() << " for order ID: "<< order.ID_<< std::endl;
+			report.quantity = shortfall.quantity;
+			report.verified = false;
+			return false;
 		}
-		std::cout << std::endl;
+
 		order.status = OrderStatus::READY_FOR_COLLECTION;
+		return true;
+	}
 
-		{
-			std::lock_guard<std::mutex> mylock(order_mutex);
-			Orders_.push_back(order);
-			Order_ptr[order.ID_] = Orders_.size() - 1; // index starts at 0
+	//Verifies several orders one after the other, each reserved as a unit exactly as by VerifyOrder,
+	//so a short order does not hold up the rest of the batch
+	//
+	//@param orders orders to verify, verified ones have their status set
+	//@param reports set to one report per order
+	//@return number of orders verified
+	size_t VerifyOrders(std::vector<Order>& orders, std::vector<OrderReport>& reports) {
+		reports.assign(orders.size(), OrderReport());
+		size_t verified = 0;
+		for (size_t i = 0; i < orders.size(); i++) {
+			if (VerifyOrder(orders[i], reports[i])) {
+				verified++;
+			}
 		}
-		
-
-		return true;
+		return verified;
 	}
 
 	//Poppulates the products in order with shelf locations then adds it to collection queue
 	// Updates the order status
-	//pre conditions: must verify order before attempting to add it;
+	//The order is verified here, a failed or duplicate order is not stored
 	OrderReport AddOrder(Order order_in){
-		OrderReport report;
+		return AddOrders(std::vector<Order>(1, order_in))[0];
+	}
 
-		if (!VerifyOrder(order_in, report)) {
-			return report;
+	//Adds a batch of orders as AddOrder does, but the order store and the batcher are each
+	//locked once for the whole batch rather than once per order
+	//
+	//@return one report per order, in the order they were given
+	std::vector<OrderReport> AddOrders(const std::vector<Order>& orders_in) {
+		std::vector<OrderReport> reports(orders_in.size());
+		{
+			// simulated time stands still until the batch is with the batcher, so all of it arrives at one time
+			ClockInput input(*clock_);
+
+			// claim the IDs first so two orders with the same ID can't both reserve stock
+			std::vector<bool> inserted;
+			orders_.insert(orders_in, OrderStatus::UNKNOWN, inserted);
+
+			std::vector<Order> fresh;
+			std::vector<size_t> positions;
+			for (size_t i = 0; i < orders_in.size(); i++) {
+				if (inserted[i]) {
+					fresh.push_back(orders_in[i]);
+					positions.push_back(i);
+				}
+				else {
+					reports[i].verified = false;
+					reports[i].duplicate = true;
+					reports[i].quantity = 0;
+				}
+			}
+
+			std::vector<OrderReport> fresh_reports;
+			VerifyOrders(fresh, fresh_reports);
+
+			std::vector<int> failed;
+			std::vector<Order> collections;
+			std::vector<size_t> collected; // report position of each collection
+			for (size_t k = 0; k < fresh.size(); k++) {
+				reports[positions[k]] = fresh_reports[k];
+				if (!fresh_reports[k].verified) {
+					failed.push_back(fresh[k].ID_);
+					continue;
+				}
+				// ready only once its items are aquired, recovery relies on that order in the journal
+				collections.push_back(CollectionTask(fresh[k]));
+				collected.push_back(positions[k]);
+				orders_.setStatus(fresh[k].ID_, OrderStatus::READY_FOR_COLLECTION);
+			}
+			orders_.erase(failed);
+
+			// the robots were shut down, put the items back on the shelves rather than keep orders nobody collects
+			if (!order_batcher.add(collections)) {
+				LOG_ERROR("Robots are shut down, turned away %zu orders", collections.size());
+				std::vector<int> refused;
+				for (size_t c = 0; c < collections.size(); c++) {
+					for (auto& item : collections[c].products_) {
+						getInventory(item.ID_)->store(item.location_);
+					}
+					refused.push_back(collections[c].ID_);
+					reports[collected[c]].verified = false;
+					reports[collected[c]].quantity = 0;
+				}
+				orders_.erase(refused);
+			}
 		}
-	
+
+		// one sync for the whole batch, and it is shared with any other batch being placed meanwhile
+		if (journaling_) {
+			journal_.Sync();
+		}
+		return reports;
+	}
+
+	//Turns a verified order into a collection task with one product entry per item and its shelf location.
+	//Name, weight and price come from the catalog, orders from the server or the order channel only
+	//carry product ids and quantities.
+	Order CollectionTask(Order order_in) {
 		order_in.task_ = RobotTask::COLLECT_AND_LOAD;
 		std::vector<Product> robot_collection;
-		ShelfLocation loc;
 
-		for (auto product : order_in.products_) {
-			Product p = product;
+		for (auto& product : order_in.products_) {
+			Product p = getProduct(product.ID_);
+			p.quantity_ = product.quantity_;
 
 			for (int i = 0; i < product.quantity_; i++)
 			{
-				p.location_ = getInventory(p.ID_).aquire();
+				p.location_ = getInventory(p.ID_)->aquire();
 				robot_collection.push_back(p);
 			}
-			
-			
-		}
-
-		{
-			std::lock_guard<std::mutex> mylock(order_mutex);
-			Orders_.push_back(order_in);
-			Order_ptr[order_in.ID_] = Orders_.size() - 1; // index starts at 0
 		}
 
 		order_in.products_ = robot_collection;
-		order_queue.add(order_in);
-		return report;
+		return order_in;
 	}
 
+	//@return a copy of the order with its current status, status UNKNOWN if no such order is stored
 	Order getOrder(int order_id) {
-		std::lock_guard<std::mutex> mylock(order_mutex);
-		return Orders_[Order_ptr[order_id]];
+		Order order;
+		if (!orders_.get(order_id, order)) {
+			order.ID_ = order_id;
+			order.status = OrderStatus::UNKNOWN;
+		}
+		return order;
+	}
+
+	// Lock-free, UNKNOWN if no such order is stored
+	OrderStatus getOrderStatus(int order_id) {
+		return orders_.getStatus(order_id);
+	}
+
+	SimClock& getClock() {
+		return *clock_;
+	}
+
+	const RoutePlanner& getRoutePlanner() const {
+		return planner_;
+	}
+
+	Storage& getStorage() {
+		return StorageUnits_;
+	}
+
+	RobotStats getRobotStats(int robot) const {
+		return scheduler_.getStats(robot);
+	}
+
+	const ReservationStats& getReservationStats() const {
+		return Inventories_.stats();
+	}
+
+	// Takes orders placed by other processes on this host through a shared-memory OrderChannelWriter,
+	// batches waiting in the channel go through AddOrders together
+	void OpenOrderChannel(const std::string& name) {
+		CloseOrderChannel();
+		order_channel_.reset(new OrderChannelReader(name, [this](const std::vector<Order>& orders) {
+			return AddOrders(orders);
+		}));
+		order_channel_->reset(); // the shared memory outlives a crashed warehouse, don't pick up its records
+		order_channel_->start();
+		LOG_INFO("Taking orders on channel %s", name);
+	}
+
+	void CloseOrderChannel() {
+		if (order_channel_) {
+			order_channel_->stop();
+			LOG_INFO("Order channel %s placed %lu orders in %lu batches, took back %lu records whose lease ran out",
+				order_channel_->name(), order_channel_->numOrders(), order_channel_->numBatches(), order_channel_->numReclaimed());
+			order_channel_->unlink();
+			order_channel_.reset();
+		}
+	}
+
+	DockStats getDockStats() {
+		return truck_handler_.getStats();
+	}
+
+	const WarehouseJournal& getJournal() const {
+		return journal_;
 	}
 
 	//adds some stocks to beging with
 	void InitInventories() {
 
-		for (std::vector<Inventory>::iterator Inv = Inventories_.begin(); Inv != Inventories_.end(); ++Inv) {
-			std::cout << "Adding " << NUM_PRODUCTS_INIT << " products to Inventory: "
-				<< Inv->toString()
-				 << std::endl;
+		for (Inventory* Inv : Inventories_.all()) {
+			LOG_DEBUG("Adding %d products to Inventory: %d", NUM_PRODUCTS_INIT, Inv->getID());
 
 			for (int j = 0; j < NUM_PRODUCTS_INIT; j++) {
 				ShelfLocation s = StorageUnits_.GetFreeShelf();
@@ -308,79 +511,146 @@ public:
 		
 	}
 
-	// Read Product IDs from a file and create a new Inventory for each one
-	// and map it accodiring to the ID for easy access
-	void InitWarehouse(){
-		std::ifstream fin(PRODUCT_DESCRIPTION_FILE); // text file with Product descriptions
-		std::string line;
-		bool read = false; // dont read first line 
-
-		if (fin.is_open()) {
-
-			std::string name;
-			int id;
-			double weight;
-			double price;
+	// Restores stock, shelves and open orders from the journal and logs every change from then on.
+	// Starts with generated stock, logged as well, if there is nothing to recover.
+	void OpenJournal(const std::string& prefix) {
+		JournalState state;
+		bool recovered = journal_.Recover(prefix, state);
+		if (recovered) {
+			RestoreState(state);
+		}
 
-			int count = 0;
+		journaling_ = journal_.Start(state);
+		if (journaling_) {
+			StorageUnits_.SetJournal(&journal_);
+			Inventories_.SetJournal(&journal_);
+			orders_.SetJournal(&journal_);
+		}
+		else {
+			LOG_WARN("Warehouse is not journaling, changes will be lost on restart");
+		}
 
-			std::cout << "Loading Products... " << line << std::endl;
-			std::cout << std::endl;
+		if (!recovered) {
+			InitInventories();
+		}
+	}
 
-			while (std::getline(fin, line)) {
-				if (line.compare(NAME_FILE_IDENTIFIER) == 0) {
-					if (std::getline(fin, line)) {
-						name = line;
-						//std::cout << "Name: " << line << std::endl;
-					}
-				}
-				else if (line.compare(ID_FILE_IDENTIFIER) == 0) {
-					if (std::getline(fin, line)) {
-						id = std::stoi(line); // ID
-						//std::cout << "ID: " << id << std::endl;
-					}
+	// Puts the state recovered from the journal back in place and queues the open orders for
+	// collection again, see JournalState::Settle. The state is updated to what was restored.
+	void RestoreState(JournalState& state) {
+		std::map<int, std::vector<std::pair<int, int>>> collections =
+			state.Settle([this](int product_id) { return Inventories_.find(product_id) != nullptr; });
+
+		for (auto& entry : state.stock) {
+			std::vector<ShelfLocation> locations;
+			std::vector<int> restored;
+			for (int slot : entry.second.slots) {
+				ShelfLocation location = ShelfLocation::FromSlot(slot);
+				if (StorageUnits_.OccupyShelf(location)) {
+					locations.push_back(location);
+					restored.push_back(slot);
 				}
-				else if (line.compare(WEIGHT_FILE_IDENTIFIER) == 0) {
-					if (std::getline(fin, line)) {
-						weight = std::stod(line);
-						//std::cout << "Weight :" << weight << std::endl;
-					}
+				else {
+					LOG_ERROR("Journal: shelf %d is not on the floor map, its item is lost", slot);
 				}
-				else if (line.compare(PRICE_FILE_IDENTIFIER) == 0) {
-					if (std::getline(fin, line)) {
-						price = std::stod(line);
-						//std::cout << "Price :" << weight << std::endl;
-
-						//Add Product and link to its ID
-						Products_.push_back(Product(name, id, weight, price)); // add the product 
-						Product_ptr[id] = count;
-						
-						//Create Inventory and link to Product ID
-						Inventories_.push_back(Inventory(id));
-						Inventory_ptr[id] = count;
-						//low_stock[id] = false;
-
-						std::cout << "Product: " << Products_[count].toString() << std::endl;
-						count++;
-						std::cout << "Num Products: " <<count << std::endl;
-					}
+			}
+			entry.second.slots = restored;
+			entry.second.available = std::min(entry.second.available, (int)restored.size());
+			Inventories_.find(entry.first)->Restore(locations, entry.second.available, entry.second.reserved);
+		}
+
+		std::vector<Order> tasks;
+		for (auto& entry : state.orders) {
+			Order order;
+			order.ID_ = entry.first;
+			for (auto& line : entry.second.lines) {
+				Product product = getProduct(line.first);
+				product.quantity_ = line.second;
+				order.products_.push_back(product);
+			}
+			orders_.insert(order, OrderStatus::READY_FOR_COLLECTION);
+
+			Order task = order;
+			task.task_ = RobotTask::COLLECT_AND_LOAD;
+			task.status = OrderStatus::READY_FOR_COLLECTION;
+			task.products_.clear();
+			for (auto& item : collections[entry.first]) {
+				Product product = getProduct(item.first);
+				product.location_ = ShelfLocation::FromSlot(item.second);
+				if (!StorageUnits_.OccupyShelf(product.location_)) {
+					state.aquired.erase(item.second);
+					continue;
 				}
+				task.products_.push_back(product);
 			}
-			fin.close();
+			tasks.push_back(task);
+		}
+		order_batcher.add(tasks);
 
+		const JournalRecoveryStats& stats = journal_.recoveryStats();
+		LOG_INFO("Recovered %zu inventories and %zu open orders in %.3f ms (snapshot %.3f ms, %lu events from %lu log segments%s)",
+			state.stock.size(), state.orders.size(), stats.snapshot_ms + stats.replay_ms, stats.snapshot_ms,
+			stats.events, stats.segments, stats.torn ? ", torn tail dropped" : "");
+	}
+
+	// Creates an Inventory for every product of the description file. Starts from the compiled
+	// catalog, which is compiled again if the text file changed since, and reads the text file
+	// directly only if there is no usable catalog.
+	void InitWarehouse(){
+		if (catalog_.Open(PRODUCT_CATALOG_FILE, PRODUCT_DESCRIPTION_FILE)
+			|| (ProductCatalog::Compile(PRODUCT_DESCRIPTION_FILE, PRODUCT_CATALOG_FILE)
+				&& catalog_.Open(PRODUCT_CATALOG_FILE, PRODUCT_DESCRIPTION_FILE))) {
+			for (int i = 0; i < catalog_.size(); i++) {
+				Inventories_.add(catalog_.id(i));
+			}
+			LOG_INFO("Loaded %d products from %s", catalog_.size(), PRODUCT_CATALOG_FILE);
+			return;
 		}
-		else{
-			std::cout << "Warehouse could not open file for reading:" << PRODUCT_DESCRIPTION_FILE << std::endl;
+
+		std::vector<Product> products;
+		if (!ProductCatalog::ReadText(PRODUCT_DESCRIPTION_FILE, products)) {
+			LOG_ERROR("Warehouse could not open file for reading: %s", PRODUCT_DESCRIPTION_FILE);
+			return;
 		}
-		
+		for (const Product& product : products) {
+			AddProduct(product);
+		}
+		LOG_INFO("Loaded %zu products from %s", products.size(), PRODUCT_DESCRIPTION_FILE);
 	}
 
-	Inventory& getInventory(int product_id) {
-		return Inventories_[Inventory_ptr[product_id]];
+	// Adds a product to the catalog with an empty inventory, can be called while robots are running
+	//@return false if a product with that ID already exists
+	bool AddProduct(const Product& product) {
+		if (catalog_.Find(product.ID_) >= 0) {
+			return false;
+		}
+		std::lock_guard<std::mutex> mylock(product_mutex);
+		if (Product_ptr.count(product.ID_)) {
+			return false;
+		}
+		Products_.push_back(product);
+		Product_ptr[product.ID_] = Products_.size() - 1;
+		Inventories_.add(product.ID_);
+		return true;
+	}
+
+	//@return the inventory of the product or nullptr if the product is unknown
+	Inventory* getInventory(int product_id) {
+		return Inventories_.find(product_id);
 	}
 		
+	//@return the product, or one with only its ID set if the product is unknown
 	Product getProduct(int product_id) {
-		return Products_[Product_ptr[product_id]];
+		int record = catalog_.Find(product_id);
+		if (record >= 0) {
+			return catalog_.product(record);
+		}
+		std::lock_guard<std::mutex> mylock(product_mutex);
+		auto it = Product_ptr.find(product_id);
+		if (it == Product_ptr.end()) {
+			return Product("", product_id, 0, 0);
+		}
+		return Products_[it->second];
 	}
 
 };
@@ -0,0 +1,78 @@
+/*
+*Description: Measures items per second through cpen333::process::fifo between two processes at
+*			  several batch sizes. Run without arguments, the program creates the fifo and starts itself
+*			  twice, once as the producer and once as the consumer, for each batch size. The consumer
+*			  checks every item arrives in order and prints the rate.
+*/
+
+#include <cpen333/process/fifo.h>
+#include <cpen333/process/subprocess.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define BENCH_FIFO_NAME "bench_fifo"
+#define BENCH_FIFO_SIZE 1024
+#define BENCH_ITEMS 4096000L	// a multiple of every batch size
+
+static int produce(size_t batch) {
+	cpen333::process::fifo<long> fifo(BENCH_FIFO_NAME, BENCH_FIFO_SIZE);
+	std::vector<long> values(batch);
+	for (long i = 0; i < BENCH_ITEMS; i += batch) {
+		for (size_t k = 0; k < batch; k++) {
+			values[k] = i + k;
+		}
+		fifo.push_n(values.data(), batch);
+	}
+	return 0;
+}
+
+static int consume(size_t batch) {
+	cpen333::process::fifo<long> fifo(BENCH_FIFO_NAME, BENCH_FIFO_SIZE);
+	std::vector<long> values(batch);
+
+	// the clock starts with the first item so starting the producer isn't counted
+	long received = (long)fifo.pop_n(values.data(), batch);
+	auto start = std::chrono::steady_clock::now();
+	long expected = received;
+	while (received < BENCH_ITEMS) {
+		size_t k = fifo.pop_n(values.data(), batch);
+		for (size_t i = 0; i < k; i++) {
+			if (values[i] != expected++) {
+				std::cout << "batches of " << batch << ": item " << values[i] << " out of order" << std::endl;
+				return 1;
+			}
+		}
+		received += (long)k;
+	}
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "batches of " << batch << ": " << BENCH_ITEMS / s / 1e6 << " M items/s" << std::endl;
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc == 3) {
+		size_t batch = (size_t)std::atol(argv[2]);
+		if (std::string(argv[1]) == "produce") {
+			return produce(batch);
+		}
+		if (std::string(argv[1]) == "consume") {
+			return consume(batch);
+		}
+	}
+
+	std::cout << "Passing " << BENCH_ITEMS << " items through a fifo of " << BENCH_FIFO_SIZE
+		<< " between two processes" << std::endl;
+	for (size_t batch : { 1, 4, 16, 64, 256 }) {
+		// both children open the fifo this process created, it is unlinked again once they are done
+		cpen333::process::fifo<long> fifo(BENCH_FIFO_NAME, BENCH_FIFO_SIZE);
+		cpen333::process::subprocess consumer({ argv[0], "consume", std::to_string(batch) }, true, false);
+		cpen333::process::subprocess producer({ argv[0], "produce", std::to_string(batch) }, true, false);
+		producer.join();
+		consumer.join();
+		fifo.unlink();
+	}
+	return 0;
+}
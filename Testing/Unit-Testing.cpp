@@ -6,6 +6,13 @@
 */
 
 #include "warehouse.h"
+#include "ConcurrentIdMap.h"
+#include "OrderChannel.h"
+#include <cmath>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
 
 int main() {
 
@@ -74,6 +81,658 @@ int main() {
 //	}
 //-----------------------------------------------------------------------------------
 
+	// Route planner benchmark: average pick route length before and after planning
+	//-----------------------------------------------------------------------------------
+	/*Warehouse ware;
+	const RoutePlanner& planner = ware.getRoutePlanner();
+	Location dock = planner.Dock(BAY1);
+	const int trials = 200;
+	const int picks = 10;
+	double before = 0;
+	double after = 0;
+	for (int t = 0; t < trials; t++) {
+		std::vector<Product> list;
+		for (int i = 0; i < picks; i++) {
+			Product p;
+			p.location_ = ware.getStorage().GetFreeShelf();
+			list.push_back(p);
+		}
+		before += planner.RouteLength(list, dock);
+		after += planner.RouteLength(planner.PlanRoute(list, dock), dock);
+		for (auto& p : list) {
+			ware.getStorage().FreeShelf(p.location_);
+		}
+	}
+	std::cout << "Average route length over " << trials << " pick lists of " << picks << " items" << std::endl;
+	std::cout << "Unordered: " << before / trials << " cells" << std::endl;
+	std::cout << "Planned: " << after / trials << " cells" << std::endl;*/
+	//-----------------------------------------------------------------------------------
+
+	// Web server frame reader benchmark, needs #include "../WebServer/FrameReader.h"
+	// reads back to back frames of 1 KB to 10 MB from memory handed out 64 KB per read like a socket
+	//-----------------------------------------------------------------------------------
+	/*struct MemoryStream {
+		const std::string& data;
+		size_t pos;
+		size_t read(void* buff, size_t size) {
+			size = std::min(std::min(size, (size_t)65536), data.size() - pos);
+			memcpy(buff, &data[pos], size);
+			pos += size;
+			return size;
+		}
+	};
+	for (size_t size : { 1024, 10 * 1024, 100 * 1024, 1024 * 1024, 10 * 1024 * 1024 }) {
+		int frames = std::max<size_t>(1, 20000000 / size);
+		std::string data;
+		for (int i = 0; i < frames; i++) {
+			char header[4] = { (char)(size >> 24), (char)(size >> 16), (char)(size >> 8), (char)size };
+			data.append(header, 4);
+			data.append(size, 'x');
+		}
+
+		MemoryStream stream = { data, 0 };
+		FrameReader<MemoryStream> reader(stream);
+		std::string frame;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++) {
+			reader.readFrame(frame);
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+		std::cout << size << " bytes: " << ms << " ms per frame, " << size / 1048576.0 / (ms / 1000) << " MB/s" << std::endl;
+	}*/
+	//-----------------------------------------------------------------------------------
+
+	// Web server codec benchmark, needs #include "../WebServer/BinaryWarehouseApi.h" and <json.hpp>
+	// encodes and decodes the same 4 line order with field-named JSON and with the binary API
+	//-----------------------------------------------------------------------------------
+	/*ServerOrder order;
+	order.ID_ = 456334;
+	for (int id : { 5215667, 7886538, 92873884, 73738462 }) {
+		ServerProduct p;
+		p.product_id = id;
+		p.quantity = 2;
+		p.price_ = 1999;
+		p.name_ = "Widget";
+		order.products_.push_back(p);
+	}
+	VerifyOrderMessage msg(order);
+	const int messages = 200000;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < messages; i++) {
+		nlohmann::json j;
+		j["msg"] = "verify order";
+		j["order ID"] = order.ID_;
+		for (auto& p : order.products_) {
+			nlohmann::json jp;
+			jp["product ID"] = p.product_id;
+			jp["quantity"] = p.quantity;
+			jp["price"] = p.price_;
+			jp["name"] = p.name_;
+			j["products"].push_back(jp);
+		}
+		nlohmann::json back = nlohmann::json::parse(j.dump());
+		ServerOrder decoded;
+		decoded.ID_ = back["order ID"];
+		for (auto& jp : back["products"]) {
+			ServerProduct p;
+			p.product_id = jp["product ID"];
+			p.quantity = jp["quantity"];
+			p.price_ = jp["price"];
+			p.name_ = jp["name"].get<std::string>();
+			decoded.products_.push_back(p);
+		}
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "JSON: " << messages / ms * 1000 << " messages/s" << std::endl;
+
+	start = std::chrono::steady_clock::now();
+	std::string body;
+	for (int i = 0; i < messages; i++) {
+		std::string wire = BinaryWarehouseApi::encodeMessage(msg);
+		body.assign(wire, BINARY_HEADER_SIZE, std::string::npos);
+		BinaryWarehouseApi::decodeMessage(body);
+	}
+	ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Binary: " << messages / ms * 1000 << " messages/s, "
+		<< BinaryWarehouseApi::encodeMessage(msg).size() << " bytes per message" << std::endl;*/
+	//-----------------------------------------------------------------------------------
+
+	// Web server catalog search benchmark, needs #include "../WebServer/MusicLibrary.h"
+	// typeahead latency over 1M generated product names
+	//-----------------------------------------------------------------------------------
+	/*std::vector<std::string> adjectives = { "red", "blue", "green", "shiny", "large", "small", "organic", "wireless", "smart", "vintage" };
+	std::vector<std::string> nouns = { "shoes", "bike", "phone", "lamp", "chair", "table", "speaker", "watch", "kettle", "drill" };
+	std::mt19937 rnd(1);
+	MusicLibrary catalog;
+	std::vector<ServerProduct> products;
+	for (int i = 0; i < 1000000; i++) {
+		ServerProduct p;
+		p.product_id = i;
+		p.price_ = 100;
+		p.quantity = 1;
+		p.name_ = adjectives[rnd() % 10] + " " + nouns[rnd() % 10] + " model" + std::to_string(rnd() % 100000);
+		products.push_back(p);
+	}
+	catalog.add(products);  // every edit publishes a copy of the catalog, so add in one batch
+	for (std::string query : { "r", "red sh", "model1234", "wire dr", "vint kett model99" }) {
+		auto start = std::chrono::steady_clock::now();
+		size_t found = 0;
+		for (int k = 0; k < 1000; k++) {
+			found = catalog.typeahead(query).size();
+		}
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / 1000;
+		std::cout << "\"" << query << "\": " << found << " suggestions in " << us << " us" << std::endl;
+	}*/
+	//-----------------------------------------------------------------------------------
+
+	// Web server catalog snapshot benchmark, needs #include "../WebServer/MusicLibrary.h"
+	// search latency of 4 reader threads while a writer keeps publishing new catalog versions
+	//-----------------------------------------------------------------------------------
+	/*MusicLibrary snapshots;
+	std::vector<ServerProduct> initial;
+	for (int i = 0; i < 100000; i++) {
+		ServerProduct p;
+		p.product_id = i;
+		p.name_ = (i % 7 ? "red shoes " : "blue bike ") + std::to_string(i);
+		initial.push_back(p);
+	}
+	snapshots.add(initial);
+	std::atomic<bool> stop_readers(false);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < 4; r++) {
+		readers.emplace_back([&]() {
+			while (!stop_readers) {
+				snapshots.typeahead("blue bi");
+			}
+		});
+	}
+	for (int i = 0; i < 100; i++) {
+		ServerProduct p;
+		p.product_id = 100000 + i;
+		p.name_ = "blue kettle";
+		snapshots.add(p);
+		snapshots.remove(p);
+	}
+	stop_readers = true;
+	for (auto& reader : readers) {
+		reader.join();
+	}
+	const LatencyHistogram& reads = snapshots.readLatency();
+	const LatencyHistogram& grace = snapshots.writeGraceLatency();
+	std::cout << reads.count() << " searches: p50 " << reads.percentile(0.5) << " ns, p99 " << reads.percentile(0.99)
+		<< " ns, max " << reads.max() << " ns" << std::endl;
+	std::cout << grace.count() << " versions: writer waited p50 " << grace.percentile(0.5) << " ns, max "
+		<< grace.max() << " ns for readers of the old version" << std::endl;*/
+	//-----------------------------------------------------------------------------------
+
+	// Web server inventory cache benchmark, needs #include "../WebServer/JsonWarehouseApi.h" and "../WebServer/InventoryCache.h"
+	// encoding an inventory response every time vs serving it from the cache
+	//-----------------------------------------------------------------------------------
+	/*RequestInventoryResponseMessage stock;
+	ServerProduct line;
+	line.product_id = 5215667;
+	line.name_ = "wireless speaker";
+	line.price_ = 60;
+	line.quantity = 42;
+	stock.products_.push_back(line);
+	InventoryCache inventory_cache;
+	inventory_cache.put(JsonWarehouseApi::JSON_ID, line.product_id, 1, JsonWarehouseApi::encodeMessage(stock));
+	std::string frame;
+	auto encode_start = std::chrono::steady_clock::now();
+	for (uint32_t k = 1; k <= 100000; k++) {
+		stock.id = k;
+		frame = JsonWarehouseApi::encodeMessage(stock);
+	}
+	double encode_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - encode_start).count() / 100000;
+	auto hit_start = std::chrono::steady_clock::now();
+	for (uint32_t k = 1; k <= 100000; k++) {
+		inventory_cache.get(JsonWarehouseApi::JSON_ID, line.product_id, 1, frame);
+		frame = JsonWarehouseApi::withRequestId(frame, k);
+	}
+	double hit_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - hit_start).count() / 100000;
+	std::cout << "encode " << encode_ns << " ns, cache hit " << hit_ns << " ns per response" << std::endl;*/
+	//-----------------------------------------------------------------------------------
+
+	// Web server catalog load benchmark, needs #include "../WebServer/CatalogLoader.h"
+	// streams 8 generated catalog files of 100000 products each on 1 to 8 threads
+	//-----------------------------------------------------------------------------------
+	/*std::vector<std::string> catalog_files;
+	for (int f = 0; f < 8; f++) {
+		catalog_files.push_back("catalog" + std::to_string(f) + ".json");
+		std::ofstream fout(catalog_files.back());
+		fout << "[";
+		for (int i = 0; i < 100000; i++) {
+			fout << (i ? "," : "") << "{\"product ID\": " << f * 100000 + i << ", \"name\": \"product " << i
+				<< "\", \"price\": " << i % 100 << ", \"quantity\": 1}\n";
+		}
+		fout << "]";
+	}
+	for (size_t threads : { 1, 2, 4, 8 }) {
+		MusicLibrary loaded;
+		CatalogLoadStats stats = CatalogLoader::loadFiles(loaded, catalog_files, threads);
+		std::cout << threads << " threads: " << stats.products << " products, " << stats.megabytesPerSecond() << " MB/s" << std::endl;
+	}*/
+	//-----------------------------------------------------------------------------------
+
+	// Product catalog benchmark: reading 1M products as text vs opening the compiled catalog
+	//-----------------------------------------------------------------------------------
+	/*{
+		std::ofstream fout("big_products.txt");
+		for (int i = 0; i < 1000000; i++) {
+			fout << "name\nproduct " << i << "\n\nID\n" << i << "\n\nweight\n1.0\n\nprice\n" << i % 1000 << ".99\n";
+		}
+	}
+	auto text_start = std::chrono::steady_clock::now();
+	std::vector<Product> text_products;
+	ProductCatalog::ReadText("big_products.txt", text_products);
+	double text_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - text_start).count();
+	ProductCatalog::Compile("big_products.txt", "big_products.bin");
+	auto open_start = std::chrono::steady_clock::now();
+	ProductCatalog mapped;
+	mapped.Open("big_products.bin", "big_products.txt");
+	double open_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open_start).count();
+	std::cout << "text " << text_ms << " ms, mapped " << open_ms << " ms for " << mapped.size() << " products" << std::endl;*/
+	//-----------------------------------------------------------------------------------
+
+	// Journal benchmark, needs #include <chrono>: cost of logging on the order path and recovery time
+	// places 500 single-item orders in batches of 50 with and without a journal, restocking between
+	// batches, then recovers
+	//-----------------------------------------------------------------------------------
+	/*for (int journaled = 0; journaled < 2; journaled++) {
+		double place_ms = 0;
+		unsigned long events = 0, commits = 0;
+		{
+			Warehouse bench(DISCRETE_EVENT_CLOCK, 1, SCALED_CLOCK_FACTOR, journaled ? "bench" : "");
+			std::vector<Product> catalog = bench.getProducts();
+			for (int batch = 0; batch < 10; batch++) {
+				std::vector<Order> orders(50);
+				for (int i = 0; i < 50; i++) {
+					orders[i].ID_ = batch * 50 + i;
+					orders[i].products_.push_back(catalog[i % catalog.size()]);
+					orders[i].products_.back().quantity_ = 1;
+					bench.getInventory(orders[i].products_.back().ID_)->store(bench.getStorage().GetFreeShelf());
+				}
+				auto start = std::chrono::steady_clock::now();
+				bench.AddOrders(orders);
+				place_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+			events = bench.getJournal().numEvents();
+			commits = bench.getJournal().numCommits();
+		}
+		std::cout << (journaled ? "journal: " : "memory only: ") << place_ms * 1000 / 500 << " us per order, "
+			<< events << " events in " << commits << " syncs" << std::endl;
+	}
+	Warehouse recovered(DISCRETE_EVENT_CLOCK, 1, SCALED_CLOCK_FACTOR, "bench");
+	const JournalRecoveryStats& recovery = recovered.getJournal().recoveryStats();
+	std::cout << "recovery: snapshot " << recovery.snapshot_ms << " ms, " << recovery.events << " events replayed in "
+		<< recovery.replay_ms << " ms" << std::endl;*/
+	//-----------------------------------------------------------------------------------
+
+	// Logging benchmark, needs #include <chrono>: wall time from AddOrders until the robots have handed
+	// every order to the dock, 400 single-item orders in batches of 10 on a discrete event clock so only
+	// the work of the threads is timed, once printing each status line on the thread logging it and
+	// once through the log thread. Run with stdout redirected so the terminal doesn't set the pace.
+	//-----------------------------------------------------------------------------------
+	/*for (int async = 0; async < 2; async++) {
+		AsyncLog::SetSynchronous(!async);
+		Warehouse bench(DISCRETE_EVENT_CLOCK, 1);
+		bench.CreateRobotArmy(4);
+		std::vector<Product> catalog = bench.getProducts();
+		double total_ms = 0;
+		int delivered = 0;
+		for (int batch = 0; batch < 40; batch++) {
+			std::vector<Order> orders(10);
+			for (int i = 0; i < 10; i++) {
+				orders[i].ID_ = batch * 10 + i;
+				orders[i].products_.push_back(catalog[(batch + i) % catalog.size()]);
+				orders[i].products_.back().quantity_ = 1;
+				bench.getInventory(orders[i].products_.back().ID_)->store(bench.getStorage().GetFreeShelf());
+			}
+			auto start = std::chrono::steady_clock::now();
+			bench.AddOrders(orders);
+			bench.RunUntilIdle();
+			total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			for (auto& order : orders) {
+				delivered += bench.getOrderStatus(order.ID_) == OUT_FOR_DELIVERY;
+			}
+		}
+		bench.KillRobots();
+		AsyncLog::Flush();
+		std::cerr << (async ? "async log: " : "synchronous printing: ") << total_ms * 1000 / 400
+			<< " us per order to the dock, " << delivered << " of 400 delivered" << std::endl;
+	}
+	AsyncLog::SetSynchronous(false);*/
+	//-----------------------------------------------------------------------------------
+
+	// Dock benchmark: robot wait at the dock and bay use for the truck schedule in LoadingBay.h, 400
+	// single-item orders placed in batches of 10 on a discrete event clock, rerun with other TRUCK_ARRIVAL_MS
+	//-----------------------------------------------------------------------------------
+	/*{
+		Warehouse bench(DISCRETE_EVENT_CLOCK, 1);
+		bench.CreateRobotArmy(4);
+		std::vector<Product> catalog = bench.getProducts();
+		for (int batch = 0; batch < 40; batch++) {
+			std::vector<Order> orders(10);
+			for (int i = 0; i < 10; i++) {
+				orders[i].ID_ = batch * 10 + i;
+				orders[i].products_.push_back(catalog[(batch + i) % catalog.size()]);
+				orders[i].products_.back().quantity_ = 1;
+				bench.getInventory(orders[i].products_.back().ID_)->store(bench.getStorage().GetFreeShelf());
+			}
+			bench.AddOrders(orders);
+		}
+		bench.KillRobots();
+		DockStats dock = bench.getDockStats();
+		std::cout << "trucks every " << TRUCK_ARRIVAL_MS / 1000 << " s: " << dock.trucks_departed << " trucks, "
+			<< dock.averageFill() * 100 << "% fill, robots waited " << dock.averageWait() << " ms on average, "
+			<< dock.max_robot_wait_ms << " ms at most, bays loading " << dock.bay_loading[BAY1] * 100 << "% / "
+			<< dock.bay_loading[BAY2] * 100 << "%" << std::endl;
+	}*/
+	//-----------------------------------------------------------------------------------
+
+	// Ring buffer benchmark, needs #include <cpen333/thread/fifo.h> and "../Amazoom/RingBuffer.h": N pushing and
+	// N popping threads passing 400000 numbers each through the semaphore fifo and the ring, same capacity
+	//-----------------------------------------------------------------------------------
+	/*for (int threads : { 1, 2, 4 }) {
+		const long per_thread = 400000;
+		auto run = [&](std::function<void(long)> push, std::function<long()> pop) {
+			auto start = std::chrono::steady_clock::now();
+			std::vector<std::thread> workers;
+			for (int t = 0; t < threads; t++) {
+				workers.push_back(std::thread([&, t]() { for (long i = 0; i < per_thread; i++) push(t * per_thread + i); }));
+				workers.push_back(std::thread([&]() { for (long i = 0; i < per_thread; i++) pop(); }));
+			}
+			for (auto& worker : workers) {
+				worker.join();
+			}
+			return threads * per_thread / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+		};
+		cpen333::thread::fifo<long> fifo(1024);
+		RingFifo<long, 1024> mpmc;
+		std::cout << threads << "x" << threads << " fifo: " << run([&](long v) { fifo.push(v); }, [&]() { return fifo.pop(); })
+			<< " M/s, ring: " << run([&](long v) { mpmc.push(v); }, [&]() { return mpmc.pop(); }) << " M/s";
+		if (threads == 1) {
+			RingFifo<long, 1024, RING_SPSC> spsc;
+			std::cout << ", single producer ring: " << run([&](long v) { spsc.push(v); }, [&]() { return spsc.pop(); }) << " M/s";
+		}
+		std::cout << std::endl;
+	}*/
+	//-----------------------------------------------------------------------------------
+
+	// Order channel benchmark, needs #include "../Amazoom/OrderChannel.h" and <cpen333/process/socket.h>: round trip
+	// of a 3 line order through the shared-memory channel and, as a lower bound for the socket path, a localhost
+	// TCP exchange of the same record and its report with nothing encoded
+	//-----------------------------------------------------------------------------------
+	/*const int trips = 20000;
+	Order order;
+	order.ID_ = 456334;
+	for (int id : { 5215667, 7886538, 92873884 }) {
+		Product p;
+		p.ID_ = id;
+		p.quantity_ = 2;
+		order.products_.push_back(p);
+	}
+
+	OrderChannelReader reader("bench_orders", [](const std::vector<Order>& orders) {
+		return std::vector<OrderReport>(orders.size());
+	});
+	reader.start();
+	OrderChannelWriter writer("bench_orders");
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < trips; i++) {
+		writer.Submit(order);
+	}
+	double channel_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / trips;
+	std::vector<Order> batch(64, order);
+	std::vector<OrderReport> reports;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < trips / 64; i++) {
+		writer.Submit(batch, reports);
+	}
+	double batch_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / (trips / 64 * 64);
+	reader.stop();
+	reader.unlink();
+
+	cpen333::process::socket_server server(0);
+	server.open();
+	std::thread echo([&]() {
+		cpen333::process::socket client;
+		server.accept(client);
+		OrderChannelRecord record;
+		while (client.read_all(&record, sizeof(record))) {
+			client.write(&record.verified, sizeof(int32_t[4]));
+		}
+	});
+	cpen333::process::socket socket("localhost", server.port());
+	socket.open();
+	OrderChannelRecord record = OrderChannelRecord();
+	int32_t report[4];
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < trips; i++) {
+		socket.write(&record, sizeof(record));
+		socket.read_all(report, sizeof(report));
+	}
+	double tcp_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / trips;
+	socket.close();
+	echo.join();
+	server.close();
+	std::cout << "channel: " << channel_us << " us per order, " << batch_us << " us per order in batches of 64, TCP: " << tcp_us << " us per order" << std::endl;*/
+	//-----------------------------------------------------------------------------------
+
+	// Robot queue benchmark: N adding threads and N robot threads passing 20000 tasks each
+	//-----------------------------------------------------------------------------------
+	/*for (int threads : { 1, 2, 4, 8, 16, 32, 64 }) {
+		RobotOrderQueue queue;
+		const int per_thread = 20000;
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<std::thread> robots;
+		for (int i = 0; i < threads; i++) {
+			robots.push_back(std::thread([&]() {
+				TaskHandle task;
+				while (queue.get(task)) {}
+			}));
+		}
+		std::vector<std::thread> producers;
+		for (int i = 0; i < threads; i++) {
+			producers.push_back(std::thread([&]() {
+				for (int k = 0; k < per_thread; k++) {
+					queue.add(TaskHandle(new Order()));
+				}
+			}));
+		}
+		for (auto& t : producers) {
+			t.join();
+		}
+		queue.close();
+		for (auto& t : robots) {
+			t.join();
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << threads << " threads: " << (threads * per_thread) / ms << " tasks/ms" << std::endl;
+	}*/
+	//-----------------------------------------------------------------------------------
+
+	// Testing ConcurrentIdMap: threads erase ids and insert others into the freed slots while readers look
+	// ids up, a lookup must never return the record of a different id
+	//-----------------------------------------------------------------------------------
+	{
+		struct Record {
+			int id;
+		};
+		const int num_ids = 64;
+		std::vector<Record> records(num_ids);
+		ConcurrentIdMap<Record> map(num_ids);
+		for (int i = 0; i < num_ids; i++) {
+			records[i].id = i;
+		}
+		std::atomic<bool> done(false);
+		std::atomic<long> lookups(0), wrong(0);
+
+		std::vector<std::thread> threads;
+		for (int w = 0; w < 2; w++) {
+			threads.push_back(std::thread([&, w]() {
+				// each writer owns half the ids, erasing one and inserting the next leaves tombstones to reuse
+				for (int round = 0; round < 200000; round++) {
+					int id = w + 2 * (round % (num_ids / 2));
+					map.insert(id, &records[id]);
+					map.erase(w + 2 * ((round + num_ids / 4) % (num_ids / 2)));
+				}
+			}));
+		}
+		for (int r = 0; r < 2; r++) {
+			threads.push_back(std::thread([&]() {
+				while (!done.load()) {
+					for (int id = 0; id < num_ids; id++) {
+						Record* record = map.find(id);
+						if (record != nullptr && record->id != id) {
+							wrong++;
+						}
+						lookups++;
+					}
+				}
+			}));
+		}
+		for (int w = 0; w < 2; w++) {
+			threads[w].join();
+		}
+		done = true;
+		for (size_t t = 2; t < threads.size(); t++) {
+			threads[t].join();
+		}
+		std::cout << "ConcurrentIdMap: " << lookups << " lookups, " << wrong << " returned another id's record: "
+			<< (wrong == 0 ? "PASSED" : "FAILED") << std::endl;
+	}
+	//-----------------------------------------------------------------------------------
+
+	// Testing collection tasks of orders that only carry product ids and quantities, as orders from
+	// the web server do: every item must weigh what the catalog says
+	//-----------------------------------------------------------------------------------
+	{
+		Warehouse weights(DISCRETE_EVENT_CLOCK, 1);
+		Order bare;
+		bare.ID_ = 9001;
+		double expected = 0;
+		for (auto& product : weights.getProducts()) {
+			Product line;
+			line.ID_ = product.ID_;
+			line.quantity_ = 2;
+			line.weight_ = 0;
+			bare.products_.push_back(line);
+			expected += 2 * product.weight_;
+		}
+		OrderReport report;
+		bool verified = weights.VerifyOrder(bare, report);
+		Order task = weights.CollectionTask(bare);
+		double weight = 0;
+		for (auto& item : task.products_) {
+			weight += item.weight_;
+		}
+		std::cout << "Collection task weight: " << weight << " kg, catalog " << expected << " kg: "
+			<< (verified && expected > 0 && std::abs(weight - expected) < 1e-9 ? "PASSED" : "FAILED") << std::endl;
+	}
+	//-----------------------------------------------------------------------------------
+
+	// Testing orders placed through the shared-memory order channel: only ids and quantities cross it,
+	// the collection tasks made from them must still carry the catalog weights
+	//-----------------------------------------------------------------------------------
+	{
+		Warehouse channel_ware(DISCRETE_EVENT_CLOCK, 1);
+		double weight = 0;
+		OrderChannelReader reader("test_orders", [&](const std::vector<Order>& orders) {
+			std::vector<OrderReport> reports(orders.size());
+			for (size_t i = 0; i < orders.size(); i++) {
+				Order order = orders[i];
+				if (channel_ware.VerifyOrder(order, reports[i])) {
+					for (auto& item : channel_ware.CollectionTask(order).products_) {
+						weight += item.weight_;
+					}
+				}
+			}
+			return reports;
+		});
+		reader.reset();
+		reader.start();
+
+		Order order;
+		order.ID_ = 9002;
+		double expected = 0;
+		for (auto& product : channel_ware.getProducts()) {
+			Product line;
+			line.ID_ = product.ID_;
+			line.quantity_ = 3;
+			order.products_.push_back(line);
+			expected += 3 * product.weight_;
+		}
+		OrderChannelWriter writer("test_orders");
+		OrderReport report = writer.Submit(order);
+		reader.stop();
+		reader.unlink();
+		std::cout << "Order channel task weight: " << weight << " kg, catalog " << expected << " kg: "
+			<< (report.verified && expected > 0 && std::abs(weight - expected) < 1e-9 ? "PASSED" : "FAILED") << std::endl;
+	}
+	//-----------------------------------------------------------------------------------
+
+	// Testing discrete event replay: the same seed and the same orders placed at the same simulated
+	// times must hand out the same clock turns at the same times on every run
+	//-----------------------------------------------------------------------------------
+	{
+		auto replay = [](unsigned int seed) {
+			Warehouse sim(DISCRETE_EVENT_CLOCK, seed);
+			sim.getClock().RecordEvents(true);
+			sim.CreateRobotArmy(4);
+			std::vector<Product> catalog = sim.getProducts();
+			std::mt19937 rnd(seed);
+			for (int round = 0; round < 10; round++) {
+				std::vector<Order> orders(5);
+				for (int i = 0; i < 5; i++) {
+					orders[i].ID_ = round * 5 + i;
+					orders[i].products_.push_back(catalog[rnd() % catalog.size()]);
+					orders[i].products_.back().quantity_ = 1;
+					sim.getInventory(orders[i].products_.back().ID_)->store(sim.getStorage().GetFreeShelf());
+				}
+				sim.AddOrders(orders);
+				sim.RunFor(300);
+			}
+			sim.RunUntilIdle();
+			std::vector<ClockEvent> events = sim.getClock().Events();
+			sim.KillRobots();
+			return events;
+		};
+		std::vector<ClockEvent> first = replay(7);
+		std::vector<ClockEvent> second = replay(7);
+		bool same = !first.empty() && first.size() == second.size();
+		for (size_t i = 0; same && i < first.size(); i++) {
+			same = first[i].time == second[i].time && first[i].participant == second[i].participant;
+		}
+		std::cout << "Discrete event replay: " << first.size() << " and " << second.size() << " turns: "
+			<< (same ? "PASSED" : "FAILED") << std::endl;
+	}
+	//-----------------------------------------------------------------------------------
+
+	// Testing orders placed after the robots are shut down: the batcher refuses them, so they must be
+	// reported as not placed and their items put back in stock
+	//-----------------------------------------------------------------------------------
+	{
+		Warehouse stopped(DISCRETE_EVENT_CLOCK, 1);
+		stopped.KillRobots();
+		Order late;
+		late.ID_ = 9003;
+		late.products_.push_back(stopped.getProducts()[0]);
+		late.products_.back().quantity_ = 1;
+		Inventory* inventory = stopped.getInventory(late.products_.back().ID_);
+		inventory->store(stopped.getStorage().GetFreeShelf());
+		int stock = inventory->numStored();
+		OrderReport report = stopped.AddOrder(late);
+		std::cout << "Order after shutdown: " << (report.verified ? "placed" : "turned away") << ", stock "
+			<< inventory->numStored() << " of " << stock << ": "
+			<< (!report.verified && inventory->numStored() == stock && stopped.getOrderStatus(late.ID_) == OrderStatus::UNKNOWN
+				? "PASSED" : "FAILED") << std::endl;
+	}
+	//-----------------------------------------------------------------------------------
+
 	// Testing Robot queue
 	//-----------------------------------------------------------------------------------
 
@@ -0,0 +1,455 @@
+/**
+ * @file
+ *
+ * Compact binary alternative to the JSON API, for clients that submit orders at a high rate.
+ *
+ * Frames use the same header as JSON frames, with a different indicator byte, so the server
+ * tells the two apart from the first byte a client sends and answers every frame in the
+ * encoding it arrived in.  The JSON API stays available for debugging.
+ *
+ * Communication format:
+ *   BINARY_ID (1 byte), body size (4 bytes - big endian), message type (1 byte),
+ *   request id (__uint__), fields
+ *
+ * No field names are sent.  Integers are varints: 7 bits per byte, least significant group
+ * first, high bit set on every byte but the last.  Signed fields are zig-zag mapped first so
+ * small negative values stay short.  Strings are a length followed by the bytes, with no
+ * terminating zero.
+ *
+ *  __uint__: varint, used for counts, lengths and request ids
+ *  __int__: zig-zag varint
+ *  __str__: __uint__ length, bytes
+ *  __line__: product line: __int__ product id, __int__ quantity, __int__ price, __str__ name
+ *  __order__: __int__ order id, __uint__ number of lines, __line__ ... (packed back to back)
+ *  __report__: flags (1 byte: 1 verified, 2 duplicate), __int__ product id, __int__ quantity
+ *
+ * Verify an order:
+ *   VERIFY_ORDER, __order__
+ *
+ * Response to verifying an order:
+ *   VERIFY_ORDER_RESPONSE, __report__
+ *
+ * Submit several orders:
+ *   SUBMIT_ORDERS, __uint__ number of orders, __order__ ...
+ *
+ * Response to submitting orders:
+ *   SUBMIT_ORDERS_RESPONSE, __uint__ number of reports, __report__ ...
+ *
+ * Request the stock of a product:
+ *   REQUEST_INVENTORY, __int__ product id
+ *
+ * Response to an inventory request, no lines if the product is unknown:
+ *   REQUEST_INVENTORY_RESPONSE, __uint__ number of lines, __line__ ...
+ *
+ * Goodbye:
+ *   GOODBYE
+ *
+ * The request id of every request is copied into its response.
+ *
+ * E.g. request 7, verifying order 300 for 2 of product 5 at price 10 named "ab":
+ *    0x42   0x00 0x00 0x00 0x0B   0x00   0x07   0xD8 0x04   0x01   0x0A 0x04 0x14 0x02 0x61 0x62
+ *  <BINARY>   <integer: 11>     <type>  <7>   <id: 300>  <1 line>  <5>  <2>  <10>  <"ab">
+ */
+
+#ifndef BINARYWAREHOUSEAPI_H
+#define BINARYWAREHOUSEAPI_H
+
+#include <memory>
+#include <string>
+#include <cstdint>
+#include "WarehouseApi.h"
+#include "Message.h"
+#include "FrameReader.h"
+
+#include <cpen333/process/socket.h>
+
+#define BINARY_HEADER_SIZE 5  // indicator byte and body size
+#define BINARY_MIN_LINE 4     // smallest encoded product line, bounds the line count of a frame
+#define BINARY_MIN_ORDER 2    // smallest encoded order
+#define BINARY_MIN_REPORT 3   // smallest encoded report
+#define BINARY_VERIFIED 1
+#define BINARY_DUPLICATE 2
+
+/**
+ * Varint encoding and decoding of the individual fields
+ */
+class BinaryCodec {
+ public:
+
+  static void putVarint(std::string &out, uint64_t value) {
+    while (value >= 0x80) {
+      out.push_back((char)((value & 0x7F) | 0x80));
+      value >>= 7;
+    }
+    out.push_back((char)value);
+  }
+
+  static void putInt(std::string &out, int64_t value) {
+    putVarint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+  }
+
+  static void putString(std::string &out, const std::string &str) {
+    putVarint(out, str.size());
+    out.append(str);
+  }
+
+  static void putLine(std::string &out, const ServerProduct &product) {
+    putInt(out, product.product_id);
+    putInt(out, product.quantity);
+    putInt(out, product.price_);
+    putString(out, product.name_);
+  }
+
+  static void putOrder(std::string &out, const ServerOrder &order) {
+    putInt(out, order.ID_);
+    putVarint(out, order.products_.size());
+    for (const auto &product : order.products_) {
+      putLine(out, product);
+    }
+  }
+
+  static void putReport(std::string &out, const ServerReport &report) {
+    out.push_back((char)((report.verified ? BINARY_VERIFIED : 0) | (report.duplicate ? BINARY_DUPLICATE : 0)));
+    putInt(out, report.product_ID);
+    putInt(out, report.quantity);
+  }
+
+  /**
+   * Reads fields back out of a frame body, every get fails once the body runs out
+   */
+  class Reader {
+   private:
+    const unsigned char *pos_;
+    const unsigned char *end_;
+
+   public:
+    Reader(const std::string &body) :
+      pos_((const unsigned char*)body.data()), end_(pos_ + body.size()) {}
+
+    size_t remaining() const {
+      return end_ - pos_;
+    }
+
+    bool getByte(unsigned char &out) {
+      if (pos_ == end_) {
+        return false;
+      }
+      out = *pos_++;
+      return true;
+    }
+
+    bool getVarint(uint64_t &out) {
+      out = 0;
+      for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char b;
+        if (!getByte(b)) {
+          return false;
+        }
+        out |= (uint64_t)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+          return true;
+        }
+      }
+      return false;  // more than 10 bytes, corrupt
+    }
+
+    bool getInt(int &out) {
+      uint64_t v;
+      if (!getVarint(v)) {
+        return false;
+      }
+      out = (int)(int64_t)((v >> 1) ^ (~(v & 1) + 1));
+      return true;
+    }
+
+    bool getString(std::string &out) {
+      uint64_t size;
+      if (!getVarint(size) || size > remaining()) {
+        return false;
+      }
+      out.assign((const char*)pos_, (size_t)size);
+      pos_ += size;
+      return true;
+    }
+
+    bool getLine(ServerProduct &out) {
+      return getInt(out.product_id) && getInt(out.quantity)
+          && getInt(out.price_) && getString(out.name_);
+    }
+
+    bool getOrder(ServerOrder &out) {
+      uint64_t lines;
+      if (!getInt(out.ID_) || !getVarint(lines) || lines > remaining() / BINARY_MIN_LINE) {
+        return false;
+      }
+      out.products_.resize((size_t)lines);
+      for (auto &product : out.products_) {
+        if (!getLine(product)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    bool getReport(ServerReport &out) {
+      unsigned char flags;
+      if (!getByte(flags) || !getInt(out.product_ID) || !getInt(out.quantity)) {
+        return false;
+      }
+      out.verified = (flags & BINARY_VERIFIED) != 0;
+      out.duplicate = (flags & BINARY_DUPLICATE) != 0;
+      return true;
+    }
+  };
+};
+
+/**
+ * Handles communication between sockets using the binary encoding
+ */
+class BinaryWarehouseApi {
+ private:
+  cpen333::process::socket socket_;
+  FrameReader<cpen333::process::socket> reader_;  // all reads go through here, keep after socket_
+  std::string frame_;  // last frame body, reused so its capacity carries over between messages
+
+  // prevent default constructor
+  BinaryWarehouseApi();
+
+ public:
+
+  // Fixed message type, sent where the JSON API sends JsonWarehouseApi::JSON_ID
+  static const char BINARY_ID = 0x42;
+
+  /**
+   * Encodes a message as it goes on the wire: binary byte, size and body
+   * @param msg message to encode
+   * @return bytes to send, empty if the message type has no binary encoding
+   */
+  static std::string encodeMessage(const Message &msg) {
+    std::string out(BINARY_HEADER_SIZE, 0);
+    out[0] = BINARY_ID;
+    out.push_back((char)msg.type());
+    BinaryCodec::putVarint(out, msg.id);
+
+    switch (msg.type()) {
+      case MessageType::VERIFY_ORDER: {
+        BinaryCodec::putOrder(out, ((const VerifyOrderMessage &) msg).order_);
+        break;
+      }
+      case MessageType::VERIFY_ORDER_RESPONSE: {
+        BinaryCodec::putReport(out, ((const VerifyOrderResponseMessage &) msg).report_);
+        break;
+      }
+      case MessageType::SUBMIT_ORDERS: {
+        const std::vector<ServerOrder> &orders = ((const SubmitOrdersMessage &) msg).orders_;
+        BinaryCodec::putVarint(out, orders.size());
+        for (const auto &order : orders) {
+          BinaryCodec::putOrder(out, order);
+        }
+        break;
+      }
+      case MessageType::SUBMIT_ORDERS_RESPONSE: {
+        const std::vector<ServerReport> &reports = ((const SubmitOrdersResponseMessage &) msg).reports_;
+        BinaryCodec::putVarint(out, reports.size());
+        for (const auto &report : reports) {
+          BinaryCodec::putReport(out, report);
+        }
+        break;
+      }
+      case MessageType::REQUEST_INVENTORY_RESPONSE: {
+        const RequestInventoryResponseMessage &inv = (const RequestInventoryResponseMessage &) msg;
+        BinaryCodec::putVarint(out, inv.products_.size());
+        for (const auto &product : inv.products_) {
+          BinaryCodec::putLine(out, product);
+        }
+        break;
+      }
+      case MessageType::REQUEST_INVENTORY: {
+        BinaryCodec::putInt(out, ((const RequestInventoryMessage &) msg).product_id_);
+        break;
+      }
+      case MessageType::GOODBYE:
+        break;
+      default:
+        return std::string();
+    }
+
+    // body size, big endian
+    size_t size = out.size() - BINARY_HEADER_SIZE;
+    for (int i = BINARY_HEADER_SIZE; i-- > 1;) {
+      out[i] = (char)(size & 0xFF);
+      size >>= 8;
+    }
+    return out;
+  }
+
+  /**
+   * Parses the content of a binary frame (everything after the size)
+   * @param body frame body
+   * @return parsed message, nullptr if the body is not exactly one valid message
+   */
+  static std::unique_ptr<Message> decodeMessage(const std::string &body) {
+    BinaryCodec::Reader in(body);
+    unsigned char type;
+    uint64_t id;
+    if (!in.getByte(type) || !in.getVarint(id) || id > UINT32_MAX) {
+      return nullptr;
+    }
+
+    std::unique_ptr<Message> msg;
+    switch (type) {
+      case MessageType::VERIFY_ORDER: {
+        ServerOrder order;
+        if (!in.getOrder(order)) {
+          return nullptr;
+        }
+        msg.reset(new VerifyOrderMessage(order));
+        break;
+      }
+      case MessageType::VERIFY_ORDER_RESPONSE: {
+        ServerReport report;
+        if (!in.getReport(report)) {
+          return nullptr;
+        }
+        msg.reset(new VerifyOrderResponseMessage(report));
+        break;
+      }
+      case MessageType::SUBMIT_ORDERS: {
+        std::unique_ptr<SubmitOrdersMessage> submit(new SubmitOrdersMessage());
+        uint64_t count;
+        if (!in.getVarint(count) || count > in.remaining() / BINARY_MIN_ORDER) {
+          return nullptr;
+        }
+        submit->orders_.resize((size_t)count);
+        for (auto &order : submit->orders_) {
+          if (!in.getOrder(order)) {
+            return nullptr;
+          }
+        }
+        msg = std::move(submit);
+        break;
+      }
+      case MessageType::SUBMIT_ORDERS_RESPONSE: {
+        std::unique_ptr<SubmitOrdersResponseMessage> resp(new SubmitOrdersResponseMessage());
+        uint64_t count;
+        if (!in.getVarint(count) || count > in.remaining() / BINARY_MIN_REPORT) {
+          return nullptr;
+        }
+        resp->reports_.resize((size_t)count);
+        for (auto &report : resp->reports_) {
+          if (!in.getReport(report)) {
+            return nullptr;
+          }
+        }
+        msg = std::move(resp);
+        break;
+      }
+      case MessageType::REQUEST_INVENTORY: {
+        int product_id;
+        if (!in.getInt(product_id)) {
+          return nullptr;
+        }
+        msg.reset(new RequestInventoryMessage(product_id));
+        break;
+      }
+      case MessageType::REQUEST_INVENTORY_RESPONSE: {
+        std::unique_ptr<RequestInventoryResponseMessage> inv(new RequestInventoryResponseMessage());
+        uint64_t lines;
+        if (!in.getVarint(lines) || lines > in.remaining() / BINARY_MIN_LINE) {
+          return nullptr;
+        }
+        inv->products_.resize((size_t)lines);
+        for (auto &product : inv->products_) {
+          if (!in.getLine(product)) {
+            return nullptr;
+          }
+        }
+        msg = std::move(inv);
+        break;
+      }
+      case MessageType::GOODBYE: {
+        msg.reset(new GoodbyeMessage());
+        break;
+      }
+      default:
+        return nullptr;
+    }
+
+    // trailing bytes mean the sender and receiver disagree on the format
+    if (in.remaining() != 0) {
+      return nullptr;
+    }
+    msg->id = (uint32_t)id;
+    return msg;
+  }
+
+  /**
+   * Gives a frame encoded without a request id the given one, so a cached response can be
+   * reused for any request without encoding it again
+   * @param frame output of encodeMessage for a message with id 0
+   * @param id request id to put in its place
+   * @return frame carrying id
+   */
+  static std::string withRequestId(const std::string &frame, uint32_t id) {
+    if (id == 0 || frame.size() < BINARY_HEADER_SIZE + 2) {
+      return frame;
+    }
+    std::string out(frame, 0, BINARY_HEADER_SIZE + 1);
+    BinaryCodec::putVarint(out, id);
+    out.append(frame, BINARY_HEADER_SIZE + 2, std::string::npos);
+
+    size_t size = out.size() - BINARY_HEADER_SIZE;
+    for (int i = BINARY_HEADER_SIZE; i-- > 1;) {
+      out[i] = (char)(size & 0xFF);
+      size >>= 8;
+    }
+    return out;
+  }
+
+  /**
+   * Main constructor, takes ownership of socket
+   * @param socket
+   */
+  BinaryWarehouseApi(cpen333::process::socket&& socket) :
+    socket_(std::move(socket)), reader_(socket_) {}
+
+  // the reader refers to our own socket, so it can't be moved along with it
+  BinaryWarehouseApi(BinaryWarehouseApi&& other) :
+    socket_(std::move(other.socket_)), reader_(socket_) {}
+
+  /**
+   * Sends a message by writing the data to the socket
+   * @param msg message to write
+   * @return true if successful, false if error
+   */
+  bool sendMessage(const Message& msg) {
+    std::string out = encodeMessage(msg);
+    if (out.empty()) {
+      return false;
+    }
+    return socket_.write(out.data(), out.size());
+  }
+
+  /**
+   * Reads a message from the socket.  The returned message is
+   * contained within a smart pointer to preserve polymorphism.
+   *
+   * @return parsed message, nullptr if an error occurred
+   */
+  std::unique_ptr<Message> recvMessage() {
+
+    // parse first byte, ensure it is of binary type
+    char id;
+    if (!reader_.read(&id, 1) || id != BINARY_ID) {
+      return nullptr;
+    }
+
+    if (!reader_.readFrame(frame_, false)) {
+      return nullptr;
+    }
+    return decodeMessage(frame_);
+  }
+
+};
+
+#endif //BINARYWAREHOUSEAPI_H
@@ -0,0 +1,310 @@
+/**
+ * @file
+ *
+ * Search index over the product catalog, behind the catalog search endpoint.
+ *
+ * It has three parts:
+ *  - products by ID in a hash map, for exact lookups
+ *  - a sorted map from every lower-case word of a product name to the products containing it,
+ *    so all words that start with a prefix are one lower_bound away (typeahead)
+ *  - a cache of compiled regular expressions for the full regex search, which still scans
+ *
+ * Adding or removing a product only touches the words of its own name.  The index is not
+ * thread safe, callers lock around it or publish copies of it; the regex cache locks itself
+ * and is shared between copies.
+ */
+
+#ifndef CATALOGINDEX_H
+#define CATALOGINDEX_H
+
+#include "ServerObjects.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define CATALOG_REGEX_CACHE_SIZE 64  // compiled patterns kept
+#define CATALOG_TYPEAHEAD_LIMIT 10   // default number of typeahead suggestions
+
+/**
+ * Compiled regular expressions by pattern, least recently used dropped first
+ */
+class RegexCache {
+ private:
+  struct Entry {
+    std::shared_ptr<const std::regex> regex;
+    std::list<std::string>::iterator lru;
+  };
+
+  std::mutex mutex_;
+  const size_t capacity_;
+  std::list<std::string> lru_;  // most recently used first
+  std::unordered_map<std::string, Entry> entries_;
+  unsigned long hits_;
+  unsigned long misses_;
+
+ public:
+  RegexCache(size_t capacity = CATALOG_REGEX_CACHE_SIZE) :
+    capacity_(capacity), hits_(0), misses_(0) {}
+
+  /**
+   * Looks up or compiles a pattern
+   * @param pattern ECMAScript regular expression
+   * @return the compiled pattern, nullptr if it is not a valid regular expression
+   */
+  std::shared_ptr<const std::regex> get(const std::string& pattern) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = entries_.find(pattern);
+      if (it != entries_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        hits_++;
+        return it->second.regex;
+      }
+      misses_++;
+    }
+
+    // compile without the lock, other patterns can be served meanwhile
+    std::shared_ptr<const std::regex> regex;
+    try {
+      regex = std::make_shared<const std::regex>(pattern, std::regex::optimize);
+    } catch (const std::regex_error&) {
+      return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.count(pattern) == 0) {
+      lru_.push_front(pattern);
+      Entry entry = { regex, lru_.begin() };
+      entries_[pattern] = entry;
+      if (entries_.size() > capacity_) {
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+      }
+    }
+    return regex;
+  }
+
+  unsigned long hits() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+  }
+
+  unsigned long misses() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+  }
+};
+
+class CatalogIndex {
+ private:
+  std::unordered_map<int, ServerProduct> products_;
+  std::map<std::string, std::vector<int>> words_;  // word -> IDs of the products whose name has it
+  std::shared_ptr<RegexCache> regexes_;  // shared by copies of the index, see SnapshotPublisher
+
+  static bool starts_with(const std::string& word, const std::string& prefix) {
+    return word.size() >= prefix.size() && word.compare(0, prefix.size(), prefix) == 0;
+  }
+
+  // true if some word of text starts with prefix, compared as tokenize() would see it
+  static bool has_word_prefix(const std::string& text, const std::string& prefix) {
+    size_t n = text.size();
+    for (size_t start = 0; start < n; start++) {
+      if (!std::isalnum((unsigned char)text[start]) || (start > 0 && std::isalnum((unsigned char)text[start - 1]))) {
+        continue;
+      }
+      size_t k = 0;
+      while (k < prefix.size() && start + k < n && std::isalnum((unsigned char)text[start + k])
+             && std::tolower((unsigned char)text[start + k]) == (unsigned char)prefix[k]) {
+        k++;
+      }
+      if (k == prefix.size()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // number of postings under words starting with prefix, stops counting past bound
+  size_t postings(const std::string& prefix, size_t bound) const {
+    size_t count = 0;
+    for (auto it = words_.lower_bound(prefix); it != words_.end() && starts_with(it->first, prefix); ++it) {
+      count += it->second.size();
+      if (count > bound) {
+        break;
+      }
+    }
+    return count;
+  }
+
+ public:
+  CatalogIndex() : regexes_(std::make_shared<RegexCache>()) {}
+
+  /**
+   * Splits text into lower-case runs of letters and digits, each word listed once
+   */
+  static std::vector<std::string> tokenize(const std::string& text) {
+    std::vector<std::string> out;
+    std::string word;
+    for (size_t i = 0; i <= text.size(); i++) {
+      unsigned char c = i < text.size() ? (unsigned char)text[i] : ' ';
+      if (std::isalnum(c)) {
+        word.push_back((char)std::tolower(c));
+      } else if (!word.empty()) {
+        if (std::find(out.begin(), out.end(), word) == out.end()) {
+          out.push_back(word);
+        }
+        word.clear();
+      }
+    }
+    return out;
+  }
+
+  /**
+   * Adds a product to the catalog
+   * @return false if a product with that ID is already in the catalog
+   */
+  bool add(const ServerProduct& product) {
+    auto inserted = products_.insert(std::make_pair(product.product_id, product));
+    if (!inserted.second) {
+      return false;
+    }
+    for (const auto& word : tokenize(product.name_)) {
+      words_[word].push_back(product.product_id);
+    }
+    return true;
+  }
+
+  /**
+   * Removes a product from the catalog
+   * @return false if there is no product with that ID
+   */
+  bool remove(int product_id) {
+    auto it = products_.find(product_id);
+    if (it == products_.end()) {
+      return false;
+    }
+    for (const auto& word : tokenize(it->second.name_)) {
+      auto posting = words_.find(word);
+      if (posting == words_.end()) {
+        continue;
+      }
+      std::vector<int>& ids = posting->second;
+      auto pos = std::find(ids.begin(), ids.end(), product_id);
+      if (pos != ids.end()) {
+        *pos = ids.back();
+        ids.pop_back();
+      }
+      if (ids.empty()) {
+        words_.erase(posting);
+      }
+    }
+    products_.erase(it);
+    return true;
+  }
+
+  /**
+   * Exact lookup by ID
+   * @return the product, nullptr if there is none, valid until the product is removed
+   */
+  const ServerProduct* find(int product_id) const {
+    auto it = products_.find(product_id);
+    return it == products_.end() ? nullptr : &it->second;
+  }
+
+  size_t size() const {
+    return products_.size();
+  }
+
+  /**
+   * Suggestions for a partly typed query: products that have, for every word of the query,
+   * a name word starting with it.  "red sh" finds "Red Shoes" and "Shiny red bike".
+   * Candidates come from the query word with the fewest matching postings and the scan stops
+   * at limit, so the cost depends on how rare the query is rather than on the catalog size.
+   *
+   * @param query words typed so far, case is ignored
+   * @param limit most suggestions to return
+   * @return matching products, products matched through alphabetically earlier words first
+   */
+  std::vector<ServerProduct> typeahead(const std::string& query, size_t limit = CATALOG_TYPEAHEAD_LIMIT) const {
+    std::vector<ServerProduct> out;
+    std::vector<std::string> query_words = tokenize(query);
+    if (query_words.empty() || limit == 0) {
+      return out;
+    }
+
+    // drive the search from the most selective word
+    size_t driver = 0;
+    size_t fewest = SIZE_MAX;
+    for (size_t i = 0; i < query_words.size() && query_words.size() > 1; i++) {
+      size_t count = postings(query_words[i], fewest);
+      if (count < fewest) {
+        fewest = count;
+        driver = i;
+      }
+    }
+
+    const std::string& prefix = query_words[driver];
+    std::unordered_set<int> seen;
+    for (auto it = words_.lower_bound(prefix); it != words_.end() && starts_with(it->first, prefix); ++it) {
+      for (int id : it->second) {
+        if (!seen.insert(id).second) {
+          continue;
+        }
+        const ServerProduct& product = products_.find(id)->second;
+        bool match = true;
+        for (size_t i = 0; i < query_words.size() && match; i++) {
+          match = i == driver || has_word_prefix(product.name_, query_words[i]);
+        }
+        if (!match) {
+          continue;
+        }
+        out.push_back(product);
+        if (out.size() == limit) {
+          return out;
+        }
+      }
+    }
+    return out;
+  }
+
+  /**
+   * Full regular expression search over product names.  Still a scan of the catalog, but the
+   * pattern is compiled once and reused by later searches.
+   *
+   * @param name_regex ECMAScript regular expression searched for in each name
+   * @param limit most products to return
+   * @return matching products, none if the expression is invalid
+   */
+  std::vector<ServerProduct> search(const std::string& name_regex, size_t limit = SIZE_MAX) const {
+    std::vector<ServerProduct> out;
+    std::shared_ptr<const std::regex> regex = regexes_->get(name_regex);
+    if (regex == nullptr) {
+      return out;
+    }
+    for (const auto& entry : products_) {
+      if (out.size() == limit) {
+        break;
+      }
+      if (std::regex_search(entry.second.name_, *regex)) {
+        out.push_back(entry.second);
+      }
+    }
+    return out;
+  }
+
+  RegexCache& regexCache() const {
+    return *regexes_;
+  }
+};
+
+#endif //CATALOGINDEX_H
@@ -0,0 +1,191 @@
+/**
+ * @file
+ *
+ * Streams product catalogs from JSON files into the library.
+ *
+ * A catalog file is a top-level JSON array of products, each as JsonConverter::parseProduct
+ * reads them.  The file is parsed straight from the stream with a parser callback that takes
+ * every product as soon as its closing brace is read and then drops it from the document, so
+ * memory stays at the size of one product plus the batch waiting to be added.  Products reach
+ * the library in batches that grow with the catalog, so they become searchable while the file
+ * is still loading without the catalog being copied once per product (see MusicLibrary).
+ *
+ * Several files load on parallel threads.
+ */
+
+#ifndef CATALOGLOADER_H
+#define CATALOGLOADER_H
+
+#include "MusicLibrary.h"
+#include "JsonConverter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CATALOG_LOAD_MIN_BATCH 4096  // products added to the library at once, at least
+
+/**
+ * What a load did, summed over files
+ */
+struct CatalogLoadStats {
+  size_t files;       // files read to the end
+  size_t failed;      // files that could not be opened or are not valid JSON
+  uint64_t bytes;     // size of the files read
+  size_t products;    // products added
+  size_t duplicates;  // products whose ID was already in the catalog
+  size_t skipped;     // array elements that are not products
+  double seconds;     // wall clock time of the whole load
+
+  CatalogLoadStats() : files(0), failed(0), bytes(0), products(0), duplicates(0), skipped(0), seconds(0) {}
+
+  double megabytesPerSecond() const {
+    return seconds > 0 ? bytes / (1024.0 * 1024.0) / seconds : 0;
+  }
+
+  void add(const CatalogLoadStats& other) {
+    files += other.files;
+    failed += other.failed;
+    bytes += other.bytes;
+    products += other.products;
+    duplicates += other.duplicates;
+    skipped += other.skipped;
+  }
+};
+
+class CatalogLoader {
+ private:
+  // adds a batch to the library and counts what went in
+  static void flush(MusicLibrary &lib, std::vector<ServerProduct> &batch, CatalogLoadStats &stats) {
+    if (batch.empty()) {
+      return;
+    }
+    size_t added = lib.add(batch);
+    stats.products += added;
+    stats.duplicates += batch.size() - added;
+    batch.clear();
+  }
+
+  // parseProduct asserts on missing keys, only wrong types throw
+  static bool has_product_keys(const JSON &j) {
+    return j.is_object() && j.count(MESSAGE_PRODUCT_ID) > 0 && j.count(MESSAGE_PRODUCT_NAME) > 0
+        && j.count(MESSAGE_PRODUCT_PRICE) > 0 && j.count(MESSAGE_QUANTITY) > 0;
+  }
+
+ public:
+  /**
+   * Loads one catalog file
+   * @param lib library to add the products to
+   * @param filename JSON file holding an array of products
+   * @param stats updated with what was read, even if the file turns out to be invalid
+   * @return false if the file could not be opened or parsed, products read before the
+   *         error are still added
+   */
+  static bool loadFile(MusicLibrary &lib, const std::string &filename, CatalogLoadStats &stats) {
+    std::ifstream fin(filename, std::ios::binary);
+    if (!fin.is_open()) {
+      std::cerr << "Failed to open file: " << filename << std::endl;
+      stats.failed++;
+      return false;
+    }
+    fin.seekg(0, std::ios::end);
+    uint64_t size = (uint64_t)fin.tellg();
+    fin.seekg(0, std::ios::beg);
+
+    std::vector<ServerProduct> batch;
+    auto on_event = [&](int depth, JSON::parse_event_t event, JSON &parsed) {
+      // only elements of the top-level array are of interest, everything inside them is kept
+      // until the element is complete
+      if (depth != 1) {
+        return true;
+      }
+      if (event == JSON::parse_event_t::object_end) {
+        try {
+          if (has_product_keys(parsed)) {
+            batch.push_back(JsonConverter::parseProduct(parsed));
+          } else {
+            stats.skipped++;
+          }
+        } catch (const std::exception &) {
+          stats.skipped++;
+        }
+        if (batch.size() >= std::max((size_t)CATALOG_LOAD_MIN_BATCH, lib.size() / 2)) {
+          flush(lib, batch, stats);
+        }
+        return false;  // drop the element from the document
+      }
+      if (event == JSON::parse_event_t::value) {
+        if (!parsed.is_discarded()) {
+          stats.skipped++;    // not an object
+          parsed = nullptr;   // free it before the parser discards it
+        }
+        return false;
+      }
+      return true;
+    };
+
+    bool ok = true;
+    try {
+      JSON::parse(fin, on_event);
+    } catch (const std::exception &e) {
+      std::cerr << "Failed to parse " << filename << ": " << e.what() << std::endl;
+      ok = false;
+    }
+    flush(lib, batch, stats);
+
+    stats.bytes += size;
+    if (ok) {
+      stats.files++;
+    } else {
+      stats.failed++;
+    }
+    return ok;
+  }
+
+  /**
+   * Loads catalog files on parallel threads
+   * @param lib library to add the products to
+   * @param filenames JSON files holding arrays of products
+   * @param threads most files loading at once, 0 for one per core
+   * @return totals over all files
+   */
+  static CatalogLoadStats loadFiles(MusicLibrary &lib, const std::vector<std::string> &filenames,
+                                    size_t threads = 0) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min(threads, filenames.size());
+
+    auto start = std::chrono::steady_clock::now();
+    CatalogLoadStats total;
+    std::mutex total_mutex;
+    std::atomic<size_t> next(0);
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; i++) {
+      workers.emplace_back([&]() {
+        CatalogLoadStats stats;
+        for (size_t file = next++; file < filenames.size(); file = next++) {
+          loadFile(lib, filenames[file], stats);
+        }
+        std::lock_guard<std::mutex> lock(total_mutex);
+        total.add(stats);
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+
+    total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return total;
+  }
+};
+
+#endif //CATALOGLOADER_H
@@ -0,0 +1,121 @@
+/**
+ * @file
+ *
+ * Buffered reader for the length-prefixed frames used by the warehouse APIs.
+ *
+ * Bytes are pulled off the socket in large reads into one buffer that is reused for the
+ * lifetime of the connection, so a client that pipelines several small messages has them
+ * all served from a single recv.  A frame body is read straight into the caller's string,
+ * sized once from the 4-byte header: whatever is already buffered is copied over, and the
+ * rest of a large body bypasses the buffer and goes directly from the socket into the string.
+ */
+
+#ifndef FRAMEREADER_H
+#define FRAMEREADER_H
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define FRAME_BUFFER_SIZE 65536
+#define FRAME_MAX_SIZE (64u*1024u*1024u)  // larger headers are treated as a corrupt stream
+
+/**
+ * @tparam Stream anything with size_t read(void* buff, size_t size) returning 0 on error or
+ *         disconnect, e.g. cpen333::process::socket
+ */
+template<typename Stream>
+class FrameReader {
+ private:
+  Stream& stream_;
+  std::vector<char> buffer_;
+  size_t begin_;  // first unread byte in buffer_
+  size_t end_;    // one past the last valid byte in buffer_
+
+  // refills the buffer with at least one byte, false on error or disconnect
+  bool fill() {
+    begin_ = 0;
+    end_ = stream_.read(buffer_.data(), buffer_.size());
+    return end_ > 0;
+  }
+
+ public:
+  FrameReader(Stream& stream, size_t buffer_size = FRAME_BUFFER_SIZE) :
+    stream_(stream), buffer_(buffer_size), begin_(0), end_(0) {}
+
+  /**
+   * Number of bytes already received but not consumed, i.e. the start of
+   * further pipelined frames
+   */
+  size_t buffered() const {
+    return end_ - begin_;
+  }
+
+  /**
+   * Reads exactly size bytes
+   * @return false if the stream failed or closed before size bytes arrived
+   */
+  bool read(void* buff, size_t size) {
+    char* out = (char*)buff;
+
+    size_t n = std::min(size, buffered());
+    std::memcpy(out, &buffer_[begin_], n);
+    begin_ += n;
+    out += n;
+    size -= n;
+
+    while (size > 0) {
+      // big remainders go straight into the destination, small ones through the buffer
+      // so the bytes after them (the next frames) are picked up by the same read
+      if (size >= buffer_.size()) {
+        size_t lread = stream_.read(out, size);
+        if (lread == 0) {
+          return false;
+        }
+        out += lread;
+        size -= lread;
+      } else {
+        if (!fill()) {
+          return false;
+        }
+        n = std::min(size, buffered());
+        std::memcpy(out, &buffer_[begin_], n);
+        begin_ += n;
+        out += n;
+        size -= n;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Reads a 4-byte big-endian size followed by that many bytes
+   * @param out replaced by the frame body
+   * @param text drop the terminating zero a text (JSON) sender appends, binary bodies
+   *        are returned as is
+   * @return false if the stream failed, closed, or the size is over FRAME_MAX_SIZE
+   */
+  bool readFrame(std::string& out, bool text = true) {
+    unsigned char header[4];
+    if (!read(header, 4)) {
+      return false;
+    }
+    size_t size = ((size_t)header[0] << 24) | ((size_t)header[1] << 16)
+        | ((size_t)header[2] << 8) | (size_t)header[3];
+    if (size > FRAME_MAX_SIZE) {
+      return false;
+    }
+
+    out.resize(size);
+    if (size > 0 && !read(&out[0], size)) {
+      return false;
+    }
+    if (text && !out.empty() && out.back() == 0) {
+      out.pop_back();
+    }
+    return true;
+  }
+};
+
+#endif //FRAMEREADER_H
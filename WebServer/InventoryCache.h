@@ -0,0 +1,138 @@
+/**
+ * @file
+ *
+ * Cache of encoded inventory responses.  Product pages ask for the stock of the same few
+ * hundred products over and over, and the stock changes far less often than it is asked for.
+ *
+ * An entry is a whole response frame, encoded without a request id, keyed by the API it is
+ * encoded for and the product ID.  It is stamped with the version of the product's inventory
+ * it was built from and only served while the inventory is still at that version, so nothing
+ * needs to be invalidated when stock moves.
+ *
+ * Slots are sequence locks: a lookup copies the frame out and then checks that no writer
+ * touched the slot meanwhile, so hits never wait on a lock.  A writer that finds the slot
+ * busy just doesn't cache its frame.  Two keys landing on the same slot evict each other.
+ */
+
+#ifndef INVENTORYCACHE_H
+#define INVENTORYCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#define INVENTORY_CACHE_SLOTS 1024      // power of two
+#define INVENTORY_CACHE_FRAME_BYTES 256 // larger frames are not cached
+
+class InventoryCache {
+ private:
+  static const size_t FRAME_WORDS = (INVENTORY_CACHE_FRAME_BYTES + 7) / 8;
+
+  struct Slot {
+    std::atomic<unsigned> seq;           // odd while a writer is filling the slot
+    std::atomic<uint64_t> key;
+    std::atomic<unsigned long> version;
+    std::atomic<uint32_t> size;          // frame bytes, 0 while empty
+    std::atomic<uint64_t> words[FRAME_WORDS];
+
+    Slot() : seq(0), key(0), version(0), size(0) {
+      for (auto& word : words) {
+        word = 0;
+      }
+    }
+  };
+
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<unsigned long> hits_;
+  std::atomic<unsigned long> misses_;
+
+  static uint64_t key(char api, int product_id) {
+    return ((uint64_t)(unsigned char)api << 32) | (uint32_t)product_id;
+  }
+
+  Slot& slot(uint64_t key) {
+    return slots_[(size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (INVENTORY_CACHE_SLOTS - 1)];
+  }
+
+ public:
+  InventoryCache() : slots_(new Slot[INVENTORY_CACHE_SLOTS]), hits_(0), misses_(0) {}
+
+  /**
+   * Looks up the response for a product's inventory
+   * @param api frame type byte the response is encoded for
+   * @param product_id product asked for
+   * @param version current version of the product's inventory
+   * @param frame set to the cached frame on a hit
+   * @return true on a hit, false if there is no entry for this version
+   */
+  bool get(char api, int product_id, unsigned long version, std::string& frame) {
+    uint64_t k = key(api, product_id);
+    Slot& s = slot(k);
+
+    unsigned before = s.seq.load(std::memory_order_acquire);
+    if ((before & 1) == 0 && s.key.load(std::memory_order_relaxed) == k
+        && s.version.load(std::memory_order_relaxed) == version) {
+      uint32_t size = s.size.load(std::memory_order_relaxed);
+      uint64_t buffer[FRAME_WORDS];
+      size_t words = size <= INVENTORY_CACHE_FRAME_BYTES ? (size + 7) / 8 : 0;
+      for (size_t i = 0; i < words; i++) {
+        buffer[i] = s.words[i].load(std::memory_order_relaxed);
+      }
+      // the copy only counts if no writer started on the slot while we made it
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (size > 0 && words > 0 && s.seq.load(std::memory_order_relaxed) == before) {
+        frame.assign((const char*)buffer, size);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  /**
+   * Caches the response for a product's inventory, replacing whatever was in its slot
+   * @param api frame type byte the response is encoded for
+   * @param product_id product asked for
+   * @param version version of the inventory loaded before reading the stock in the frame
+   * @param frame response encoded with request id 0
+   * @return false if the frame is too large or another writer has the slot
+   */
+  bool put(char api, int product_id, unsigned long version, const std::string& frame) {
+    if (frame.empty() || frame.size() > INVENTORY_CACHE_FRAME_BYTES) {
+      return false;
+    }
+    uint64_t k = key(api, product_id);
+    Slot& s = slot(k);
+
+    unsigned seq = s.seq.load(std::memory_order_relaxed);
+    if ((seq & 1) != 0 || !s.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire)) {
+      return false;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint64_t buffer[FRAME_WORDS] = {};
+    std::memcpy(buffer, frame.data(), frame.size());
+    for (size_t i = 0; i < (frame.size() + 7) / 8; i++) {
+      s.words[i].store(buffer[i], std::memory_order_relaxed);
+    }
+    s.key.store(k, std::memory_order_relaxed);
+    s.version.store(version, std::memory_order_relaxed);
+    s.size.store((uint32_t)frame.size(), std::memory_order_relaxed);
+
+    s.seq.store(seq + 2, std::memory_order_release);
+    return true;
+  }
+
+  unsigned long hits() const {
+    return hits_.load(std::memory_order_relaxed);
+  }
+
+  unsigned long misses() const {
+    return misses_.load(std::memory_order_relaxed);
+  }
+};
+
+#endif //INVENTORYCACHE_H
@@ -14,7 +14,6 @@
 
 #include <vector>
 #include <memory>     // for std::unique_ptr
-#include <set>
 
 // convenience alias for json
 using JSON = nlohmann::json;
@@ -24,15 +23,38 @@ using JSON = nlohmann::json;
 #define MESSAGE_VERIFY_ORDER_RESPONSE "order report"
 #define MESSAGE_REQUEST_INVENTORY "request inventory"
 #define MESSAGE_REQUEST_INVENTORY_RESPONSE "inventory"
+#define MESSAGE_SUBMIT_ORDERS "submit orders"
+#define MESSAGE_SUBMIT_ORDERS_RESPONSE "order reports"
+#define MESSAGE_ADD "add"
+#define MESSAGE_ADD_RESPONSE "add_response"
+#define MESSAGE_REMOVE "remove"
+#define MESSAGE_REMOVE_RESPONSE "remove_response"
+#define MESSAGE_SEARCH "search"
+#define MESSAGE_SEARCH_RESPONSE "search_response"
+#define MESSAGE_TYPEAHEAD "typeahead"
+#define MESSAGE_TYPEAHEAD_RESPONSE "typeahead_response"
+#define MESSAGE_GOODBYE "goodbye"
 
 
 // other keys
 #define MESSAGE_TYPE "msg"
+#define MESSAGE_REQUEST_ID "id"
 #define MESSAGE_PRODUCT "product"
+#define MESSAGE_PRODUCTS "products"
 #define MESSAGE_PRODUCT_NAME "name"
 #define MESSAGE_PRODUCT_ID "product ID"
-#define MESSAGE_PRODUCT "price"
+#define MESSAGE_PRODUCT_PRICE "price"
+#define MESSAGE_QUANTITY "quantity"
 #define MESSAGE_ORDER_ID "order ID"
+#define MESSAGE_ORDERS "orders"
+#define MESSAGE_REPORTS "reports"
+#define MESSAGE_VERIFIED "verified"
+#define MESSAGE_DUPLICATE "duplicate"
+#define MESSAGE_STATUS "status"
+#define MESSAGE_INFO "info"
+#define MESSAGE_NAME_REGEX "name_regex"
+#define MESSAGE_QUERY "query"
+#define MESSAGE_RESULTS "results"
 
 /**
  * Handles all conversions to and from JSON
@@ -40,39 +62,118 @@ using JSON = nlohmann::json;
 class JsonConverter {
  public:
   /**
-   * Converts the song to a JSON object
-   * @param song song to jsonify
+   * Converts a product to a JSON object
+   * @param product product to jsonify
    * @return JSON object representation
    */
   static JSON toJSON(const ServerProduct &product) {
     JSON j;
-    j[MESSAGE_SONG_ARTIST] = song.artist;
-    j[MESSAGE_SONG_TITLE] = song.title;
+    j[MESSAGE_PRODUCT_ID] = product.product_id;
+    j[MESSAGE_PRODUCT_NAME] = product.name_;
+    j[MESSAGE_PRODUCT_PRICE] = product.price_;
+    j[MESSAGE_QUANTITY] = product.quantity;
     return j;
   }
 
   /**
-   * Converts a vector of songs to a JSON array of objects
-   * @param songs vector of songs to jsonify
-   * @return JSON array representation
+   * Converts an order to a JSON object
+   * @param order order to jsonify
+   * @return JSON object representation
    */
-  static JSON toJSON(const std::vector<Song> &songs) {
+  static JSON toJSON(const ServerOrder &order) {
     JSON j;
-    for (const auto& song : songs) {
-      j.push_back(toJSON(song));
+    j[MESSAGE_ORDER_ID] = order.ID_;
+    JSON products = JSON::array();
+    for (const auto& product : order.products_) {
+      products.push_back(toJSON(product));
     }
+    j[MESSAGE_PRODUCTS] = products;
     return j;
   }
 
   /**
-   * Converts a vector of songs to a JSON array of objects
-   * @param songs vector of songs to jsonify
-   * @return JSON array representation
+   * Converts an order report to a JSON object
+   * @param report report to jsonify
+   * @return JSON object representation
+   */
+  static JSON toJSON(const ServerReport &report) {
+    JSON j;
+    j[MESSAGE_VERIFIED] = report.verified;
+    j[MESSAGE_DUPLICATE] = report.duplicate;
+    j[MESSAGE_PRODUCT_ID] = report.product_ID;
+    j[MESSAGE_QUANTITY] = report.quantity;
+    return j;
+  }
+
+  /**
+   * Converts a "submit orders" message to a JSON object
+   * @param submit message
+   * @return JSON object representation
+   */
+  static JSON toJSON(const SubmitOrdersMessage &submit) {
+    JSON j;
+    j[MESSAGE_TYPE] = MESSAGE_SUBMIT_ORDERS;
+    JSON orders = JSON::array();
+    for (const auto& order : submit.orders_) {
+      orders.push_back(toJSON(order));
+    }
+    j[MESSAGE_ORDERS] = orders;
+    return j;
+  }
+
+  /**
+   * Converts a "submit orders" response message to a JSON object
+   * @param submit_response message
+   * @return JSON object representation
+   */
+  static JSON toJSON(const SubmitOrdersResponseMessage &submit_response) {
+    JSON j;
+    j[MESSAGE_TYPE] = MESSAGE_SUBMIT_ORDERS_RESPONSE;
+    JSON reports = JSON::array();
+    for (const auto& report : submit_response.reports_) {
+      reports.push_back(toJSON(report));
+    }
+    j[MESSAGE_REPORTS] = reports;
+    return j;
+  }
+
+  /**
+   * Converts an inventory request to a JSON object
+   * @param inv message
+   * @return JSON object representation
    */
-  static JSON toJSON(const std::set<Song> &songs) {
+  static JSON toJSON(const RequestInventoryMessage &inv) {
     JSON j;
-    for (const auto& song : songs) {
-      j.push_back(toJSON(song));
+    j[MESSAGE_TYPE] = MESSAGE_REQUEST_INVENTORY;
+    j[MESSAGE_PRODUCT_ID] = inv.product_id_;
+    return j;
+  }
+
+  /**
+   * Converts an inventory response to a JSON object
+   * @param inv_response message
+   * @return JSON object representation
+   */
+  static JSON toJSON(const RequestInventoryResponseMessage &inv_response) {
+    JSON j;
+    j[MESSAGE_TYPE] = MESSAGE_REQUEST_INVENTORY_RESPONSE;
+    JSON products = JSON::array();
+    for (const auto& product : inv_response.products_) {
+      products.push_back(toJSON(product));
+    }
+    j[MESSAGE_PRODUCTS] = products;
+    return j;
+  }
+
+  /**
+   * Converts a vector of products to a JSON array of objects
+   * @param products vector of products to jsonify
+   * @return JSON array representation
+   */
+  static JSON toJSON(const std::vector<ServerProduct> &products) {
+    JSON j = JSON::array();
+    for (const auto& product : products) {
+      j.push_back(toJSON(product));
     }
     return j;
   }
@@ -85,7 +186,7 @@ class JsonConverter {
   static JSON toJSON(const AddMessage &add) {
     JSON j;
     j[MESSAGE_TYPE] = MESSAGE_ADD;
-    j[MESSAGE_SONG] = toJSON(add.song);
+    j[MESSAGE_PRODUCT] = toJSON(add.product);
     return j;
   }
 
@@ -102,39 +203,32 @@ class JsonConverter {
     j[MESSAGE_ADD] = toJSON(add_response.add);
     return j;
   }
-  //======================================================
-  // TODO: Convert "remove" and response message to JSON
-  //======================================================
-  //ADDED FUNCTIONS
-  //============================================================================================================
 
   /**
-  * Converts an "add" message to a JSON object
-  * @param add message
-  * @return JSON object representation
-  */
-  static JSON toJSON(const RemoveMessage &rem) {
-	  JSON j;
-	  j[MESSAGE_TYPE] = MESSAGE_REMOVE;
-	  j[MESSAGE_SONG] = toJSON(rem.song);
-	  return j;
+   * Converts a "remove" message to a JSON object
+   * @param remove message
+   * @return JSON object representation
+   */
+  static JSON toJSON(const RemoveMessage &remove) {
+    JSON j;
+    j[MESSAGE_TYPE] = MESSAGE_REMOVE;
+    j[MESSAGE_PRODUCT] = toJSON(remove.product);
+    return j;
   }
 
   /**
-  * Converts a "Remove" response message to a JSON object
-  * @param remove_response message
-  * @return JSON object representation
-  */
-  static JSON toJSON(const RemoveResponseMessage &rem_response) {
-	  JSON j;
-	  j[MESSAGE_TYPE] = MESSAGE_REMOVE_RESPONSE;
-	  j[MESSAGE_STATUS] = rem_response.status;
-	  j[MESSAGE_INFO] = rem_response.info;
-	  j[MESSAGE_REMOVE] = toJSON(rem_response.remove);
-	  return j;
+   * Converts a "remove" response message to a JSON object
+   * @param remove_response message
+   * @return JSON object representation
+   */
+  static JSON toJSON(const RemoveResponseMessage &remove_response) {
+    JSON j;
+    j[MESSAGE_TYPE] = MESSAGE_REMOVE_RESPONSE;
+    j[MESSAGE_STATUS] = remove_response.status;
+    j[MESSAGE_INFO] = remove_response.info;
+    j[MESSAGE_REMOVE] = toJSON(remove_response.remove);
+    return j;
   }
-  //============================================================================================================
-  
 
   /**
    * Converts a "search" message to a JSON object
@@ -144,8 +238,7 @@ class JsonConverter {
   static JSON toJSON(const SearchMessage &search) {
     JSON j;
     j[MESSAGE_TYPE] = MESSAGE_SEARCH;
-    j[MESSAGE_SONG_ARTIST_REGEX] = search.artist_regex;
-    j[MESSAGE_SONG_TITLE_REGEX] = search.title_regex;
+    j[MESSAGE_NAME_REGEX] = search.name_regex;
     return j;
   }
 
@@ -160,7 +253,34 @@ class JsonConverter {
     j[MESSAGE_STATUS] = search_response.status;
     j[MESSAGE_INFO] = search_response.info;
     j[MESSAGE_SEARCH] = toJSON(search_response.search);
-    j[MESSAGE_SEARCH_RESULTS] = toJSON(search_response.results);
+    j[MESSAGE_RESULTS] = toJSON(search_response.results);
+    return j;
+  }
+
+  /**
+   * Converts a "typeahead" message to a JSON object
+   * @param typeahead message
+   * @return JSON object representation
+   */
+  static JSON toJSON(const TypeaheadMessage &typeahead) {
+    JSON j;
+    j[MESSAGE_TYPE] = MESSAGE_TYPEAHEAD;
+    j[MESSAGE_QUERY] = typeahead.query;
+    return j;
+  }
+
+  /**
+   * Converts a "typeahead" response message to a JSON object
+   * @param typeahead_response message
+   * @return JSON object representation
+   */
+  static JSON toJSON(const TypeaheadResponseMessage &typeahead_response) {
+    JSON j;
+    j[MESSAGE_TYPE] = MESSAGE_TYPEAHEAD_RESPONSE;
+    j[MESSAGE_STATUS] = typeahead_response.status;
+    j[MESSAGE_INFO] = typeahead_response.info;
+    j[MESSAGE_TYPEAHEAD] = toJSON(typeahead_response.typeahead);
+    j[MESSAGE_RESULTS] = toJSON(typeahead_response.results);
     return j;
   }
 
@@ -181,32 +301,73 @@ class JsonConverter {
    * @return JSON object representation, {"status"="ERROR", "info"=...} if not recognized
    */
   static JSON toJSON(const Message &msg) {
-
-    //=============================================================
-    // TODO: Convert "remove" and its response to JSON
-    //=============================================================
-
+    JSON j;
     switch(msg.type()) {
       case ADD: {
-        return toJSON((AddMessage &) msg);
+        j = toJSON((AddMessage &) msg);
+        break;
       }
       case ADD_RESPONSE: {
-        return toJSON((AddResponseMessage &) msg);
+        j = toJSON((AddResponseMessage &) msg);
+        break;
+      }
+      case REMOVE: {
+        j = toJSON((RemoveMessage &) msg);
+        break;
+      }
+      case REMOVE_RESPONSE: {
+        j = toJSON((RemoveResponseMessage &) msg);
+        break;
       }
       case SEARCH: {
-        return toJSON((SearchMessage &) msg);
+        j = toJSON((SearchMessage &) msg);
+        break;
       }
       case SEARCH_RESPONSE: {
-        return toJSON((SearchResponseMessage &) msg);
+        j = toJSON((SearchResponseMessage &) msg);
+        break;
+      }
+      case TYPEAHEAD: {
+        j = toJSON((TypeaheadMessage &) msg);
+        break;
+      }
+      case TYPEAHEAD_RESPONSE: {
+        j = toJSON((TypeaheadResponseMessage &) msg);
+        break;
+      }
+      case SUBMIT_ORDERS: {
+        j = toJSON((SubmitOrdersMessage &) msg);
+        break;
+      }
+      case SUBMIT_ORDERS_RESPONSE: {
+        j = toJSON((SubmitOrdersResponseMessage &) msg);
+        break;
+      }
+      case REQUEST_INVENTORY: {
+        j = toJSON((RequestInventoryMessage &) msg);
+        break;
+      }
+      case REQUEST_INVENTORY_RESPONSE: {
+        j = toJSON((RequestInventoryResponseMessage &) msg);
+        break;
       }
       case GOODBYE: {
-        return toJSON((GoodbyeMessage &) msg);
+        j = toJSON((GoodbyeMessage &) msg);
+        break;
       }
       default: {
 
       }
     }
 
+    if (!j.is_null()) {
+      // responses carry the id of their request
+      if (msg.id != 0) {
+        j[MESSAGE_REQUEST_ID] = msg.id;
+      }
+      return j;
+    }
+
     // unknown message type
     JSON err;
     err[MESSAGE_STATUS] = MESSAGE_STATUS_ERROR;
@@ -215,27 +376,30 @@ class JsonConverter {
   }
 
   /**
-   * Converts a JSON object representing a song to a Song object
+   * Converts a JSON object representing a product to a ServerProduct object
    * @param j JSON object
-   * @return Song
+   * @return ServerProduct
    */
-  static Song parseSong(const JSON &j) {
-    return Song(j[MESSAGE_SONG_ARTIST], j[MESSAGE_SONG_TITLE]);
+  static ServerProduct parseProduct(const JSON &j) {
+    ServerProduct product;
+    product.product_id = j[MESSAGE_PRODUCT_ID];
+    product.name_ = j[MESSAGE_PRODUCT_NAME].get<std::string>();
+    product.price_ = j[MESSAGE_PRODUCT_PRICE];
+    product.quantity = j[MESSAGE_QUANTITY];
+    return product;
   }
 
   /**
-   * Converts a JSON array representing a list of songs to a
-   * vector of Song objects
-   * @param jsongs JSON array
-   * @return resulting vector of Song
+   * Converts a JSON array representing a list of products to a
+   * vector of ServerProduct objects
+   * @param jproducts JSON array
+   * @return resulting vector of ServerProduct
    */
-  static std::vector<Song> parseSongs(const JSON &jsongs) {
-    std::vector<Song> out;
-
-    for (const auto& song : jsongs) {
-      out.push_back(parseSong(song));
+  static std::vector<ServerProduct> parseProducts(const JSON &jproducts) {
+    std::vector<ServerProduct> out;
+    for (const auto& product : jproducts) {
+      out.push_back(parseProduct(product));
     }
-
     return out;
   }
 
@@ -245,8 +409,7 @@ class JsonConverter {
    * @return AddMessage
    */
   static AddMessage parseAdd(const JSON &jadd) {
-    Song song = parseSong(jadd[MESSAGE_SONG]);
-    return AddMessage(song);
+    return AddMessage(parseProduct(jadd[MESSAGE_PRODUCT]));
   }
 
   /**
@@ -261,34 +424,26 @@ class JsonConverter {
     return AddResponseMessage(add, status, info);
   }
 
-  //======================================================
-  // TODO: Parse "remove" and response message from JSON
-  //======================================================
-  //ADDED FUNCTIONS
-  //============================================================================================================
   /**
-  * Converts a JSON object representing a RemoveMessage to a RemoveMessage object
-  * @param j JSON object
-  * @return RemoveMessage
-  */
-  static RemoveMessage parseRemove(const JSON &jrem) {
-	  Song song = parseSong(jrem[MESSAGE_SONG]);
-	  return RemoveMessage(song);
+   * Converts a JSON object representing a RemoveMessage to a RemoveMessage object
+   * @param j JSON object
+   * @return RemoveMessage
+   */
+  static RemoveMessage parseRemove(const JSON &jremove) {
+    return RemoveMessage(parseProduct(jremove[MESSAGE_PRODUCT]));
   }
 
   /**
-  * Converts a JSON object representing a RemoveResponseMessage to a RemoveResponseMessage object
-  * @param j JSON object
-  * @return RemoveResponseMessage
-  */
-  static RemoveResponseMessage parseRemoveResponse(const JSON &jrem) {
-	  RemoveMessage rem = parseRemove(jrem[MESSAGE_REMOVE]);
-	  std::string status = jrem[MESSAGE_STATUS];
-	  std::string info = jrem[MESSAGE_INFO];
-	  return RemoveResponseMessage(rem, status, info);
+   * Converts a JSON object representing a RemoveResponseMessage to a RemoveResponseMessage object
+   * @param j JSON object
+   * @return RemoveResponseMessage
+   */
+  static RemoveResponseMessage parseRemoveResponse(const JSON &jremover) {
+    RemoveMessage remove = parseRemove(jremover[MESSAGE_REMOVE]);
+    std::string status = jremover[MESSAGE_STATUS];
+    std::string info = jremover[MESSAGE_INFO];
+    return RemoveResponseMessage(remove, status, info);
   }
-  //============================================================================================================
-  
 
   /**
    * Converts a JSON object representing a SearchMessage to a SearchMessage object
@@ -296,9 +451,7 @@ class JsonConverter {
    * @return SearchMessage
    */
   static SearchMessage parseSearch(const JSON &jsearch) {
-    std::string artist_regex = jsearch[MESSAGE_SONG_ARTIST_REGEX];
-    std::string title_regex = jsearch[MESSAGE_SONG_TITLE_REGEX];
-    return SearchMessage(artist_regex, title_regex);
+    return SearchMessage(jsearch[MESSAGE_NAME_REGEX].get<std::string>());
   }
 
   /**
@@ -308,12 +461,110 @@ class JsonConverter {
    */
   static SearchResponseMessage parseSearchResponse(const JSON &jsearchr) {
     SearchMessage search = parseSearch(jsearchr[MESSAGE_SEARCH]);
-    std::vector<Song> results = parseSongs(jsearchr[MESSAGE_SEARCH_RESULTS]);
+    std::vector<ServerProduct> results = parseProducts(jsearchr[MESSAGE_RESULTS]);
     std::string status = jsearchr[MESSAGE_STATUS];
     std::string info = jsearchr[MESSAGE_INFO];
     return SearchResponseMessage(search, results, status, info);
   }
 
+  /**
+   * Converts a JSON object representing a TypeaheadMessage to a TypeaheadMessage object
+   * @param j JSON object
+   * @return TypeaheadMessage
+   */
+  static TypeaheadMessage parseTypeahead(const JSON &jtypeahead) {
+    return TypeaheadMessage(jtypeahead[MESSAGE_QUERY].get<std::string>());
+  }
+
+  /**
+   * Converts a JSON object representing a TypeaheadResponseMessage to a TypeaheadResponseMessage object
+   * @param j JSON object
+   * @return TypeaheadResponseMessage
+   */
+  static TypeaheadResponseMessage parseTypeaheadResponse(const JSON &jtypeaheadr) {
+    TypeaheadMessage typeahead = parseTypeahead(jtypeaheadr[MESSAGE_TYPEAHEAD]);
+    std::vector<ServerProduct> results = parseProducts(jtypeaheadr[MESSAGE_RESULTS]);
+    std::string status = jtypeaheadr[MESSAGE_STATUS];
+    std::string info = jtypeaheadr[MESSAGE_INFO];
+    return TypeaheadResponseMessage(typeahead, results, status, info);
+  }
+
+  /**
+   * Converts a JSON object representing an order to a ServerOrder object
+   * @param j JSON object
+   * @return ServerOrder
+   */
+  static ServerOrder parseOrder(const JSON &j) {
+    ServerOrder order;
+    order.ID_ = j[MESSAGE_ORDER_ID];
+    for (const auto& product : j[MESSAGE_PRODUCTS]) {
+      order.products_.push_back(parseProduct(product));
+    }
+    return order;
+  }
+
+  /**
+   * Converts a JSON object representing an order report to a ServerReport object
+   * @param j JSON object
+   * @return ServerReport
+   */
+  static ServerReport parseReport(const JSON &j) {
+    ServerReport report;
+    report.verified = j[MESSAGE_VERIFIED];
+    report.duplicate = j[MESSAGE_DUPLICATE];
+    report.product_ID = j[MESSAGE_PRODUCT_ID];
+    report.quantity = j[MESSAGE_QUANTITY];
+    return report;
+  }
+
+  /**
+   * Converts a JSON object representing a SubmitOrdersMessage to a SubmitOrdersMessage object
+   * @param j JSON object
+   * @return SubmitOrdersMessage
+   */
+  static SubmitOrdersMessage parseSubmitOrders(const JSON &jsubmit) {
+    SubmitOrdersMessage submit;
+    for (const auto& order : jsubmit[MESSAGE_ORDERS]) {
+      submit.orders_.push_back(parseOrder(order));
+    }
+    return submit;
+  }
+
+  /**
+   * Converts a JSON object representing a SubmitOrdersResponseMessage to a SubmitOrdersResponseMessage object
+   * @param j JSON object
+   * @return SubmitOrdersResponseMessage
+   */
+  static SubmitOrdersResponseMessage parseSubmitOrdersResponse(const JSON &jsubmitr) {
+    SubmitOrdersResponseMessage submit_response;
+    for (const auto& report : jsubmitr[MESSAGE_REPORTS]) {
+      submit_response.reports_.push_back(parseReport(report));
+    }
+    return submit_response;
+  }
+
+  /**
+   * Converts a JSON object representing a RequestInventoryMessage to a RequestInventoryMessage object
+   * @param j JSON object
+   * @return RequestInventoryMessage
+   */
+  static RequestInventoryMessage parseRequestInventory(const JSON &jinv) {
+    return RequestInventoryMessage(jinv[MESSAGE_PRODUCT_ID].get<int>());
+  }
+
+  /**
+   * Converts a JSON object representing a RequestInventoryResponseMessage to a RequestInventoryResponseMessage object
+   * @param j JSON object
+   * @return RequestInventoryResponseMessage
+   */
+  static RequestInventoryResponseMessage parseRequestInventoryResponse(const JSON &jinvr) {
+    RequestInventoryResponseMessage inv_response;
+    for (const auto& product : jinvr[MESSAGE_PRODUCTS]) {
+      inv_response.products_.push_back(parseProduct(product));
+    }
+    return inv_response;
+  }
+
   /**
    * Converts a JSON object representing a GoodbyeMessage to a GoodbyeMessage object
    * @param j JSON object
@@ -342,10 +593,22 @@ class JsonConverter {
       return MessageType::SEARCH;
     } else if (MESSAGE_SEARCH_RESPONSE == msg) {
       return MessageType::SEARCH_RESPONSE;
+    } else if (MESSAGE_TYPEAHEAD == msg) {
+      return MessageType::TYPEAHEAD;
+    } else if (MESSAGE_TYPEAHEAD_RESPONSE == msg) {
+      return MessageType::TYPEAHEAD_RESPONSE;
+    } else if (MESSAGE_SUBMIT_ORDERS == msg) {
+      return MessageType::SUBMIT_ORDERS;
+    } else if (MESSAGE_SUBMIT_ORDERS_RESPONSE == msg) {
+      return MessageType::SUBMIT_ORDERS_RESPONSE;
+    } else if (MESSAGE_REQUEST_INVENTORY == msg) {
+      return MessageType::REQUEST_INVENTORY;
+    } else if (MESSAGE_REQUEST_INVENTORY_RESPONSE == msg) {
+      return MessageType::REQUEST_INVENTORY_RESPONSE;
     } else if (MESSAGE_GOODBYE == msg) {
       return MessageType::GOODBYE;
     }
-    return MessageType::UNKNOWN;
+    return MessageType::UNKNOWN_MESSAGE;
   }
 
   /**
@@ -356,37 +619,70 @@ class JsonConverter {
    * @return parsed Message object, or nullptr if invalid
    */
   static std::unique_ptr<Message> parseMessage(const JSON &jmsg) {
-
-    //=============================================================
-    // TODO: Add parsing of "remove" and its response
-    //=============================================================
-
+    std::unique_ptr<Message> msg;
     MessageType type = parseType(jmsg);
     switch(type) {
-	  case REMOVE: {
-			return std::unique_ptr<Message>(new RemoveMessage(parseRemove(jmsg)));
-		}
-	  case REMOVE_RESPONSE: {
-		  return std::unique_ptr<Message>(new RemoveResponseMessage(parseRemoveResponse(jmsg)));
-	  }
       case ADD: {
-        return std::unique_ptr<Message>(new AddMessage(parseAdd(jmsg)));
+        msg.reset(new AddMessage(parseAdd(jmsg)));
+        break;
       }
       case ADD_RESPONSE: {
-        return std::unique_ptr<Message>(new AddResponseMessage(parseAddResponse(jmsg)));
+        msg.reset(new AddResponseMessage(parseAddResponse(jmsg)));
+        break;
+      }
+      case REMOVE: {
+        msg.reset(new RemoveMessage(parseRemove(jmsg)));
+        break;
+      }
+      case REMOVE_RESPONSE: {
+        msg.reset(new RemoveResponseMessage(parseRemoveResponse(jmsg)));
+        break;
       }
       case SEARCH: {
-        return std::unique_ptr<Message>(new SearchMessage(parseSearch(jmsg)));
+        msg.reset(new SearchMessage(parseSearch(jmsg)));
+        break;
       }
       case SEARCH_RESPONSE: {
-        return std::unique_ptr<Message>(new SearchResponseMessage(parseSearchResponse(jmsg)));
+        msg.reset(new SearchResponseMessage(parseSearchResponse(jmsg)));
+        break;
+      }
+      case TYPEAHEAD: {
+        msg.reset(new TypeaheadMessage(parseTypeahead(jmsg)));
+        break;
+      }
+      case TYPEAHEAD_RESPONSE: {
+        msg.reset(new TypeaheadResponseMessage(parseTypeaheadResponse(jmsg)));
+        break;
+      }
+      case SUBMIT_ORDERS: {
+        msg.reset(new SubmitOrdersMessage(parseSubmitOrders(jmsg)));
+        break;
+      }
+      case SUBMIT_ORDERS_RESPONSE: {
+        msg.reset(new SubmitOrdersResponseMessage(parseSubmitOrdersResponse(jmsg)));
+        break;
+      }
+      case REQUEST_INVENTORY: {
+        msg.reset(new RequestInventoryMessage(parseRequestInventory(jmsg)));
+        break;
+      }
+      case REQUEST_INVENTORY_RESPONSE: {
+        msg.reset(new RequestInventoryResponseMessage(parseRequestInventoryResponse(jmsg)));
+        break;
       }
       case GOODBYE: {
-        return std::unique_ptr<Message>(new GoodbyeMessage(parseGoodbye(jmsg)));
+        msg.reset(new GoodbyeMessage(parseGoodbye(jmsg)));
+        break;
+      }
+      default: {
+
       }
     }
 
-    return std::unique_ptr<Message>(nullptr);
+    if (msg != nullptr && jmsg.count(MESSAGE_REQUEST_ID) > 0) {
+      msg->id = jmsg[MESSAGE_REQUEST_ID];
+    }
+    return msg;
   }
 
 };
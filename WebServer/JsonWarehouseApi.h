@@ -1,7 +1,7 @@
 /**
  * @file
  *
- * This file provides an implementation of the MusicLibraryAPI, encapsulating all information
+ * This file provides an implementation of the WarehouseAPI, encapsulating all information
  * required for communication between the client and server.
  *
  * The API currently only has one type of message: JSON_ID
@@ -22,31 +22,57 @@
  *
  *  ___str____: any quoted string
  *  __status__: "OK" or "ERROR"
- *  ___song___: { "title": __str__, "artist": __str__ }
+ *  _product__: { "product ID": __int__, "name": __str__, "price": __int__, "quantity": __int__ }
  *  __<msg>___: message of type <msg>
  *
- * Adding a song:
- *   { "msg": "add", "song": __song__ }
+ * Adding a product to the catalog:
+ *   { "msg": "add", "product": __product__ }
  *
- * Response to adding a song:
+ * Response to adding a product:
  *   { "msg": "add_response", "status": __status__, "info": __str__, "add": __add__ }
  *
- * Removing a song:
- *   { "msg": "remove", "song": __song__ }
+ * Removing a product, only its ID is used:
+ *   { "msg": "remove", "product": __product__ }
  *
- * Response to removing a song:
+ * Response to removing a product:
  *   { "msg": "remove_response", "status": __status__, "info": __str__, "remove": __remove__ }
  *
- * Search for a song:
- *   { "msg": "search", "artist_regex": __str__, "title_regex": __str__ }
+ * Search for products by name:
+ *   { "msg": "search", "name_regex": __str__ }
  *
  * Response to a search:
  *   { "msg": "search_response", "status": __status__, "info": __str__,
- *      "search": __search__, "results": [ __song__, ... ] }
+ *      "search": __search__, "results": [ __product__, ... ] }
+ *
+ * Suggestions for a partly typed name:
+ *   { "msg": "typeahead", "query": __str__ }
+ *
+ * Response to a typeahead query:
+ *   { "msg": "typeahead_response", "status": __status__, "info": __str__,
+ *      "typeahead": __typeahead__, "results": [ __product__, ... ] }
+ *
+ * Submitting several orders:
+ *   { "msg": "submit orders", "orders": [ __order__, ... ] }
+ *   __order__: { "order ID": __int__, "products": [ { "product ID": __int__, "name": __str__,
+ *                "price": __int__, "quantity": __int__ }, ... ] }
+ *
+ * Response to submitting orders, one report per order:
+ *   { "msg": "order reports", "reports": [ { "verified": __bool__, "duplicate": __bool__,
+ *      "product ID": __int__, "quantity": __int__ }, ... ] }
+ *
+ * Requesting the stock of a product:
+ *   { "msg": "request inventory", "product ID": __int__ }
+ *
+ * Response to an inventory request, no products if the product is unknown:
+ *   { "msg": "inventory", "products": [ { "product ID": __int__, "name": __str__,
+ *      "price": __int__, "quantity": __int__ } ] }
  *
  * Goodbye:
  *   { "msg": "goodbye" }
  *
+ * Any message may also carry a request id, "id": __int__, which is copied into its response
+ * so a client with several requests in flight can match the responses.
+ *
  */
 
 #ifndef JSONWAREHOUSEAPI_H
@@ -56,6 +82,7 @@
 #include "WarehouseApi.h"
 #include "Message.h"
 #include "JsonConverter.h"
+#include "FrameReader.h"
 
 #include <cpen333/process/socket.h>
 
@@ -70,11 +97,8 @@
 class JsonWarehouseApi {
  private:
   cpen333::process::socket socket_;
-
-  // Fixed message type
-  //   NOTE: constants like this don't actually have a memory address,
-  //         so they can only be passed by value
-  static const char JSON_ID = 0x55;
+  FrameReader<cpen333::process::socket> reader_;  // all reads go through here, keep after socket_
+  std::string frame_;  // last frame body, reused so its capacity carries over between messages
 
   /**
    * Writes the JSON info to the socket, NOT including the JSON byte
@@ -105,43 +129,6 @@ class JsonWarehouseApi {
     return success;
   }
 
-  /**
-   * Reads a string consisting of exactly size bytes
-   * @param str string to append to
-   * @param size number of bytes
-   * @return true if successful
-   */
-  bool readString(std::string& str, size_t size) {
-
-    char cbuff[256];
-
-    //======================================================
-    // TODO: read and append to str in chunks of 256 bytes
-    //======================================================
-	
-	bool success = false;
-	int buffer_size = 256;
-	int remaining_size = size;
-	if (size < 256)
-		buffer_size = size;
-
-	while (remaining_size > 0) {
-		if (socket_.read_all(cbuff, buffer_size)) {
-			success = true;
-			for (int i = 0; i < buffer_size; i++) {
-				str = str + cbuff[i];
-			}
-			remaining_size -= buffer_size;
-			if (remaining_size - buffer_size < 0) {
-				buffer_size = remaining_size;
-			}
-		}
-
-	}
-
-	return success;
-  }
-
   /**
    * Reads and populates a JSON message
    * Assumes the initial JSON indicator byte has already been read, which
@@ -152,29 +139,18 @@ class JsonWarehouseApi {
    */
   bool recvJSON(JSON& jout) {
 
-    // receive 4-byte size
-    char buff[4];
-    if (!socket_.read_all(buff, 4)) {
+    // size header and exactly that many bytes, sized once and read in place
+    if (!reader_.readFrame(frame_)) {
       return false;
     }
 
-    //=================================================
-    // TODO: Decode 4-byte big-endian integer size
-    //=================================================
-	//int size = 0;
-
-	int size = ((unsigned char)(buff[0]) << 24 | (unsigned char)(buff[1]) << 16 | 
-		(unsigned char)(buff[2]) << 8 | (unsigned char)(buff[3]));
-
-    // read entire JSON string
-    std::string str;
-    if (!readString(str, size)) {
+    // parse JSON
+    try {
+      jout = JSON::parse(frame_);
+    } catch (const std::exception&) {
       return false;
     }
 
-    // parse JSON
-    jout = JSON::parse(str);
-
     return true;
   }
 
@@ -183,12 +159,87 @@ class JsonWarehouseApi {
 
  public:
 
+  // Fixed message type
+  //   NOTE: constants like this don't actually have a memory address,
+  //         so they can only be passed by value
+  static const char JSON_ID = 0x55;
+
+  /**
+   * Encodes a message as it goes on the wire: JSON byte, size and JSON string
+   * @param msg message to encode
+   * @return bytes to send
+   */
+  static std::string encodeMessage(const Message& msg) {
+    std::string jsonstr = JsonConverter::toJSON(msg).dump();
+    size_t size = jsonstr.size()+1;           // one for terminating zero
+
+    std::string out;
+    out.reserve(5 + size);
+    out.push_back(JSON_ID);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      out.push_back((char)((size >> shift) & 0xFF));
+    }
+    out.append(jsonstr);
+    out.push_back(0);
+    return out;
+  }
+
+  /**
+   * Parses the content of a JSON frame (everything after the size)
+   * @param body JSON string, with or without the terminating zero
+   * @return parsed message, nullptr if the content is not a valid message
+   */
+  static std::unique_ptr<Message> decodeMessage(const std::string& body) {
+    size_t len = body.size();
+    if (len > 0 && body[len-1] == 0) {
+      --len;
+    }
+    try {
+      return JsonConverter::parseMessage(JSON::parse(body.begin(), body.begin() + len));
+    } catch (const std::exception&) {
+      return nullptr;
+    }
+  }
+
+  /**
+   * Gives a frame encoded without a request id the given one, so a cached response can be
+   * reused for any request without converting it again
+   * @param frame output of encodeMessage for a message with id 0
+   * @param id request id to add
+   * @return frame with "id" as the first key, the same frame if id is 0
+   */
+  static std::string withRequestId(const std::string& frame, uint32_t id) {
+    if (id == 0 || frame.size() < 7 || frame[5] != '{') {
+      return frame;
+    }
+    std::string key = "\"" MESSAGE_REQUEST_ID "\":" + std::to_string(id);
+    if (frame[6] != '}') {
+      key.push_back(',');
+    }
+
+    std::string out;
+    out.reserve(frame.size() + key.size());
+    out.push_back(JSON_ID);
+    size_t size = frame.size() - 5 + key.size();
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      out.push_back((char)((size >> shift) & 0xFF));
+    }
+    out.push_back('{');
+    out.append(key);
+    out.append(frame, 6, std::string::npos);
+    return out;
+  }
+
   /**
    * Main constructor, takes ownership of socket
    * @param socket
    */
 	 JsonWarehouseApi(cpen333::process::socket&& socket) :
-    socket_(std::move(socket)) {}
+    socket_(std::move(socket)), reader_(socket_) {}
+
+  // the reader refers to our own socket, so it can't be moved along with it
+  JsonWarehouseApi(JsonWarehouseApi&& other) :
+    socket_(std::move(other.socket_)), reader_(socket_) {}
 
   /**
    * Sends a message by writing the data to the socket
@@ -222,7 +273,7 @@ class JsonWarehouseApi {
 
     // parse first byte, ensure it is of JSON type
     char id;
-    if (!socket_.read_all(&id, 1) || id != JSON_ID) {
+    if (!reader_.read(&id, 1) || id != JSON_ID) {
       return nullptr;
     }
 
@@ -12,7 +12,9 @@
 #define MESSAGE_H
 
 #include "ServerObjects.h"
+#include <cstdint>
 #include <string>
+#include <vector>
 
 /**
  * Types of messages that can be sent between client/server
@@ -23,7 +25,17 @@ enum MessageType {
   REQUEST_INVENTORY,
   REQUEST_INVENTORY_RESPONSE,
   GOODBYE,
-  UNKNOWN
+  SUBMIT_ORDERS,
+  SUBMIT_ORDERS_RESPONSE,
+  ADD,
+  ADD_RESPONSE,
+  REMOVE,
+  REMOVE_RESPONSE,
+  SEARCH,
+  SEARCH_RESPONSE,
+  TYPEAHEAD,
+  TYPEAHEAD_RESPONSE,
+  UNKNOWN_MESSAGE  // not UNKNOWN, which the warehouse uses for OrderStatus
 };
 
 // status messages for response objects
@@ -35,11 +47,26 @@ enum MessageType {
  */
 class Message {
  public:
+  // Chosen by the client, the response to a message carries the same id so a client with
+  // several requests in flight can match responses that come back out of order. 0 if unused.
+  uint32_t id;
+
+  Message() : id(0) {}
+
   virtual MessageType type() const = 0;
 };
 
+/**
+ * Base class for responses, status is MESSAGE_STATUS_OK or MESSAGE_STATUS_ERROR with the
+ * reason in info
+ */
 class ResponseMessage : public Message {
  public:
+  std::string status;
+  std::string info;
+
+  ResponseMessage(const std::string& status = MESSAGE_STATUS_OK, const std::string& info = "") :
+    status(status), info(info) {}
 };
 
 /**
@@ -70,10 +97,13 @@ class VerifyOrderResponseMessage : public ResponseMessage {
 };
 
 /**
- * Remove a song from the library
+ * Ask for the stock of a product
  */
 class RequestInventoryMessage : public Message {
  public:
+  int product_id_;
+
+  RequestInventoryMessage(int product_id = 0) : product_id_(product_id) {}
 
   MessageType type() const {
     return MessageType::REQUEST_INVENTORY;
@@ -81,17 +111,171 @@ class RequestInventoryMessage : public Message {
 };
 
 /**
- * Response to removing a song from the library
+ * Response to an inventory request: the product with its quantity in stock, empty if the
+ * product is unknown
  */
 class RequestInventoryResponseMessage : public ResponseMessage {
  public:
-  ServerProduct products_[MAX_NUM_PRODUCTS];
+  std::vector<ServerProduct> products_;
+
+  RequestInventoryResponseMessage() {}
+  RequestInventoryResponseMessage(const std::vector<ServerProduct>& products) : products_(products) {}
 
   MessageType type() const {
     return MessageType::REQUEST_INVENTORY_RESPONSE;
   }
 };
 
+/**
+ * Submit several orders in one message
+ */
+class SubmitOrdersMessage : public Message {
+ public:
+  std::vector<ServerOrder> orders_;
+
+  SubmitOrdersMessage() {}
+  SubmitOrdersMessage(const std::vector<ServerOrder>& orders) : orders_(orders) {}
+
+  MessageType type() const {
+    return MessageType::SUBMIT_ORDERS;
+  }
+};
+
+/**
+ * Response to submitting orders, one report per order in the order they were submitted
+ */
+class SubmitOrdersResponseMessage : public ResponseMessage {
+ public:
+  std::vector<ServerReport> reports_;
+
+  SubmitOrdersResponseMessage() {}
+  SubmitOrdersResponseMessage(const std::vector<ServerReport>& reports) : reports_(reports) {}
+
+  MessageType type() const {
+    return MessageType::SUBMIT_ORDERS_RESPONSE;
+  }
+};
+
+/**
+ * Add a product to the catalog
+ */
+class AddMessage : public Message {
+ public:
+  ServerProduct product;
+
+  AddMessage(const ServerProduct& product) : product(product) {}
+
+  MessageType type() const {
+    return MessageType::ADD;
+  }
+};
+
+/**
+ * Response to adding a product
+ */
+class AddResponseMessage : public ResponseMessage {
+ public:
+  AddMessage add;
+
+  AddResponseMessage(const AddMessage& add, const std::string& status,
+                     const std::string& info = "") : ResponseMessage(status, info), add(add) {}
+
+  MessageType type() const {
+    return MessageType::ADD_RESPONSE;
+  }
+};
+
+/**
+ * Remove a product from the catalog, only its ID is used
+ */
+class RemoveMessage : public Message {
+ public:
+  ServerProduct product;
+
+  RemoveMessage(const ServerProduct& product) : product(product) {}
+
+  MessageType type() const {
+    return MessageType::REMOVE;
+  }
+};
+
+/**
+ * Response to removing a product
+ */
+class RemoveResponseMessage : public ResponseMessage {
+ public:
+  RemoveMessage remove;
+
+  RemoveResponseMessage(const RemoveMessage& remove, const std::string& status,
+                        const std::string& info = "") : ResponseMessage(status, info), remove(remove) {}
+
+  MessageType type() const {
+    return MessageType::REMOVE_RESPONSE;
+  }
+};
+
+/**
+ * Search the catalog for products whose name matches a regular expression
+ */
+class SearchMessage : public Message {
+ public:
+  std::string name_regex;
+
+  SearchMessage(const std::string& name_regex) : name_regex(name_regex) {}
+
+  MessageType type() const {
+    return MessageType::SEARCH;
+  }
+};
+
+/**
+ * Response to a search, with the matching products
+ */
+class SearchResponseMessage : public ResponseMessage {
+ public:
+  SearchMessage search;
+  std::vector<ServerProduct> results;
+
+  SearchResponseMessage(const SearchMessage& search, const std::vector<ServerProduct>& results,
+                        const std::string& status, const std::string& info = "") :
+    ResponseMessage(status, info), search(search), results(results) {}
+
+  MessageType type() const {
+    return MessageType::SEARCH_RESPONSE;
+  }
+};
+
+/**
+ * Ask for suggestions while the user is still typing a product name
+ */
+class TypeaheadMessage : public Message {
+ public:
+  std::string query;
+
+  TypeaheadMessage(const std::string& query) : query(query) {}
+
+  MessageType type() const {
+    return MessageType::TYPEAHEAD;
+  }
+};
+
+/**
+ * Response to a typeahead query, with the suggested products
+ */
+class TypeaheadResponseMessage : public ResponseMessage {
+ public:
+  TypeaheadMessage typeahead;
+  std::vector<ServerProduct> results;
+
+  TypeaheadResponseMessage(const TypeaheadMessage& typeahead, const std::vector<ServerProduct>& results,
+                           const std::string& status, const std::string& info = "") :
+    ResponseMessage(status, info), typeahead(typeahead), results(results) {}
+
+  MessageType type() const {
+    return MessageType::TYPEAHEAD_RESPONSE;
+  }
+};
+
 /**
  * Goodbye message
  */
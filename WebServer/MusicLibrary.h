@@ -1,122 +1,162 @@
 /**
  * @file
  *
- * This contains the data structure for storing the music library locally in memory.
+ * This contains the data structure for storing the product catalog locally in memory.
+ *
+ * Searches vastly outnumber catalog edits, so the catalog is published as immutable snapshots:
+ * searches read the current snapshot without locking while an edit builds and swaps in the
+ * next one.  Safe to share between client threads without an outside lock.
  *
  */
 #ifndef LAB4_MUSIC_LIBRARY_H
 #define LAB4_MUSIC_LIBRARY_H
 
 #include "ServerObjects.h"
+#include "CatalogIndex.h"
+#include "SnapshotPublisher.h"
 #include <vector>
-#include <set>
-#include <regex>
+#include <string>
 
-// Stores a list of songs
+// Stores the product catalog, indexed for search
 class MusicLibrary {
-  // private vector
-  std::set<Song> songs_;
+  // products by ID and by name word, one immutable version per edit
+  mutable SnapshotPublisher<CatalogIndex> catalog_;
 
  public:
 
   /**
-   * Adds a song to the music library
-   * @param song song info to add
-   * @return true if added, false if already exists
+   * Adds a product to the catalog
+   * @param product product info to add
+   * @return true if added, false if a product with that ID already exists
    */
-  bool add(const Song& song) {
-    // try to add element to the set
-    auto elem = songs_.insert(song);
-    return elem.second;
+  bool add(const ServerProduct& product) {
+    // cheap check first so a duplicate doesn't cost a copy of the catalog
+    if (catalog_.read()->find(product.product_id) != nullptr) {
+      return false;
+    }
+    return catalog_.update([&](CatalogIndex& catalog) {
+      return catalog.add(product);
+    });
   }
 
   /**
-   * Adds songs to the music library
-   * @param songs song info to add
-   * @return number of songs added
+   * Adds products to the catalog
+   * @param products product info to add
+   * @return number of products added
    */
-  size_t add(const std::vector<Song>& songs) {
+  size_t add(const std::vector<ServerProduct>& products) {
     size_t count = 0;
 
-    for (const Song& song : songs) {
-      if (add(song)) {
-        ++count;
+    // one new version for the whole batch
+    catalog_.update([&](CatalogIndex& catalog) {
+      for (const ServerProduct& product : products) {
+        if (catalog.add(product)) {
+          ++count;
+        }
       }
-    }
+      return count > 0;
+    });
 
     return count;
   }
 
   /**
-   * Removes a song from the music library
-   * @param song song info to remove
-   * @return true if removed, false if not in library
+   * Removes a product from the catalog
+   * @param product product to remove, only its ID is used
+   * @return true if removed, false if not in catalog
    */
-  bool remove(const Song& song) {
-	size_t removed = 0;
-
-	removed = songs_.erase(song);
-	if (removed) {
-		return true;
-	}
-   
-    return false;
+  bool remove(const ServerProduct& product) {
+    if (catalog_.read()->find(product.product_id) == nullptr) {
+      return false;
+    }
+    return catalog_.update([&](CatalogIndex& catalog) {
+      return catalog.remove(product.product_id);
+    });
   }
 
   /**
-   * Removes songs from the music library
-   * @param songs song info to remove
-   * @return number of songs removed
+   * Removes products from the catalog
+   * @param products products to remove
+   * @return number of products removed
    */
-  size_t remove(const std::vector<Song>& songs) {
+  size_t remove(const std::vector<ServerProduct>& products) {
     size_t count = 0;
-	size_t removed = 0;
 
-	for (const Song& song : songs) {
-		removed = songs_.erase(song);
-		if (removed) {
-			++count;
-		}
-	}
+    catalog_.update([&](CatalogIndex& catalog) {
+      for (const ServerProduct& product : products) {
+        if (catalog.remove(product.product_id)) {
+          ++count;
+        }
+      }
+      return count > 0;
+    });
 
     return count;
   }
 
   /**
-   * Finds songs in the database matching title and artist expressions
-   * @param artist_regex artist regular expression
-   * @param title_regex title regular expression
-   * @return set of songs matching expressions
+   * Finds products whose name matches a regular expression.  Compiled
+   * expressions are cached, so repeated searches don't recompile them.
+   * @param name_regex name regular expression
+   * @return products matching the expression, none if it is invalid
    */
-  std::vector<Song> find(const std::string& artist_regex,
-                         const std::string& title_regex) const {
-    std::vector<Song> out;
+  std::vector<ServerProduct> find(const std::string& name_regex) const {
+    return catalog_.read(true)->search(name_regex);
+  }
 
-    //=====================================================
-    // TODO: Modify to also include title_regex in search
-    //=====================================================
+  /**
+   * Suggestions as the user types, answered from the word index
+   * @param query words typed so far
+   * @param limit most suggestions to return
+   * @return products with a name word starting with each query word
+   */
+  std::vector<ServerProduct> typeahead(const std::string& query,
+                                       size_t limit = CATALOG_TYPEAHEAD_LIMIT) const {
+    return catalog_.read(true)->typeahead(query, limit);
+  }
 
+  /**
+   * Looks a product up by its ID
+   * @param product_id product ID
+   * @param out set to the product if found
+   * @return true if found
+   */
+  bool get(int product_id, ServerProduct& out) const {
+    auto catalog = catalog_.read();
+    const ServerProduct* product = catalog->find(product_id);
+    if (product == nullptr) {
+      return false;
+    }
+    out = *product;
+    return true;
+  }
 
-    // compile regular expressions
-    std::regex aregex(artist_regex);
-	std::regex tregex(title_regex);
+  /**
+   * Number of products in the catalog
+   */
+  size_t size() const {
+    return catalog_.read()->size();
+  }
 
-    // search through songs for titles and artists matching search expressions
-    for (const auto& song : songs_) {
-      if (std::regex_search(song.artist, aregex) && std::regex_search(song.title, tregex)) {
-        out.push_back(song);
-      }
-    }
+  /**
+   * Catalog version, goes up by one with every edit
+   */
+  unsigned long version() const {
+    return catalog_.version();
+  }
 
-    return out;
+  /**
+   * How long find() and typeahead() held a catalog snapshot, i.e. their latency seen from the catalog
+   */
+  const LatencyHistogram& readLatency() const {
+    return catalog_.readLatency();
   }
 
   /**
-   * Retrieves the unmodifiable list of songs
-   * @return internal set of songs
+   * How long edits waited for searches still reading the version they replaced
    */
-  const std::set<Song>& songs() const {
-    return songs_;
+  const LatencyHistogram& writeGraceLatency() const {
+    return catalog_.graceLatency();
   }
 };
 
@@ -0,0 +1,504 @@
+/**
+ * @file
+ *
+ * Event-driven server for the warehouse APIs (Linux only).
+ *
+ * One thread runs an epoll loop over the listening socket and every client connection,
+ * all non-blocking.  It splits incoming bytes into frames and queues complete frames for a
+ * fixed pool of worker threads, which decode them, talk to the warehouse and hand back the
+ * encoded response.  The loop then writes responses out as the sockets accept them.
+ *
+ * Frame format (shared by all APIs):
+ *   type (1 byte), size (4 bytes - big endian), size bytes of content
+ *
+ * The type byte of a connection's first frame fixes the API it speaks, a later frame of
+ * another type closes the connection.  Up to REACTOR_MAX_IN_FLIGHT frames of a connection
+ * are with the workers at a time and responses go out as they are finished, so a client that
+ * pipelines requests matches the responses by the request id in the message.  Back-pressure: once REACTOR_MAX_PENDING frames are waiting for a worker,
+ * connections with a complete frame are parked until a worker frees up, and a connection
+ * stops being read once REACTOR_MAX_CONN_BUFFER unprocessed bytes (or one whole frame, if
+ * bigger) are buffered for it, so a client that sends faster than the workers keep up is
+ * slowed down by TCP itself.
+ */
+
+#ifndef REACTORSERVER_H
+#define REACTORSERVER_H
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cpen333/process/socket.h>
+
+#define REACTOR_NUM_WORKERS 4
+#define REACTOR_MAX_EVENTS 256
+#define REACTOR_READ_CHUNK 65536
+#define REACTOR_MAX_PENDING 1024                  // frames waiting for a worker before connections are parked
+#define REACTOR_MAX_IN_FLIGHT 16                  // frames of one connection with the workers at a time
+#define REACTOR_MAX_CONN_BUFFER (1u*1024u*1024u)  // unprocessed bytes per connection before it stops being read
+#define REACTOR_MAX_FRAME (64u*1024u*1024u)       // larger sizes are treated as a corrupt stream
+#define REACTOR_FRAME_HEADER 5
+
+/**
+ * Handles one frame on a worker thread
+ *
+ * @param client connection number, for printing
+ * @param type frame type byte
+ * @param body frame content
+ * @param response filled with the complete encoded response (header included), may be left empty
+ * @return false to close the connection once the response is sent
+ */
+typedef std::function<bool(uint64_t client, char type, const std::string& body, std::string& response)> FrameHandler;
+
+class ReactorServer {
+ private:
+  // epoll tags for the two descriptors that aren't connections
+  static const uint64_t LISTEN_TAG = 0;
+  static const uint64_t WAKE_TAG = 1;
+
+  struct Connection {
+    int fd;
+    std::string in;        // received, in_pos onwards not yet dispatched
+    size_t in_pos;
+    std::string out;       // to send, out_pos onwards not yet written
+    size_t out_pos;
+    size_t in_flight;      // frames with the workers
+    bool parked;           // has a complete frame but the workers are saturated
+    bool peer_closed;
+    bool closing;          // close once out is flushed
+    bool negotiated;       // type holds the frame type of the first frame
+    char type;
+    uint32_t events;       // currently registered epoll events
+
+    Connection(int fd) : fd(fd), in_pos(0), out_pos(0), in_flight(0), parked(false),
+        peer_closed(false), closing(false), negotiated(false), type(0), events(0) {}
+  };
+
+  struct Job {
+    uint64_t client;
+    char type;
+    std::string body;
+  };
+
+  struct Result {
+    uint64_t client;
+    std::string response;
+    bool keep_open;
+  };
+
+  cpen333::process::socket_server& server_;
+  FrameHandler handler_;
+  int epoll_;
+  int wake_;               // eventfd the workers poke when results are ready
+  std::atomic<bool> quit_;
+
+  std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+  uint64_t next_client_;
+  std::deque<uint64_t> parked_;
+
+  std::vector<std::thread> workers_;
+  std::mutex jobs_mutex_;
+  std::condition_variable jobs_cv_;
+  std::deque<Job> jobs_;
+
+  std::mutex results_mutex_;
+  std::vector<Result> results_;
+
+  std::atomic<unsigned long> frames_;
+  std::atomic<unsigned long> parks_;
+
+ public:
+  /**
+   * @param server opened server whose listening socket is handed to epoll
+   * @param handler called by the workers for every frame
+   * @param nworkers number of worker threads
+   */
+  ReactorServer(cpen333::process::socket_server& server, FrameHandler handler,
+                size_t nworkers = REACTOR_NUM_WORKERS) :
+      server_(server), handler_(handler), epoll_(epoll_create1(EPOLL_CLOEXEC)),
+      wake_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), quit_(false), next_client_(WAKE_TAG + 1),
+      frames_(0), parks_(0) {
+
+    int listen_fd = server_.native_handle();
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL, 0) | O_NONBLOCK);
+    watch(listen_fd, LISTEN_TAG, EPOLLIN, EPOLL_CTL_ADD);
+    watch(wake_, WAKE_TAG, EPOLLIN, EPOLL_CTL_ADD);
+
+    for (size_t i = 0; i < nworkers; ++i) {
+      workers_.push_back(std::thread(&ReactorServer::work, this));
+    }
+  }
+
+  ReactorServer(const ReactorServer&) = delete;
+  ReactorServer& operator=(const ReactorServer&) = delete;
+
+  ~ReactorServer() {
+    stop();
+    {
+      std::lock_guard<std::mutex> lock(jobs_mutex_);
+      jobs_.clear();
+    }
+    jobs_cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+    for (auto& conn : connections_) {
+      ::close(conn.second->fd);
+    }
+    ::close(wake_);
+    ::close(epoll_);
+  }
+
+  /**
+   * Runs the event loop in the calling thread until stop() is called
+   */
+  void run() {
+    epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (!quit_) {
+      int n = epoll_wait(epoll_, events, REACTOR_MAX_EVENTS, -1);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::cerr << "epoll_wait(...) failed" << std::endl;
+        return;
+      }
+
+      for (int i = 0; i < n; ++i) {
+        uint64_t tag = events[i].data.u64;
+        if (tag == LISTEN_TAG) {
+          accept_all();
+        } else if (tag == WAKE_TAG) {
+          uint64_t count;
+          while (::read(wake_, &count, sizeof(count)) > 0) {}
+          collect_results();
+        } else {
+          service(tag, events[i].events);
+        }
+      }
+    }
+  }
+
+  /**
+   * Makes run() return, can be called from any thread
+   */
+  void stop() {
+    quit_ = true;
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wake_, &one, sizeof(one));
+    (void)ignored;
+  }
+
+  // frames handed to the workers so far
+  unsigned long frames() const {
+    return frames_.load();
+  }
+
+  // times a connection had to wait because the workers were saturated
+  unsigned long parks() const {
+    return parks_.load();
+  }
+
+ private:
+  void watch(int fd, uint64_t tag, uint32_t events, int op) {
+    epoll_event ev;
+    ev.events = events;
+    ev.data.u64 = tag;
+    epoll_ctl(epoll_, op, fd, &ev);
+  }
+
+  void accept_all() {
+    for (;;) {
+      int fd = ::accept4(server_.native_handle(), NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        // EAGAIN: no more pending clients, anything else (e.g. out of descriptors): try again later
+        return;
+      }
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+      uint64_t client = next_client_++;
+      std::unique_ptr<Connection> conn(new Connection(fd));
+      conn->events = EPOLLIN | EPOLLRDHUP;
+      watch(fd, client, conn->events, EPOLL_CTL_ADD);
+      connections_[client] = std::move(conn);
+    }
+  }
+
+  void service(uint64_t client, uint32_t events) {
+    auto it = connections_.find(client);
+    if (it == connections_.end()) {
+      return;
+    }
+    Connection& conn = *it->second;
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+      close(client);
+      return;
+    }
+    if (events & EPOLLOUT) {
+      if (!flush(client, conn)) {
+        return;
+      }
+    }
+    if (events & (EPOLLIN | EPOLLRDHUP)) {
+      receive(conn);
+      if (!dispatch(client, conn)) {
+        return;
+      }
+    }
+    update(client, conn);
+  }
+
+  // true while the buffer has room, or the frame at its head is incomplete and needs more bytes anyway
+  static bool wants_input(const Connection& conn) {
+    size_t available = conn.in.size() - conn.in_pos;
+    if (available < REACTOR_MAX_CONN_BUFFER) {
+      return true;
+    }
+    const unsigned char* header = (const unsigned char*)&conn.in[conn.in_pos];
+    size_t size = ((size_t)header[1] << 24) | ((size_t)header[2] << 16)
+        | ((size_t)header[3] << 8) | (size_t)header[4];
+    return available < REACTOR_FRAME_HEADER + size && size <= REACTOR_MAX_FRAME;
+  }
+
+  // reads whatever is available, up to the per-connection limit
+  void receive(Connection& conn) {
+    char chunk[REACTOR_READ_CHUNK];
+    while (wants_input(conn)) {
+      ssize_t nread = ::recv(conn.fd, chunk, sizeof(chunk), 0);
+      if (nread > 0) {
+        conn.in.append(chunk, nread);
+      } else if (nread == 0) {
+        conn.peer_closed = true;
+        return;
+      } else {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          conn.peer_closed = true;
+        }
+        return;
+      }
+    }
+  }
+
+  /**
+   * Hands the complete frames of a connection to the workers, up to REACTOR_MAX_IN_FLIGHT at a time
+   * @return false if the connection was closed
+   */
+  bool dispatch(uint64_t client, Connection& conn) {
+    while (!conn.closing && conn.in_flight < REACTOR_MAX_IN_FLIGHT) {
+      size_t available = conn.in.size() - conn.in_pos;
+      if (available < REACTOR_FRAME_HEADER) {
+        break;
+      }
+      const unsigned char* header = (const unsigned char*)&conn.in[conn.in_pos];
+      size_t size = ((size_t)header[1] << 24) | ((size_t)header[2] << 16)
+          | ((size_t)header[3] << 8) | (size_t)header[4];
+      if (size > REACTOR_MAX_FRAME) {
+        close(client);
+        return false;
+      }
+      if (!conn.negotiated) {
+        conn.type = (char)header[0];
+        conn.negotiated = true;
+      } else if ((char)header[0] != conn.type) {
+        // answer what was sent before the switch, then hang up
+        conn.closing = true;
+        break;
+      }
+      if (available < REACTOR_FRAME_HEADER + size) {
+        break;
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(jobs_mutex_);
+        if (jobs_.size() >= REACTOR_MAX_PENDING) {
+          if (!conn.parked) {
+            conn.parked = true;
+            parked_.push_back(client);
+            parks_++;
+          }
+          break;
+        }
+        Job job;
+        job.client = client;
+        job.type = conn.in[conn.in_pos];
+        job.body.assign(conn.in, conn.in_pos + REACTOR_FRAME_HEADER, size);
+        jobs_.push_back(std::move(job));
+      }
+      jobs_cv_.notify_one();
+      frames_++;
+
+      conn.in_flight++;
+      conn.in_pos += REACTOR_FRAME_HEADER + size;
+    }
+
+    // drop consumed bytes once they make up most of the buffer
+    if (conn.in_pos > conn.in.size() / 2) {
+      conn.in.erase(0, conn.in_pos);
+      conn.in_pos = 0;
+    }
+    return finish_if_done(client, conn);
+  }
+
+  // a client that hung up, or is being hung up on, with nothing left to answer is closed
+  bool finish_if_done(uint64_t client, Connection& conn) {
+    if ((conn.peer_closed || conn.closing) && conn.in_flight == 0 && conn.out_pos == conn.out.size()) {
+      close(client);
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Writes as much of the pending output as the socket takes
+   * @return false if the connection was closed
+   */
+  bool flush(uint64_t client, Connection& conn) {
+    while (conn.out_pos < conn.out.size()) {
+      ssize_t nwrite = ::send(conn.fd, &conn.out[conn.out_pos], conn.out.size() - conn.out_pos, MSG_NOSIGNAL);
+      if (nwrite < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+          return true;
+        }
+        close(client);
+        return false;
+      }
+      conn.out_pos += nwrite;
+    }
+    conn.out.clear();
+    conn.out_pos = 0;
+
+    // responses to frames still with the workers go out before the connection is closed
+    if (conn.closing && conn.in_flight == 0) {
+      close(client);
+      return false;
+    }
+    return true;
+  }
+
+  // registers for reads while there is room in the input buffer and for writes while output is pending
+  void update(uint64_t client, Connection& conn) {
+    uint32_t events = 0;
+    if (!conn.peer_closed && !conn.closing && wants_input(conn)) {
+      events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (conn.out_pos < conn.out.size()) {
+      events |= EPOLLOUT;
+    }
+    if (events != conn.events) {
+      conn.events = events;
+      watch(conn.fd, client, events, EPOLL_CTL_MOD);
+    }
+  }
+
+  void close(uint64_t client) {
+    auto it = connections_.find(client);
+    if (it == connections_.end()) {
+      return;
+    }
+    epoll_ctl(epoll_, EPOLL_CTL_DEL, it->second->fd, NULL);
+    ::close(it->second->fd);
+    connections_.erase(it);
+  }
+
+  // queues finished responses and moves every affected connection along
+  void collect_results() {
+    std::vector<Result> results;
+    {
+      std::lock_guard<std::mutex> lock(results_mutex_);
+      results.swap(results_);
+    }
+
+    for (auto& result : results) {
+      auto it = connections_.find(result.client);
+      if (it == connections_.end()) {
+        continue;
+      }
+      Connection& conn = *it->second;
+      conn.in_flight--;
+      conn.out.append(result.response);
+      if (!result.keep_open) {
+        conn.closing = true;
+      }
+      if (flush(result.client, conn) && dispatch(result.client, conn)) {
+        update(result.client, conn);
+      }
+    }
+
+    // workers freed up, give parked connections their turn in the order they were parked
+    while (!parked_.empty()) {
+      {
+        std::lock_guard<std::mutex> lock(jobs_mutex_);
+        if (jobs_.size() >= REACTOR_MAX_PENDING) {
+          break;
+        }
+      }
+      uint64_t client = parked_.front();
+      parked_.pop_front();
+      auto it = connections_.find(client);
+      if (it == connections_.end()) {
+        continue;
+      }
+      Connection& conn = *it->second;
+      conn.parked = false;
+      if (dispatch(client, conn)) {
+        update(client, conn);
+      }
+    }
+  }
+
+  void work() {
+    for (;;) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(jobs_mutex_);
+        jobs_cv_.wait(lock, [&]() { return quit_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+          return;
+        }
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+
+      Result result;
+      result.client = job.client;
+      try {
+        result.keep_open = handler_(job.client, job.type, job.body, result.response);
+      } catch (const std::exception&) {
+        // e.g. a malformed message, drop the client rather than the server
+        result.response.clear();
+        result.keep_open = false;
+      }
+      {
+        std::lock_guard<std::mutex> lock(results_mutex_);
+        results_.push_back(std::move(result));
+      }
+      uint64_t one = 1;
+      ssize_t ignored = ::write(wake_, &one, sizeof(one));
+      (void)ignored;
+    }
+  }
+};
+
+#endif //REACTORSERVER_H
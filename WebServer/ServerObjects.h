@@ -10,6 +10,7 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
 
 #define MAX_NUM_PRODUCTS 5
 
@@ -24,7 +25,7 @@ struct ServerProduct {
 	std::string toString() const {
 		std::string out = std::to_string(product_id);
 		out.append(" - ");
-		out.append(std::to_string(quantity_));
+		out.append(std::to_string(quantity));
 		return out;
 	}
 
@@ -35,6 +36,10 @@ struct ServerProduct {
 		return os;
 	}
 
+	friend bool operator==(const ServerProduct& a, const ServerProduct& b) {
+		return a.product_id == b.product_id && a.price_ == b.price_
+			&& a.name_ == b.name_ && a.quantity == b.quantity;
+	}
 
 };
 
@@ -86,9 +91,13 @@ class ServerOrder {
 };
 
 class ServerReport {
+ public:
 	bool verified;
-	int product_ID;
-	int quantity;
+	bool duplicate;		// an order with the same ID was already placed
+	int product_ID;		// first short product when not verified
+	int quantity;		// quantity of it available
+
+	ServerReport() : verified(false), duplicate(false), product_ID(0), quantity(0) {}
 };
 
 #endif //LAB4_MUSIC_LIBRARY_SONG_H
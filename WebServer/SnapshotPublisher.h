@@ -0,0 +1,240 @@
+/**
+ * @file
+ *
+ * Read-mostly sharing of a data structure between client threads.
+ *
+ * Readers take the current version without locking: they announce themselves in a counter for
+ * the current epoch, load the version pointer and read it as an immutable snapshot.  A writer
+ * copies the current version, edits the copy, swaps it in with one atomic store, then moves
+ * to the next epoch and waits for the readers of the previous one to finish before freeing the
+ * old version.  Writers are serialized among themselves and never block readers; an edit costs
+ * a copy of the whole structure, so batch edits where possible.
+ */
+
+#ifndef SNAPSHOTPUBLISHER_H
+#define SNAPSHOTPUBLISHER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#define LATENCY_BUCKETS 40  // powers of two of nanoseconds, the last one catches everything slower
+
+/**
+ * Lock-free histogram of durations in power of two buckets
+ */
+class LatencyHistogram {
+ private:
+  std::atomic<unsigned long> buckets_[LATENCY_BUCKETS];
+  std::atomic<unsigned long> count_;
+  std::atomic<uint64_t> max_ns_;
+
+ public:
+  LatencyHistogram() : count_(0), max_ns_(0) {
+    for (auto& bucket : buckets_) {
+      bucket = 0;
+    }
+  }
+
+  void record(uint64_t ns) {
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && (ns >> bucket) > 1) {
+      bucket++;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = max_ns_.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+  }
+
+  unsigned long count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t max() const {
+    return max_ns_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Upper bound of the bucket the given fraction of samples falls in
+   * @param fraction e.g. 0.99 for the 99th percentile
+   * @return nanoseconds, 0 if nothing was recorded
+   */
+  uint64_t percentile(double fraction) const {
+    unsigned long total = count();
+    if (total == 0) {
+      return 0;
+    }
+    unsigned long wanted = std::max(1ul, (unsigned long)(fraction * total + 0.5));
+    unsigned long seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+      seen += buckets_[bucket].load(std::memory_order_relaxed);
+      if (seen >= wanted) {
+        return std::min((uint64_t)2 << bucket, max());
+      }
+    }
+    return max();
+  }
+
+  void reset() {
+    for (auto& bucket : buckets_) {
+      bucket = 0;
+    }
+    count_ = 0;
+    max_ns_ = 0;
+  }
+};
+
+/**
+ * Publishes versions of a T to concurrent readers
+ * @tparam T copy-constructible structure, only read through const methods once published
+ */
+template<typename T>
+class SnapshotPublisher {
+ private:
+  struct Version {
+    T value;
+    unsigned long number;
+
+    Version(const T& value, unsigned long number) : value(value), number(number) {}
+  };
+
+  std::atomic<Version*> current_;
+  std::mutex write_mutex_;  // one writer at a time
+
+  // readers announce themselves in the counter of the epoch they started in
+  std::atomic<unsigned long> epoch_;
+  std::atomic<long> readers_[2];
+
+  LatencyHistogram read_latency_;   // how long timed readers held a snapshot
+  LatencyHistogram grace_latency_;  // how long writers waited for readers of the old version
+
+ public:
+  /**
+   * A snapshot being read: the version it refers to stays alive and unchanged until the
+   * snapshot is destroyed.  Keep it short, the next writer waits for it.
+   */
+  class Snapshot {
+   private:
+    SnapshotPublisher* owner_;
+    unsigned long epoch_;
+    const Version* version_;
+    bool timed_;
+    std::chrono::steady_clock::time_point start_;
+
+    friend class SnapshotPublisher;
+
+    Snapshot(SnapshotPublisher* owner, bool timed) : owner_(owner), timed_(timed) {
+      if (timed_) {
+        start_ = std::chrono::steady_clock::now();
+      }
+      for (;;) {
+        epoch_ = owner_->epoch_.load();
+        owner_->readers_[epoch_ & 1]++;
+        if (owner_->epoch_.load() == epoch_) {
+          break;
+        }
+        owner_->readers_[epoch_ & 1]--;
+      }
+      version_ = owner_->current_.load();
+    }
+
+   public:
+    Snapshot(Snapshot&& other) :
+      owner_(other.owner_), epoch_(other.epoch_), version_(other.version_), timed_(other.timed_), start_(other.start_) {
+      other.owner_ = nullptr;
+    }
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    ~Snapshot() {
+      if (owner_ != nullptr) {
+        owner_->readers_[epoch_ & 1]--;
+        if (timed_) {
+          owner_->read_latency_.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start_).count());
+        }
+      }
+    }
+
+    const T& operator*() const {
+      return version_->value;
+    }
+
+    const T* operator->() const {
+      return &version_->value;
+    }
+
+    // 1 for the initial version, then one more for every published edit
+    unsigned long version() const {
+      return version_->number;
+    }
+  };
+
+  SnapshotPublisher(const T& initial = T()) : current_(new Version(initial, 1)), epoch_(0) {
+    readers_[0] = 0;
+    readers_[1] = 0;
+  }
+
+  SnapshotPublisher(const SnapshotPublisher&) = delete;
+  SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+  ~SnapshotPublisher() {
+    delete current_.load();
+  }
+
+  /**
+   * Lock-free, the snapshot must not outlive the publisher
+   * @param timed record how long the snapshot is held in readLatency(), for the reads whose
+   *        latency is worth watching rather than every lookup
+   */
+  Snapshot read(bool timed = false) {
+    return Snapshot(this, timed);
+  }
+
+  /**
+   * Applies an edit to a copy of the current version and publishes the copy
+   * @param edit callable taking T&, returning false if nothing changed and the copy can be dropped
+   * @return true if a new version was published
+   */
+  template<typename Edit>
+  bool update(Edit edit) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    Version* old = current_.load();
+    Version* next = new Version(old->value, old->number + 1);
+    if (!edit(next->value)) {
+      delete next;
+      return false;
+    }
+    current_.store(next);
+
+    // wait out every reader that might have loaded the old version
+    auto start = std::chrono::steady_clock::now();
+    unsigned long epoch = epoch_.fetch_add(1);
+    while (readers_[epoch & 1].load() != 0) {
+      std::this_thread::yield();
+    }
+    grace_latency_.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    delete old;
+    return true;
+  }
+
+  unsigned long version() {
+    return read().version();
+  }
+
+  const LatencyHistogram& readLatency() const {
+    return read_latency_;
+  }
+
+  const LatencyHistogram& graceLatency() const {
+    return grace_latency_;
+  }
+};
+
+#endif //SNAPSHOTPUBLISHER_H
@@ -1,15 +1,15 @@
 /**
  * @file
  *
- * The Music Library Client connects to a remote server and provides an interface
- * for adding, removing, and searching for songs in the server database
+ * The Warehouse Client connects to a remote server and provides an interface
+ * for adding, removing, and searching for products in the server catalog
  *
  */
 
-#include "MusicLibrary.h"
-#include "JsonMusicLibraryApi.h"
+#include "JsonWarehouseApi.h"
 
 #include <cpen333/process/socket.h>
+#include <cpen333/util.h>
 
 #include <iostream>
 #include <limits>
@@ -17,7 +17,8 @@
 static const char CLIENT_ADD = '1';
 static const char CLIENT_REMOVE = '2';
 static const char CLIENT_SEARCH = '3';
-static const char CLIENT_QUIT = '4';
+static const char CLIENT_TYPEAHEAD = '4';
+static const char CLIENT_QUIT = '5';
 
 // print menu options
 void print_menu() {
@@ -25,89 +26,163 @@ void print_menu() {
   std::cout << "=========================================" << std::endl;
   std::cout << "=                  MENU                 =" << std::endl;
   std::cout << "=========================================" << std::endl;
-  std::cout << " (1) Add Song" << std::endl;
-  std::cout << " (2) Remove Song" << std::endl;
+  std::cout << " (1) Add Product" << std::endl;
+  std::cout << " (2) Remove Product" << std::endl;
   std::cout << " (3) Search" << std::endl;
-  std::cout << " (4) Quit"  << std::endl;
+  std::cout << " (4) Suggest" << std::endl;
+  std::cout << " (5) Quit"  << std::endl;
   std::cout << "=========================================" << std::endl;
   std::cout << "Enter number: ";
   std::cout.flush();
 
 }
 
-// add a song to remote server
-void do_add(MusicLibraryApi &api) {
+// read a whole number, 0 if the line isn't one
+int read_int() {
+  std::string line;
+  std::getline(std::cin, line);
+  try {
+    return std::stoi(line);
+  } catch (const std::exception&) {
+    return 0;
+  }
+}
+
+// print the products a search or suggestion came back with
+void print_results(const std::vector<ServerProduct>& results) {
+  std::cout << std::endl << "   Results:" << std::endl;
+  for (const auto& product : results) {
+    std::cout << "      " << product.product_id << ": " << product.name_
+              << " ($" << product.price_ << ")" << std::endl;
+  }
+}
 
-  std::string artist, title;
+// add a product to remote server
+void do_add(JsonWarehouseApi &api) {
 
-  // collect artist and title
-  std::cout << std::endl << "Add Song" << std::endl;
-  std::cout << "   Artist: ";
-  std::getline(std::cin, artist);
-  std::cout << "   Title:  ";
-  std::getline(std::cin, title);
+  ServerProduct product;
+  product.quantity = 0;
+
+  // collect ID, name and price
+  std::cout << std::endl << "Add Product" << std::endl;
+  std::cout << "   ID:    ";
+  product.product_id = read_int();
+  std::cout << "   Name:  ";
+  std::getline(std::cin, product.name_);
+  std::cout << "   Price: ";
+  product.price_ = read_int();
 
   // send message to server and wait for response
-  Song song(artist, title);
-  AddMessage msg(song);
+  AddMessage msg(product);
   if (api.sendMessage(msg)) {
     // get response
     std::unique_ptr<Message> msgr = api.recvMessage();
+    if (msgr == nullptr || msgr->type() != MessageType::ADD_RESPONSE) {
+      std::cout << std::endl << "   Lost connection to server" << std::endl;
+      return;
+    }
     AddResponseMessage& resp = (AddResponseMessage&)(*msgr);
 
     if (resp.status == MESSAGE_STATUS_OK) {
-      std::cout << std::endl << "   \"" << song << "\" added successfull." << std::endl;
+      std::cout << std::endl << "   \"" << product.name_ << "\" added successfully." << std::endl;
     } else {
-      std::cout << std::endl << "   Adding \"" << song << "\" failed: " << resp.info << std::endl;
+      std::cout << std::endl << "   Adding \"" << product.name_ << "\" failed: " << resp.info << std::endl;
     }
   }
 
   std::cout << std::endl;
 }
 
-// remove song from server
-void do_remove(MusicLibraryApi &api) {
+// remove product from server
+void do_remove(JsonWarehouseApi &api) {
+
+  ServerProduct product;
+  product.price_ = 0;
+  product.quantity = 0;
+
+  // only the ID is needed to remove a product
+  std::cout << std::endl << "Remove Product" << std::endl;
+  std::cout << "   ID: ";
+  product.product_id = read_int();
+
+  RemoveMessage msg(product);
+  if (api.sendMessage(msg)) {
+    std::unique_ptr<Message> msgr = api.recvMessage();
+    if (msgr == nullptr || msgr->type() != MessageType::REMOVE_RESPONSE) {
+      std::cout << std::endl << "   Lost connection to server" << std::endl;
+      return;
+    }
+    RemoveResponseMessage& resp = (RemoveResponseMessage&)(*msgr);
+
+    if (resp.status == MESSAGE_STATUS_OK) {
+      std::cout << std::endl << "   Product " << product.product_id << " removed successfully." << std::endl;
+    } else {
+      std::cout << std::endl << "   Removing product " << product.product_id << " failed: " << resp.info << std::endl;
+    }
+  }
 
-  //=================================================
-  // TODO: Implement "remove" functionality
-  //=================================================
-  
+  std::cout << std::endl;
 }
 
-// search for songs on server
-void do_search(MusicLibraryApi &api) {
-  std::string artist_regex, title_regex;
+// search for products on server
+void do_search(JsonWarehouseApi &api) {
+  std::string name_regex;
 
-  // collect regular expressions for song search
-  std::cout << std::endl << "Search for Songs" << std::endl;
-  std::cout << "   Artist Expression: ";
-  std::getline(std::cin, artist_regex);
-  std::cout << "   Title Expression:  ";
-  std::getline(std::cin, title_regex);
+  // collect regular expression for product search
+  std::cout << std::endl << "Search for Products" << std::endl;
+  std::cout << "   Name Expression: ";
+  std::getline(std::cin, name_regex);
 
   // send search message and wait for response
-  SearchMessage msg(artist_regex, title_regex);
+  SearchMessage msg(name_regex);
   if (api.sendMessage(msg)) {
     // get response
     std::unique_ptr<Message> msgr = api.recvMessage();
+    if (msgr == nullptr || msgr->type() != MessageType::SEARCH_RESPONSE) {
+      std::cout << std::endl << "   Lost connection to server" << std::endl;
+      return;
+    }
     SearchResponseMessage& resp = (SearchResponseMessage&)(*msgr);
 
     if (resp.status == MESSAGE_STATUS_OK) {
-      std::cout << std::endl << "   Results:" << std::endl;
-      for (const auto& song : resp.results) {
-        std::cout << "      " << song << std::endl;
-      }
+      print_results(resp.results);
+    } else {
+      std::cout << std::endl << "   Search \"" << name_regex << "\" failed: " << resp.info << std::endl;
+    }
+  }
+
+  std::cout << std::endl;
+}
+
+// suggest products for the start of a name
+void do_typeahead(JsonWarehouseApi &api) {
+  std::string query;
+
+  std::cout << std::endl << "Suggest Products" << std::endl;
+  std::cout << "   Start of name: ";
+  std::getline(std::cin, query);
+
+  TypeaheadMessage msg(query);
+  if (api.sendMessage(msg)) {
+    std::unique_ptr<Message> msgr = api.recvMessage();
+    if (msgr == nullptr || msgr->type() != MessageType::TYPEAHEAD_RESPONSE) {
+      std::cout << std::endl << "   Lost connection to server" << std::endl;
+      return;
+    }
+    TypeaheadResponseMessage& resp = (TypeaheadResponseMessage&)(*msgr);
+
+    if (resp.status == MESSAGE_STATUS_OK) {
+      print_results(resp.results);
     } else {
-      std::cout << std::endl << "   Search \"" << artist_regex << " - "
-                << title_regex << "\" failed: " << resp.info << std::endl;
+      std::cout << std::endl << "   Suggesting \"" << query << "\" failed: " << resp.info << std::endl;
     }
   }
 
   std::cout << std::endl;
 }
 
-// search for songs on server
-void do_goodbye(MusicLibraryApi &api) {
+// say goodbye to server
+void do_goodbye(JsonWarehouseApi &api) {
   GoodbyeMessage msg;
   if (api.sendMessage(msg)) {
     std::cout << "Goodbye." << std::endl;
@@ -118,7 +193,7 @@ void do_goodbye(MusicLibraryApi &api) {
 int main() {
 
   // start client
-  cpen333::process::socket socket("localhost", MUSIC_LIBRARY_SERVER_PORT);
+  cpen333::process::socket socket("localhost", WAREHOUSE_SERVER_PORT);
   std::cout << "Client connecting...";
   std::cout.flush();
 
@@ -127,7 +202,7 @@ int main() {
     std::cout << "connected." << std::endl;
 
     // create API handler
-    JsonMusicLibraryApi api(std::move(socket));
+    JsonWarehouseApi api(std::move(socket));
 
     // keep reading commands until the user quits
     char cmd = 0;
@@ -149,6 +224,9 @@ int main() {
         case CLIENT_SEARCH:
           do_search(api);
           break;
+        case CLIENT_TYPEAHEAD:
+          do_typeahead(api);
+          break;
         case CLIENT_QUIT:
           do_goodbye(api);
           break;
@@ -2,7 +2,8 @@
  * @file
  *
  * This is the main server process.  When it starts it listens for clients.  It then
- * accepts remote commands for modifying/viewing the music database.
+ * accepts remote commands for editing and searching the product catalog and for placing orders.  On Linux all clients
+ * are served by one epoll thread and a fixed pool of workers (see ReactorServer.h).
  *
  */
 
@@ -14,137 +15,302 @@
 #include <mutex>
 
 #include "MusicLibrary.h"
+#include "CatalogLoader.h"
+#include "warehouse.h"
 #include "JsonWarehouseApi.h"
+#include "BinaryWarehouseApi.h"
+#include "FrameReader.h"
+#include "InventoryCache.h"
+#ifdef __linux__
+#include "ReactorServer.h"
+#endif
 
 #include <cpen333/process/socket.h>
-#include <cpen333/process/mutex.h>
 
+#define SERVER_NUM_ROBOTS 4
+#define SERVER_JOURNAL "warehouse"  // stock and orders are recovered from warehouse.snapshot and warehouse.wal.*
+#define SERVER_ORDER_CHANNEL "amazoom_orders"  // processes on this host can place orders without a socket
 
-#define SHARED_MUTEX_NAME "warehouse_server_mutex"
+/**
+ * Converts an order received from a client to a warehouse order
+ * @param in order as sent over the wire
+ * @return order with product IDs and quantities filled in
+ */
+Order to_order(const ServerOrder &in) {
+  Order order;
+  order.ID_ = in.ID_;
+  for (const auto &line : in.products_) {
+    Product product;
+    product.ID_ = line.product_id;
+    product.name_ = line.name_;
+    product.price_ = line.price_;
+    product.quantity_ = line.quantity;
+    order.products_.push_back(product);
+  }
+  return order;
+}
+
+/**
+ * Converts the warehouse's verdict on an order to the report sent back to the client
+ */
+ServerReport to_report(const OrderReport &in) {
+  ServerReport report;
+  report.verified = in.verified;
+  report.duplicate = in.duplicate;
+  report.product_ID = in.verified || in.duplicate ? 0 : in.product.ID_;
+  report.quantity = in.verified ? 0 : in.quantity;
+  return report;
+}
 
 
 /**
- * Main thread function for handling communication with a single remote
- * client.
+ * Reacts to a single message from a client
  *
- * @param lib shared library
- * @param api communication interface layer
+ * @param lib shared library, safe to use from several clients at once
+ * @param warehouse takes the orders, safe to use from several clients at once
+ * @param msg message received
  * @param id client id for printing messages to the console
+ * @param response set to the message to send back, left empty if there is nothing to send
+ * @return false if the client is done and the connection should be closed
  */
-void service(MusicLibrary &lib, JsonWarehouseApi &&api, int id) {
+bool handle(MusicLibrary &lib, Warehouse &warehouse, Message &msg, uint64_t id,
+            std::unique_ptr<Message> &response) {
+
+  // react and respond to message
+  MessageType type = msg.type();
+  switch (type) {
+    case MessageType::ADD: {
+      // process "add" message
+      // get reference to ADD
+      AddMessage &add = (AddMessage &) msg;
+      std::cout << "Client " << id << " adding product: " << add.product.name_ << std::endl;
+
+      // add product to catalog
+      bool success = lib.add(add.product);
+
+      // send response
+      if (success) {
+        response.reset(new AddResponseMessage(add, MESSAGE_STATUS_OK));
+      } else {
+        response.reset(new AddResponseMessage(add,
+          MESSAGE_STATUS_ERROR,
+          "Product already exists in catalog"));
+      }
+      break;
+    }
+    case MessageType::REMOVE: {
+      RemoveMessage &remove = (RemoveMessage &) msg;
+      std::cout << "Client " << id << " removing product: " << remove.product.product_id << std::endl;
+
+      // remove product from catalog
+      bool success = lib.remove(remove.product);
+
+      // send response
+      if (success) {
+        response.reset(new RemoveResponseMessage(remove, MESSAGE_STATUS_OK));
+      } else {
+        response.reset(new RemoveResponseMessage(remove,
+          MESSAGE_STATUS_ERROR,
+          "Product does not exist in catalog"));
+      }
+      break;
+    }
+    case MessageType::SEARCH: {
+      // process "search" message
+      // get reference to SEARCH
+      SearchMessage &search = (SearchMessage &) msg;
 
-  //=========================================================
-  // TODO: Implement thread safety
-  //=========================================================
+      std::cout << "Client " << id << " searching for: " << search.name_regex << std::endl;
 
-  cpen333::process::mutex mutex_(SHARED_MUTEX_NAME);
-  std::cout << "Client " << id << " connected" << std::endl;
+      // search catalog, reads a catalog snapshot without blocking edits
+      std::vector<ServerProduct> results = lib.find(search.name_regex);
+
+      // send response
+      response.reset(new SearchResponseMessage(search, results, MESSAGE_STATUS_OK));
+      break;
+    }
+    case MessageType::TYPEAHEAD: {
+      // not printed, sent on every keystroke
+      TypeaheadMessage &typeahead = (TypeaheadMessage &) msg;
+      std::vector<ServerProduct> results = lib.typeahead(typeahead.query);
+      response.reset(new TypeaheadResponseMessage(typeahead, results, MESSAGE_STATUS_OK));
+      break;
+    }
+    case MessageType::SUBMIT_ORDERS: {
+      SubmitOrdersMessage &submit = (SubmitOrdersMessage &) msg;
+      // off the console, batches can arrive thousands of times a second
+      LOG_DEBUG("Client %llu submitting %zu orders", (unsigned long long)id, submit.orders_.size());
+
+      // the whole batch goes through the warehouse in one call
+      std::vector<Order> orders;
+      orders.reserve(submit.orders_.size());
+      for (const auto &order : submit.orders_) {
+        orders.push_back(to_order(order));
+      }
+      std::vector<OrderReport> reports = warehouse.AddOrders(orders);
 
-  // receive message
-  std::unique_ptr<Message> msg = api.recvMessage();
-
-  // continue while we don't have an error
-  while (msg != nullptr) {
-
-    // react and respond to message
-    MessageType type = msg->type();
-    switch (type) {
-      case MessageType::ADD: {
-        // process "add" message
-        // get reference to ADD
-        AddMessage &add = (AddMessage &) (*msg);
-        std::cout << "Client " << id << " adding song: " << add.song << std::endl;
-
-        // add song to library
-        bool success = false;
-		{
-			std::lock_guard<decltype(mutex_)> lock(mutex_);
-			success = lib.add(add.song);
-		}
-
-        // send response
-        if (success) {
-          api.sendMessage(AddResponseMessage(add, MESSAGE_STATUS_OK));
-        } else {
-          api.sendMessage(AddResponseMessage(add,
-            MESSAGE_STATUS_ERROR,
-            "Song already exists in database"));
-        }
-        break;
+      SubmitOrdersResponseMessage *submit_response = new SubmitOrdersResponseMessage();
+      response.reset(submit_response);
+      submit_response->reports_.reserve(reports.size());
+      for (const auto &report : reports) {
+        submit_response->reports_.push_back(to_report(report));
       }
-      case MessageType::REMOVE: {
-		 RemoveMessage &remove = (RemoveMessage &)(*msg);
-		 std::cout << "Client " << id << " removing song: " << remove.song << std::endl;
-
-		 // remove song from library
-		 bool success = false;
-		 success = lib.remove(remove.song);
-
-		 // send response
-		 if (success) {
-			 api.sendMessage(RemoveResponseMessage(remove, MESSAGE_STATUS_OK));
-		 }
-		 else {
-			 api.sendMessage(RemoveResponseMessage(remove,
-				 MESSAGE_STATUS_ERROR,
-				 "Song does not exists in database"));
-		 }
-
-        break;
+      break;
+    }
+    case MessageType::REQUEST_INVENTORY: {
+      // not printed, product pages ask for stock far too often
+      RequestInventoryMessage &request = (RequestInventoryMessage &) msg;
+      RequestInventoryResponseMessage *inventory_response = new RequestInventoryResponseMessage();
+      response.reset(inventory_response);
+
+      Inventory *inventory = warehouse.getInventory(request.product_id_);
+      if (inventory != nullptr) {
+        Product product = warehouse.getProduct(request.product_id_);
+        ServerProduct line;
+        line.product_id = product.ID_;
+        line.name_ = product.name_;
+        line.price_ = (int) product.price_;
+        line.quantity = inventory->numStored();
+        inventory_response->products_.push_back(line);
       }
-      case MessageType::SEARCH: {
-        // process "search" message
-        // get reference to SEARCH
-        SearchMessage &search = (SearchMessage &) (*msg);
+      break;
+    }
+    case MessageType::GOODBYE: {
+      // process "goodbye" message
+      std::cout << "Client " << id << " closing" << std::endl;
+      return false;
+    }
+    default: {
+      std::cout << "Client " << id << " sent invalid message" << std::endl;
+    }
+  }
 
-        std::cout << "Client " << id << " searching for: "
-                    << search.artist_regex << " - " << search.title_regex << std::endl;
+  return true;
+}
 
-        // search library
-        std::vector<Song> results;
-		{
-			std::lock_guard<decltype(mutex_)> lock(mutex_);
-			results = lib.find(search.artist_regex, search.title_regex);
-		}
+/**
+ * Encodes a message with the API a frame type byte names
+ */
+std::string encode_frame(char type, const Message &msg) {
+  if (type == JsonWarehouseApi::JSON_ID) {
+    return JsonWarehouseApi::encodeMessage(msg);
+  }
+  return BinaryWarehouseApi::encodeMessage(msg);
+}
 
-        // send response
-        api.sendMessage(SearchResponseMessage(search, results, MESSAGE_STATUS_OK));
+/**
+ * Puts a request id into a frame encoded without one, see encode_frame
+ */
+std::string with_request_id(char type, const std::string &frame, uint32_t id) {
+  if (type == JsonWarehouseApi::JSON_ID) {
+    return JsonWarehouseApi::withRequestId(frame, id);
+  }
+  return BinaryWarehouseApi::withRequestId(frame, id);
+}
 
-        break;
-      }
-      case MessageType::GOODBYE: {
-        // process "goodbye" message
-        std::cout << "Client " << id << " closing" << std::endl;
-        return;
-      }
-      default: {
-        std::cout << "Client " << id << " sent invalid message" << std::endl;
+/**
+ * Decodes a frame with the API its type byte names, handles it and encodes the response
+ * with the same API, so every client is answered in the encoding it speaks.  The response
+ * carries the request id of the message.
+ *
+ * Inventory responses are kept encoded in the cache and reused while the product's stock
+ * stays the same, a hit goes straight from the decoded request to the cached bytes.
+ *
+ * @param lib shared library
+ * @param warehouse takes the orders
+ * @param inventory_cache encoded inventory responses
+ * @param id client id for printing messages to the console
+ * @param type frame type byte, JSON_ID or BINARY_ID
+ * @param body frame content
+ * @param out set to the encoded response, left empty if there is nothing to send
+ * @return false if the connection should be closed
+ */
+bool handle_frame(MusicLibrary &lib, Warehouse &warehouse, InventoryCache &inventory_cache, uint64_t id,
+                  char type, const std::string &body, std::string &out) {
+
+  std::unique_ptr<Message> msg;
+  if (type == JsonWarehouseApi::JSON_ID) {
+    msg = JsonWarehouseApi::decodeMessage(body);
+  } else if (type == BinaryWarehouseApi::BINARY_ID) {
+    msg = BinaryWarehouseApi::decodeMessage(body);
+  }
+  if (msg == nullptr) {
+    return false;
+  }
+
+  // load the version before handle() reads the stock, so the entry can only be too old
+  Inventory *inventory = nullptr;
+  unsigned long version = 0;
+  int product_id = 0;
+  if (msg->type() == MessageType::REQUEST_INVENTORY) {
+    product_id = ((RequestInventoryMessage &) *msg).product_id_;
+    inventory = warehouse.getInventory(product_id);
+    if (inventory != nullptr) {
+      version = inventory->version();
+      std::string cached;
+      if (inventory_cache.get(type, product_id, version, cached)) {
+        out = with_request_id(type, cached, msg->id);
+        return true;
       }
     }
+  }
 
-    // receive next message
-    msg = api.recvMessage();
+  std::unique_ptr<Message> response;
+  bool open = handle(lib, warehouse, *msg, id, response);
+  if (response != nullptr && inventory != nullptr) {
+    // cached without the request id, which differs from request to request
+    std::string frame = encode_frame(type, *response);
+    inventory_cache.put(type, product_id, version, frame);
+    out = with_request_id(type, frame, msg->id);
+  } else if (response != nullptr) {
+    response->id = msg->id;
+    out = encode_frame(type, *response);
   }
+  return open;
 }
 
 /**
- * Load songs from a JSON file and add them to the music library
- * @param lib music library
- * @param filename file to load
+ * Main thread function for handling communication with a single remote
+ * client, used where the event-driven server is not available.  The type
+ * byte of the first frame picks the API for the rest of the connection.
+ *
+ * @param lib shared library
+ * @param warehouse takes the orders
+ * @param inventory_cache encoded inventory responses
+ * @param client connected socket
+ * @param id client id for printing messages to the console
  */
-void load_songs(MusicLibrary &lib, const std::string& filename) {
-
-  // parse from file stream
-  std::ifstream fin(filename);
-  if (fin.is_open()) {
-    JSON j;
-    fin >> j;
-    std::vector<Song> songs = JsonConverter::parseSongs(j);
-    lib.add(songs);
-  } else {
-    std::cerr << "Failed to open file: " << filename << std::endl;
+void service(MusicLibrary &lib, Warehouse &warehouse, InventoryCache &inventory_cache, cpen333::process::socket &&client, int id) {
+
+  std::cout << "Client " << id << " connected" << std::endl;
+
+  cpen333::process::socket socket(std::move(client));
+  FrameReader<cpen333::process::socket> reader(socket);
+  std::string body;
+  std::string out;
+
+  char api;
+  if (!reader.read(&api, 1)) {
+    return;
   }
 
+  char type = api;
+  // continue while we don't have an error and the client sticks to its API
+  while (type == api && reader.readFrame(body, false)) {
+    out.clear();
+    bool open = handle_frame(lib, warehouse, inventory_cache, id, type, body, out);
+    if (!out.empty()) {
+      socket.write(out.data(), out.size());
+    }
+    if (!open) {
+      return;
+    }
+
+    // receive next message
+    if (!reader.read(&type, 1)) {
+      return;
+    }
+  }
 }
 
 int main() {
@@ -164,41 +330,43 @@ int main() {
       "data/billboard_rock.json",
   };
 
-  MusicLibrary lib;       // main shared music library
-  cpen333::process::mutex mutex_(SHARED_MUTEX_NAME);
+  MusicLibrary lib;       // main shared music library, publishes snapshots to concurrent clients
 
-  // load music library files
-  for (const auto &filename : filenames) {
-    load_songs(lib, filename);
-  }
+  // stream the catalog files in on parallel threads
+  CatalogLoadStats loaded = CatalogLoader::loadFiles(lib, filenames);
+  std::cout << "Loaded " << loaded.products << " products from " << loaded.files << " files ("
+            << loaded.failed << " failed) in " << loaded.seconds << " s, "
+            << loaded.megabytesPerSecond() << " MB/s" << std::endl;
+
+  // orders submitted by clients go straight into the warehouse, which picks up where the last run stopped
+  Warehouse warehouse(REAL_TIME_CLOCK, (unsigned int)time(NULL), SCALED_CLOCK_FACTOR, SERVER_JOURNAL);
+  warehouse.CreateRobotArmy(SERVER_NUM_ROBOTS);
+  warehouse.OpenOrderChannel(SERVER_ORDER_CHANNEL);
+  InventoryCache inventory_cache;  // shared by all clients
 
   // start server
-  cpen333::process::socket_server server(MUSIC_LIBRARY_SERVER_PORT);
+  cpen333::process::socket_server server(WAREHOUSE_SERVER_PORT);
   server.open();
   std::cout << "Server started on port " << server.port() << std::endl;
 
-  //===============================================================
-  // TODO: Modify to allow multiple client-server connections
-  //     Loop:
-  //       - 'Accept' a socket client
-  //       - Create an API wrapper around the socket
-  //       - Send the API wrapper to the service(...) function
-  //         to run in a new detached thread
-  //===============================================================
+#ifdef __linux__
+  // one epoll thread for every connection, a fixed pool of workers for the messages
+  ReactorServer reactor(server, [&](uint64_t client, char type, const std::string &body, std::string &out) {
+    return handle_frame(lib, warehouse, inventory_cache, client, type, body, out);
+  });
+  reactor.run();
+#else
   int clientID = 0;
 
   while (1) {
-	  cpen333::process::socket client;
-	  if (server.accept(client)) {
-		  // create API handler
-		  JsonWarehouseApi api(std::move(client));
-		  // service client-server communication
-		  //service(lib, std::move(api), 0);
-		  std::thread (service, lib, std::move(api), clientID).detach();
-		  clientID++;
-	  }
+    cpen333::process::socket client;
+    if (server.accept(client)) {
+      // service client-server communication, the library is shared not copied
+      std::thread(service, std::ref(lib), std::ref(warehouse), std::ref(inventory_cache), std::move(client), clientID).detach();
+      clientID++;
+    }
   }
-  
+#endif
 
   // close server
   server.close();